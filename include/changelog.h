@@ -0,0 +1,65 @@
+#ifndef __CHANGELOG_H
+#define __CHANGELOG_H
+
+#include "status.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#define SL_OP_PUT 1 // 写入/覆盖
+#define SL_OP_DEL 2 // 删除
+#define SL_OP_DELRANGE 3 // 范围删除(只出现在日志中)：data为lo和hi拼接，value低16位为lo的长度，第62/63位表示lo/hi不限
+
+#define CHANGELOG_BUFF_SIZE (uint64_t)(65536) // 写缓冲大小(64K)，合并一次写锁内的记录，释放写锁前写入文件
+#define CHANGELOG_MAXPARTS 4 // cl_appendv一条记录最多由几段拼接
+
+// 变更日志记录，磁盘格式与复制流的传输格式相同
+typedef struct logrecord_s {
+    uint64_t seq;
+    uint64_t value;
+    uint16_t type; // SL_OP_PUT/SL_OP_DEL/SL_OP_DELRANGE
+    uint16_t size; // key size
+    uint32_t reserved;
+    char data[0];
+} logrecord_t;
+
+#define LOGRECORDSIZE(rec) (sizeof(logrecord_t) + (rec)->size)
+
+typedef struct changelog_s {
+    pthread_mutex_t mutex;
+    int fd;
+    uint64_t seq;  // 最后写入的序列号
+    uint64_t size; // 已落盘(write)的文件大小
+    char* buff;
+    size_t buffsize;
+    char* name;
+} changelog_t;
+
+typedef struct clreader_s {
+    int fd;
+    uint64_t pos;  // 下一条记录在文件中的位置
+    uint64_t seq;  // 只返回 >= seq 的记录
+    uint64_t bpos; // 读缓冲对应的文件位置
+    size_t blen;   // 读缓冲有效长度
+    char* buff;
+    size_t buffcap;
+} clreader_t;
+
+status_t cl_open(const char* name, changelog_t** log);
+status_t cl_append(changelog_t* log, uint16_t type, const void* key, size_t key_len, uint64_t value, uint64_t* seq);
+// data由parts拼接而成，总长不能超过UINT16_MAX
+status_t cl_appendv(changelog_t* log, uint16_t type, const struct iovec parts[], int nparts, uint64_t value, uint64_t* seq);
+status_t cl_flush(changelog_t* log);
+status_t cl_sync(changelog_t* log);
+status_t cl_close(changelog_t* log);
+
+status_t cl_reader_open(const char* name, uint64_t seq, clreader_t** r);
+// *rec指向读缓冲，下一次调用前有效；读到日志尾部时*rec = NULL，之后可继续调用追踪新记录
+status_t cl_reader_next(clreader_t* r, logrecord_t** rec);
+status_t cl_ship(clreader_t* r, int fd, uint64_t* shipped);
+void cl_reader_close(clreader_t* r);
+
+#endif // __CHANGELOG_H
@@ -0,0 +1,54 @@
+#ifndef __LSM_H
+#define __LSM_H
+
+#include "skiplist.h"
+
+// LSM模式：写入进入一个小的跳表(memtable，<prefix>.<id>.sl.*)，其已使用的元数据和数据达到flushsize
+// (或元数据已满)时冻结，新写入进入新的memtable；后台线程把冻结的memtable按key顺序写成不可变的有序表
+// (<prefix>.<id>.sst：数据块 + 稀疏索引 + 布隆过滤器)。点查和扫描按 memtable、冻结的memtable、表(新到旧)
+// 合并，同一个key以最新的为准。后台按大小分层合并：从最旧的表开始，相邻且大小相近的表超过maxtables个时
+// 把这些表合并为一个(包含最旧的表时丢弃删除标记)，表数和重写量随数据量对数增长。
+// 清单<prefix>.lsm记录当前的memtable和表，每次变更整体重写后rename
+
+#define SL_LSM_TOMBSTONE UINT64_MAX // 删除标记，LSM模式下不能作为值写入
+
+#define LSM_MAGIC   0x4d534c53 // "SLSM"
+#define LSM_VERSION 1
+
+typedef struct lsm_options_s {
+    sl_options_t sl;    // memtable的选项；不支持shared和SL_KEY_CUSTOM(表按字节序比较key)
+    uint64_t flushsize; // memtable冻结的大小，默认2 * DEFAULT_METAFILE_SIZE(sl.metasize默认为4倍)
+    uint32_t blocksize; // 表的数据块大小，默认4096
+    uint32_t bloombits; // 表的布隆过滤器每key位数，默认10，0不建
+    int maxtables;      // 相邻且大小相近的表超过这么多个时后台合并它们，默认4
+} lsm_options_t;
+
+typedef struct lsm_info_s {
+    uint64_t memkeys;     // memtable(含冻结的)中的key数，含删除标记
+    uint64_t tables;
+    uint64_t tablekeys;   // 表中的条目数，含删除标记和未合并的旧版本
+    uint64_t tablebytes;
+    uint64_t flushes;     // 本次打开以来写成的表数
+    uint64_t compactions;
+} lsm_info_t;
+
+typedef struct lsm_s lsm_t;
+
+void lsm_options_init(lsm_options_t* opts);
+status_t lsm_open(const char* prefix, const lsm_options_t* opts, lsm_t** lsm);
+status_t lsm_put(lsm_t* lsm, const void* key, size_t key_len, uint64_t value);
+// *found为0表示key不存在(或已删除)
+status_t lsm_get(lsm_t* lsm, const void* key, size_t key_len, uint64_t* value, int* found);
+status_t lsm_del(lsm_t* lsm, const void* key, size_t key_len);
+// 按key顺序合并扫描[lo, hi)，lo/hi为NULL表示不限，cb的part为0。扫描期间冻结和表替换会等待，cb中不能写入
+status_t lsm_scan(lsm_t* lsm, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg);
+// 冻结当前memtable(非空时)并等待它写成表
+status_t lsm_flush(lsm_t* lsm);
+// flush后把全部表合并为一个，丢弃删除标记
+status_t lsm_compact(lsm_t* lsm);
+status_t lsm_info(lsm_t* lsm, lsm_info_t* info);
+status_t lsm_sync(lsm_t* lsm);
+// 等待进行中的flush/合并结束；内存模式的memtable先写成表
+status_t lsm_close(lsm_t* lsm);
+
+#endif // __LSM_H
@@ -2,6 +2,7 @@
 #define __PRINT_H
 
 #include "skiplist.h"
+#include "warm.h"
 
 #define STDOUT0(fmt)                dprintf(STDOUT_FILENO, (fmt))
 #define STDOUT1(fmt, arg1)          dprintf(STDOUT_FILENO, (fmt), (arg1))
@@ -10,5 +11,6 @@
 void sl_print(skiplist_t* sl, FILE* stream, int isprintnode);
 void sl_print_keys(skiplist_t* sl, FILE* stream);
 void sl_print_rkeys(skiplist_t* sl, FILE* stream);
+void sl_print_residency(const sl_residency_t* r, FILE* stream);
 
 #endif // __PRINT_H
@@ -0,0 +1,16 @@
+#ifndef __REPLICA_H
+#define __REPLICA_H
+
+#include "changelog.h"
+#include "skiplist.h"
+
+#define REPLICA_BATCH_SIZE 1024 // 从库每次加锁批量应用的记录数
+
+// 主库：从seq开始读取变更日志(需以changelog选项打开)
+status_t sl_log_reader(skiplist_t* sl, uint64_t seq, clreader_t** r);
+// 主库：读取从库发来的起始序列号，把之后的变更发送到fd；istail时持续追踪新变更直到对端关闭
+status_t sl_serve_replica(skiplist_t* sl, int fd, int istail);
+// 从库：发送已应用的序列号 + 1，然后按batch条一批应用fd上的变更流直到EOF
+status_t sl_follow(skiplist_t* sl, int fd, size_t batch);
+
+#endif // __REPLICA_H
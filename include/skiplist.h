@@ -1,7 +1,7 @@
 #ifndef __SKIPLIST_H
 #define __SKIPLIST_H
 
-#include "list.h"
+#include "changelog.h"
 #include "status.h"
 #include <fcntl.h>
 #include <pthread.h>
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -17,6 +18,8 @@
 
 #define METANODE_HEAD 0x8000 // 跳表头节点
 #define METANODE_DELETED 0x0002 // 跳表节点已被惰性删除
+#define METANODE_BLOCK 0x0004 // 块节点(SL_FORMAT_BLOCKED)，forwards之后是有序的key块
+#define METANODE_REF 0x0008 // 缓存模式的CLOCK引用位：命中和覆盖写时置位，淘汰扫描时清除
 #define METANODE_USED 0x0001 // 跳表节点已被使用
 #define METANODE_NONE 0x0000 // 空节点(未被使用过)
 
@@ -30,6 +33,9 @@
 #define MAX_KEY_LEN         65535   // key最大长度(1 << 16 - 1), ::uint16_t datanode->size::
 #define SKIPLIST_MAXLEVEL   64      // 跳表最大level
 
+#define SKIPLIST_MAGIC      0x534b4950 // "SKIP"
+#define SKIPLIST_VERSION    4          // 文件格式版本，头部布局变化时递增；其他版本的文件拒绝加载(见loadmeta)
+
 typedef struct metanode_s {
     uint32_t level;
     uint32_t flag;
@@ -39,55 +45,306 @@ typedef struct metanode_s {
     uint64_t forwards[0];
 } metanode_t;
 
+// key类型
+#define SL_KEY_BYTES  0 // 变长字节串，memcmp + 长度比较
+#define SL_KEY_U64    1 // 8字节大端无符号整数
+#define SL_KEY_U128   2 // 16字节大端无符号整数(如大端(uint32, uint64)元组补齐)
+#define SL_KEY_CUSTOM 3 // 用户注册的比较函数(每次打开都需要提供同一个函数)
+
+// 节点格式，创建时确定
+#define SL_FORMAT_NODE    0 // 每个key一个metanode
+#define SL_FORMAT_BLOCKED 1 // level 0的每个节点存放最多SL_BLOCK_ENTRIES个有序key，只有块参与上层索引
+
+#define SL_BLOCK_ENTRIES 16 // 每个块的key数，前缀数组占2个cache line
+
+// 自定义key比较函数，返回<0, 0, >0
+typedef int (*sl_keycmp_fn)(const void* k1, size_t l1, const void* k2, size_t l2);
+
+// 内存模式的大页选项
+#define SL_HUGEPAGE_NONE 0
+#define SL_HUGEPAGE_THP  1 // madvise(MADV_HUGEPAGE)
+#define SL_HUGEPAGE_TLB  2 // MAP_HUGETLB，未预留大页时退回THP
+
+// 映射的访问模式提示，见sl_advise
+#define SL_ADVISE_NORMAL     0 // MADV_NORMAL
+#define SL_ADVISE_RANDOM     1 // MADV_RANDOM，点查为主(默认)
+#define SL_ADVISE_SEQUENTIAL 2 // MADV_SEQUENTIAL，扫描/批量读
+#define SL_ADVISE_WILLNEED   3 // 一次性预读高层索引节点，不改变当前模式
+#define SL_ADVISE_HUGEPAGE   4 // 一次性对元数据映射开启THP
+
+#define SL_WILLNEED_NODES 65536 // SL_ADVISE_WILLNEED最多预读的节点数
+
+struct keyops_s;
+struct upperidx_s;
+struct bloom_s;
+struct hashidx_s;
+struct vidx_s;
+struct retired_s;
+struct asyncio_s;
+struct tracer_s;
+struct statslot_s;
+struct bufpool_s;
+
+// 元数据文件头，位于共享映射中，多进程可见；不能存放进程内指针
 typedef struct skipmeta_s {
+    uint32_t magic;
+    uint32_t version;
+    pthread_rwlock_t rwlock; // 多进程模式使用的锁(PTHREAD_PROCESS_SHARED)
+    uint64_t generation;     // 数据文件映射代数，扩容时递增，其他进程据此重新映射
     uint64_t mapsize; // 已使用used
     uint64_t mapcap;  // 已映射total
     uint64_t tail;    // tail metanode
+    uint64_t seq;     // 最后一次变更的序列号(主库: 变更日志序列号，未开启日志时每次变更加1; 从库: 已应用的序列号)
+    uint64_t metafree[SKIPLIST_MAXLEVEL + 1]; // 按level回收的metanode链表头，经metanode->backward串联
     uint32_t count;   // key个数（不包括已被删除节点）
     float p;          // p
-    void* mapped;     // mmap map pointer
+    uint32_t keytype; // key类型，创建时确定
+    uint32_t format;  // 节点格式SL_FORMAT_*，创建时确定(占用原对齐填充，旧文件为0)
+    uint64_t levels[SKIPLIST_MAXLEVEL + 1]; // 各level已分配的节点(块)数，含待回收的，分配/回收时维护
+    uint64_t metafreen;     // metafree链表上的节点数
+    uint64_t metafreebytes; // metafree链表上的节点字节数
+    uint64_t datafreen;     // datafree链表上的datanode数
+    uint64_t datafreebytes; // datafree链表上的datanode字节数
 } skipmeta_t;
 
 typedef struct datanode_s {
-    uint64_t offset;
+    uint64_t offset; // 所属metanode；已回收时为下一个空闲datanode
     uint16_t size; // NOTE: key max
+    uint16_t slack; // 缓存模式复用时比key多出的字节(占用原对齐填充)，回收时随节点一起回收
     void* data[0];
 } datanode_t;
 
 typedef struct skipdata_t {
     uint64_t mapsize;
     uint64_t mapcap;
-    void* mapped;
+    uint64_t datafree; // 回收的datanode链表头，经datanode->offset串联
 } skipdata_t;
 
 typedef struct skiplist_s {
-    pthread_rwlock_t rwlock;
-    skipmeta_t* meta;
-    skipdata_t* data;
-    list_t* metafree[SKIPLIST_MAXLEVEL];
-    list_t* datafree;
+    pthread_rwlock_t rwlock; // 进程内锁；多进程模式下用于保护本进程的数据文件重新映射
+    skipmeta_t* meta;        // 元数据文件映射起始地址
+    skipdata_t* data;        // 数据文件映射起始地址
+    int shared;              // 多进程模式
+    int inmemory;            // 内存模式(匿名映射，不落盘)
+    int hugepage;            // SL_HUGEPAGE_*
+    int advice;              // 稳态访问模式SL_ADVISE_NORMAL/RANDOM/SEQUENTIAL
+    int seqscans;            // 进行中的顺序扫描数，非0时映射临时为MADV_SEQUENTIAL
+    int guards;              // 进行中的read guard数，见guard.c
+    struct retired_s* retired; // read guard期间被替换、尚未解除的旧数据映射
+    int heat;                // 关闭时保存驻留页到<prefix>.sl.heat
+    int lockfd;              // 元数据文件fd，持有flock直到关闭
+    uint64_t generation;     // 本进程数据文件映射对应的代数
+    uint64_t datacap;        // 本进程数据文件映射大小
+    const struct keyops_s* keyops; // 按key类型特化的比较/查找函数
+    struct upperidx_s* upper; // 内存中的上层索引(未开启时为NULL)，见upper.c
+    struct bloom_s* bloom;   // 布隆过滤器(未开启时为NULL)，见bloom.c
+    struct hashidx_s* hash;  // 哈希索引(未开启时为NULL)，见hash.c
+    struct vidx_s* vidx;     // 值索引(未开启时为NULL)，见vidx.c
+    struct asyncio_s* aio;   // sl_get_async的I/O线程(未开启时为NULL)，见async.c
+    sl_keycmp_fn keycmp;     // SL_KEY_CUSTOM的比较函数
+    changelog_t* log; // 变更日志(未开启时为NULL)
+    struct tracer_s* trace; // 操作跟踪(未开启时为NULL)，见trace.h
+    struct statslot_s* stats; // 每线程的操作计数，见stats.c
+    struct bufpool_s* pool;  // 数据文件的缓冲池(未开启时为NULL，数据文件映射)，见pool.c
+    int cache;               // 缓存模式：元数据满时淘汰冷节点，见cache.c
+    uint64_t clockhand;      // 缓存模式的CLOCK指针(元数据位置)
     char* metaname;
     char* dataname;
 } skiplist_t;
 
+typedef struct sl_options_s {
+    float p;       // skip list p
+    int changelog; // 是否记录变更日志(<prefix>.sl.log)
+    int trace;     // 打开时开始跟踪sl_put/sl_get/sl_del到<prefix>.sl.trace(覆盖)，见trace.h
+    int shared;    // 多进程模式：多个进程可同时打开同一个prefix
+    uint32_t keytype;    // SL_KEY_*，仅创建时生效，加载时需与文件一致
+    sl_keycmp_fn keycmp; // keytype为SL_KEY_CUSTOM时必须提供
+    int inmemory;        // 内存模式：匿名映射，不创建文件，无msync，prefix可为NULL
+    int hugepage;        // 大页选项SL_HUGEPAGE_*；文件模式只作用于元数据映射(THP)
+    int advice;          // 稳态访问模式，默认SL_ADVISE_RANDOM
+    int willneed;        // 打开后预读高层索引节点(SL_ADVISE_WILLNEED)
+    int heat;            // 关闭时记录驻留页(<prefix>.sl.heat)，供下次打开后sl_warmup使用
+    uint32_t format;     // SL_FORMAT_*，仅创建时生效，加载时需与文件一致；SL_FORMAT_BLOCKED不支持SL_KEY_CUSTOM
+    int upperindex;      // 在内存中维护高层节点的有序前缀索引加速点查，默认开启；多进程模式和SL_KEY_CUSTOM不支持，忽略
+    uint32_t bloom;      // 布隆过滤器每key位数(<prefix>.sl.bloom)，0不开启，建议10；多进程模式和SL_KEY_CUSTOM不支持
+    int hashindex;       // 哈希索引(<prefix>.sl.hash)加速点查；只支持SL_FORMAT_NODE，多进程模式和SL_KEY_CUSTOM不支持
+    int valueindex;      // 值索引(<prefix>.sl.vidx)，支持sl_scan_by_value；只支持SL_FORMAT_NODE，多进程模式不支持
+    int iothreads;       // sl_get_async的I/O线程数，0不开启；内存模式不需要
+    int populate;        // 内存模式：MAP_POPULATE预先分配全部页
+    uint64_t metasize;   // 新建时元数据大小(不扩容)，默认DEFAULT_METAFILE_SIZE
+    uint64_t datasize;   // 新建时数据初始大小(自动扩容)，默认DEFAULT_DATAFILE_SIZE
+    uint64_t poolsize;   // 非0时数据文件不映射，经这么大的缓冲池pread/pwrite(内存有上限)；多进程模式和内存模式不支持
+    int direct;          // 缓冲池以O_DIRECT读写数据文件，绕过页缓存
+    int cache;           // 缓存模式：元数据满或数据区放不下时按CLOCK淘汰最近未访问的key而不是返回STATUS_SKIPLIST_FULL/扩容，
+                         // 数据区保持datasize(只有read guard期间不复用datanode时扩容)；
+                         // 只支持SL_FORMAT_NODE，多进程模式不支持。淘汰按删除记录到变更日志
+} sl_options_t;
+
+// 批量写操作，见sl_write
+typedef struct sl_op_s {
+    int type; // SL_OP_PUT/SL_OP_DEL
+    const void* key;
+    size_t key_len;
+    uint64_t value;
+} sl_op_t;
+
+// 读-改-写回调，在写锁内调用：exists表示key是否存在(old为其值)；把新值写入*value并返回非0则写入，返回0不修改
+typedef int (*sl_merge_fn)(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg);
+
+// sl_get_async的完成回调，在I/O线程上调用；found为0表示key不存在。
+// 事件循环可在回调里写自己的eventfd，再在循环线程上处理结果
+typedef void (*sl_get_cb)(status_t status, int found, uint64_t value, void* arg);
+
+// 借用的key，指向数据映射(缓冲池模式下是pin住的页)，在取得它的read guard结束前有效
+typedef struct sl_view_s {
+    const void* data;
+    size_t size;
+} sl_view_t;
+
+// 迭代器，只能在read guard内使用；每步单独加读锁，期间有写入时按当前key重新定位(弱一致)
+typedef struct sl_iter_s {
+    skiplist_t* sl;
+    int valid;       // 0表示已到末尾
+    sl_view_t key;
+    uint64_t value;
+    uint64_t seq;    // 定位时的meta->seq
+    uint64_t node;   // 当前节点(块)位置
+    uint32_t index;  // 块内下标
+} sl_iter_t;
+
+// sl_stats的操作类型
+#define SL_STAT_GET      0 // sl_get/sl_get_async
+#define SL_STAT_PUT      1
+#define SL_STAT_DEL      2
+#define SL_STAT_WRITE    3 // sl_write批量
+#define SL_STAT_MERGE    4 // sl_merge/sl_put_if_absent/sl_cas/sl_fetch_add
+#define SL_STAT_DELRANGE 5 // sl_del_range/sl_del_prefix
+#define SL_STAT_SCAN     6 // sl_scan/sl_parallel_scan/sl_iter_seek(锁统计还包括sl_iter_next)
+#define SL_STAT_OTHER    7 // 其他调用(sl_sync、sl_stats、sl_advise等)，只用于锁统计
+#define SL_STAT_OPS      8
+
+// 按操作类型的锁统计。先尝试加锁，失败时才计时等待，所以等待时间是精确的；
+// 持有时间每线程每SL_LOCK_SAMPLE次加锁抽样一次
+#define SL_LOCK_SAMPLE 64
+
+typedef struct sl_lockstats_s {
+    uint64_t acquires;    // 加锁次数
+    uint64_t contended;   // 需要等待的次数
+    uint64_t waitns;      // 等待的总纳秒数
+    uint64_t holdns;      // 抽样的持有总纳秒数
+    uint64_t holdsamples; // 持有时间的抽样数
+    double avgwaitns;     // 每次加锁的平均等待
+    double avgholdns;     // 每次加锁的平均持有(抽样估计)
+} sl_lockstats_t;
+
+// 运行时统计。计数器为本进程打开以来的累计值，其余为当前值(多进程模式下文件相关的值包括其他进程的变更)
+typedef struct sl_stats_s {
+    uint64_t ops[SL_STAT_OPS];   // 按类型的调用数
+    uint64_t hits;               // 点查命中数
+    uint64_t misses;             // 点查未命中数
+    double hitrate;              // hits / (hits + misses)
+    uint64_t evictions;          // 缓存模式淘汰的key数
+    uint64_t lookups;            // 从头节点(或上层索引)下降的次数，包括写操作的定位
+    uint64_t hops;               // 下降中前进的节点数
+    uint64_t compares;           // 下降中key比较的次数
+    double avghops;              // 每次下降的平均前进数
+    double avgcompares;          // 每次下降的平均比较数
+    uint64_t count;              // key数
+    uint32_t maxlevel;           // 头节点当前level
+    uint64_t levels[SKIPLIST_MAXLEVEL + 1]; // 各level的节点(块)数，含范围删除后待回收的
+    uint64_t metafreen;          // 元数据空闲链表的节点数
+    uint64_t metafreebytes;
+    double metafrag;             // 元数据碎片率：空闲字节 / 已使用字节
+    uint64_t datafreen;          // 数据空闲链表的datanode数
+    uint64_t datafreebytes;
+    double datafrag;             // 数据碎片率：空闲字节 / 已使用字节
+    uint64_t metamapsize;
+    uint64_t metamapcap;
+    uint64_t datamapsize;
+    uint64_t datamapcap;
+    uint64_t expansions;         // 数据文件扩容次数
+    uint64_t synced;             // sl_sync交给msync的字节数
+    uint64_t poolframes;         // 缓冲池的页数，未开启为0
+    uint64_t poolhits;           // 缓冲池的页访问命中数
+    uint64_t poolmisses;
+    uint64_t poolevictions;      // 被替换出的页数
+    uint64_t poolwritebacks;     // 写回的脏页数
+    uint64_t poolreadaheads;     // 扫描预读的页数
+    uint64_t poolbypasses;       // 全部页都被pin住时绕过缓冲池的访问数
+    sl_lockstats_t locks[SL_STAT_OPS]; // 按操作类型的锁等待/持有
+} sl_stats_t;
+
+// 扫描回调，part为分区编号(并行扫描时每个线程一个分区)；返回非0时结束该分区的扫描
+typedef int (*sl_scan_cb)(int part, const void* key, size_t key_len, uint64_t value, void* arg);
+
+void sl_options_init(sl_options_t* opts);
 status_t sl_open(const char* prefix, float p, skiplist_t** sl);
+status_t sl_open_opt(const char* prefix, const sl_options_t* opts, skiplist_t** sl);
 status_t sl_put(skiplist_t* sl, const void* key, size_t key_len, uint64_t value);
 status_t sl_get(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value);
+// 不阻塞于缺页的点查：路径上的页都驻留时同步完成，返回的type为0，*value同sl_get；
+// 否则把查找交给I/O线程(需opts.iothreads，key已复制)，返回的type为STATUS_SKIPLIST_PENDING，完成后调用cb
+status_t sl_get_async(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value, sl_get_cb cb, void* arg);
 status_t sl_del(skiplist_t* sl, const void* key, size_t key_len);
+// 在一次读锁内点查n个key，found[i]表示keys[i]是否存在(存在时values[i]为其值)
+status_t sl_mget(skiplist_t* sl, size_t n, const void* const keys[], const size_t key_lens[], uint64_t values[], int found[]);
+// 在一次写锁内删除n个key，*removed返回实际删除数(可为NULL)
+status_t sl_mdel(skiplist_t* sl, size_t n, const void* const keys[], const size_t key_lens[], uint64_t* removed);
+status_t sl_write(skiplist_t* sl, const sl_op_t ops[], size_t ops_n);
+// 删除[lo, hi)内的所有key(lo/hi为NULL表示不限)，整段摘除；*removed返回删除数(可为NULL)
+status_t sl_del_range(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, uint64_t* removed);
+// 删除以prefix开头的所有key(按字节序)，不支持SL_KEY_CUSTOM
+status_t sl_del_prefix(skiplist_t* sl, const void* prefix, size_t prefix_len, uint64_t* removed);
+// 在一次加锁、一次查找内完成读-改-写，变更日志中记录为写入后的PUT
+status_t sl_merge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg);
+// key不存在时写入，*inserted返回是否写入(可为NULL)
+status_t sl_put_if_absent(skiplist_t* sl, const void* key, size_t key_len, uint64_t value, int* inserted);
+// key存在且值等于expected时改为desired，*swapped返回是否修改(可为NULL)
+status_t sl_cas(skiplist_t* sl, const void* key, size_t key_len, uint64_t expected, uint64_t desired, int* swapped);
+// 值加delta(key不存在时视为0，回绕)，*old返回原值(可为NULL)
+status_t sl_fetch_add(skiplist_t* sl, const void* key, size_t key_len, uint64_t delta, uint64_t* old);
+// 按key顺序扫描[lo, hi)，lo/hi为NULL表示不限
+status_t sl_scan(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg);
+// 按值扫描[lo, hi](含两端)，值相同的按节点位置；需opts.valueindex，cb的part为0
+status_t sl_scan_by_value(skiplist_t* sl, uint64_t lo, uint64_t hi, sl_scan_cb cb, void* arg);
+status_t sl_parallel_scan(skiplist_t* sl, int nthreads, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg);
+// 设置访问模式(SL_ADVISE_NORMAL/RANDOM/SEQUENTIAL)或执行一次性提示(SL_ADVISE_WILLNEED/HUGEPAGE)
+status_t sl_advise(skiplist_t* sl, int hint);
+// 按当前key重建布隆过滤器，清除已删除key留下的位；批量导入或大量删除后调用
+status_t sl_bloom_rebuild(skiplist_t* sl);
+// read guard：begin/end之间取得的视图保持有效，数据映射的替换推迟到没有guard时；可多线程、嵌套调用
+status_t sl_read_begin(skiplist_t* sl);
+status_t sl_read_end(skiplist_t* sl);
+// 定位到第一个 >= key(为NULL时第一个key)，需在read guard内
+status_t sl_iter_seek(skiplist_t* sl, sl_iter_t* it, const void* key, size_t key_len);
+status_t sl_iter_next(sl_iter_t* it);
+// 最小/最大key的视图，空表时data为NULL，需在read guard内
+status_t sl_view_minkey(skiplist_t* sl, sl_view_t* key);
+status_t sl_view_maxkey(skiplist_t* sl, sl_view_t* key);
+// 开始/停止把sl_put/sl_get/sl_del记录到path(覆盖)，格式见trace.h
+status_t sl_trace_start(skiplist_t* sl, const char* path);
+status_t sl_trace_stop(skiplist_t* sl);
+// 汇总各线程的计数器并读取文件状态，只加读锁，不遍历跳表
+status_t sl_stats(skiplist_t* sl, sl_stats_t* stats);
 status_t sl_sync(skiplist_t* sl);
 status_t sl_close(skiplist_t* sl);
 status_t sl_rdlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n);
 status_t sl_wrlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n);
 status_t sl_unlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n);
+// 返回的指针指向数据映射：在read guard内调用时到guard结束前有效，否则只到下一次写操作
 status_t sl_get_maxkey(skiplist_t* sl, void** key, size_t* size);
 datanode_t* sl_get_datanode(skiplist_t* sl, uint64_t offset);
 
-#define METANODEHEAD(sl) ((metanode_t*)((sl)->meta->mapped + sizeof(skipmeta_t) + 1))
-#define METANODE(sl, offset) ((offset) == 0 ? NULL : ((metanode_t*)((sl)->meta->mapped + (offset))))
+#define METAMAPPED(sl) ((void*)(sl)->meta)
+#define DATAMAPPED(sl) ((void*)(sl)->data)
+
+#define METANODEHEAD(sl) ((metanode_t*)(METAMAPPED(sl) + sizeof(skipmeta_t) + 1))
+#define METANODE(sl, offset) ((offset) == 0 ? NULL : ((metanode_t*)(METAMAPPED(sl) + (offset))))
 #define METANODESIZE(mnode) (sizeof(metanode_t) + sizeof(uint64_t) * (mnode)->level)
-#define METANODEPOSITION(sl, node) ((uint64_t)((void*)(node) - (sl)->meta->mapped))
+#define METANODEPOSITION(sl, node) ((uint64_t)((void*)(node) - METAMAPPED(sl)))
 
 #define DATANODESIZE(dnode) (sizeof(datanode_t) + sizeof(char) * (dnode)->size)
-#define DATANODEPOSITION(sl, node) ((uint64_t)((void*)(node) - (sl)->data->mapped))
+#define DATANODECAP(dnode) (DATANODESIZE(dnode) + (dnode)->slack) // 占用的空间
+#define DATANODEPOSITION(sl, node) ((uint64_t)((void*)(node) - DATAMAPPED(sl)))
 
 #endif // __SKIPLIST_H
@@ -5,6 +5,7 @@
 
 #define STATUS_SKIPLIST_FULL 1
 #define STATUS_SKIPLIST_LOAD 2
+#define STATUS_SKIPLIST_PENDING 3 // 异步操作已提交，结果经回调返回
 
 typedef struct status_s {
     int ok;
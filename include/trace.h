@@ -0,0 +1,36 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "status.h"
+#include <stdint.h>
+
+// 操作跟踪文件(sl_trace_start或opts.trace开启)：文件头之后是记录，每条记录后紧跟key。
+// 每个线程先写自己的缓冲区，满了或停止跟踪时整块追加到文件，因此同一线程的记录按时间有序，
+// 不同线程的记录交错。回放工具见test/replay.c
+
+#define SL_TRACE_MAGIC 0x52544c53 // "SLTR"
+#define SL_TRACE_VERSION 1
+#define SL_TRACE_BUFF_SIZE (uint64_t)(65536) // 每个线程的缓冲大小(64K)
+
+#define SL_TRACE_GET 4    // 操作类型，写操作与changelog.h的SL_OP_PUT/SL_OP_DEL相同
+#define SL_TRACE_FOUND 1  // flags：get命中
+
+typedef struct traceheader_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start; // 开始跟踪时的CLOCK_REALTIME(纳秒)
+} traceheader_t;
+
+typedef struct tracerecord_s {
+    uint64_t ts;     // 距开始跟踪的纳秒数(CLOCK_MONOTONIC)
+    uint64_t value;  // put写入的值，get命中时的值
+    uint32_t thread; // 跟踪内的线程编号，从0开始
+    uint8_t op;      // SL_OP_PUT/SL_OP_DEL/SL_TRACE_GET
+    uint8_t flags;   // SL_TRACE_FOUND
+    uint16_t size;   // key长度
+    char data[0];
+} tracerecord_t;
+
+#define TRACERECORDSIZE(rec) (sizeof(tracerecord_t) + (rec)->size)
+
+#endif // __TRACE_H
@@ -0,0 +1,25 @@
+#ifndef __WARM_H
+#define __WARM_H
+
+#include "skiplist.h"
+
+#define SL_RESIDENCY_REGIONS 16 // 按文件区域等分统计的区域数
+
+// 页驻留统计(mincore)，只统计已使用的部分[0, mapsize]
+typedef struct sl_residency_s {
+    uint64_t pagesize;
+    uint64_t metapages, metaresident;
+    uint64_t datapages, dataresident;
+    uint64_t metaregion[SL_RESIDENCY_REGIONS][2]; // {页数, 驻留页数}
+    uint64_t dataregion[SL_RESIDENCY_REGIONS][2];
+    uint64_t levelnodes[SKIPLIST_MAXLEVEL];    // 按节点最高层(level - 1)统计的节点数
+    uint64_t levelresident[SKIPLIST_MAXLEVEL]; // 其中metanode与key(块格式为首key)所在页都已驻留的节点数
+} sl_residency_t;
+
+status_t sl_residency(skiplist_t* sl, sl_residency_t* r);
+// 把当前驻留的页记录到<prefix>.sl.heat，opts.heat开启时关闭前自动保存
+status_t sl_heat_save(skiplist_t* sl);
+// 预热：先高层索引节点所在页，再按heat文件记录的页，nthreads个线程并发缺页，最多预热budget字节(0不限)
+status_t sl_warmup(skiplist_t* sl, int nthreads, uint64_t budget, uint64_t* warmed);
+
+#endif // __WARM_H
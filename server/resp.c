@@ -0,0 +1,207 @@
+#include "resp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void buf_reserve(buf_t* b, size_t n) {
+    if (b->len + n <= b->cap) {
+        return;
+    }
+    size_t cap = b->cap == 0 ? 4096 : b->cap;
+    while (cap < b->len + n) {
+        cap *= 2;
+    }
+    char* data = (char*)realloc(b->data, cap);
+    if (data == NULL) {
+        fprintf(stderr, "realloc %ld bytes failed\n", cap);
+        abort();
+    }
+    b->data = data;
+    b->cap = cap;
+}
+
+void buf_append(buf_t* b, const void* data, size_t n) {
+    buf_reserve(b, n);
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+void buf_free(buf_t* b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+static void addarg(respargs_t* args, const char* arg, size_t len) {
+    if (args->n == args->cap) {
+        args->cap = args->cap == 0 ? 256 : args->cap * 2;
+        args->argv = (const char**)realloc(args->argv, sizeof(char*) * args->cap);
+        args->lens = (size_t*)realloc(args->lens, sizeof(size_t) * args->cap);
+        if (args->argv == NULL || args->lens == NULL) {
+            fprintf(stderr, "realloc args failed\n");
+            abort();
+        }
+    }
+    args->argv[args->n] = arg;
+    args->lens[args->n] = len;
+    ++args->n;
+}
+
+void resp_freeargs(respargs_t* args) {
+    free(args->argv);
+    free(args->lens);
+    memset(args, 0, sizeof(respargs_t));
+}
+
+// 解析data[*pos]起以\r\n结束的整数行(首字节为类型前缀)；不完整返回0，格式错误返回-1
+static int parseline(const char* data, size_t len, size_t* pos, long* value) {
+    const char* p = data + *pos + 1;
+    const char* end = memchr(p, '\r', len - *pos - 1);
+    long v = 0;
+    int neg = 0;
+
+    if (end == NULL || (size_t)(end - data) + 1 >= len) {
+        return len - *pos > 32 ? -1 : 0;
+    }
+    if (end[1] != '\n') {
+        return -1;
+    }
+    if (p < end && *p == '-') {
+        neg = 1;
+        ++p;
+    }
+    if (p == end || end - p > 18) {
+        return -1;
+    }
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+        v = v * 10 + (*p - '0');
+    }
+    *value = neg ? -v : v;
+    *pos = end - data + 2;
+    return 1;
+}
+
+// 内联命令：一行，以空白分隔
+static ssize_t parseinline(const char* data, size_t len, respargs_t* args, const char** err) {
+    const char* end = memchr(data, '\n', len);
+
+    if (end == NULL) {
+        if (len > RESP_MAX_BULK) {
+            *err = "inline request too long";
+            return -1;
+        }
+        return 0;
+    }
+    size_t linelen = end - data;
+    if (linelen > 0 && data[linelen - 1] == '\r') {
+        --linelen;
+    }
+    for (size_t i = 0; i < linelen;) {
+        while (i < linelen && (data[i] == ' ' || data[i] == '\t')) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < linelen && data[i] != ' ' && data[i] != '\t') {
+            ++i;
+        }
+        if (i > start) {
+            addarg(args, data + start, i - start);
+        }
+    }
+    return end - data + 1;
+}
+
+ssize_t resp_parse(const char* data, size_t len, respargs_t* args, const char** err) {
+    size_t pos = 0;
+    size_t first = args->n;
+    long n = 0;
+    int r;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (data[0] != '*') {
+        return parseinline(data, len, args, err);
+    }
+    if ((r = parseline(data, len, &pos, &n)) <= 0) {
+        *err = "invalid multibulk length";
+        return r;
+    }
+    if (n > RESP_MAX_ARGS) {
+        *err = "invalid multibulk length";
+        return -1;
+    }
+    for (long i = 0; i < n; ++i) {
+        long size = 0;
+        if (pos >= len) {
+            args->n = first;
+            return 0;
+        }
+        if (data[pos] != '$') {
+            *err = "expected '$'";
+            return -1;
+        }
+        if ((r = parseline(data, len, &pos, &size)) <= 0) {
+            args->n = first;
+            *err = "invalid bulk length";
+            return r;
+        }
+        if (size < 0 || size > RESP_MAX_BULK) {
+            *err = "invalid bulk length";
+            return -1;
+        }
+        if (len - pos < (size_t)size + 2) {
+            args->n = first;
+            return 0;
+        }
+        if (data[pos + size] != '\r' || data[pos + size + 1] != '\n') {
+            *err = "bulk not terminated by CRLF";
+            return -1;
+        }
+        addarg(args, data + pos, size);
+        pos += size + 2;
+    }
+    return pos;
+}
+
+void resp_simple(buf_t* b, const char* s) {
+    buf_reserve(b, strlen(s) + 4); // sprintf还要写结尾的\0
+    b->len += sprintf(b->data + b->len, "+%s\r\n", s);
+}
+
+void resp_error(buf_t* b, const char* msg) {
+    buf_reserve(b, strlen(msg) + 8);
+    b->len += sprintf(b->data + b->len, "-ERR %s\r\n", msg);
+}
+
+void resp_int(buf_t* b, int64_t v) {
+    buf_reserve(b, 24);
+    b->len += sprintf(b->data + b->len, ":%ld\r\n", v);
+}
+
+void resp_bulk(buf_t* b, const void* data, size_t n) {
+    buf_reserve(b, n + 24);
+    b->len += sprintf(b->data + b->len, "$%ld\r\n", n);
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    b->data[b->len++] = '\r';
+    b->data[b->len++] = '\n';
+}
+
+void resp_u64(buf_t* b, uint64_t v) {
+    char digits[24];
+    int n = sprintf(digits, "%lu", v);
+    resp_bulk(b, digits, n);
+}
+
+void resp_nil(buf_t* b) {
+    buf_append(b, "$-1\r\n", 5);
+}
+
+void resp_array(buf_t* b, size_t n) {
+    buf_reserve(b, 24);
+    b->len += sprintf(b->data + b->len, "*%ld\r\n", n);
+}
@@ -0,0 +1,45 @@
+#ifndef __RESP_H
+#define __RESP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// RESP(Redis序列化协议)：请求的解析和回复的编码
+
+#define RESP_MAX_ARGS 65536      // 一条命令最多的参数数
+#define RESP_MAX_BULK (1 << 20)  // 单个参数最大长度(1M)
+
+// 可增长的字节缓冲
+typedef struct buf_s {
+    char* data;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+void buf_reserve(buf_t* b, size_t n);
+void buf_append(buf_t* b, const void* data, size_t n);
+void buf_free(buf_t* b);
+
+// 解析出的参数，指向读缓冲；多条命令的参数依次追加
+typedef struct respargs_s {
+    const char** argv;
+    size_t* lens;
+    size_t n;
+    size_t cap;
+} respargs_t;
+
+// 从data[0, len)解析一条命令(多条批量格式或内联格式)，参数追加到args末尾。
+// 返回消耗的字节数；数据不完整返回0；协议错误返回-1，*err为错误信息
+ssize_t resp_parse(const char* data, size_t len, respargs_t* args, const char** err);
+void resp_freeargs(respargs_t* args);
+
+void resp_simple(buf_t* b, const char* s);
+void resp_error(buf_t* b, const char* msg);
+void resp_int(buf_t* b, int64_t v);
+void resp_bulk(buf_t* b, const void* data, size_t n);
+void resp_u64(buf_t* b, uint64_t v); // 十进制的bulk string
+void resp_nil(buf_t* b);
+void resp_array(buf_t* b, size_t n);
+
+#endif // __RESP_H
@@ -0,0 +1,753 @@
+#define _GNU_SOURCE
+#include "../include/skiplist.h"
+#include "resp.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// skipdb-server：通过RESP协议(GET/SET/DEL/MGET/SCAN等)在TCP和Unix socket上提供一个skiplist。
+// 每个线程一个epoll循环，监听socket以EPOLLEXCLUSIVE加入所有线程，连接归接受它的线程所有。
+// 一次读到的多条命令(pipelining)先全部解析，连续的GET/MGET合并为一次sl_mget(一次读锁)，
+// 连续的SET合并为一次sl_write(一次写锁，失败时逐个写入)，回复按命令顺序写回。值为uint64，SET的值须是十进制整数
+
+#define SERVER_MAXTHREADS 256
+#define SERVER_MAXEVENTS 256
+#define SERVER_READSIZE 65536
+#define SERVER_BATCH 1024                    // 一次加锁最多合并的命令数
+#define SERVER_WBUF_HIGH (64 * 1024 * 1024)  // 未发送的回复超过该值时暂停读取
+#define SERVER_SCAN_COUNT 10                 // SCAN默认的COUNT
+
+#define log_info(fmt, ...) fprintf(stderr, "skipdb-server: " fmt, ##__VA_ARGS__)
+#define log_fatal(fmt, ...) (fprintf(stderr, "skipdb-server: " fmt, ##__VA_ARGS__), exit(1))
+
+typedef struct _options {
+    char prefix[128];
+    char bind[64];
+    int port;          // 0不监听TCP
+    char unixpath[108];
+    int threads;
+    float p;
+    uint32_t format;
+    int inmemory;
+    uint64_t metasize;
+} _options;
+
+_options opt = {
+    .prefix   = "skipdb",
+    .bind     = "127.0.0.1",
+    .port     = 6380,
+    .unixpath = "",
+    .threads  = 0, // 默认每个CPU一个
+    .p        = 0.25,
+    .format   = SL_FORMAT_NODE,
+    .inmemory = 0,
+    .metasize = 64 * 1024 * 1024,
+};
+
+enum { CMD_UNKNOWN, CMD_GET, CMD_MGET, CMD_SET, CMD_DEL, CMD_SCAN, CMD_PING, CMD_ECHO, CMD_DBSIZE, CMD_INFO, CMD_QUIT, CMD_COMMAND, CMD_CONFIG };
+
+static const struct {
+    const char* name;
+    int type;
+} commands[] = {
+    { "GET", CMD_GET }, { "MGET", CMD_MGET }, { "SET", CMD_SET }, { "DEL", CMD_DEL }, { "SCAN", CMD_SCAN },
+    { "PING", CMD_PING }, { "ECHO", CMD_ECHO }, { "DBSIZE", CMD_DBSIZE }, { "INFO", CMD_INFO }, { "QUIT", CMD_QUIT },
+    { "COMMAND", CMD_COMMAND }, { "CONFIG", CMD_CONFIG },
+};
+
+typedef struct cmd_s {
+    int type;
+    size_t first; // 在respargs中的下标
+    size_t argc;
+} cmd_t;
+
+typedef struct conn_s {
+    int fd;
+    int closing;  // 发送完回复后关闭
+    int reading;  // EPOLLIN是否开启
+    int writing;  // EPOLLOUT是否开启
+    buf_t rbuf;
+    buf_t wbuf;
+    size_t wpos;  // wbuf中已发送的字节数
+} conn_t;
+
+typedef struct worker_s {
+    pthread_t tid;
+    int epfd;
+    respargs_t args;
+    cmd_t* cmds;
+    size_t cmdcap;
+    // 合并执行用的临时数组
+    const void** keys;
+    size_t* lens;
+    uint64_t* values;
+    int* found;
+    sl_op_t* ops;
+    size_t batchcap;
+} worker_t;
+
+static skiplist_t* sl = NULL;
+static int listenfds[2] = { -1, -1 };
+static volatile sig_atomic_t stop = 0;
+
+static void onsignal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static int cmdtype(const char* name, size_t len) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+        if (strlen(commands[i].name) == len && strncasecmp(commands[i].name, name, len) == 0) {
+            return commands[i].type;
+        }
+    }
+    return CMD_UNKNOWN;
+}
+
+static void growbatch(worker_t* w, size_t n) {
+    if (n <= w->batchcap) {
+        return;
+    }
+    w->batchcap = n;
+    w->keys = (const void**)realloc(w->keys, sizeof(void*) * n);
+    w->lens = (size_t*)realloc(w->lens, sizeof(size_t) * n);
+    w->values = (uint64_t*)realloc(w->values, sizeof(uint64_t) * n);
+    w->found = (int*)realloc(w->found, sizeof(int) * n);
+    w->ops = (sl_op_t*)realloc(w->ops, sizeof(sl_op_t) * n);
+    if (w->keys == NULL || w->lens == NULL || w->values == NULL || w->found == NULL || w->ops == NULL) {
+        log_fatal("realloc batch failed\n");
+    }
+}
+
+static int parseu64(const char* s, size_t len, uint64_t* v) {
+    uint64_t r = 0;
+
+    if (len == 0 || len > 20) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] < '0' || s[i] > '9' || r > (UINT64_MAX - (s[i] - '0')) / 10) {
+            return 0;
+        }
+        r = r * 10 + (s[i] - '0');
+    }
+    *v = r;
+    return 1;
+}
+
+// 合并的GET/MGET：cmds[0, n)中的key一次sl_mget
+static void execgets(worker_t* w, conn_t* c, cmd_t* cmds, size_t n) {
+    size_t nkeys = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        nkeys += cmds[i].argc - 1;
+    }
+    growbatch(w, nkeys);
+    nkeys = 0;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t a = 1; a < cmds[i].argc; ++a, ++nkeys) {
+            w->keys[nkeys] = w->args.argv[cmds[i].first + a];
+            w->lens[nkeys] = w->args.lens[cmds[i].first + a];
+        }
+    }
+    status_t s = sl_mget(sl, nkeys, w->keys, w->lens, w->values, w->found);
+    nkeys = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!s.ok) {
+            resp_error(&c->wbuf, s.errmsg);
+            continue;
+        }
+        if (cmds[i].type == CMD_MGET) {
+            resp_array(&c->wbuf, cmds[i].argc - 1);
+        }
+        for (size_t a = 1; a < cmds[i].argc; ++a, ++nkeys) {
+            if (w->found[nkeys]) {
+                resp_u64(&c->wbuf, w->values[nkeys]);
+            } else {
+                resp_nil(&c->wbuf);
+            }
+        }
+    }
+}
+
+// 合并的SET：cmds[0, n)一次sl_write。sl_write失败时停在失败的操作，之前的已写入，
+// 所以改为逐个sl_put，每个SET回复自己的结果(已写入的再写一次值不变)
+static void execsets(worker_t* w, conn_t* c, cmd_t* cmds, size_t n) {
+    size_t nops = 0;
+
+    growbatch(w, n);
+    for (size_t i = 0; i < n; ++i) {
+        const char** argv = w->args.argv + cmds[i].first;
+        size_t* lens = w->args.lens + cmds[i].first;
+        w->found[i] = parseu64(argv[2], lens[2], &w->ops[nops].value);
+        if (w->found[i]) {
+            w->ops[nops].type = SL_OP_PUT;
+            w->ops[nops].key = argv[1];
+            w->ops[nops].key_len = lens[1];
+            ++nops;
+        }
+    }
+    status_t s = sl_write(sl, w->ops, nops);
+    nops = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!w->found[i]) {
+            resp_error(&c->wbuf, "value is not an unsigned 64-bit integer");
+            continue;
+        }
+        sl_op_t* op = &w->ops[nops++];
+        status_t one = s.ok ? s : sl_put(sl, op->key, op->key_len, op->value);
+        if (one.ok) {
+            resp_simple(&c->wbuf, "OK");
+        } else {
+            resp_error(&c->wbuf, one.errmsg);
+        }
+    }
+}
+
+typedef struct scanarg_s {
+    buf_t* keys;        // 依次存放(uint16_t长度, key)
+    size_t n;
+    size_t count;       // 最多访问的key数
+    size_t visited;
+    const char* match;  // 为NULL时不过滤
+    buf_t* cursor;      // 下一个key
+} scanarg_t;
+
+static int scancollect(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    scanarg_t* a = (scanarg_t*)arg;
+    char name[MAX_KEY_LEN + 1];
+
+    (void)part;
+    (void)value;
+    if (a->visited == a->count) {
+        buf_append(a->cursor, key, key_len);
+        return 1;
+    }
+    ++a->visited;
+    if (a->match != NULL) {
+        memcpy(name, key, key_len);
+        name[key_len] = '\0';
+        if (fnmatch(a->match, name, 0) != 0) {
+            return 0;
+        }
+    }
+    uint16_t len = (uint16_t)key_len;
+    buf_append(a->keys, &len, sizeof(len));
+    buf_append(a->keys, key, key_len);
+    ++a->n;
+    return 0;
+}
+
+static int hexval(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    ch |= 0x20;
+    return ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : -1;
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count]：cursor为"0"(开始/结束)或"k"加下一个key的十六进制
+static void execscan(conn_t* c, const char** argv, size_t* lens, size_t argc) {
+    char lo[MAX_KEY_LEN];
+    char match[1024];
+    size_t lo_len = 0;
+    buf_t keys = { 0 }, cursor = { 0 };
+    scanarg_t a = { .keys = &keys, .count = SERVER_SCAN_COUNT, .cursor = &cursor };
+
+    if (!(lens[1] == 1 && argv[1][0] == '0')) {
+        if (argv[1][0] != 'k' || lens[1] % 2 != 1 || lens[1] / 2 > MAX_KEY_LEN) {
+            resp_error(&c->wbuf, "invalid cursor");
+            return;
+        }
+        for (size_t i = 1; i < lens[1]; i += 2) {
+            int hi = hexval(argv[1][i]), low = hexval(argv[1][i + 1]);
+            if (hi < 0 || low < 0) {
+                resp_error(&c->wbuf, "invalid cursor");
+                return;
+            }
+            lo[lo_len++] = (char)(hi << 4 | low);
+        }
+    }
+    for (size_t i = 2; i < argc; i += 2) {
+        uint64_t count = 0;
+        if (i + 1 < argc && lens[i] == 5 && strncasecmp(argv[i], "COUNT", 5) == 0 && parseu64(argv[i + 1], lens[i + 1], &count) && count > 0) {
+            a.count = count;
+        } else if (i + 1 < argc && lens[i] == 5 && strncasecmp(argv[i], "MATCH", 5) == 0 && lens[i + 1] < sizeof(match)) {
+            memcpy(match, argv[i + 1], lens[i + 1]);
+            match[lens[i + 1]] = '\0';
+            a.match = match;
+        } else {
+            resp_error(&c->wbuf, "syntax error");
+            return;
+        }
+    }
+    status_t s = sl_scan(sl, lo_len > 0 ? lo : NULL, lo_len, NULL, 0, scancollect, &a);
+    if (!s.ok) {
+        resp_error(&c->wbuf, s.errmsg);
+    } else {
+        resp_array(&c->wbuf, 2);
+        if (cursor.len == 0) { // 扫描到末尾
+            resp_bulk(&c->wbuf, "0", 1);
+        } else {
+            buf_t hex = { 0 };
+            buf_reserve(&hex, cursor.len * 2 + 1);
+            hex.data[hex.len++] = 'k';
+            for (size_t i = 0; i < cursor.len; ++i) {
+                hex.len += sprintf(hex.data + hex.len, "%02x", (unsigned char)cursor.data[i]);
+            }
+            resp_bulk(&c->wbuf, hex.data, hex.len);
+            buf_free(&hex);
+        }
+        resp_array(&c->wbuf, a.n);
+        for (size_t pos = 0; pos < keys.len;) {
+            uint16_t len;
+            memcpy(&len, keys.data + pos, sizeof(len));
+            resp_bulk(&c->wbuf, keys.data + pos + sizeof(len), len);
+            pos += sizeof(len) + len;
+        }
+    }
+    buf_free(&keys);
+    buf_free(&cursor);
+}
+
+static void execinfo(conn_t* c) {
+    char info[2048];
+    sl_stats_t st;
+    status_t s = sl_stats(sl, &st);
+
+    if (!s.ok) {
+        resp_error(&c->wbuf, s.errmsg);
+        return;
+    }
+    int n = snprintf(info, sizeof(info),
+        "# skipdb\r\nkeys:%lu\r\nthreads:%d\r\nget:%lu\r\nwrite:%lu\r\ndel:%lu\r\nscan:%lu\r\nhits:%lu\r\nmisses:%lu\r\n"
+        "avg_hops:%.2f\r\navg_compares:%.2f\r\nmax_level:%u\r\nmeta_used:%lu\r\nmeta_cap:%lu\r\ndata_used:%lu\r\n"
+        "data_cap:%lu\r\nget_lock_wait_ns:%.0f\r\nwrite_lock_wait_ns:%.0f\r\n",
+        st.count, opt.threads, st.ops[SL_STAT_GET], st.ops[SL_STAT_WRITE], st.ops[SL_STAT_DEL], st.ops[SL_STAT_SCAN],
+        st.hits, st.misses, st.avghops, st.avgcompares, st.maxlevel, st.metamapsize, st.metamapcap, st.datamapsize,
+        st.datamapcap, st.locks[SL_STAT_GET].avgwaitns, st.locks[SL_STAT_WRITE].avgwaitns);
+    resp_bulk(&c->wbuf, info, n);
+}
+
+// 检查参数个数，合并执行的命令在合并前检查
+static int checkargs(cmd_t* cmd, worker_t* w) {
+    size_t argc = cmd->argc;
+
+    switch (cmd->type) {
+    case CMD_GET:
+        return argc == 2 && w->args.lens[cmd->first + 1] <= MAX_KEY_LEN;
+    case CMD_MGET:
+        for (size_t a = 1; a < argc; ++a) {
+            if (w->args.lens[cmd->first + a] > MAX_KEY_LEN) {
+                return 0;
+            }
+        }
+        return argc >= 2;
+    case CMD_SET:
+        return argc == 3 && w->args.lens[cmd->first + 1] <= MAX_KEY_LEN;
+    case CMD_DEL:
+        for (size_t a = 1; a < argc; ++a) {
+            if (w->args.lens[cmd->first + a] > MAX_KEY_LEN) {
+                return 0;
+            }
+        }
+        return argc >= 2;
+    case CMD_SCAN:
+        return argc >= 2 && argc % 2 == 0;
+    case CMD_ECHO:
+        return argc == 2;
+    case CMD_PING:
+        return argc <= 2;
+    }
+    return 1;
+}
+
+static inline int isget(int type) {
+    return type == CMD_GET || type == CMD_MGET;
+}
+
+static void execute(worker_t* w, conn_t* c, size_t ncmds) {
+    for (size_t i = 0; i < ncmds && !c->closing;) {
+        cmd_t* cmd = &w->cmds[i];
+        const char** argv = w->args.argv + cmd->first;
+        size_t* lens = w->args.lens + cmd->first;
+
+        if (cmd->type == CMD_UNKNOWN) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "unknown command '%.*s'", (int)(lens[0] < 64 ? lens[0] : 64), argv[0]);
+            resp_error(&c->wbuf, msg);
+            ++i;
+            continue;
+        }
+        if (!checkargs(cmd, w)) {
+            resp_error(&c->wbuf, "wrong number of arguments or key too long");
+            ++i;
+            continue;
+        }
+        size_t j = i + 1;
+        switch (cmd->type) {
+        case CMD_GET:
+        case CMD_MGET:
+            while (j < ncmds && j - i < SERVER_BATCH && isget(w->cmds[j].type) && checkargs(&w->cmds[j], w)) {
+                ++j;
+            }
+            execgets(w, c, cmd, j - i);
+            break;
+        case CMD_SET:
+            while (j < ncmds && j - i < SERVER_BATCH && w->cmds[j].type == CMD_SET && checkargs(&w->cmds[j], w)) {
+                ++j;
+            }
+            execsets(w, c, cmd, j - i);
+            break;
+        case CMD_DEL: {
+            uint64_t removed = 0;
+            status_t s = sl_mdel(sl, cmd->argc - 1, (const void* const*)(argv + 1), lens + 1, &removed);
+            if (s.ok) {
+                resp_int(&c->wbuf, removed);
+            } else {
+                resp_error(&c->wbuf, s.errmsg);
+            }
+            break;
+        }
+        case CMD_SCAN:
+            execscan(c, argv, lens, cmd->argc);
+            break;
+        case CMD_PING:
+            if (cmd->argc == 2) {
+                resp_bulk(&c->wbuf, argv[1], lens[1]);
+            } else {
+                resp_simple(&c->wbuf, "PONG");
+            }
+            break;
+        case CMD_ECHO:
+            resp_bulk(&c->wbuf, argv[1], lens[1]);
+            break;
+        case CMD_DBSIZE: {
+            sl_stats_t st;
+            status_t s = sl_stats(sl, &st); // 持有读锁读取key数
+            if (s.ok) {
+                resp_int(&c->wbuf, st.count);
+            } else {
+                resp_error(&c->wbuf, s.errmsg);
+            }
+            break;
+        }
+        case CMD_INFO:
+            execinfo(c);
+            break;
+        case CMD_QUIT:
+            resp_simple(&c->wbuf, "OK");
+            c->closing = 1;
+            break;
+        case CMD_COMMAND: // 客户端(如redis-benchmark、redis-cli)启动时的探测
+        case CMD_CONFIG:
+            resp_array(&c->wbuf, 0);
+            break;
+        }
+        i = j;
+    }
+}
+
+static void closeconn(worker_t* w, conn_t* c) {
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    buf_free(&c->rbuf);
+    buf_free(&c->wbuf);
+    free(c);
+}
+
+static void updateevents(worker_t* w, conn_t* c) {
+    int reading = !c->closing && c->wbuf.len - c->wpos < SERVER_WBUF_HIGH;
+    int writing = c->wbuf.len > c->wpos;
+
+    if (reading == c->reading && writing == c->writing) {
+        return;
+    }
+    struct epoll_event ev = { .events = (reading ? EPOLLIN : 0) | (writing ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->reading = reading;
+    c->writing = writing;
+}
+
+// 尽量发送回复，返回-1表示连接出错
+static int flush(conn_t* c) {
+    while (c->wpos < c->wbuf.len) {
+        ssize_t n = write(c->fd, c->wbuf.data + c->wpos, c->wbuf.len - c->wpos);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+        c->wpos += n;
+    }
+    c->wbuf.len = c->wpos = 0;
+    return 0;
+}
+
+// 读取并解析全部完整的命令后合并执行；返回-1表示应关闭连接
+static int onreadable(worker_t* w, conn_t* c) {
+    while (1) {
+        buf_reserve(&c->rbuf, SERVER_READSIZE);
+        ssize_t n = read(c->fd, c->rbuf.data + c->rbuf.len, c->rbuf.cap - c->rbuf.len);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return -1;
+        }
+        c->rbuf.len += n;
+        if ((size_t)n < SERVER_READSIZE) {
+            break;
+        }
+    }
+    size_t pos = 0, ncmds = 0;
+    const char* err = NULL;
+    w->args.n = 0;
+    while (pos < c->rbuf.len) {
+        size_t first = w->args.n;
+        ssize_t used = resp_parse(c->rbuf.data + pos, c->rbuf.len - pos, &w->args, &err);
+        if (used < 0) {
+            execute(w, c, ncmds);
+            resp_error(&c->wbuf, err);
+            c->closing = 1;
+            return 0;
+        }
+        if (used == 0) {
+            break;
+        }
+        pos += used;
+        if (w->args.n == first) { // 空行或*0
+            continue;
+        }
+        if (ncmds == w->cmdcap) {
+            w->cmdcap = w->cmdcap == 0 ? 256 : w->cmdcap * 2;
+            w->cmds = (cmd_t*)realloc(w->cmds, sizeof(cmd_t) * w->cmdcap);
+            if (w->cmds == NULL) {
+                log_fatal("realloc cmds failed\n");
+            }
+        }
+        w->cmds[ncmds].first = first;
+        w->cmds[ncmds].argc = w->args.n - first;
+        w->cmds[ncmds].type = cmdtype(w->args.argv[first], w->args.lens[first]);
+        ++ncmds;
+    }
+    execute(w, c, ncmds);
+    memmove(c->rbuf.data, c->rbuf.data + pos, c->rbuf.len - pos);
+    c->rbuf.len -= pos;
+    return 0;
+}
+
+static void onaccept(worker_t* w, int lfd) {
+    while (1) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return; // EAGAIN，或被其他线程接受
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Unix socket上失败，忽略
+        conn_t* c = (conn_t*)calloc(1, sizeof(conn_t));
+        if (c == NULL) { // 内存不足时拒绝这个连接，继续服务已有的连接
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->reading = 1;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(c);
+        }
+    }
+}
+
+static void* serve(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    struct epoll_event events[SERVER_MAXEVENTS];
+
+    while (!stop) {
+        int n = epoll_wait(w->epfd, events, SERVER_MAXEVENTS, 100);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &listenfds[0] || events[i].data.ptr == &listenfds[1]) {
+                onaccept(w, *(int*)events[i].data.ptr);
+                continue;
+            }
+            conn_t* c = (conn_t*)events[i].data.ptr;
+            int failed = (events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN);
+            if (!failed && (events[i].events & EPOLLIN)) {
+                failed = onreadable(w, c) < 0;
+            }
+            if (!failed) {
+                failed = flush(c) < 0 || (c->closing && c->wpos == c->wbuf.len);
+            }
+            if (failed) {
+                closeconn(w, c);
+                continue;
+            }
+            updateevents(w, c);
+        }
+    }
+    return NULL;
+}
+
+static int listentcp() {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(opt.port) };
+    int one = 1;
+
+    if (inet_pton(AF_INET, opt.bind, &addr.sin_addr) != 1) {
+        log_fatal("invalid bind address %s\n", opt.bind);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+        log_fatal("listen on %s:%d failed: %s\n", opt.bind, opt.port, strerror(errno));
+    }
+    return fd;
+}
+
+static int listenunix() {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", opt.unixpath);
+    unlink(opt.unixpath);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+        log_fatal("listen on %s failed: %s\n", opt.unixpath, strerror(errno));
+    }
+    return fd;
+}
+
+void usage() {
+    log_info("\n\t./skipdb-server [-f prefix] [-b bind] [-p port(0 disables tcp)] [-s unix_socket] [-t threads]\n"
+             "\t                [-P p] [-B(locked format)] [-M(inmemory)] [-m metasize_mb]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+    sl_options_t opts;
+
+    while ((c = getopt(argc, argv, "f:b:p:s:t:P:BMm:h")) != -1) {
+        switch (c) {
+        case 'f':
+            snprintf(opt.prefix, sizeof(opt.prefix), "%s", optarg);
+            break;
+        case 'b':
+            snprintf(opt.bind, sizeof(opt.bind), "%s", optarg);
+            break;
+        case 'p':
+            opt.port = atoi(optarg);
+            break;
+        case 's':
+            snprintf(opt.unixpath, sizeof(opt.unixpath), "%s", optarg);
+            break;
+        case 't':
+            opt.threads = atoi(optarg);
+            break;
+        case 'P':
+            opt.p = atof(optarg);
+            break;
+        case 'B':
+            opt.format = SL_FORMAT_BLOCKED;
+            break;
+        case 'M':
+            opt.inmemory = 1;
+            break;
+        case 'm':
+            opt.metasize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (opt.threads <= 0) {
+        opt.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (opt.threads > SERVER_MAXTHREADS) {
+        opt.threads = SERVER_MAXTHREADS;
+    }
+    if (opt.port <= 0 && opt.unixpath[0] == '\0') {
+        usage();
+    }
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.format = opt.format;
+    opts.inmemory = opt.inmemory;
+    opts.metasize = opt.metasize;
+    status_t s = sl_open_opt(opt.inmemory ? NULL : opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onsignal);
+    signal(SIGTERM, onsignal);
+    if (opt.port > 0) {
+        listenfds[0] = listentcp();
+    }
+    if (opt.unixpath[0] != '\0') {
+        listenfds[1] = listenunix();
+    }
+
+    worker_t* workers = (worker_t*)calloc(opt.threads, sizeof(worker_t));
+    if (workers == NULL) {
+        log_fatal("calloc workers failed\n");
+    }
+    for (int t = 0; t < opt.threads; ++t) {
+        worker_t* w = &workers[t];
+        if ((w->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            log_fatal("epoll_create1 failed: %s\n", strerror(errno));
+        }
+        for (int i = 0; i < 2; ++i) {
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &listenfds[i] };
+            if (listenfds[i] >= 0 && epoll_ctl(w->epfd, EPOLL_CTL_ADD, listenfds[i], &ev) < 0) {
+                log_fatal("epoll_ctl failed: %s\n", strerror(errno));
+            }
+        }
+        pthread_create(&w->tid, NULL, serve, w);
+    }
+    log_info("%u keys, %d threads, tcp %s:%d, unix %s\n", sl->meta->count, opt.threads, opt.bind, opt.port,
+        opt.unixpath[0] != '\0' ? opt.unixpath : "-");
+
+    for (int t = 0; t < opt.threads; ++t) {
+        worker_t* w = &workers[t];
+        pthread_join(w->tid, NULL);
+        close(w->epfd);
+        resp_freeargs(&w->args);
+        free(w->cmds);
+        free(w->keys);
+        free(w->lens);
+        free(w->values);
+        free(w->found);
+        free(w->ops);
+    }
+    free(workers);
+    for (int i = 0; i < 2; ++i) {
+        if (listenfds[i] >= 0) {
+            close(listenfds[i]);
+        }
+    }
+    if (opt.unixpath[0] != '\0') {
+        unlink(opt.unixpath);
+    }
+    s = sl_close(sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    log_info("stopped\n");
+    return 0;
+}
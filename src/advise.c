@@ -0,0 +1,126 @@
+#include "internal.h"
+#include <errno.h>
+
+int sl_madvflag(int advice) {
+    switch (advice) {
+    case SL_ADVISE_NORMAL:
+        return MADV_NORMAL;
+    case SL_ADVISE_SEQUENTIAL:
+        return MADV_SEQUENTIAL;
+    }
+    return MADV_RANDOM;
+}
+
+// 对本进程的元数据/数据映射设置访问模式；只修改VMA标志，不需要持有写锁
+void sl_madvise(skiplist_t* sl, int advice) {
+    int flag = sl_madvflag(advice);
+
+    madvise(METAMAPPED(sl), sl->meta->mapcap, flag);
+    if (sl->pool == NULL) { // 缓冲池模式的数据文件没有映射
+        madvise(DATAMAPPED(sl), sl->datacap, flag);
+    }
+}
+
+// 大范围扫描期间临时改为MADV_SEQUENTIAL打开预读，最后一个扫描结束后恢复稳态模式
+void sl_seqbegin(skiplist_t* sl) {
+    if (__sync_fetch_and_add(&sl->seqscans, 1) == 0 && sl->advice != SL_ADVISE_SEQUENTIAL) {
+        sl_madvise(sl, SL_ADVISE_SEQUENTIAL);
+    }
+}
+
+void sl_seqend(skiplist_t* sl) {
+    if (__sync_sub_and_fetch(&sl->seqscans, 1) == 0 && sl->advice != SL_ADVISE_SEQUENTIAL) {
+        sl_madvise(sl, sl->advice);
+    }
+}
+
+static int pagecmp(const void* a, const void* b) {
+    uintptr_t x = *(const uintptr_t*)a;
+    uintptr_t y = *(const uintptr_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 高层节点按插入顺序散落在文件中，从最高层往下逐个收集其metanode与key所在页，
+// 直到页数达到cap，返回页数(高层在前，可能重复)；level 0即全部节点，不收集。
+// 缓冲池模式下数据文件没有映射，只收集metanode所在页
+size_t sl_indexpages(skiplist_t* sl, uintptr_t pages[], size_t cap) {
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    metanode_t* head = METANODEHEAD(sl);
+    size_t n = 0;
+
+    for (int level = (int)head->level - 1; level >= 1 && n + 2 <= cap; --level) {
+        for (metanode_t* curr = METANODE(sl, head->forwards[level]); curr != NULL && n + 2 <= cap;
+             curr = METANODE(sl, curr->forwards[level])) {
+            if (curr->level - 1 != (uint32_t)level) { // 更高层已收集
+                continue;
+            }
+            pages[n++] = (uintptr_t)curr & ~(pagesize - 1);
+            if (sl->pool != NULL) {
+                continue;
+            }
+            uint64_t offset = (curr->flag & METANODE_BLOCK) ? BLOCKENTRIES(curr)->offsets[0] : curr->offset;
+            pages[n++] = (uintptr_t)sl_get_datanode(sl, offset) & ~(pagesize - 1);
+        }
+    }
+    return n;
+}
+
+static status_t willneedindex(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+
+    uintptr_t* pages = (uintptr_t*)malloc(sizeof(uintptr_t) * 2 * SL_WILLNEED_NODES);
+    if (pages == NULL) {
+        return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    }
+    size_t n = sl_indexpages(sl, pages, 2 * SL_WILLNEED_NODES);
+    qsort(pages, n, sizeof(uintptr_t), pagecmp);
+    for (size_t i = 0; i < n;) { // 合并重复和相邻的页
+        size_t j = i + 1;
+        while (j < n && pages[j] <= pages[j - 1] + pagesize) {
+            ++j;
+        }
+        madvise((void*)pages[i], pages[j - 1] - pages[i] + pagesize, MADV_WILLNEED);
+        i = j;
+    }
+    free(pages);
+    return _status;
+}
+
+status_t sl_advise(skiplist_t* sl, int hint) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (hint < SL_ADVISE_NORMAL || hint > SL_ADVISE_HUGEPAGE) {
+        return statusnotok1(_status, "unknown hint(%d)", hint);
+    }
+    // 读锁保证数据映射在此期间不被替换
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    switch (hint) {
+    case SL_ADVISE_WILLNEED:
+        _status = willneedindex(sl);
+        break;
+    case SL_ADVISE_HUGEPAGE:
+        if (madvise(METAMAPPED(sl), sl->meta->mapcap, MADV_HUGEPAGE) == -1) {
+            _status = statusnotok2(_status, "madvise(%d): %s", errno, strerror(errno));
+        }
+        break;
+    default:
+        sl->advice = hint;
+        if (sl->seqscans == 0) {
+            sl_madvise(sl, hint);
+        }
+    }
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
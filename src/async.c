@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include "internal.h"
+#include <errno.h>
+#include <time.h>
+
+// 不阻塞于缺页的点查(sl_get_async)：下降时每访问一个元数据/数据页之前先确认驻留，
+// 全部驻留时在调用线程内同步完成；遇到不驻留的页则放弃，复制key交给I/O线程用sl_get的路径查找
+// (缺页发生在I/O线程上)，完成后在I/O线程上调用回调。
+// mincore是一次系统调用，确认驻留的页记在一个按页号直接映射的小表里，ASYNC_RECHECK_MS内不再检查；
+// 这期间被换出的页仍可能在调用线程上缺页，是用一次系统调用换每跳一次系统调用的折中。
+// 内存模式的映射总是驻留，不检查也不需要I/O线程
+
+#define ASYNC_MAXTHREADS 64
+#define ASYNC_PAGECACHE 16384 // 驻留页表的项数(2的幂)
+#define ASYNC_RECHECK_MS 1000 // 驻留页表的有效期
+
+typedef struct asyncjob_s {
+    struct asyncjob_s* next;
+    sl_get_cb cb;
+    void* arg;
+    size_t key_len;
+    char key[];
+} asyncjob_t;
+
+typedef struct asyncio_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    asyncjob_t* head;
+    asyncjob_t* tail;
+    int stop;
+    int nthreads;
+    pthread_t threads[ASYNC_MAXTHREADS];
+    uintptr_t pagemask;
+    uint64_t epoch;                  // 当前有效期编号(低于页大小的位)
+    uint64_t pages[ASYNC_PAGECACHE]; // 确认驻留的页：页地址 | 确认时的epoch
+} asyncio_t;
+
+static void* ioworker(void* arg) {
+    skiplist_t* sl = (skiplist_t*)arg;
+    asyncio_t* aio = sl->aio;
+    uint64_t _offsets[] = {};
+
+    while (1) {
+        SL_OPSCOPE(SL_STAT_GET);
+        pthread_mutex_lock(&aio->mutex);
+        while (aio->head == NULL && !aio->stop) {
+            pthread_cond_wait(&aio->cond, &aio->mutex);
+        }
+        asyncjob_t* job = aio->head;
+        if (job == NULL) { // stop且队列已空
+            pthread_mutex_unlock(&aio->mutex);
+            return NULL;
+        }
+        aio->head = job->next;
+        if (aio->head == NULL) {
+            aio->tail = NULL;
+        }
+        pthread_mutex_unlock(&aio->mutex);
+
+        uint64_t value = 0;
+        int found = 0;
+        status_t _status = sl_rdlock(sl, _offsets, 0);
+        if (_status.ok) {
+            found = sl_doget(sl, job->key, job->key_len, &value);
+            _status = sl_unlock(sl, _offsets, 0);
+        }
+        job->cb(_status, found, value, job->arg);
+        free(job);
+    }
+}
+
+status_t sl_async_open(skiplist_t* sl, int nthreads) {
+    status_t _status = { .ok = 1 };
+    int err;
+
+    if (nthreads > ASYNC_MAXTHREADS) {
+        nthreads = ASYNC_MAXTHREADS;
+    }
+    asyncio_t* aio = (asyncio_t*)calloc(1, sizeof(asyncio_t));
+    if (aio == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    pthread_mutex_init(&aio->mutex, NULL);
+    pthread_cond_init(&aio->cond, NULL);
+    aio->pagemask = ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+    sl->aio = aio;
+    for (; aio->nthreads < nthreads; ++aio->nthreads) {
+        if ((err = pthread_create(&aio->threads[aio->nthreads], NULL, ioworker, sl)) != 0) {
+            sl_async_close(sl);
+            return statusnotok2(_status, "pthread_create(%d): %s", err, strerror(err));
+        }
+    }
+    return _status;
+}
+
+// 已提交的查找全部完成(回调返回)后退出
+void sl_async_close(skiplist_t* sl) {
+    asyncio_t* aio = sl->aio;
+
+    if (aio == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&aio->mutex);
+    aio->stop = 1;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->mutex);
+    for (int i = 0; i < aio->nthreads; ++i) {
+        pthread_join(aio->threads[i], NULL);
+    }
+    pthread_cond_destroy(&aio->cond);
+    pthread_mutex_destroy(&aio->mutex);
+    free(aio);
+    sl->aio = NULL;
+}
+
+// [p, p + len)所在的页是否都驻留(访问不会缺页)
+int sl_resident(skiplist_t* sl, const void* p, size_t len) {
+    asyncio_t* aio = sl->aio;
+    unsigned char vec;
+
+    if (sl->inmemory) {
+        return 1;
+    }
+    uintptr_t pagesize = ~aio->pagemask + 1;
+    uintptr_t last = ((uintptr_t)p + len - 1) & aio->pagemask;
+    uint64_t epoch = __atomic_load_n(&aio->epoch, __ATOMIC_RELAXED);
+    for (uintptr_t page = (uintptr_t)p & aio->pagemask; page <= last; page += pagesize) {
+        uint64_t* slot = &aio->pages[(page / pagesize) & (ASYNC_PAGECACHE - 1)];
+        if (__atomic_load_n(slot, __ATOMIC_RELAXED) == (page | epoch)) {
+            continue;
+        }
+        if (mincore((void*)page, pagesize, &vec) != 0 || (vec & 1) == 0) {
+            return 0;
+        }
+        __atomic_store_n(slot, page | epoch, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+// 头部和key都驻留时返回datanode，否则返回NULL
+datanode_t* sl_trydatanode(skiplist_t* sl, uint64_t offset) {
+    datanode_t* dnode = NULL;
+
+    if (sl->pool != NULL) { // 不在缓冲池中的页需要读文件
+        return sl_pool_trydatanode(sl, offset);
+    }
+    dnode = sl_get_datanode(sl, offset);
+    if (!sl_resident(sl, dnode, sizeof(datanode_t)) || !sl_resident(sl, dnode->data, dnode->size)) {
+        return NULL;
+    }
+    return dnode;
+}
+
+// 同find，只访问驻留的页：遇到不驻留的页返回-1，否则返回是否找到
+static int tryfind(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    metanode_t* curr = METANODEHEAD(sl);
+    int level = (int)curr->level - 1;
+
+    if (sl->upper != NULL) {
+        curr = sl_upper_seek(sl, key, key_len, &level);
+    }
+    if (!sl_resident(sl, curr, sizeof(metanode_t) + sizeof(uint64_t) * (level + 1))) {
+        return -1;
+    }
+    for (; level >= 0; --level) {
+        while (1) {
+            metanode_t* next = METANODE(sl, curr->forwards[level]);
+            if (next == NULL) {
+                break;
+            }
+            if (!sl_resident(sl, next, sizeof(metanode_t) + sizeof(uint64_t) * (level + 1))) {
+                return -1;
+            }
+            datanode_t* dnode = sl_trydatanode(sl, next->offset);
+            if (dnode == NULL) {
+                return -1;
+            }
+            int cmp = sl->keyops->cmp(sl, dnode->data, dnode->size, key, key_len);
+            if (cmp < 0) {
+                curr = next;
+                continue;
+            }
+            if (cmp == 0) {
+                sl_cache_touch(sl, next);
+                *value = next->value;
+                return 1;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+static int tryget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    if (sl->bloom != NULL) {
+        int may = sl_bloom_trymaycontain(sl, key, key_len);
+        if (may <= 0) {
+            return may;
+        }
+    }
+    // 哈希索引的槽在另一个文件里，这里直接下降
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        return blk_tryget(sl, key, key_len, value);
+    }
+    return tryfind(sl, key, key_len, value);
+}
+
+status_t sl_get_async(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value, sl_get_cb cb, void* arg) {
+    SL_OPSCOPE(SL_STAT_GET);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    struct timespec ts;
+
+    if (sl == NULL || key == NULL || cb == NULL) {
+        return statusnotok0(_status, "skiplist, key or cb is NULL");
+    }
+    if (!sl->inmemory && sl->aio == NULL) {
+        return statusnotok0(_status, "sl_get_async requires iothreads");
+    }
+    _status = sl_checkkey(sl, key_len);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (sl->aio != NULL) {
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        uint64_t epoch = (uint64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / ASYNC_RECHECK_MS & ~sl->aio->pagemask;
+        __atomic_store_n(&sl->aio->epoch, epoch, __ATOMIC_RELAXED);
+    }
+    SL_STATADD(sl, ops[SL_STAT_GET], 1);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    int found = tryget(sl, key, key_len, value);
+    _status = sl_unlock(sl, _offsets, 0);
+    if (found > 0) {
+        SL_STATADD(sl, hits, 1);
+    } else if (found == 0) {
+        SL_STATADD(sl, misses, 1);
+    }
+    if (!_status.ok || found >= 0) {
+        return _status;
+    }
+    asyncjob_t* job = (asyncjob_t*)malloc(sizeof(asyncjob_t) + key_len);
+    if (job == NULL) {
+        return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    }
+    job->next = NULL;
+    job->cb = cb;
+    job->arg = arg;
+    job->key_len = key_len;
+    memcpy(job->key, key, key_len);
+    asyncio_t* aio = sl->aio;
+    pthread_mutex_lock(&aio->mutex);
+    if (aio->tail != NULL) {
+        aio->tail->next = job;
+    } else {
+        aio->head = job;
+    }
+    aio->tail = job;
+    pthread_cond_signal(&aio->cond);
+    pthread_mutex_unlock(&aio->mutex);
+    _status.type = STATUS_SKIPLIST_PENDING;
+    return _status;
+}
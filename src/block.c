@@ -0,0 +1,477 @@
+#include "internal.h"
+
+// SL_FORMAT_BLOCKED：level 0的每个节点是一个有序块，最多SL_BLOCK_ENTRIES个key，
+// 块按首key有序，只有块参与上层索引。块内先顺序比较连续存放的前缀，前缀相等时才访问datanode。
+// 满块插入时对半分裂(追加到最后一个块末尾时开新块)，删除后块过小则并入后继块。所有操作在调用方持有的锁内完成
+
+#define BLOCK_MERGE (SL_BLOCK_ENTRIES / 4) // 删除后key数不超过该值时尝试合并后继块
+
+static inline int cmpentry(skiplist_t* sl, blockentries_t* e, uint32_t i, const void* key, size_t key_len, uint64_t prefix) {
+    if (e->prefixes[i] != prefix) {
+        return e->prefixes[i] < prefix ? -1 : 1;
+    }
+    datanode_t* dnode = sl_get_datanode(sl, e->offsets[i]);
+    return sl->keyops->cmp(sl, dnode->data, dnode->size, key, key_len);
+}
+
+// 块内第一个 >= key的下标，*iseq表示是否相等
+static uint32_t search(skiplist_t* sl, metanode_t* b, const void* key, size_t key_len, uint64_t prefix, int* iseq) {
+    blockentries_t* e = BLOCKENTRIES(b);
+    uint32_t n = (uint32_t)b->value;
+    uint32_t i = 0;
+    uint64_t compares = 0;
+
+    *iseq = 0;
+    while (i < n && e->prefixes[i] < prefix) {
+        ++i;
+    }
+    compares += i + (i < n);
+    for (; i < n && e->prefixes[i] == prefix; ++i) {
+        int cmp = cmpentry(sl, e, i, key, key_len, prefix);
+        ++compares;
+        if (cmp >= 0) {
+            *iseq = (cmp == 0);
+            break;
+        }
+    }
+    SL_STATADD(sl, compares, compares);
+    return i;
+}
+
+// 从头节点下降，返回最后一个首key <= key(isstrict时 < key)的块，没有则返回头节点；update记录每层前驱
+static metanode_t* descend(skiplist_t* sl, const void* key, size_t key_len, uint64_t prefix, int isstrict, metanode_t* update[]) {
+    metanode_t* curr = METANODEHEAD(sl);
+    uint64_t hops = 0, compares = 0;
+
+    for (int level = (int)curr->level - 1; level >= 0; --level) {
+        while (1) {
+            metanode_t* next = METANODE(sl, curr->forwards[level]);
+            if (next == NULL) {
+                break;
+            }
+            int cmp = cmpentry(sl, BLOCKENTRIES(next), 0, key, key_len, prefix);
+            ++compares;
+            if (cmp > 0 || (cmp == 0 && isstrict)) {
+                break;
+            }
+            curr = next;
+            ++hops;
+        }
+        if (update != NULL) {
+            update[level] = curr;
+        }
+    }
+    SL_STATLOOKUP(sl, hops, compares);
+    return curr;
+}
+
+static metanode_t* newblock(skiplist_t* sl) {
+    uint32_t level = sl_random_level(sl->meta->p);
+    metanode_t* b = sl_allocnode(sl, level, BLOCKNODESIZE(level));
+
+    if (b == NULL) {
+        return NULL;
+    }
+    b->level = level;
+    b->flag = METANODE_USED | METANODE_BLOCK;
+    b->offset = 0;
+    b->value = 0;
+    b->backward = 0;
+    for (uint32_t i = 0; i < level; ++i) {
+        b->forwards[i] = 0;
+    }
+    return b;
+}
+
+// update[i]为b在第i层的前驱(低于头节点高度的部分)
+static void linkblock(skiplist_t* sl, metanode_t* update[], metanode_t* b) {
+    metanode_t* head = METANODEHEAD(sl);
+
+    for (uint32_t i = head->level; i < b->level; ++i) {
+        update[i] = head;
+    }
+    if (head->level < b->level) {
+        head->level = b->level;
+    }
+    for (uint32_t i = 0; i < b->level; ++i) {
+        b->forwards[i] = update[i]->forwards[i];
+        update[i]->forwards[i] = METANODEPOSITION(sl, b);
+    }
+    b->backward = METANODEPOSITION(sl, update[0]);
+    metanode_t* next = METANODE(sl, b->forwards[0]);
+    if (next != NULL) {
+        next->backward = METANODEPOSITION(sl, b);
+    }
+}
+
+// update[i]为b在第i层的前驱(按b的首key严格小于下降得到)
+static void unlinkblock(skiplist_t* sl, metanode_t* update[], metanode_t* b) {
+    metanode_t* head = METANODEHEAD(sl);
+
+    for (uint32_t i = 0; i < b->level; ++i) {
+        update[i]->forwards[i] = b->forwards[i];
+    }
+    metanode_t* next = METANODE(sl, b->forwards[0]);
+    if (next != NULL) {
+        next->backward = b->backward;
+    }
+    while (head->level > 0 && head->forwards[head->level - 1] == 0) {
+        --head->level;
+    }
+    sl_freemetanode(sl, b);
+}
+
+static void insertentry(metanode_t* b, uint32_t i, uint64_t prefix, uint64_t value, uint64_t offset) {
+    blockentries_t* e = BLOCKENTRIES(b);
+    uint32_t n = (uint32_t)b->value;
+
+    memmove(e->prefixes + i + 1, e->prefixes + i, sizeof(uint64_t) * (n - i));
+    memmove(e->values + i + 1, e->values + i, sizeof(uint64_t) * (n - i));
+    memmove(e->offsets + i + 1, e->offsets + i, sizeof(uint64_t) * (n - i));
+    e->prefixes[i] = prefix;
+    e->values[i] = value;
+    e->offsets[i] = offset;
+    ++b->value;
+}
+
+static void removeentry(metanode_t* b, uint32_t i) {
+    blockentries_t* e = BLOCKENTRIES(b);
+    uint32_t n = (uint32_t)b->value;
+
+    memmove(e->prefixes + i, e->prefixes + i + 1, sizeof(uint64_t) * (n - i - 1));
+    memmove(e->values + i, e->values + i + 1, sizeof(uint64_t) * (n - i - 1));
+    memmove(e->offsets + i, e->offsets + i + 1, sizeof(uint64_t) * (n - i - 1));
+    --b->value;
+}
+
+// 把src[from, from + n)追加到dst末尾
+static void moveentries(metanode_t* dst, metanode_t* src, uint32_t from, uint32_t n) {
+    blockentries_t* d = BLOCKENTRIES(dst);
+    blockentries_t* s = BLOCKENTRIES(src);
+    uint32_t to = (uint32_t)dst->value;
+
+    memcpy(d->prefixes + to, s->prefixes + from, sizeof(uint64_t) * n);
+    memcpy(d->values + to, s->values + from, sizeof(uint64_t) * n);
+    memcpy(d->offsets + to, s->offsets + from, sizeof(uint64_t) * n);
+    dst->value += n;
+}
+
+// 一次下降完成读-改-写，*written表示是否写入了*value
+status_t blk_merge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg, uint64_t* value, int* written) {
+    status_t _status = { .ok = 1 };
+    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
+    metanode_t* head = METANODEHEAD(sl);
+    uint64_t prefix = sl_keyprefix(key, key_len);
+    uint32_t i = 0;
+    int iseq = 0;
+
+    *written = 0;
+    metanode_t* b = descend(sl, key, key_len, prefix, 0, update);
+    if (b == head) { // 比所有块的首key都小，放入第一个块
+        b = METANODE(sl, head->forwards[0]);
+    }
+    if (b != NULL) {
+        i = search(sl, b, key, key_len, prefix, &iseq);
+        if (iseq) {
+            uint64_t* v = &BLOCKENTRIES(b)->values[i];
+            if (fn(key, key_len, 1, *v, value, arg)) {
+                *v = *value;
+                *written = 1;
+            }
+            return _status;
+        }
+    }
+    if (!fn(key, key_len, 0, 0, value, arg)) {
+        return _status;
+    }
+    _status = sl_reservedata(sl);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (b == NULL) {
+        if ((b = newblock(sl)) == NULL) {
+            _status.type = STATUS_SKIPLIST_FULL;
+            return statusnotok0(_status, "skiplist is full");
+        }
+        linkblock(sl, update, b);
+    } else if (b->value == SL_BLOCK_ENTRIES) {
+        metanode_t* c = newblock(sl);
+        if (c == NULL) {
+            _status.type = STATUS_SKIPLIST_FULL;
+            return statusnotok0(_status, "skiplist is full");
+        }
+        // 追加到最后一个块末尾(顺序写入)时新key单独开一个块，已满的块不再分裂，否则对半分裂
+        uint32_t half = i == SL_BLOCK_ENTRIES && b->forwards[0] == 0 ? SL_BLOCK_ENTRIES : SL_BLOCK_ENTRIES / 2;
+        moveentries(c, b, half, SL_BLOCK_ENTRIES - half);
+        b->value = half;
+        // c紧跟在b之后：b所在的层前驱是b，更高的层沿用下降路径
+        for (uint32_t l = 0; l < c->level && l < b->level; ++l) {
+            update[l] = b;
+        }
+        linkblock(sl, update, c);
+        if (i >= half) {
+            b = c;
+            i -= half;
+        }
+    }
+    insertentry(b, i, prefix, *value, sl_writedatanode(sl, key, key_len, 0));
+    ++sl->meta->count;
+    *written = 1;
+    return _status;
+}
+
+int blk_get(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    uint64_t prefix = sl_keyprefix(key, key_len);
+    int iseq = 0;
+
+    metanode_t* b = descend(sl, key, key_len, prefix, 0, NULL);
+    if ((b->flag & METANODE_HEAD) == METANODE_HEAD) {
+        return 0;
+    }
+    uint32_t i = search(sl, b, key, key_len, prefix, &iseq);
+    if (iseq) {
+        *value = BLOCKENTRIES(b)->values[i];
+    }
+    return iseq;
+}
+
+// 同cmpentry，datanode不驻留时返回-1
+static inline int trycmpentry(skiplist_t* sl, blockentries_t* e, uint32_t i, const void* key, size_t key_len, uint64_t prefix, int* cmp) {
+    if (e->prefixes[i] != prefix) {
+        *cmp = e->prefixes[i] < prefix ? -1 : 1;
+        return 0;
+    }
+    datanode_t* dnode = sl_trydatanode(sl, e->offsets[i]);
+    if (dnode == NULL) {
+        return -1;
+    }
+    *cmp = sl->keyops->cmp(sl, dnode->data, dnode->size, key, key_len);
+    return 0;
+}
+
+// 同blk_get，只访问驻留的页：遇到不驻留的页返回-1，否则返回是否找到
+int blk_tryget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    uint64_t prefix = sl_keyprefix(key, key_len);
+    metanode_t* curr = METANODEHEAD(sl);
+    int cmp = 1;
+
+    if (!sl_resident(sl, curr, sizeof(metanode_t) + sizeof(uint64_t) * curr->level)) {
+        return -1;
+    }
+    for (int level = (int)curr->level - 1; level >= 0; --level) {
+        while (1) {
+            metanode_t* next = METANODE(sl, curr->forwards[level]);
+            if (next == NULL) {
+                break;
+            }
+            if (!sl_resident(sl, next, sizeof(metanode_t)) || !sl_resident(sl, next, BLOCKNODESIZE(next->level)) ||
+                trycmpentry(sl, BLOCKENTRIES(next), 0, key, key_len, prefix, &cmp) < 0) {
+                return -1;
+            }
+            if (cmp > 0) {
+                break;
+            }
+            curr = next;
+        }
+    }
+    if ((curr->flag & METANODE_HEAD) == METANODE_HEAD) {
+        return 0;
+    }
+    blockentries_t* e = BLOCKENTRIES(curr);
+    uint32_t i = 0;
+    cmp = 1;
+    while (i < curr->value && e->prefixes[i] < prefix) {
+        ++i;
+    }
+    for (; i < curr->value && e->prefixes[i] == prefix; ++i) {
+        if (trycmpentry(sl, e, i, key, key_len, prefix, &cmp) < 0) {
+            return -1;
+        }
+        if (cmp >= 0) {
+            break;
+        }
+    }
+    if (cmp != 0) {
+        return 0;
+    }
+    *value = e->values[i];
+    return 1;
+}
+
+// 第一个 >= key的块及块内下标，key为NULL时为第一个key；没有返回NULL。
+// update不为NULL时记录每层最后一个首key <= key的块(或头节点)
+metanode_t* blk_seek(skiplist_t* sl, const void* key, size_t key_len, uint32_t* index, metanode_t* update[]) {
+    metanode_t* head = METANODEHEAD(sl);
+    metanode_t* b = METANODE(sl, head->forwards[0]);
+    int iseq = 0;
+
+    *index = 0;
+    if (key == NULL && update != NULL) {
+        for (int level = 0; level < SKIPLIST_MAXLEVEL; ++level) {
+            update[level] = head;
+        }
+    }
+    if (key != NULL) {
+        uint64_t prefix = sl_keyprefix(key, key_len);
+        metanode_t* curr = descend(sl, key, key_len, prefix, 0, update);
+        if (curr != head) {
+            b = curr;
+            *index = search(sl, b, key, key_len, prefix, &iseq);
+        }
+    }
+    if (b != NULL && *index == b->value) {
+        b = METANODE(sl, b->forwards[0]);
+        *index = 0;
+    }
+    return b;
+}
+
+status_t blk_del(skiplist_t* sl, const void* key, size_t key_len, int* found) {
+    status_t _status = { .ok = 1 };
+    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
+    uint64_t prefix = sl_keyprefix(key, key_len);
+    int iseq = 0;
+
+    *found = 0;
+    metanode_t* b = descend(sl, key, key_len, prefix, 0, NULL);
+    if ((b->flag & METANODE_HEAD) == METANODE_HEAD) {
+        return _status;
+    }
+    uint32_t i = search(sl, b, key, key_len, prefix, &iseq);
+    if (!iseq) {
+        return _status;
+    }
+    *found = 1;
+    uint64_t offset = BLOCKENTRIES(b)->offsets[i];
+    if (b->value == 1) { // 块将变空：被删的key就是首key，按它严格小于下降得到各层前驱后摘除
+        descend(sl, key, key_len, prefix, 1, update);
+        unlinkblock(sl, update, b);
+    } else {
+        removeentry(b, i);
+        metanode_t* next = METANODE(sl, b->forwards[0]);
+        if (b->value <= BLOCK_MERGE && next != NULL && b->value + next->value <= SL_BLOCK_ENTRIES * 3 / 4) {
+            blockentries_t* e = BLOCKENTRIES(next);
+            datanode_t* first = sl_get_datanode(sl, e->offsets[0]);
+            descend(sl, first->data, first->size, e->prefixes[0], 1, update);
+            moveentries(b, next, 0, (uint32_t)next->value);
+            unlinkblock(sl, update, next);
+        }
+    }
+    sl_freedatanode(sl, offset);
+    --sl->meta->count;
+    return _status;
+}
+
+// 删除块内[i, j)的key，datanode立即回收
+static void removeentries(skiplist_t* sl, metanode_t* b, uint32_t i, uint32_t j) {
+    blockentries_t* e = BLOCKENTRIES(b);
+    uint32_t n = (uint32_t)b->value;
+
+    for (uint32_t k = i; k < j; ++k) {
+        sl_freedatanode(sl, e->offsets[k]);
+    }
+    memmove(e->prefixes + i, e->prefixes + j, sizeof(uint64_t) * (n - j));
+    memmove(e->values + i, e->values + j, sizeof(uint64_t) * (n - j));
+    memmove(e->offsets + i, e->offsets + j, sizeof(uint64_t) * (n - j));
+    b->value -= j - i;
+}
+
+// 删除[lo, hi)，返回删除的key数。blo为最后一个首key < lo的块(保留，删尾部)，
+// bhi为最后一个首key < hi的块(还有 >= hi的key时保留，删头部)，两者之间的整块逐层摘除后挂到待回收链表
+uint64_t blk_delrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len) {
+    metanode_t* ulo[SKIPLIST_MAXLEVEL] = { NULL };
+    metanode_t* uhi[SKIPLIST_MAXLEVEL] = { NULL };
+    metanode_t* head = METANODEHEAD(sl);
+    uint64_t removed = 0;
+    int iseq = 0;
+
+    if (lo != NULL) {
+        descend(sl, lo, lo_len, sl_keyprefix(lo, lo_len), 1, ulo);
+    } else {
+        for (uint32_t i = 0; i < head->level; ++i) {
+            ulo[i] = head;
+        }
+    }
+    if (hi != NULL) {
+        descend(sl, hi, hi_len, sl_keyprefix(hi, hi_len), 1, uhi);
+    } else {
+        metanode_t* curr = head;
+        for (int level = (int)head->level - 1; level >= 0; --level) {
+            while (curr->forwards[level] != 0) {
+                curr = METANODE(sl, curr->forwards[level]);
+            }
+            uhi[level] = curr;
+        }
+    }
+    metanode_t* blo = ulo[0];
+    metanode_t* bhi = uhi[0];
+    if (head->level == 0 || bhi == head) {
+        return 0;
+    }
+    uint32_t i = blo == head ? 0 : (lo != NULL ? search(sl, blo, lo, lo_len, sl_keyprefix(lo, lo_len), &iseq) : 0);
+    if (blo == bhi) { // 同一个块
+        uint32_t j = hi != NULL ? search(sl, blo, hi, hi_len, sl_keyprefix(hi, hi_len), &iseq) : (uint32_t)blo->value;
+        removeentries(sl, blo, i, j);
+        sl->meta->count -= j - i;
+        return j - i;
+    }
+    uint32_t j = hi != NULL ? search(sl, bhi, hi, hi_len, sl_keyprefix(hi, hi_len), &iseq) : (uint32_t)bhi->value;
+    int keephi = j < bhi->value;
+    metanode_t* first = METANODE(sl, blo->forwards[0]);
+    metanode_t* last = keephi ? METANODE(sl, bhi->backward) : bhi;
+    metanode_t* next = keephi ? bhi : METANODE(sl, bhi->forwards[0]);
+    if (last != blo) { // 有整块被删除
+        for (metanode_t* curr = first;; curr = METANODE(sl, curr->forwards[0])) {
+            removed += curr->value;
+            if (curr == last) {
+                break;
+            }
+        }
+        for (uint32_t l = 0; l < head->level; ++l) {
+            if (ulo[l] != uhi[l]) {
+                metanode_t* succ = keephi && uhi[l] == bhi ? bhi : METANODE(sl, uhi[l]->forwards[l]);
+                ulo[l]->forwards[l] = succ != NULL ? METANODEPOSITION(sl, succ) : 0;
+            }
+        }
+        if (next != NULL) {
+            next->backward = METANODEPOSITION(sl, blo);
+        }
+        last->forwards[0] = RECLAIMHEAD(sl);
+        RECLAIMHEAD(sl) = METANODEPOSITION(sl, first);
+        while (head->level > 0 && head->forwards[head->level - 1] == 0) {
+            --head->level;
+        }
+    }
+    if (blo != head) {
+        removed += blo->value - i;
+        removeentries(sl, blo, i, (uint32_t)blo->value);
+    }
+    if (keephi) {
+        removed += j;
+        removeentries(sl, bhi, 0, j);
+    }
+    sl->meta->count -= removed;
+    return removed;
+}
+
+// 从块b的第i个key扫描到块stop之前(stop为NULL时到末尾)，遇到 >= hi的key停止(hi为NULL时不限)
+void blk_scanpart(skiplist_t* sl, metanode_t* b, uint32_t i, metanode_t* stop, const void* hi, size_t hi_len, int part, sl_scan_cb cb, void* arg) {
+    uint64_t hiprefix = hi != NULL ? sl_keyprefix(hi, hi_len) : 0;
+
+    for (; b != NULL && b != stop; b = METANODE(sl, b->forwards[0]), i = 0) {
+        blockentries_t* e = BLOCKENTRIES(b);
+        if (sl->pool != NULL) { // 每个块先预读块内的key
+            sl_pool_release(sl);
+            sl_pool_readahead(sl, e->offsets + i, b->value - i);
+        }
+        for (; i < b->value; ++i) {
+            if (hi != NULL && cmpentry(sl, e, i, hi, hi_len, hiprefix) >= 0) {
+                return;
+            }
+            datanode_t* dnode = sl_get_datanode(sl, e->offsets[i]);
+            if (cb(part, dnode->data, dnode->size, e->values[i], arg) != 0) {
+                return;
+            }
+        }
+    }
+}
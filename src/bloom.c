@@ -0,0 +1,227 @@
+#include "internal.h"
+#include <errno.h>
+
+// 分块布隆过滤器(<prefix>.sl.bloom)：每个key只落在一个64字节块(一条cache line)里，
+// 块内置k位。sl_get先查过滤器，不存在的key一次cache line访问即可返回。
+// 删除不清位，只计数；失效位或加入的key过多时按当前key数重建。
+// 文件头的seq在sync/关闭时写为meta->seq，加载时不一致(崩溃、或未开启过滤器时写过)则重建
+
+#define BLOOM_MAGIC 0x4d4f4c42     // "BLOM"
+#define BLOOM_BLOCKBITS 512        // 每块位数
+#define BLOOM_MINKEYS 65536        // 最小容量(key数)
+
+typedef struct bloomhead_s {
+    uint32_t magic;
+    uint32_t bitsperkey;
+    uint32_t k;          // 每个key置位数
+    uint32_t reserved;
+    uint64_t nblocks;
+    uint64_t nkeys;      // 上次重建后加入的新key数(不含覆盖写)
+    uint64_t ndeleted;   // 上次重建后的删除数，对应的位仍置位
+    uint64_t seq;        // 与meta->seq相等时过滤器与跳表一致
+    uint64_t padding[2]; // 块按64字节对齐
+} bloomhead_t;
+
+typedef struct bloom_s {
+    sidecar_t sc;
+    bloomhead_t* head;
+    uint64_t* blocks;
+} bloom_t;
+
+static inline uint64_t capacity(bloomhead_t* head) {
+    return head->nblocks * BLOOM_BLOCKBITS / head->bitsperkey;
+}
+
+// h的高32位选块，另一个混合值做32位双重hash产生块内位置(取高9位)
+static inline uint64_t* blockof(bloom_t* b, uint64_t h, uint32_t* x, uint32_t* d) {
+    uint64_t h2 = h * 0x9e3779b97f4a7c15ULL;
+    *x = (uint32_t)h;
+    *d = (uint32_t)(h2 >> 32) | 1;
+    return b->blocks + (((h >> 32) * b->head->nblocks) >> 32) * (BLOOM_BLOCKBITS / 64);
+}
+
+static inline void add(bloom_t* b, const void* key, size_t key_len) {
+    uint32_t x, d;
+    uint64_t* block = blockof(b, sl_hashkey(key, key_len), &x, &d);
+
+    for (uint32_t i = 0; i < b->head->k; ++i, x += d) {
+        uint32_t bit = x >> 23;
+        block[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+static void addall(skiplist_t* sl) {
+    metanode_t* head = METANODEHEAD(sl);
+
+    for (metanode_t* curr = METANODE(sl, head->forwards[0]); curr != NULL; curr = METANODE(sl, curr->forwards[0])) {
+        sl_pool_yield(sl);
+        if (sl->meta->format == SL_FORMAT_BLOCKED) {
+            blockentries_t* e = BLOCKENTRIES(curr);
+            for (uint32_t i = 0; i < curr->value; ++i) {
+                datanode_t* dnode = sl_get_datanode(sl, e->offsets[i]);
+                add(sl->bloom, dnode->data, dnode->size);
+            }
+        } else {
+            datanode_t* dnode = sl_get_datanode(sl, curr->offset);
+            add(sl->bloom, dnode->data, dnode->size);
+        }
+    }
+}
+
+// 按2倍当前key数调整大小并重新加入全部key
+static status_t rebuild(skiplist_t* sl, uint32_t bitsperkey) {
+    status_t _status = { .ok = 1 };
+    bloom_t* b = sl->bloom;
+    uint64_t keys = (uint64_t)sl->meta->count * 2;
+
+    if (keys < BLOOM_MINKEYS) {
+        keys = BLOOM_MINKEYS;
+    }
+    uint64_t nblocks = (keys * bitsperkey + BLOOM_BLOCKBITS - 1) / BLOOM_BLOCKBITS;
+    uint64_t size = sizeof(bloomhead_t) + nblocks * (BLOOM_BLOCKBITS / 8);
+    if (b->sc.size != size) {
+        _status = sl_sidecar_resize(&b->sc, size);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    b->head = (bloomhead_t*)b->sc.mapped;
+    b->blocks = (uint64_t*)(b->sc.mapped + sizeof(bloomhead_t));
+    memset(b->blocks, 0, nblocks * (BLOOM_BLOCKBITS / 8));
+    b->head->magic = BLOOM_MAGIC;
+    b->head->bitsperkey = bitsperkey;
+    b->head->k = (bitsperkey * 69 + 50) / 100; // bitsperkey * ln2
+    if (b->head->k < 1) {
+        b->head->k = 1;
+    }
+    if (b->head->k > 16) {
+        b->head->k = 16;
+    }
+    b->head->nblocks = nblocks;
+    b->head->ndeleted = 0;
+    b->head->seq = 0;
+    addall(sl);
+    b->head->nkeys = sl->meta->count;
+    return _status;
+}
+
+// 重建失败时丢弃过滤器，回退到直接查找
+static void rebuildordrop(skiplist_t* sl) {
+    status_t _status = rebuild(sl, sl->bloom->head->bitsperkey);
+    if (!_status.ok) {
+        sl_bloom_close(sl);
+    }
+}
+
+status_t sl_bloom_open(skiplist_t* sl, uint32_t bitsperkey) {
+    status_t _status = { .ok = 1 };
+
+    sl->bloom = (bloom_t*)calloc(1, sizeof(bloom_t));
+    if (sl->bloom == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    _status = sl_sidecar_open(sl, "bloom", sizeof(bloomhead_t), &sl->bloom->sc);
+    if (!_status.ok) {
+        sl_bloom_close(sl);
+        return _status;
+    }
+    bloomhead_t* head = (bloomhead_t*)sl->bloom->sc.mapped;
+    if (_status.type == STATUS_SKIPLIST_LOAD && sl->bloom->sc.size >= sizeof(bloomhead_t) &&
+        head->magic == BLOOM_MAGIC && head->bitsperkey == bitsperkey && head->seq == sl->meta->seq &&
+        sl->bloom->sc.size == sizeof(bloomhead_t) + head->nblocks * (BLOOM_BLOCKBITS / 8)) {
+        sl->bloom->head = head;
+        sl->bloom->blocks = (uint64_t*)(sl->bloom->sc.mapped + sizeof(bloomhead_t));
+        return (status_t){ .ok = 1 };
+    }
+    _status = rebuild(sl, bitsperkey);
+    if (!_status.ok) {
+        sl_bloom_close(sl);
+    }
+    return _status;
+}
+
+void sl_bloom_close(skiplist_t* sl) {
+    if (sl->bloom == NULL) {
+        return;
+    }
+    sl_sidecar_close(&sl->bloom->sc);
+    free(sl->bloom);
+    sl->bloom = NULL;
+}
+
+status_t sl_bloom_sync(skiplist_t* sl) {
+    sl->bloom->head->seq = sl->meta->seq;
+    return sl_sidecar_sync(&sl->bloom->sc);
+}
+
+int sl_bloom_maycontain(skiplist_t* sl, const void* key, size_t key_len) {
+    bloom_t* b = sl->bloom;
+    uint32_t x, d;
+    uint64_t* block = blockof(b, sl_hashkey(key, key_len), &x, &d);
+
+    for (uint32_t i = 0; i < b->head->k; ++i, x += d) {
+        uint32_t bit = x >> 23;
+        if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 同sl_bloom_maycontain，key所在块不驻留时返回-1
+int sl_bloom_trymaycontain(skiplist_t* sl, const void* key, size_t key_len) {
+    uint32_t x, d;
+    uint64_t* block = blockof(sl->bloom, sl_hashkey(key, key_len), &x, &d);
+
+    if (!sl_resident(sl, block, BLOOM_BLOCKBITS / 8)) {
+        return -1;
+    }
+    return sl_bloom_maycontain(sl, key, key_len);
+}
+
+// 新key已写入跳表；覆盖已有key不调用，nkeys只计不同的key
+void sl_bloom_put(skiplist_t* sl, const void* key, size_t key_len) {
+    bloom_t* b = sl->bloom;
+
+    if (b->head->nkeys >= capacity(b->head)) {
+        rebuildordrop(sl);
+        return;
+    }
+    add(b, key, key_len);
+    ++b->head->nkeys;
+}
+
+// n个key已从跳表删除
+void sl_bloom_del(skiplist_t* sl, uint64_t n) {
+    bloom_t* b = sl->bloom;
+
+    b->head->ndeleted += n;
+    if (b->head->ndeleted >= BLOOM_MINKEYS / 4 && b->head->ndeleted * 2 > b->head->nkeys) {
+        rebuildordrop(sl);
+    }
+}
+
+status_t sl_bloom_rebuild(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (sl->bloom == NULL) {
+        sl_unlock(sl, _offsets, 0);
+        return statusnotok0(_status, "bloom filter is not enabled");
+    }
+    _status = rebuild(sl, sl->bloom->head->bitsperkey);
+    if (!_status.ok) {
+        sl_bloom_close(sl);
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
@@ -0,0 +1,126 @@
+#include "internal.h"
+#include <stdlib.h>
+
+// 缓存模式(sl_options_t.cache)：元数据满时不返回STATUS_SKIPLIST_FULL，而是淘汰一个最近未访问的key。
+// 点查命中和覆盖写时给节点置METANODE_REF(新插入的不置，只写一次的key先被淘汰)；元数据区按分配顺序紧密排列(节点大小由level决定，
+// 回收的节点保持原level)，CLOCK指针沿元数据区逐个节点前进：有引用位的清除后跳过，
+// 没有的按删除摘除(维护各索引并记录到变更日志)。新节点沿用被淘汰节点的level复用其空间，
+// 被淘汰节点的level与随机level同分布，不改变跳表的形状。
+// 被淘汰的datanode在没有read guard时才复用(guard内的视图可能还指向它)，见sl_writedatanode。
+// 数据区也不扩容：放不下新key时继续淘汰，直到空闲链表头部有放得下的datanode；复用时多出的字节记在datanode->slack，
+// 回收时一并回收，不会泄漏。read guard期间，或淘汰CACHE_EVICTMAX个仍放不下(新key比淘汰的都大)时才扩容
+
+// 头节点按最大level分配，之后是第一个普通节点
+#define FIRSTNODE (sizeof(skipmeta_t) + 1 + sizeof(metanode_t) + sizeof(uint64_t) * SKIPLIST_MAXLEVEL)
+
+// 空闲链表前CACHE_FITSCAN个里放得下key、多出不超过maxslack字节的datanode中多出最少的(大节点留给大key)，
+// *prev为链表上的前一个(0为链表头)
+static uint64_t findfit(skiplist_t* sl, size_t key_len, size_t maxslack, uint64_t* prev) {
+    uint64_t offset = sl->data->datafree;
+    uint64_t before = 0, best = 0;
+    size_t bestslack = maxslack;
+
+    *prev = 0;
+    for (int n = 0; offset != 0 && n < CACHE_FITSCAN; ++n) {
+        datanode_t* dnode = sl_get_datanode(sl, offset);
+        size_t cap = (size_t)dnode->size + dnode->slack;
+        if (cap >= key_len && cap - key_len <= bestslack) {
+            *prev = before;
+            best = offset;
+            bestslack = cap - key_len;
+            if (bestslack == 0) {
+                break;
+            }
+        }
+        before = offset;
+        offset = dnode->offset;
+    }
+    return best;
+}
+
+// 追加的datanode位于mapsize + 1
+static int appendfits(skiplist_t* sl, size_t key_len) {
+    return sl->data->mapcap - sl->data->mapsize > sizeof(datanode_t) + key_len;
+}
+
+// 数据区末尾放得下时只取大小接近的(大节点不被小key长期占用)，否则取任何放得下的
+uint64_t sl_cache_takedata(skiplist_t* sl, size_t key_len, uint16_t* slack) {
+    uint64_t prev = 0;
+    uint64_t offset = findfit(sl, key_len, appendfits(sl, key_len) ? CACHE_FITSLACK : MAX_KEY_LEN, &prev);
+
+    if (offset == 0) {
+        return 0;
+    }
+    datanode_t* dnode = sl_get_datanode(sl, offset);
+    uint64_t next = dnode->offset;
+    *slack = (uint16_t)(dnode->size + dnode->slack - key_len);
+    --sl->meta->datafreen;
+    sl->meta->datafreebytes -= DATANODECAP(dnode);
+    if (prev == 0) {
+        sl->data->datafree = next;
+    } else {
+        sl_setdatanodenext(sl, prev, next);
+    }
+    return offset;
+}
+
+status_t sl_cache_reservedata(skiplist_t* sl, size_t key_len, int* evicted) {
+    status_t _status = { .ok = 1 };
+    uint64_t prev = 0;
+
+    *evicted = 0;
+    if (appendfits(sl, key_len)) {
+        return _status;
+    }
+    if (__atomic_load_n(&sl->guards, __ATOMIC_ACQUIRE) == 0) { // 被淘汰的datanode在链表头部
+        for (int n = 0; findfit(sl, key_len, MAX_KEY_LEN, &prev) == 0; ++n) {
+            if (n == CACHE_EVICTMAX || sl_cache_evict(sl) == 0) { // 淘汰的都比key小时不清空缓存，扩容
+                return sl_reservedata(sl);
+            }
+            *evicted = 1;
+        }
+        return _status;
+    }
+    return sl_reservedata(sl);
+}
+
+uint32_t sl_cache_evict(skiplist_t* sl) {
+    if (RECLAIMHEAD(sl) != 0) { // 待回收链表上的节点已摘除但仍标记为使用，先回收
+        sl_reclaim(sl, UINT64_MAX);
+    }
+    if (sl->meta->count == 0) {
+        return 0;
+    }
+    uint64_t end = sl->meta->mapsize + 1;
+    // 两圈内必然遇到引用位已被清除的节点
+    for (uint64_t steps = 0; steps < 2 * (end - FIRSTNODE); ++steps) {
+        if (sl->clockhand < FIRSTNODE || sl->clockhand >= end) {
+            sl->clockhand = FIRSTNODE;
+        }
+        metanode_t* mnode = METANODE(sl, sl->clockhand);
+        sl->clockhand += METANODESIZE(mnode);
+        if ((mnode->flag & METANODE_USED) == 0) {
+            continue;
+        }
+        if (mnode->flag & METANODE_REF) {
+            mnode->flag &= ~METANODE_REF;
+            continue;
+        }
+        uint32_t level = mnode->level;
+        datanode_t* dnode = sl_get_datanode(sl, mnode->offset);
+        size_t key_len = dnode->size;
+        char* key = (char*)malloc(key_len + 1); // 删除会回收datanode(缓冲池模式下dnode可能是副本)，先复制key
+        if (key == NULL) {
+            return 0;
+        }
+        memcpy(key, dnode->data, key_len);
+        status_t deleted = sl_dodel(sl, key, key_len);
+        free(key);
+        if (!deleted.ok) { // 只有变更日志写入失败
+            return 0;
+        }
+        SL_STATADD(sl, evictions, 1);
+        return level;
+    }
+    return 0;
+}
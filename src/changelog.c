@@ -0,0 +1,302 @@
+#include "changelog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static status_t writeall(int fd, const void* buff, size_t size, uint64_t offset, int ispwrite) {
+    status_t _status = { .ok = 1 };
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = ispwrite ? pwrite(fd, buff + done, size - done, offset + done) : write(fd, buff + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+        }
+        done += n;
+    }
+    return _status;
+}
+
+// 读取[pos, pos + len)到读缓冲，数据不足(日志尾部尚未写完)时*p = NULL
+static status_t readat(clreader_t* r, uint64_t pos, size_t len, char** p) {
+    status_t _status = { .ok = 1 };
+
+    *p = NULL;
+    if (pos >= r->bpos && pos + len <= r->bpos + r->blen) {
+        *p = r->buff + (pos - r->bpos);
+        return _status;
+    }
+    size_t want = len < CHANGELOG_BUFF_SIZE ? CHANGELOG_BUFF_SIZE : len;
+    if (r->buffcap < want) {
+        char* buff = (char*)realloc(r->buff, want);
+        if (buff == NULL) {
+            return statusnotok2(_status, "realloc(%d): %s", errno, strerror(errno));
+        }
+        r->buff = buff;
+        r->buffcap = want;
+    }
+    r->bpos = pos;
+    r->blen = 0;
+    while (r->blen < want) {
+        ssize_t n = pread(r->fd, r->buff + r->blen, want - r->blen, pos + r->blen);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "pread(%d): %s", errno, strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        r->blen += n;
+    }
+    if (r->blen >= len) {
+        *p = r->buff;
+    }
+    return _status;
+}
+
+status_t cl_reader_open(const char* name, uint64_t seq, clreader_t** r) {
+    status_t _status = { .ok = 1 };
+
+    *r = (clreader_t*)calloc(1, sizeof(clreader_t));
+    if (*r == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    if (((*r)->fd = open(name, O_RDONLY)) < 0) {
+        free(*r);
+        *r = NULL;
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    (*r)->seq = seq;
+    return _status;
+}
+
+status_t cl_reader_next(clreader_t* r, logrecord_t** rec) {
+    status_t _status = { .ok = 1 };
+    char* p = NULL;
+
+    *rec = NULL;
+    while (1) {
+        _status = readat(r, r->pos, sizeof(logrecord_t), &p);
+        if (!_status.ok || p == NULL) {
+            return _status;
+        }
+        size_t size = LOGRECORDSIZE((logrecord_t*)p);
+        _status = readat(r, r->pos, size, &p);
+        if (!_status.ok || p == NULL) {
+            return _status;
+        }
+        r->pos += size;
+        if (((logrecord_t*)p)->seq >= r->seq) {
+            *rec = (logrecord_t*)p;
+            r->seq = (*rec)->seq + 1;
+            return _status;
+        }
+    }
+}
+
+status_t cl_ship(clreader_t* r, int fd, uint64_t* shipped) {
+    status_t _status = { .ok = 1 };
+    logrecord_t* rec = NULL;
+
+    if (shipped != NULL) {
+        *shipped = 0;
+    }
+    while (1) {
+        _status = cl_reader_next(r, &rec);
+        if (!_status.ok || rec == NULL) {
+            return _status;
+        }
+        _status = writeall(fd, rec, LOGRECORDSIZE(rec), 0, 0);
+        if (!_status.ok) {
+            return _status;
+        }
+        if (shipped != NULL) {
+            ++*shipped;
+        }
+    }
+}
+
+void cl_reader_close(clreader_t* r) {
+    if (r == NULL) {
+        return;
+    }
+    close(r->fd);
+    free(r->buff);
+    free(r);
+}
+
+status_t cl_open(const char* name, changelog_t** log) {
+    status_t _status = { .ok = 1 };
+    clreader_t* r = NULL;
+    logrecord_t* rec = NULL;
+    int err;
+
+    *log = (changelog_t*)calloc(1, sizeof(changelog_t));
+    if (*log == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    (*log)->fd = -1;
+    if ((err = pthread_mutex_init(&(*log)->mutex, NULL)) != 0) {
+        free(*log);
+        *log = NULL;
+        return statusnotok2(_status, "pthread_mutex_init(%d): %s", err, strerror(err));
+    }
+    (*log)->name = strdup(name);
+    (*log)->buff = (char*)malloc(CHANGELOG_BUFF_SIZE);
+    if (((*log)->fd = open(name, O_RDWR | O_CREAT, 0600)) < 0) {
+        _status = statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+        cl_close(*log);
+        return _status;
+    }
+    // 找到最后一条完整记录，截掉未写完的尾部
+    _status = cl_reader_open(name, 0, &r);
+    if (!_status.ok) {
+        cl_close(*log);
+        return _status;
+    }
+    while (1) {
+        _status = cl_reader_next(r, &rec);
+        if (!_status.ok || rec == NULL) {
+            break;
+        }
+        (*log)->seq = rec->seq;
+    }
+    (*log)->size = r->pos;
+    cl_reader_close(r);
+    if (!_status.ok) {
+        cl_close(*log);
+        return _status;
+    }
+    if (ftruncate((*log)->fd, (*log)->size) < 0) {
+        _status = statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
+        cl_close(*log);
+        return _status;
+    }
+    return _status;
+}
+
+static status_t flushlocked(changelog_t* log) {
+    status_t _status = { .ok = 1 };
+
+    if (log->buffsize == 0) {
+        return _status;
+    }
+    _status = writeall(log->fd, log->buff, log->buffsize, log->size, 1);
+    if (!_status.ok) {
+        return _status;
+    }
+    log->size += log->buffsize;
+    log->buffsize = 0;
+    return _status;
+}
+
+status_t cl_append(changelog_t* log, uint16_t type, const void* key, size_t key_len, uint64_t value, uint64_t* seq) {
+    struct iovec part = { (void*)key, key_len };
+
+    return cl_appendv(log, type, &part, 1, value, seq);
+}
+
+status_t cl_appendv(changelog_t* log, uint16_t type, const struct iovec parts[], int nparts, uint64_t value, uint64_t* seq) {
+    status_t _status = { .ok = 1 };
+    struct iovec iov[1 + CHANGELOG_MAXPARTS];
+    size_t key_len = 0;
+
+    if (nparts > CHANGELOG_MAXPARTS) {
+        return statusnotok2(_status, "nparts(%d) over %d", nparts, CHANGELOG_MAXPARTS);
+    }
+    for (int i = 0; i < nparts; ++i) {
+        key_len += parts[i].iov_len;
+    }
+    if (key_len > UINT16_MAX) { // 记录的size为16位
+        return statusnotok2(_status, "record size(%ld) over %d", key_len, UINT16_MAX);
+    }
+    logrecord_t head = { .value = value, .type = type, .size = (uint16_t)key_len, .reserved = 0 };
+
+    pthread_mutex_lock(&log->mutex);
+    head.seq = log->seq + 1;
+    if (log->buffsize + LOGRECORDSIZE(&head) > CHANGELOG_BUFF_SIZE) {
+        _status = flushlocked(log);
+        if (!_status.ok) {
+            pthread_mutex_unlock(&log->mutex);
+            return _status;
+        }
+    }
+    if (LOGRECORDSIZE(&head) > CHANGELOG_BUFF_SIZE) { // 超大key直接写
+        iov[0].iov_base = &head;
+        iov[0].iov_len = sizeof(logrecord_t);
+        memcpy(iov + 1, parts, sizeof(struct iovec) * nparts);
+        ssize_t n = pwritev(log->fd, iov, 1 + nparts, log->size);
+        if (n != (ssize_t)LOGRECORDSIZE(&head)) {
+            pthread_mutex_unlock(&log->mutex);
+            return statusnotok2(_status, "pwritev(%d): %s", errno, strerror(errno));
+        }
+        log->size += n;
+    } else {
+        char* p = log->buff + log->buffsize;
+        memcpy(p, &head, sizeof(logrecord_t));
+        p += sizeof(logrecord_t);
+        for (int i = 0; i < nparts; ++i) {
+            if (parts[i].iov_len > 0) { // 不限的边界为NULL
+                memcpy(p, parts[i].iov_base, parts[i].iov_len);
+                p += parts[i].iov_len;
+            }
+        }
+        log->buffsize += LOGRECORDSIZE(&head);
+    }
+    log->seq = head.seq;
+    if (seq != NULL) {
+        *seq = head.seq;
+    }
+    pthread_mutex_unlock(&log->mutex);
+    return _status;
+}
+
+status_t cl_flush(changelog_t* log) {
+    status_t _status = { .ok = 1 };
+
+    if (log == NULL) {
+        return _status;
+    }
+    pthread_mutex_lock(&log->mutex);
+    _status = flushlocked(log);
+    pthread_mutex_unlock(&log->mutex);
+    return _status;
+}
+
+status_t cl_sync(changelog_t* log) {
+    status_t _status = cl_flush(log);
+
+    if (log == NULL || !_status.ok) {
+        return _status;
+    }
+    if (fdatasync(log->fd) != 0) {
+        return statusnotok2(_status, "fdatasync(%d): %s", errno, strerror(errno));
+    }
+    return _status;
+}
+
+status_t cl_close(changelog_t* log) {
+    status_t _status = { .ok = 1 };
+
+    if (log == NULL) {
+        return _status;
+    }
+    if (log->fd >= 0) {
+        _status = cl_sync(log);
+        close(log->fd);
+    }
+    pthread_mutex_destroy(&log->mutex);
+    free(log->buff);
+    free(log->name);
+    free(log);
+    return _status;
+}
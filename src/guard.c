@@ -0,0 +1,259 @@
+#include "internal.h"
+#include <errno.h>
+
+// read guard：sl_read_begin/sl_read_end之间取得的key视图(指向数据映射)保持有效。
+// 视图在读锁内取得，释放读锁后写操作照常进行；guard存在时数据映射的替换(扩容、
+// 其他进程扩容后的重新映射)不解除旧映射，挂到retired上，等没有guard时由持有进程内写锁的一方解除。
+// datanode回收只改写offset字段，key内容在数据区被复用之前不变。
+// 缓冲池模式下视图指向pin住的页，本线程的pin在最外层guard结束时才解除
+
+typedef struct retired_s {
+    void* mapped;
+    uint64_t size;
+    struct retired_s* next;
+} retired_t;
+
+status_t sl_read_begin(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    __sync_fetch_and_add(&sl->guards, 1);
+    if (sl->pool != NULL) { // 缓冲池的pin保留到guard结束
+        sl_pool_guard(sl, 1);
+    }
+    return _status;
+}
+
+status_t sl_read_end(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (sl->pool != NULL) {
+        sl_pool_guard(sl, -1);
+    }
+    if (__sync_sub_and_fetch(&sl->guards, 1) == 0 && sl->retired != NULL &&
+        pthread_rwlock_trywrlock(&sl->rwlock) == 0) { // 拿不到写锁时由下一次写操作解除
+        sl_release_retired(sl);
+        pthread_rwlock_unlock(&sl->rwlock);
+    }
+    return _status;
+}
+
+// 持有进程内写锁时调用：有guard时保留旧映射，否则直接解除
+void sl_retire(skiplist_t* sl, void* mapped, uint64_t size) {
+    retired_t* r = NULL;
+
+    if (sl->guards == 0 || (r = (retired_t*)malloc(sizeof(retired_t))) == NULL) {
+        munmap(mapped, size);
+        return;
+    }
+    r->mapped = mapped;
+    r->size = size;
+    r->next = sl->retired;
+    sl->retired = r;
+}
+
+// 持有进程内写锁时调用，没有guard时解除保留的旧映射
+void sl_release_retired(skiplist_t* sl) {
+    if (sl->guards != 0) {
+        return;
+    }
+    while (sl->retired != NULL) {
+        retired_t* r = sl->retired;
+        sl->retired = r->next;
+        munmap(r->mapped, r->size);
+        free(r);
+    }
+}
+
+static status_t checkguard(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (sl->guards == 0) {
+        return statusnotok0(_status, "views require sl_read_begin");
+    }
+    return _status;
+}
+
+static void fill(sl_iter_t* it, metanode_t* mnode, uint32_t index) {
+    skiplist_t* sl = it->sl;
+    datanode_t* dnode = NULL;
+
+    it->valid = mnode != NULL;
+    if (!it->valid) {
+        it->node = 0;
+        return;
+    }
+    if ((mnode->flag & METANODE_BLOCK) == METANODE_BLOCK) {
+        dnode = sl_get_datanode(sl, BLOCKENTRIES(mnode)->offsets[index]);
+        it->value = BLOCKENTRIES(mnode)->values[index];
+    } else {
+        dnode = sl_get_datanode(sl, mnode->offset);
+        it->value = mnode->value;
+    }
+    it->key.data = dnode->data;
+    it->key.size = dnode->size;
+    it->node = METANODEPOSITION(sl, mnode);
+    it->index = index;
+    it->seq = sl->meta->seq;
+}
+
+// 第一个 >= key的位置，key为NULL时为第一个key
+static metanode_t* seek(skiplist_t* sl, const void* key, size_t key_len, uint32_t* index) {
+    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
+    int iseq = 0;
+
+    *index = 0;
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        return blk_seek(sl, key, key_len, index, NULL);
+    }
+    if (key == NULL) {
+        return METANODE(sl, METANODEHEAD(sl)->forwards[0]);
+    }
+    return sl->keyops->findpath(sl, key, key_len, update, &iseq);
+}
+
+static metanode_t* advance(skiplist_t* sl, metanode_t* mnode, uint32_t* index) {
+    if ((mnode->flag & METANODE_BLOCK) == METANODE_BLOCK && *index + 1 < mnode->value) {
+        ++*index;
+        return mnode;
+    }
+    *index = 0;
+    return METANODE(sl, mnode->forwards[0]);
+}
+
+status_t sl_iter_seek(skiplist_t* sl, sl_iter_t* it, const void* key, size_t key_len) {
+    SL_OPSCOPE(SL_STAT_SCAN);
+    status_t _status = checkguard(sl);
+    uint64_t _offsets[] = {};
+    uint32_t index = 0;
+
+    if (!_status.ok) {
+        return _status;
+    }
+    if (key != NULL && !(_status = sl_checkkey(sl, key_len)).ok) {
+        return _status;
+    }
+    SL_STATADD(sl, ops[SL_STAT_SCAN], 1);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    it->sl = sl;
+    metanode_t* mnode = seek(sl, key, key_len, &index);
+    fill(it, mnode, index);
+    return sl_unlock(sl, _offsets, 0);
+}
+
+// 定位后没有写入时从原位置继续，否则按当前key重新定位到下一个更大的key
+status_t sl_iter_next(sl_iter_t* it) {
+    SL_OPSCOPE(SL_STAT_SCAN);
+    skiplist_t* sl = it->sl;
+    status_t _status = checkguard(sl);
+    uint64_t _offsets[] = {};
+    uint32_t index = it->index;
+    metanode_t* mnode = NULL;
+
+    if (!_status.ok) {
+        return _status;
+    }
+    if (!it->valid) {
+        return _status;
+    }
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (sl->meta->seq == it->seq) {
+        mnode = advance(sl, METANODE(sl, it->node), &index);
+    } else {
+        mnode = seek(sl, it->key.data, it->key.size, &index);
+        if (mnode != NULL) {
+            datanode_t* dnode = sl_get_datanode(sl, (mnode->flag & METANODE_BLOCK) == METANODE_BLOCK ?
+                                                        BLOCKENTRIES(mnode)->offsets[index] : mnode->offset);
+            if (sl->keyops->cmp(sl, dnode->data, dnode->size, it->key.data, it->key.size) == 0) {
+                mnode = advance(sl, mnode, &index);
+            }
+        }
+    }
+    fill(it, mnode, index);
+    return sl_unlock(sl, _offsets, 0);
+}
+
+static status_t boundkey(skiplist_t* sl, sl_view_t* key, int ismax) {
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    uint32_t index = 0;
+    sl_iter_t it;
+
+    key->data = NULL;
+    key->size = 0;
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    metanode_t* mnode = NULL;
+    if (!ismax) {
+        mnode = seek(sl, NULL, 0, &index);
+    } else if (sl->meta->format == SL_FORMAT_BLOCKED) { // 最后一个块的最后一个key
+        metanode_t* curr = METANODEHEAD(sl);
+        for (int level = (int)curr->level - 1; level >= 0; --level) {
+            while (curr->forwards[level] != 0) {
+                curr = METANODE(sl, curr->forwards[level]);
+            }
+        }
+        if ((curr->flag & METANODE_HEAD) != METANODE_HEAD) {
+            mnode = curr;
+            index = (uint32_t)curr->value - 1;
+        }
+    } else {
+        mnode = METANODE(sl, sl->meta->tail);
+        if (mnode != NULL && (mnode->flag & METANODE_HEAD) == METANODE_HEAD) {
+            mnode = NULL;
+        }
+    }
+    it.sl = sl;
+    fill(&it, mnode, index);
+    if (it.valid) {
+        *key = it.key;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_view_minkey(skiplist_t* sl, sl_view_t* key) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = checkguard(sl);
+    return _status.ok ? boundkey(sl, key, 0) : _status;
+}
+
+status_t sl_view_maxkey(skiplist_t* sl, sl_view_t* key) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = checkguard(sl);
+    return _status.ok ? boundkey(sl, key, 1) : _status;
+}
+
+// 不在guard内调用时，返回的指针在下一次写操作(可能扩容)之前有效
+status_t sl_get_maxkey(skiplist_t* sl, void** key, size_t* size) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    sl_view_t view;
+
+    if (sl == NULL || key == NULL) {
+        return statusnotok0(_status, "skiplist or key is NULL");
+    }
+    _status = boundkey(sl, &view, 1);
+    if (_status.ok && view.data != NULL) {
+        *key = (void*)view.data;
+        *size = view.size;
+    }
+    return _status;
+}
@@ -0,0 +1,255 @@
+#include "internal.h"
+#include <errno.h>
+
+// 哈希索引(<prefix>.sl.hash)：线性探测的开放寻址表，槽为{key的64位hash, metanode位置}，
+// 点查一般只访问一条槽所在的cache line和命中节点。只用于SL_FORMAT_NODE，节点位置不会移动。
+// 扩容是渐进的：新表(2倍)追加在文件末尾，之后每次写迁移旧表的HASH_MIGRATE个槽，
+// 迁移期间查找两张表；旧表迁移完后释放其磁盘块(打洞)。旧表中的删除和已迁移的槽置为墓碑，
+// 保证旧表的探测链不断；当前表删除时后移填补，没有墓碑。
+// 文件头的seq在sync/关闭时写为meta->seq，加载时不一致则按跳表重建
+
+#define HASH_MAGIC 0x48534c53   // "SLSH"
+#define HASH_TABLEOFF 4096      // 表按页对齐，文件头独占第一页
+#define HASH_MINCAP 4096        // 最小槽数
+#define HASH_MIGRATE 16         // 每次写迁移的旧表槽数
+#define HASH_TOMB 1             // 墓碑；槽的pos为0表示空(metanode位置不会小于头节点)
+
+typedef struct hashslot_s {
+    uint64_t hash;
+    uint64_t pos; // metanode位置
+} hashslot_t;
+
+typedef struct hashhead_s {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t seq;    // 与meta->seq相等时索引与跳表一致
+    uint64_t off;    // 当前表在文件中的偏移
+    uint64_t cap;    // 当前表槽数(2的幂)
+    uint64_t n;      // 当前表中的key数
+    uint64_t oldoff; // 迁移中的旧表，oldcap为0表示没有
+    uint64_t oldcap;
+    uint64_t cursor; // 旧表中cursor之前的槽已迁移
+} hashhead_t;
+
+typedef struct hashidx_s {
+    sidecar_t sc;
+} hashidx_t;
+
+#define HASHHEAD(hx) ((hashhead_t*)(hx)->sc.mapped)
+#define HASHTABLE(hx, off) ((hashslot_t*)((hx)->sc.mapped + (off)))
+
+static inline int keyequal(skiplist_t* sl, uint64_t pos, const void* key, size_t key_len) {
+    datanode_t* dnode = sl_get_datanode(sl, METANODE(sl, pos)->offset);
+    return dnode->size == key_len && memcmp(dnode->data, key, key_len) == 0;
+}
+
+// 在表中查找key，返回槽下标，不存在返回cap
+static uint64_t probe(skiplist_t* sl, hashslot_t* t, uint64_t cap, uint64_t h, const void* key, size_t key_len) {
+    uint64_t mask = cap - 1;
+
+    for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+        if (t[i].pos == 0) {
+            return cap;
+        }
+        if (t[i].hash == h && t[i].pos != HASH_TOMB && keyequal(sl, t[i].pos, key, key_len)) {
+            return i;
+        }
+    }
+}
+
+static void insertslot(hashslot_t* t, uint64_t cap, uint64_t h, uint64_t pos) {
+    uint64_t mask = cap - 1;
+    uint64_t i = h & mask;
+
+    while (t[i].pos != 0) {
+        i = (i + 1) & mask;
+    }
+    t[i].hash = h;
+    t[i].pos = pos;
+}
+
+// 删除当前表的槽i，把后面探测链上可以前移的槽依次填入
+static void removeslot(hashslot_t* t, uint64_t cap, uint64_t i) {
+    uint64_t mask = cap - 1;
+
+    for (uint64_t j = (i + 1) & mask; t[j].pos != 0; j = (j + 1) & mask) {
+        uint64_t home = t[j].hash & mask;
+        // home不在(i, j]内时，槽j可以移到i
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            t[i] = t[j];
+            i = j;
+        }
+    }
+    t[i].hash = 0;
+    t[i].pos = 0;
+}
+
+static void migrate(hashidx_t* hx, uint64_t nslots) {
+    hashhead_t* head = HASHHEAD(hx);
+
+    if (head->oldcap == 0) {
+        return;
+    }
+    hashslot_t* old = HASHTABLE(hx, head->oldoff);
+    hashslot_t* cur = HASHTABLE(hx, head->off);
+    for (; nslots > 0 && head->cursor < head->oldcap; --nslots, ++head->cursor) {
+        hashslot_t* s = old + head->cursor;
+        if (s->pos > HASH_TOMB) {
+            insertslot(cur, head->cap, s->hash, s->pos);
+            ++head->n;
+            s->pos = HASH_TOMB;
+        }
+    }
+    if (head->cursor == head->oldcap) {
+        sl_sidecar_discard(&hx->sc, head->oldoff, head->oldcap * sizeof(hashslot_t));
+        head->oldoff = 0;
+        head->oldcap = 0;
+        head->cursor = 0;
+    }
+}
+
+// 在文件末尾分配2倍大小的新表，当前表转为旧表
+static status_t grow(hashidx_t* hx) {
+    status_t _status = { .ok = 1 };
+    uint64_t off = hx->sc.size;
+    uint64_t cap = HASHHEAD(hx)->cap * 2;
+
+    migrate(hx, UINT64_MAX); // 上一次扩容未完成时先迁移完
+    _status = sl_sidecar_resize(&hx->sc, off + cap * sizeof(hashslot_t));
+    if (!_status.ok) {
+        return _status;
+    }
+    hashhead_t* head = HASHHEAD(hx);
+    memset(HASHTABLE(hx, off), 0, cap * sizeof(hashslot_t));
+    head->oldoff = head->off;
+    head->oldcap = head->cap;
+    head->cursor = 0;
+    head->off = off;
+    head->cap = cap;
+    head->n = 0;
+    return _status;
+}
+
+static status_t rebuild(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+    hashidx_t* hx = sl->hash;
+    metanode_t* head = METANODEHEAD(sl);
+    uint64_t cap = HASH_MINCAP;
+
+    while (cap * 3 / 4 < (uint64_t)sl->meta->count * 2) {
+        cap *= 2;
+    }
+    _status = sl_sidecar_resize(&hx->sc, HASH_TABLEOFF + cap * sizeof(hashslot_t));
+    if (!_status.ok) {
+        return _status;
+    }
+    memset(hx->sc.mapped, 0, hx->sc.size);
+    hashhead_t* hh = HASHHEAD(hx);
+    hashslot_t* t = HASHTABLE(hx, HASH_TABLEOFF);
+    hh->magic = HASH_MAGIC;
+    hh->off = HASH_TABLEOFF;
+    hh->cap = cap;
+    for (metanode_t* curr = METANODE(sl, head->forwards[0]); curr != NULL; curr = METANODE(sl, curr->forwards[0])) {
+        sl_pool_yield(sl);
+        datanode_t* dnode = sl_get_datanode(sl, curr->offset);
+        insertslot(t, cap, sl_hashkey(dnode->data, dnode->size), METANODEPOSITION(sl, curr));
+        ++hh->n;
+    }
+    return _status;
+}
+
+status_t sl_hash_open(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    sl->hash = (hashidx_t*)calloc(1, sizeof(hashidx_t));
+    if (sl->hash == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    _status = sl_sidecar_open(sl, "hash", HASH_TABLEOFF, &sl->hash->sc);
+    if (!_status.ok) {
+        sl_hash_close(sl);
+        return _status;
+    }
+    hashhead_t* head = HASHHEAD(sl->hash);
+    if (_status.type == STATUS_SKIPLIST_LOAD && sl->hash->sc.size >= HASH_TABLEOFF && head->magic == HASH_MAGIC &&
+        head->seq == sl->meta->seq && head->off + head->cap * sizeof(hashslot_t) <= sl->hash->sc.size &&
+        head->oldoff + head->oldcap * sizeof(hashslot_t) <= sl->hash->sc.size) {
+        return (status_t){ .ok = 1 };
+    }
+    _status = rebuild(sl);
+    if (!_status.ok) {
+        sl_hash_close(sl);
+    }
+    return _status;
+}
+
+void sl_hash_close(skiplist_t* sl) {
+    if (sl->hash == NULL) {
+        return;
+    }
+    sl_sidecar_close(&sl->hash->sc);
+    free(sl->hash);
+    sl->hash = NULL;
+}
+
+status_t sl_hash_sync(skiplist_t* sl) {
+    HASHHEAD(sl->hash)->seq = sl->meta->seq;
+    return sl_sidecar_sync(&sl->hash->sc);
+}
+
+metanode_t* sl_hash_find(skiplist_t* sl, const void* key, size_t key_len) {
+    hashidx_t* hx = sl->hash;
+    hashhead_t* head = HASHHEAD(hx);
+    uint64_t h = sl_hashkey(key, key_len);
+
+    uint64_t i = probe(sl, HASHTABLE(hx, head->off), head->cap, h, key, key_len);
+    if (i != head->cap) {
+        return METANODE(sl, HASHTABLE(hx, head->off)[i].pos);
+    }
+    if (head->oldcap != 0) {
+        i = probe(sl, HASHTABLE(hx, head->oldoff), head->oldcap, h, key, key_len);
+        if (i != head->oldcap) {
+            return METANODE(sl, HASHTABLE(hx, head->oldoff)[i].pos);
+        }
+    }
+    return NULL;
+}
+
+// 新节点已链入；扩容失败时丢弃索引，回退到跳表查找
+void sl_hash_insert(skiplist_t* sl, metanode_t* mnode, const void* key, size_t key_len) {
+    hashidx_t* hx = sl->hash;
+
+    if (hx == NULL) {
+        return;
+    }
+    if ((HASHHEAD(hx)->n + 1) > HASHHEAD(hx)->cap * 3 / 4 && !grow(hx).ok) {
+        sl_hash_close(sl);
+        return;
+    }
+    hashhead_t* head = HASHHEAD(hx);
+    insertslot(HASHTABLE(hx, head->off), head->cap, sl_hashkey(key, key_len), METANODEPOSITION(sl, mnode));
+    ++head->n;
+    migrate(hx, HASH_MIGRATE);
+}
+
+// 节点将被摘除，调用时其datanode仍有效
+void sl_hash_remove(skiplist_t* sl, const void* key, size_t key_len) {
+    hashidx_t* hx = sl->hash;
+
+    if (hx == NULL) {
+        return;
+    }
+    hashhead_t* head = HASHHEAD(hx);
+    uint64_t h = sl_hashkey(key, key_len);
+    uint64_t i = probe(sl, HASHTABLE(hx, head->off), head->cap, h, key, key_len);
+    if (i != head->cap) {
+        removeslot(HASHTABLE(hx, head->off), head->cap, i);
+        --head->n;
+    } else if (head->oldcap != 0) {
+        i = probe(sl, HASHTABLE(hx, head->oldoff), head->oldcap, h, key, key_len);
+        if (i != head->oldcap) {
+            HASHTABLE(hx, head->oldoff)[i].pos = HASH_TOMB;
+        }
+    }
+    migrate(hx, HASH_MIGRATE);
+}
@@ -0,0 +1,318 @@
+#ifndef __INTERNAL_H
+#define __INTERNAL_H
+
+// 库内部接口(private header)，调用方需已持有相应的锁
+
+#include "skiplist.h"
+#include "trace.h"
+#include <endian.h>
+#include <time.h>
+
+static inline int keycmp(const void* k1, size_t l1, const void* k2, size_t l2) {
+    size_t min = l1 < l2 ? l1 : l2;
+    int cmp = memcmp(k1, k2, min);
+    if (cmp == 0) {
+        return l1 < l2 ? -1 : (l1 > l2 ? 1 : 0);
+    }
+    return cmp > 0 ? 1 : -1;
+}
+
+// key的8字节大端前缀，不足补0；前缀严格小于则key严格小于(SL_KEY_CUSTOM除外)
+static inline uint64_t sl_keyprefix(const void* key, size_t key_len) {
+    uint64_t v = 0;
+    memcpy(&v, key, key_len < sizeof(uint64_t) ? key_len : sizeof(uint64_t));
+    return be64toh(v);
+}
+
+typedef struct keyops_s {
+    int (*cmp)(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2);
+    // 精确查找，未找到返回NULL
+    metanode_t* (*find)(skiplist_t* sl, const void* key, size_t key_len);
+    // 返回第一个 >= key的节点，update记录每层前驱，*iseq表示是否与key相等
+    metanode_t* (*findpath)(skiplist_t* sl, const void* key, size_t key_len, metanode_t* update[], int* iseq);
+    size_t keylen; // 定长key的长度，变长为0
+} keyops_t;
+
+const keyops_t* sl_keyops(uint32_t keytype);
+status_t sl_checkkey(skiplist_t* sl, size_t key_len);
+// key字节的64位hash(与keytype无关，SL_KEY_CUSTOM的相等不一定是字节相等)
+uint64_t sl_hashkey(const void* key, size_t key_len);
+
+int sl_madvflag(int advice);
+void sl_madvise(skiplist_t* sl, int advice);
+void sl_seqbegin(skiplist_t* sl);
+void sl_seqend(skiplist_t* sl);
+size_t sl_indexpages(skiplist_t* sl, uintptr_t pages[], size_t cap);
+// 同prefix的其他文件名<prefix>.sl.<ext>，内存模式返回NULL；调用者free
+char* sl_filename(skiplist_t* sl, const char* ext);
+
+status_t sl_upper_build(skiplist_t* sl);
+void sl_upper_free(skiplist_t* sl);
+void sl_upper_insert(skiplist_t* sl, metanode_t* update[], metanode_t* mnode, const void* key, size_t key_len);
+void sl_upper_remove(skiplist_t* sl, metanode_t* mnode);
+metanode_t* sl_upper_seek(skiplist_t* sl, const void* key, size_t key_len, int* level);
+
+// <prefix>.sl.<ext>附属文件的映射，见sidecar.c
+typedef struct sidecar_s {
+    int fd; // 内存模式为-1
+    void* mapped;
+    uint64_t size;
+} sidecar_t;
+
+status_t sl_sidecar_open(skiplist_t* sl, const char* ext, uint64_t size, sidecar_t* sc);
+status_t sl_sidecar_resize(sidecar_t* sc, uint64_t size);
+void sl_sidecar_discard(sidecar_t* sc, uint64_t off, uint64_t len);
+status_t sl_sidecar_sync(sidecar_t* sc);
+void sl_sidecar_close(sidecar_t* sc);
+
+status_t sl_bloom_open(skiplist_t* sl, uint32_t bitsperkey);
+void sl_bloom_close(skiplist_t* sl);
+status_t sl_bloom_sync(skiplist_t* sl);
+int sl_bloom_maycontain(skiplist_t* sl, const void* key, size_t key_len);
+void sl_bloom_put(skiplist_t* sl, const void* key, size_t key_len);
+void sl_bloom_del(skiplist_t* sl, uint64_t n);
+int sl_bloom_trymaycontain(skiplist_t* sl, const void* key, size_t key_len);
+
+status_t sl_hash_open(skiplist_t* sl);
+void sl_hash_close(skiplist_t* sl);
+status_t sl_hash_sync(skiplist_t* sl);
+metanode_t* sl_hash_find(skiplist_t* sl, const void* key, size_t key_len);
+void sl_hash_insert(skiplist_t* sl, metanode_t* mnode, const void* key, size_t key_len);
+void sl_hash_remove(skiplist_t* sl, const void* key, size_t key_len);
+
+status_t sl_vidx_open(skiplist_t* sl);
+void sl_vidx_close(skiplist_t* sl);
+status_t sl_vidx_sync(skiplist_t* sl);
+status_t sl_vidx_reserve(skiplist_t* sl);
+void sl_vidx_insert(skiplist_t* sl, metanode_t* mnode);
+void sl_vidx_update(skiplist_t* sl, metanode_t* mnode, uint64_t value);
+void sl_vidx_remove(skiplist_t* sl, metanode_t* mnode);
+
+void sl_retire(skiplist_t* sl, void* mapped, uint64_t size);
+void sl_release_retired(skiplist_t* sl);
+metanode_t* blk_seek(skiplist_t* sl, const void* key, size_t key_len, uint32_t* index, metanode_t* update[]);
+
+uint8_t sl_random_level(float p);
+metanode_t* sl_allocnode(skiplist_t* sl, uint32_t level, uint64_t size);
+void sl_freemetanode(skiplist_t* sl, metanode_t* mnode);
+void sl_freedatanode(skiplist_t* sl, uint64_t offset);
+void sl_setdatanodenext(skiplist_t* sl, uint64_t offset, uint64_t next); // 改写回收的datanode的下一个
+status_t sl_reservedata(skiplist_t* sl);
+uint64_t sl_writedatanode(skiplist_t* sl, const void* key, size_t key_len, uint64_t owner);
+
+// SL_FORMAT_BLOCKED的块内容，紧跟在块节点的forwards[level]之后。
+// 块节点复用metanode头部：value为块内key数，offset不用，backward为前一个块
+typedef struct blockentries_s {
+    uint64_t prefixes[SL_BLOCK_ENTRIES]; // key的8字节大端前缀
+    uint64_t values[SL_BLOCK_ENTRIES];
+    uint64_t offsets[SL_BLOCK_ENTRIES];  // datanode位置
+} blockentries_t;
+
+#define BLOCKENTRIES(node) ((blockentries_t*)&(node)->forwards[(node)->level])
+#define BLOCKNODESIZE(level) (sizeof(metanode_t) + sizeof(uint64_t) * (level) + sizeof(blockentries_t))
+
+status_t blk_merge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg, uint64_t* value, int* written);
+int blk_get(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value);
+int blk_tryget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value);
+status_t blk_del(skiplist_t* sl, const void* key, size_t key_len, int* found);
+uint64_t blk_delrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len);
+void blk_scanpart(skiplist_t* sl, metanode_t* b, uint32_t i, metanode_t* stop, const void* hi, size_t hi_len, int part, sl_scan_cb cb, void* arg);
+
+// 点查，返回是否找到
+int sl_doget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value);
+status_t sl_domerge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg);
+status_t sl_doput(skiplist_t* sl, const void* key, size_t key_len, uint64_t value);
+status_t sl_dodel(skiplist_t* sl, const void* key, size_t key_len);
+status_t sl_logchange(skiplist_t* sl, uint16_t type, const void* key, size_t key_len, uint64_t value);
+
+// 异步点查的I/O线程和驻留检查，见async.c
+status_t sl_async_open(skiplist_t* sl, int nthreads);
+void sl_async_close(skiplist_t* sl);
+int sl_resident(skiplist_t* sl, const void* p, size_t len);
+datanode_t* sl_trydatanode(skiplist_t* sl, uint64_t offset);
+
+// 缓存模式，见cache.c
+#define CACHE_FITSCAN 32 // 复用datanode时查看的空闲链表长度
+#define CACHE_FITSLACK 32 // 数据区还有空间时，复用的datanode最多比key长这么多字节
+#define CACHE_EVICTMAX 16 // 数据区放不下时一次写入最多淘汰的key数，仍放不下则扩容
+
+// 淘汰一个最近未访问的key，返回其节点的level，没有可淘汰的key时返回0
+uint32_t sl_cache_evict(skiplist_t* sl);
+// 代替sl_reservedata：数据区放不下key时淘汰冷key(最多CACHE_EVICTMAX个)直到能复用回收的datanode，淘汰过时*evicted置1
+status_t sl_cache_reservedata(skiplist_t* sl, size_t key_len, int* evicted);
+// 从空闲链表取一个放得下key的datanode，没有时返回0；*slack为多出的字节
+uint64_t sl_cache_takedata(skiplist_t* sl, size_t key_len, uint16_t* slack);
+
+static inline void sl_cache_touch(skiplist_t* sl, metanode_t* mnode) {
+    if (sl->cache && (__atomic_load_n(&mnode->flag, __ATOMIC_RELAXED) & METANODE_REF) == 0) { // 读锁下并发置位
+        __atomic_fetch_or(&mnode->flag, METANODE_REF, __ATOMIC_RELAXED);
+    }
+}
+
+// 数据文件的缓冲池，见pool.c
+#define POOL_PAGESIZE 4096
+#define POOL_READAHEAD 32 // 一次预读的最多页数
+
+status_t sl_pool_open(skiplist_t* sl, uint64_t datacap, int isload, uint64_t poolsize, int direct);
+void sl_pool_close(skiplist_t* sl);
+datanode_t* sl_pool_datanode(skiplist_t* sl, uint64_t offset);
+// 所在页已在池中时返回datanode(不读文件)，否则返回NULL
+datanode_t* sl_pool_trydatanode(skiplist_t* sl, uint64_t offset);
+void sl_pool_write(skiplist_t* sl, uint64_t offset, const void* buf, size_t len);
+void sl_pool_readahead(skiplist_t* sl, const uint64_t offsets[], size_t n);
+status_t sl_pool_release(skiplist_t* sl);
+void sl_pool_guard(skiplist_t* sl, int delta);
+status_t sl_pool_sync(skiplist_t* sl);
+status_t sl_pool_truncate(skiplist_t* sl, uint64_t newcap);
+void sl_pool_stats(skiplist_t* sl, sl_stats_t* stats);
+
+// 长循环中不再持有之前取得的datanode时调用，及时解除缓冲池的pin
+static inline void sl_pool_yield(skiplist_t* sl) {
+    if (sl->pool != NULL) {
+        sl_pool_release(sl);
+    }
+}
+
+// 操作跟踪，见trace.c
+status_t sl_trace_open(skiplist_t* sl, const char* path);
+void sl_trace_close(skiplist_t* sl);
+void sl_trace_record(skiplist_t* sl, uint8_t op, uint8_t flags, const void* key, size_t key_len, uint64_t value);
+
+// 每线程计数器，见stats.c。线程首次计数时领取一个独占槽位(线程退出时归还)，独占槽位用普通加法；
+// 槽位用完后的线程共用最后一个槽位，用原子加
+#define SL_STATS_SLOTS 64
+
+typedef struct statslot_s {
+    uint64_t ops[SL_STAT_OPS];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t lookups;
+    uint64_t hops;
+    uint64_t compares;
+    uint64_t synced;
+    uint64_t evictions;
+    uint64_t lockacquires[SL_STAT_OPS];
+    uint64_t lockcontended[SL_STAT_OPS];
+    uint64_t lockwaitns[SL_STAT_OPS];
+    uint64_t lockholdns[SL_STAT_OPS];
+    uint64_t lockholdsamples[SL_STAT_OPS];
+} __attribute__((aligned(64))) statslot_t;
+
+extern __thread int sl_statslot;
+int sl_claimslot();
+statslot_t* sl_stats_alloc();
+
+#define SL_STATADD(sl, field, n)                                                 \
+    do {                                                                         \
+        if (sl_statslot < 0) {                                                   \
+            sl_statslot = sl_claimslot();                                        \
+        }                                                                        \
+        if (sl_statslot < SL_STATS_SLOTS) {                                      \
+            (sl)->stats[sl_statslot].field += (n);                               \
+        } else {                                                                 \
+            __sync_fetch_and_add(&(sl)->stats[SL_STATS_SLOTS].field, (n));       \
+        }                                                                        \
+    } while (0)
+
+// 一次下降的前进数和比较数
+#define SL_STATLOOKUP(sl, nhops, ncompares) \
+    do {                                    \
+        SL_STATADD(sl, lookups, 1);         \
+        SL_STATADD(sl, hops, nhops);        \
+        SL_STATADD(sl, compares, ncompares); \
+    } while (0)
+
+// 静态跟踪点(USDT，provider为skiplist)：以SL_USDT编译且有<sys/sdt.h>时展开为DTRACE_PROBE，
+// 未挂载时是一条nop；否则为空，参数不求值。可用perf probe sdt_skiplist:*或bpftrace usdt:挂载
+#ifdef SL_USDT
+#include <sys/sdt.h>
+#define SL_PROBE1(name, a) DTRACE_PROBE1(skiplist, name, a)
+#define SL_PROBE2(name, a, b) DTRACE_PROBE2(skiplist, name, a, b)
+#define SL_PROBE3(name, a, b, c) DTRACE_PROBE3(skiplist, name, a, b, c)
+#else
+#define SL_PROBE1(name, a) ((void)0)
+#define SL_PROBE2(name, a, b) ((void)0)
+#define SL_PROBE3(name, a, b, c) ((void)0)
+#endif
+
+// 当前线程正在执行的公开调用(SL_STAT_*)，锁统计按它归类
+extern __thread int sl_curop;
+
+static inline int sl_openter(int op) {
+    int prev = sl_curop;
+    sl_curop = op;
+    SL_PROBE1(op__entry, op);
+    return prev;
+}
+
+static inline void sl_opexit(int* prev) {
+    SL_PROBE1(op__return, sl_curop);
+    sl_curop = *prev;
+}
+
+// 放在公开调用的开头：触发op__entry，任何return时触发op__return并恢复外层调用的类型
+#define SL_OPSCOPE(op) int _prevop __attribute__((cleanup(sl_opexit))) = sl_openter(op)
+
+static inline uint64_t sl_nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 范围删除摘下的节点(块)经forwards[0]串成待回收链表，表头存放在头节点的value中(头节点不用value)
+#define RECLAIMHEAD(sl) (METANODEHEAD(sl)->value)
+#define RECLAIM_STEP 64 // 每次写操作顺带回收的节点数
+
+uint64_t sl_reclaim(skiplist_t* sl, uint64_t n);
+status_t sl_dodelrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, uint64_t* removed);
+status_t sl_applyrange(skiplist_t* sl, const void* data, size_t size, uint64_t value);
+
+// LSM模式的不可变有序表，见sstable.c。打开后只读，多线程可并发查找和迭代
+typedef struct sst_s {
+    int fd;
+    uint64_t id;
+    uint64_t count;     // 条目数(含删除标记)
+    uint64_t size;      // 文件大小
+    uint64_t nblocks;
+    uint64_t* offs;     // 各数据块的位置，offs[nblocks]为数据区末尾
+    uint32_t* keypos;   // 各块首key在index中的位置(uint16长度 + key)
+    char* index;        // 稀疏索引，加载到内存
+    uint64_t* bloom;    // 布隆过滤器，加载到内存
+    uint64_t bloomblocks;
+    uint32_t bloomk;
+    uint32_t maxblock;  // 最大数据块字节数
+    char* name;
+} sst_t;
+
+typedef struct sstbuilder_s sstbuilder_t;
+
+// 迭代器一次读入连续的多个数据块，条目不跨块，所以读缓冲可以当作条目流顺序解析
+typedef struct sstiter_s {
+    sst_t* t;
+    int valid;
+    const void* key;    // 指向读缓冲，下一次sst_iter_next前有效
+    size_t key_len;
+    uint64_t value;
+    uint64_t block;     // 下一次读入的第一个块
+    char* buf;
+    size_t cap;
+    size_t len;
+    size_t pos;         // 下一个条目在buf中的位置
+} sstiter_t;
+
+// 按key升序逐条加入，完成时写入name(先写临时文件再rename)
+status_t sst_build_begin(const char* name, uint32_t blocksize, uint32_t bloombits, sstbuilder_t** b);
+status_t sst_build_add(sstbuilder_t* b, const void* key, size_t key_len, uint64_t value);
+uint64_t sst_build_count(sstbuilder_t* b);
+status_t sst_build_finish(sstbuilder_t* b, uint64_t id, sst_t** t);
+void sst_build_abort(sstbuilder_t* b);
+
+status_t sst_open(const char* name, uint64_t id, sst_t** t);
+void sst_close(sst_t* t);
+status_t sst_get(sst_t* t, const void* key, size_t key_len, uint64_t* value, int* found);
+// 定位到第一个 >= key(为NULL时第一个条目)
+status_t sst_iter_seek(sst_t* t, sstiter_t* it, const void* key, size_t key_len);
+status_t sst_iter_next(sstiter_t* it);
+void sst_iter_close(sstiter_t* it);
+
+#endif // __INTERNAL_H
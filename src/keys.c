@@ -0,0 +1,159 @@
+#include "internal.h"
+#include <endian.h>
+
+// 定长整数key按大端存储，memcmp序与数值序一致；这里用原生load比较，避免memcmp和长度分支
+
+static inline uint64_t loadbe64(const void* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    return be64toh(v);
+}
+
+static inline int cmpbytes(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2) {
+    return keycmp(k1, l1, k2, l2);
+}
+
+static inline int cmpu64(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2) {
+    uint64_t a = loadbe64(k1);
+    uint64_t b = loadbe64(k2);
+    return (a > b) - (a < b);
+}
+
+static inline int cmpu128(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2) {
+    uint64_t a = loadbe64(k1);
+    uint64_t b = loadbe64(k2);
+    if (a != b) {
+        return a < b ? -1 : 1;
+    }
+    a = loadbe64(k1 + 8);
+    b = loadbe64(k2 + 8);
+    return (a > b) - (a < b);
+}
+
+static inline int cmpcustom(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2) {
+    int cmp = sl->keycmp(k1, l1, k2, l2);
+    return (cmp > 0) - (cmp < 0);
+}
+
+// 每种key类型生成一份查找循环，CMP在编译期内联。经sl->keyops分派，每次查找只有一次间接调用(目标固定，可预测)，
+// 循环内的比较都是直接内联的；按keytype switch也还是调用一份不内联的循环，省不掉这次调用。
+// findpath不走上层索引：写操作需要每一层的前驱，索引只能给出从第K层往下的起点，K层以上的前驱仍要从头节点下降
+#define DEFINE_KEYOPS(type, CMP, KEYLEN)                                                                      \
+    static int cmp_##type(skiplist_t* sl, const void* k1, size_t l1, const void* k2, size_t l2) {             \
+        return CMP(sl, k1, l1, k2, l2);                                                                        \
+    }                                                                                                          \
+                                                                                                               \
+    static metanode_t* find_##type(skiplist_t* sl, const void* key, size_t key_len) {                         \
+        metanode_t* curr = METANODEHEAD(sl);                                                                   \
+        metanode_t* found = NULL;                                                                              \
+        int level = (int)curr->level - 1;                                                                      \
+        uint64_t hops = 0, compares = 0;                                                                       \
+        if (sl->upper != NULL) {                                                                               \
+            curr = sl_upper_seek(sl, key, key_len, &level);                                                    \
+        }                                                                                                      \
+        for (; level >= 0; --level) {                                                                          \
+            while (1) {                                                                                        \
+                metanode_t* next = METANODE(sl, curr->forwards[level]);                                        \
+                if (next == NULL) {                                                                            \
+                    break;                                                                                     \
+                }                                                                                              \
+                datanode_t* dnode = sl_get_datanode(sl, next->offset);                                         \
+                int cmp = CMP(sl, dnode->data, dnode->size, key, key_len);                                     \
+                ++compares;                                                                                    \
+                if (cmp < 0) {                                                                                 \
+                    curr = next;                                                                               \
+                    ++hops;                                                                                    \
+                    continue;                                                                                  \
+                }                                                                                              \
+                if (cmp == 0) {                                                                                \
+                    found = next;                                                                              \
+                    level = 0;                                                                                 \
+                }                                                                                              \
+                break;                                                                                         \
+            }                                                                                                  \
+        }                                                                                                      \
+        SL_STATLOOKUP(sl, hops, compares);                                                                     \
+        return found;                                                                                          \
+    }                                                                                                          \
+                                                                                                               \
+    static metanode_t* findpath_##type(skiplist_t* sl, const void* key, size_t key_len, metanode_t* update[], \
+                                       int* iseq) {                                                            \
+        int cmp = 1;                                                                                           \
+        metanode_t* next = NULL;                                                                               \
+        metanode_t* curr = METANODEHEAD(sl);                                                                   \
+        uint64_t hops = 0, compares = 0;                                                                       \
+        for (int level = (int)curr->level - 1; level >= 0; --level) {                                          \
+            while (1) {                                                                                        \
+                next = METANODE(sl, curr->forwards[level]);                                                    \
+                if (next == NULL) {                                                                            \
+                    cmp = 1;                                                                                   \
+                    break;                                                                                     \
+                }                                                                                              \
+                datanode_t* dnode = sl_get_datanode(sl, next->offset);                                         \
+                cmp = CMP(sl, dnode->data, dnode->size, key, key_len);                                         \
+                ++compares;                                                                                    \
+                if (cmp >= 0) {                                                                                \
+                    break;                                                                                     \
+                }                                                                                              \
+                curr = next;                                                                                   \
+                ++hops;                                                                                        \
+            }                                                                                                  \
+            update[level] = curr;                                                                              \
+        }                                                                                                      \
+        SL_STATLOOKUP(sl, hops, compares);                                                                     \
+        *iseq = (next != NULL && cmp == 0);                                                                    \
+        return METANODE(sl, curr->forwards[0]);                                                                \
+    }                                                                                                          \
+                                                                                                               \
+    static const keyops_t keyops_##type = {                                                                    \
+        .cmp = cmp_##type,                                                                                     \
+        .find = find_##type,                                                                                   \
+        .findpath = findpath_##type,                                                                           \
+        .keylen = (KEYLEN),                                                                                    \
+    };
+
+DEFINE_KEYOPS(bytes, cmpbytes, 0)
+DEFINE_KEYOPS(u64, cmpu64, 8)
+DEFINE_KEYOPS(u128, cmpu128, 16)
+DEFINE_KEYOPS(custom, cmpcustom, 0)
+
+const keyops_t* sl_keyops(uint32_t keytype) {
+    switch (keytype) {
+    case SL_KEY_BYTES:
+        return &keyops_bytes;
+    case SL_KEY_U64:
+        return &keyops_u64;
+    case SL_KEY_U128:
+        return &keyops_u128;
+    case SL_KEY_CUSTOM:
+        return &keyops_custom;
+    }
+    return NULL;
+}
+
+// MurmurHash64A
+uint64_t sl_hashkey(const void* key, size_t key_len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t h = 0x8445d61a4e774912ULL ^ (key_len * m);
+    uint64_t k;
+
+    for (size_t n = key_len / 8; n > 0; --n, p += 8) {
+        memcpy(&k, p, sizeof(uint64_t));
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (key_len & 7) {
+        k = 0;
+        memcpy(&k, p, key_len & 7);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+}
@@ -0,0 +1,848 @@
+#include "internal.h"
+#include "lsm.h"
+#include <errno.h>
+
+// LSM模式，见lsm.h。
+// 结构(mem/imm/tables)的变更都持有mutex，指针替换再加lock的写锁；读写数据只持lock的读锁，
+// 所以清单可以在mutex内、写锁外写入。冻结时若上一个冻结的memtable还没写成表，写入方等待(反压)。
+// flush和合并各一个后台线程：flush只在表列表头部加入新表，合并替换它开始时选中的一段相邻的表(更旧的表只有合并会改变)。
+// 合并按大小分层(size-tiered)：从最旧的表开始，相邻且大小相近的表超过maxtables个时只合并这些表，
+// 每个key被重写的次数随数据量对数增长；合并的表包含最旧的表时才能丢弃删除标记
+
+#define TIER_RATIO 2 // 同一层的表最大的不超过最小的这么多倍
+
+typedef struct lsmmanifest_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nextid;
+    uint64_t memid;
+    uint64_t immid;   // 冻结、尚未写成表的memtable，0表示没有
+    uint64_t ntables;
+    uint64_t ids[0];  // 表id，新到旧
+} lsmmanifest_t;
+
+struct lsm_s {
+    pthread_rwlock_t lock;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;    // 有冻结的memtable或表数变化
+    pthread_cond_t done;    // flush或合并完成
+    lsm_options_t opts;
+    char* prefix;
+    skiplist_t* mem;
+    uint64_t memid;
+    skiplist_t* imm;
+    uint64_t immid;
+    sst_t** tables;         // 新到旧
+    size_t ntables;
+    uint64_t nextid;
+    int compacting;
+    int stop;
+    status_t bgstatus;      // 后台线程的第一个错误，之后的冻结和flush返回它
+    uint64_t flushes;
+    uint64_t compactions;
+    pthread_t flusher;
+    pthread_t compactor;
+    int threads;            // 后台线程已启动
+};
+
+void lsm_options_init(lsm_options_t* opts) {
+    sl_options_init(&opts->sl);
+    opts->sl.metasize = 4 * DEFAULT_METAFILE_SIZE;
+    opts->flushsize = 2 * DEFAULT_METAFILE_SIZE;
+    opts->blocksize = 4096;
+    opts->bloombits = 10;
+    opts->maxtables = 4;
+}
+
+static char* filename(lsm_t* lsm, uint64_t id, const char* ext) {
+    size_t name_len = strlen(lsm->prefix) + strlen(ext) + 24;
+    char* name = (char*)malloc(name_len);
+    if (id == 0) {
+        snprintf(name, name_len, "%s%s", lsm->prefix, ext);
+    } else {
+        snprintf(name, name_len, "%s.%lu%s", lsm->prefix, id, ext);
+    }
+    return name;
+}
+
+static status_t openmem(lsm_t* lsm, uint64_t id, skiplist_t** sl) {
+    if (lsm->opts.sl.inmemory) {
+        return sl_open_opt(NULL, &lsm->opts.sl, sl);
+    }
+    char* prefix = filename(lsm, id, "");
+    status_t _status = sl_open_opt(prefix, &lsm->opts.sl, sl);
+    free(prefix);
+    return _status;
+}
+
+static void removemem(lsm_t* lsm, uint64_t id) {
+    const char* exts[] = { ".sl.meta", ".sl.data", ".sl.log", ".sl.heat", ".sl.bloom", ".sl.hash", ".sl.vidx", ".sl.trace" };
+
+    if (lsm->opts.sl.inmemory) {
+        return;
+    }
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        char* name = filename(lsm, id, exts[i]);
+        unlink(name);
+        free(name);
+    }
+}
+
+static void removetable(sst_t* t) {
+    unlink(t->name);
+    sst_close(t);
+}
+
+// 写临时文件后rename，调用者持有mutex
+static status_t writemanifest(lsm_t* lsm, uint64_t memid, uint64_t immid, sst_t** tables, size_t ntables) {
+    status_t _status = { .ok = 1 };
+    size_t size = sizeof(lsmmanifest_t) + sizeof(uint64_t) * ntables;
+    lsmmanifest_t* m = (lsmmanifest_t*)calloc(1, size);
+
+    if (m == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    m->magic = LSM_MAGIC;
+    m->version = LSM_VERSION;
+    m->nextid = lsm->nextid;
+    m->memid = memid;
+    m->immid = immid;
+    m->ntables = ntables;
+    for (size_t i = 0; i < ntables; ++i) {
+        m->ids[i] = tables[i]->id;
+    }
+    char* name = filename(lsm, 0, ".lsm");
+    char* tmpname = filename(lsm, 0, ".lsm.tmp");
+    int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        _status = statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    } else if (write(fd, m, size) != (ssize_t)size || fsync(fd) < 0) {
+        _status = statusnotok2(_status, "write manifest(%d): %s", errno, strerror(errno));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (_status.ok && rename(tmpname, name) < 0) {
+        _status = statusnotok2(_status, "rename(%d): %s", errno, strerror(errno));
+    }
+    free(name);
+    free(tmpname);
+    free(m);
+    return _status;
+}
+
+// 清单不存在时*m = NULL
+static status_t readmanifest(lsm_t* lsm, lsmmanifest_t** m) {
+    status_t _status = { .ok = 1 };
+    struct stat st;
+    char* name = filename(lsm, 0, ".lsm");
+    int fd = open(name, O_RDONLY);
+
+    *m = NULL;
+    free(name);
+    if (fd < 0) {
+        return errno == ENOENT ? _status : statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(lsmmanifest_t) || (*m = (lsmmanifest_t*)malloc(st.st_size)) == NULL ||
+        read(fd, *m, st.st_size) != st.st_size) {
+        close(fd);
+        free(*m);
+        *m = NULL;
+        return statusnotok0(_status, "read manifest failed");
+    }
+    close(fd);
+    if ((*m)->magic != LSM_MAGIC || (*m)->version != LSM_VERSION ||
+        (uint64_t)st.st_size != sizeof(lsmmanifest_t) + sizeof(uint64_t) * (*m)->ntables) {
+        free(*m);
+        *m = NULL;
+        return statusnotok0(_status, "manifest is corrupted");
+    }
+    return _status;
+}
+
+typedef struct memput_s {
+    skiplist_t* sl;
+    uint64_t value;
+    uint64_t size; // 写入前已使用的元数据和数据字节数
+} memput_t;
+
+// 在写入持有的跳表写锁内读大小(数据映射扩容时会替换)，不必再加一次锁
+static int memput(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg) {
+    memput_t* p = (memput_t*)arg;
+
+    p->size = p->sl->meta->mapsize + p->sl->data->mapsize;
+    *value = p->value;
+    return 1;
+}
+
+static status_t memget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value, int* found) {
+    return sl_mget(sl, 1, &key, &key_len, value, found);
+}
+
+// 冻结mem(已被其他线程冻结时直接返回)
+static status_t freeze(lsm_t* lsm, skiplist_t* mem) {
+    status_t _status = { .ok = 1 };
+    skiplist_t* fresh = NULL;
+
+    pthread_mutex_lock(&lsm->mutex);
+    while (lsm->mem == mem && lsm->imm != NULL && lsm->bgstatus.ok) {
+        pthread_cond_wait(&lsm->done, &lsm->mutex);
+    }
+    if (!lsm->bgstatus.ok || lsm->mem != mem) {
+        _status = lsm->bgstatus;
+        pthread_mutex_unlock(&lsm->mutex);
+        return _status;
+    }
+    uint64_t id = lsm->nextid++;
+    _status = openmem(lsm, id, &fresh);
+    if (_status.ok) {
+        _status = writemanifest(lsm, id, lsm->memid, lsm->tables, lsm->ntables);
+        if (!_status.ok) {
+            sl_close(fresh);
+            removemem(lsm, id);
+        }
+    }
+    if (_status.ok) {
+        pthread_rwlock_wrlock(&lsm->lock);
+        lsm->imm = lsm->mem;
+        lsm->immid = lsm->memid;
+        lsm->mem = fresh;
+        lsm->memid = id;
+        pthread_rwlock_unlock(&lsm->lock);
+        pthread_cond_broadcast(&lsm->work);
+    }
+    pthread_mutex_unlock(&lsm->mutex);
+    return _status;
+}
+
+typedef struct flushctx_s {
+    sstbuilder_t* b;
+    int dropdel;
+    status_t status;
+} flushctx_t;
+
+static int flushkey(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    flushctx_t* ctx = (flushctx_t*)arg;
+
+    (void)part;
+    if (ctx->dropdel && value == SL_LSM_TOMBSTONE) {
+        return 0;
+    }
+    ctx->status = sst_build_add(ctx->b, key, key_len, value);
+    return !ctx->status.ok;
+}
+
+// 构建完成(或失败)，没有条目时*t = NULL
+static status_t finishtable(sstbuilder_t* b, status_t _status, uint64_t id, sst_t** t) {
+    *t = NULL;
+    if (!_status.ok || sst_build_count(b) == 0) {
+        sst_build_abort(b);
+        return _status;
+    }
+    return sst_build_finish(b, id, t);
+}
+
+// 把冻结的memtable写成表放到列表头部。imm只由flush线程移除，写表期间不需要锁
+static status_t flushimm(lsm_t* lsm) {
+    status_t _status = { .ok = 1 };
+    flushctx_t ctx = { .status = { .ok = 1 } };
+    sst_t* t = NULL;
+
+    pthread_mutex_lock(&lsm->mutex);
+    skiplist_t* imm = lsm->imm;
+    uint64_t immid = lsm->immid;
+    uint64_t id = lsm->nextid++;
+    ctx.dropdel = lsm->ntables == 0; // 没有更旧的表，删除标记可以丢弃
+    pthread_mutex_unlock(&lsm->mutex);
+
+    char* name = filename(lsm, id, ".sst");
+    _status = sst_build_begin(name, lsm->opts.blocksize, lsm->opts.bloombits, &ctx.b);
+    free(name);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_scan(imm, NULL, 0, NULL, 0, flushkey, &ctx);
+    _status = finishtable(ctx.b, _status.ok ? ctx.status : _status, id, &t);
+    if (!_status.ok) {
+        return _status;
+    }
+
+    pthread_mutex_lock(&lsm->mutex);
+    size_t n = lsm->ntables + (t != NULL);
+    sst_t** tables = (sst_t**)malloc(sizeof(sst_t*) * (n + 1));
+    if (tables == NULL) {
+        _status = statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    } else {
+        if (t != NULL) {
+            tables[0] = t;
+        }
+        if (lsm->ntables > 0) { // 还没有表时lsm->tables为NULL
+            memcpy(tables + (t != NULL), lsm->tables, sizeof(sst_t*) * lsm->ntables);
+        }
+        _status = writemanifest(lsm, lsm->memid, 0, tables, n);
+    }
+    if (_status.ok) {
+        pthread_rwlock_wrlock(&lsm->lock);
+        free(lsm->tables);
+        lsm->tables = tables;
+        lsm->ntables = n;
+        lsm->imm = NULL;
+        lsm->immid = 0;
+        pthread_rwlock_unlock(&lsm->lock);
+        ++lsm->flushes;
+    } else {
+        free(tables);
+        if (t != NULL) {
+            removetable(t);
+        }
+    }
+    pthread_cond_broadcast(&lsm->work);
+    pthread_cond_broadcast(&lsm->done);
+    pthread_mutex_unlock(&lsm->mutex);
+    if (_status.ok) {
+        sl_close(imm);
+        removemem(lsm, immid);
+    }
+    return _status;
+}
+
+// 合并的输入：memtable(在read guard内迭代)或表
+typedef struct source_s {
+    skiplist_t* sl;
+    sl_iter_t sit;
+    sstiter_t tit;
+    int valid;
+    const void* key;
+    size_t key_len;
+    uint64_t value;
+} source_t;
+
+static void srcfill(source_t* src) {
+    if (src->sl != NULL) {
+        src->valid = src->sit.valid;
+        src->key = src->sit.key.data;
+        src->key_len = src->sit.key.size;
+        src->value = src->sit.value;
+    } else {
+        src->valid = src->tit.valid;
+        src->key = src->tit.key;
+        src->key_len = src->tit.key_len;
+        src->value = src->tit.value;
+    }
+}
+
+static status_t srcseek(source_t* src, skiplist_t* sl, sst_t* t, const void* lo, size_t lo_len) {
+    status_t _status = { .ok = 1 };
+
+    memset(src, 0, sizeof(source_t));
+    if (sl != NULL) {
+        _status = sl_read_begin(sl);
+        if (!_status.ok) {
+            return _status;
+        }
+        src->sl = sl;
+        _status = sl_iter_seek(sl, &src->sit, lo, lo_len);
+    } else {
+        _status = sst_iter_seek(t, &src->tit, lo, lo_len);
+    }
+    srcfill(src);
+    return _status;
+}
+
+static status_t srcnext(source_t* src) {
+    status_t _status = src->sl != NULL ? sl_iter_next(&src->sit) : sst_iter_next(&src->tit);
+    srcfill(src);
+    return _status;
+}
+
+static void srcclose(source_t* src) {
+    if (src->sl != NULL) {
+        sl_read_end(src->sl);
+    } else {
+        sst_iter_close(&src->tit);
+    }
+}
+
+// 按key合并srcs(新到旧)直到hi，同一个key只输出最新的；withdel为0时跳过删除标记
+static status_t merge(source_t* srcs, size_t n, const void* hi, size_t hi_len, int withdel, sl_scan_cb cb, void* arg) {
+    status_t _status = { .ok = 1 };
+
+    while (1) {
+        source_t* min = NULL;
+        for (size_t i = 0; i < n; ++i) {
+            if (srcs[i].valid && (min == NULL || keycmp(srcs[i].key, srcs[i].key_len, min->key, min->key_len) < 0)) {
+                min = &srcs[i];
+            }
+        }
+        if (min == NULL || (hi != NULL && keycmp(min->key, min->key_len, hi, hi_len) >= 0)) {
+            return _status;
+        }
+        if ((withdel || min->value != SL_LSM_TOMBSTONE) && cb(0, min->key, min->key_len, min->value, arg)) {
+            return _status;
+        }
+        // 先跳过旧版本，min的key在它前进后失效
+        for (size_t i = 0; i < n; ++i) {
+            if (&srcs[i] != min && srcs[i].valid && keycmp(srcs[i].key, srcs[i].key_len, min->key, min->key_len) == 0) {
+                _status = srcnext(&srcs[i]);
+                if (!_status.ok) {
+                    return _status;
+                }
+            }
+        }
+        _status = srcnext(min);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+}
+
+// 从最旧的表开始把相邻且大小相近的表分为一层，返回第一个超过maxtables个表的层[*from, *from + 返回值)，
+// 没有时返回0。调用者持有mutex
+static size_t pickrun(lsm_t* lsm, size_t* from) {
+    size_t end = lsm->ntables;
+
+    while (end > 0) {
+        size_t start = end - 1;
+        uint64_t lo = lsm->tables[start]->size;
+        uint64_t hi = lo;
+        for (; start > 0; --start) {
+            uint64_t size = lsm->tables[start - 1]->size;
+            uint64_t newlo = size < lo ? size : lo;
+            uint64_t newhi = size > hi ? size : hi;
+            if (newhi > newlo * TIER_RATIO) {
+                break;
+            }
+            lo = newlo;
+            hi = newhi;
+        }
+        if (end - start > (size_t)lsm->opts.maxtables) {
+            *from = start;
+            return end - start;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+// 把一层相邻的表(force时为全部表)合并为一个，放在原来的位置。期间flush加入的新表保留在列表头部
+static status_t compact(lsm_t* lsm, int force) {
+    status_t _status = { .ok = 1 };
+    flushctx_t ctx = { .status = { .ok = 1 } };
+    sst_t* t = NULL;
+    size_t from = 0;
+    size_t n = 0;
+
+    pthread_mutex_lock(&lsm->mutex);
+    while (lsm->compacting) {
+        pthread_cond_wait(&lsm->done, &lsm->mutex);
+    }
+    if (force) {
+        n = lsm->ntables;
+    } else {
+        n = pickrun(lsm, &from);
+    }
+    if (n == 0) {
+        pthread_mutex_unlock(&lsm->mutex);
+        return _status;
+    }
+    lsm->compacting = 1;
+    size_t total = lsm->ntables;
+    ctx.dropdel = from + n == total; // 没有更旧的表时删除标记不再需要
+    uint64_t id = lsm->nextid++;
+    sst_t** olds = (sst_t**)malloc(sizeof(sst_t*) * n);
+    source_t* srcs = (source_t*)calloc(n, sizeof(source_t));
+    if (olds != NULL) {
+        memcpy(olds, lsm->tables + from, sizeof(sst_t*) * n);
+    }
+    pthread_mutex_unlock(&lsm->mutex);
+
+    char* name = filename(lsm, id, ".sst");
+    if (olds == NULL || srcs == NULL) {
+        _status = statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    } else {
+        _status = sst_build_begin(name, lsm->opts.blocksize, lsm->opts.bloombits, &ctx.b);
+    }
+    free(name);
+    size_t opened = 0;
+    for (; _status.ok && opened < n; ++opened) {
+        _status = srcseek(&srcs[opened], NULL, olds[opened], NULL, 0);
+    }
+    if (_status.ok) {
+        _status = merge(srcs, n, NULL, 0, 1, flushkey, &ctx);
+    }
+    for (size_t i = 0; i < opened; ++i) {
+        srcclose(&srcs[i]);
+    }
+    free(srcs);
+    if (ctx.b != NULL) {
+        _status = finishtable(ctx.b, _status.ok ? ctx.status : _status, id, &t);
+    }
+
+    pthread_mutex_lock(&lsm->mutex);
+    size_t newer = lsm->ntables - total + from; // 合并的表之前的表，含期间新加入的
+    size_t older = total - from - n;
+    size_t ntables = newer + (t != NULL) + older;
+    sst_t** tables = NULL;
+    if (_status.ok) {
+        tables = (sst_t**)malloc(sizeof(sst_t*) * (ntables + 1));
+        if (tables == NULL) {
+            _status = statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+        } else {
+            memcpy(tables, lsm->tables, sizeof(sst_t*) * newer);
+            tables[newer] = t;
+            memcpy(tables + newer + (t != NULL), lsm->tables + newer + n, sizeof(sst_t*) * older);
+            _status = writemanifest(lsm, lsm->memid, lsm->immid, tables, ntables);
+        }
+    }
+    if (_status.ok) {
+        pthread_rwlock_wrlock(&lsm->lock);
+        free(lsm->tables);
+        lsm->tables = tables;
+        lsm->ntables = ntables;
+        pthread_rwlock_unlock(&lsm->lock);
+        ++lsm->compactions;
+    } else {
+        free(tables);
+        if (t != NULL) {
+            removetable(t);
+        }
+    }
+    lsm->compacting = 0;
+    pthread_cond_broadcast(&lsm->done);
+    pthread_mutex_unlock(&lsm->mutex);
+    if (_status.ok) {
+        for (size_t i = 0; i < n; ++i) {
+            removetable(olds[i]);
+        }
+    }
+    free(olds);
+    return _status;
+}
+
+static void* flushloop(void* arg) {
+    lsm_t* lsm = (lsm_t*)arg;
+
+    pthread_mutex_lock(&lsm->mutex);
+    while (!lsm->stop) {
+        if (lsm->imm == NULL || !lsm->bgstatus.ok) {
+            pthread_cond_wait(&lsm->work, &lsm->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&lsm->mutex);
+        status_t s = flushimm(lsm);
+        pthread_mutex_lock(&lsm->mutex);
+        if (!s.ok && lsm->bgstatus.ok) {
+            lsm->bgstatus = s;
+            pthread_cond_broadcast(&lsm->done);
+        }
+    }
+    pthread_mutex_unlock(&lsm->mutex);
+    return NULL;
+}
+
+static void* compactloop(void* arg) {
+    lsm_t* lsm = (lsm_t*)arg;
+
+    pthread_mutex_lock(&lsm->mutex);
+    while (!lsm->stop) {
+        size_t from = 0;
+        if (!lsm->bgstatus.ok || lsm->compacting || pickrun(lsm, &from) == 0) {
+            pthread_cond_wait(&lsm->work, &lsm->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&lsm->mutex);
+        status_t s = compact(lsm, 0);
+        pthread_mutex_lock(&lsm->mutex);
+        if (!s.ok && lsm->bgstatus.ok) {
+            lsm->bgstatus = s;
+            pthread_cond_broadcast(&lsm->done);
+        }
+    }
+    pthread_mutex_unlock(&lsm->mutex);
+    return NULL;
+}
+
+static void freelsm(lsm_t* lsm) {
+    if (lsm->threads) {
+        pthread_mutex_lock(&lsm->mutex);
+        lsm->stop = 1;
+        pthread_cond_broadcast(&lsm->work);
+        pthread_mutex_unlock(&lsm->mutex);
+        pthread_join(lsm->flusher, NULL);
+        pthread_join(lsm->compactor, NULL);
+    }
+    if (lsm->mem != NULL) {
+        sl_close(lsm->mem);
+    }
+    if (lsm->imm != NULL) {
+        sl_close(lsm->imm);
+    }
+    for (size_t i = 0; i < lsm->ntables; ++i) {
+        sst_close(lsm->tables[i]);
+    }
+    free(lsm->tables);
+    pthread_rwlock_destroy(&lsm->lock);
+    pthread_mutex_destroy(&lsm->mutex);
+    pthread_cond_destroy(&lsm->work);
+    pthread_cond_destroy(&lsm->done);
+    free(lsm->prefix);
+    free(lsm);
+}
+
+status_t lsm_open(const char* prefix, const lsm_options_t* opts, lsm_t** lsm) {
+    status_t _status = { .ok = 1 };
+    lsmmanifest_t* m = NULL;
+
+    if (prefix == NULL || opts == NULL || lsm == NULL) {
+        return statusnotok0(_status, "prefix, opts or lsm is NULL");
+    }
+    if (opts->sl.shared || opts->sl.keytype == SL_KEY_CUSTOM) {
+        return statusnotok0(_status, "lsm mode does not support shared or SL_KEY_CUSTOM");
+    }
+    if (opts->flushsize == 0 || opts->blocksize == 0 || opts->maxtables < 1) {
+        return statusnotok0(_status, "flushsize, blocksize and maxtables must be positive");
+    }
+    *lsm = (lsm_t*)calloc(1, sizeof(lsm_t));
+    if (*lsm == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    lsm_t* l = *lsm;
+    pthread_rwlock_init(&l->lock, NULL);
+    pthread_mutex_init(&l->mutex, NULL);
+    pthread_cond_init(&l->work, NULL);
+    pthread_cond_init(&l->done, NULL);
+    l->opts = *opts;
+    l->prefix = strdup(prefix);
+    l->bgstatus.ok = 1;
+
+    _status = readmanifest(l, &m);
+    if (!_status.ok) {
+        goto failed;
+    }
+    if (m == NULL) {
+        l->nextid = 1;
+        l->memid = l->nextid++;
+    } else {
+        l->nextid = m->nextid;
+        l->memid = m->memid;
+        l->immid = l->opts.sl.inmemory ? 0 : m->immid;
+        l->tables = (sst_t**)calloc(m->ntables + 1, sizeof(sst_t*));
+        for (; l->tables != NULL && l->ntables < m->ntables; ++l->ntables) {
+            char* name = filename(l, m->ids[l->ntables], ".sst");
+            _status = sst_open(name, m->ids[l->ntables], &l->tables[l->ntables]);
+            free(name);
+            if (!_status.ok) {
+                goto failed;
+            }
+        }
+    }
+    _status = openmem(l, l->memid, &l->mem);
+    if (_status.ok && l->immid != 0) {
+        _status = openmem(l, l->immid, &l->imm);
+    }
+    if (_status.ok) {
+        _status = writemanifest(l, l->memid, l->immid, l->tables, l->ntables);
+    }
+    if (!_status.ok) {
+        goto failed;
+    }
+    free(m);
+    pthread_create(&l->flusher, NULL, flushloop, l);
+    pthread_create(&l->compactor, NULL, compactloop, l);
+    l->threads = 1;
+    return _status;
+
+failed:
+    free(m);
+    freelsm(l);
+    *lsm = NULL;
+    return _status;
+}
+
+// 没有冻结的memtable和表时删除不需要留下删除标记
+static status_t apply(lsm_t* lsm, const void* key, size_t key_len, uint64_t value, int isdel) {
+    status_t _status = { .ok = 1 };
+
+    while (1) {
+        pthread_rwlock_rdlock(&lsm->lock);
+        skiplist_t* mem = lsm->mem;
+        memput_t p = { .sl = mem, .value = isdel ? SL_LSM_TOMBSTONE : value, .size = 0 };
+        if (isdel && lsm->imm == NULL && lsm->ntables == 0) {
+            _status = sl_del(mem, key, key_len);
+        } else {
+            _status = sl_merge(mem, key, key_len, memput, &p);
+        }
+        int full = !_status.ok && _status.type == STATUS_SKIPLIST_FULL && mem->meta->count > 0;
+        int over = _status.ok && p.size >= lsm->opts.flushsize;
+        pthread_rwlock_unlock(&lsm->lock);
+        if (!full && !over) {
+            return _status;
+        }
+        status_t s = freeze(lsm, mem);
+        if (!s.ok) {
+            return s;
+        }
+        if (!full) {
+            return _status;
+        }
+    }
+}
+
+status_t lsm_put(lsm_t* lsm, const void* key, size_t key_len, uint64_t value) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL || key == NULL) {
+        return statusnotok0(_status, "lsm or key is NULL");
+    }
+    if (value == SL_LSM_TOMBSTONE) {
+        return statusnotok0(_status, "value SL_LSM_TOMBSTONE is reserved");
+    }
+    return apply(lsm, key, key_len, value, 0);
+}
+
+status_t lsm_del(lsm_t* lsm, const void* key, size_t key_len) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL || key == NULL) {
+        return statusnotok0(_status, "lsm or key is NULL");
+    }
+    return apply(lsm, key, key_len, 0, 1);
+}
+
+status_t lsm_get(lsm_t* lsm, const void* key, size_t key_len, uint64_t* value, int* found) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL || key == NULL || value == NULL || found == NULL) {
+        return statusnotok0(_status, "lsm, key, value or found is NULL");
+    }
+    *found = 0;
+    pthread_rwlock_rdlock(&lsm->lock);
+    _status = memget(lsm->mem, key, key_len, value, found);
+    if (_status.ok && !*found && lsm->imm != NULL) {
+        _status = memget(lsm->imm, key, key_len, value, found);
+    }
+    for (size_t i = 0; _status.ok && !*found && i < lsm->ntables; ++i) {
+        _status = sst_get(lsm->tables[i], key, key_len, value, found);
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+    if (*found && *value == SL_LSM_TOMBSTONE) {
+        *found = 0;
+    }
+    return _status;
+}
+
+status_t lsm_scan(lsm_t* lsm, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg) {
+    status_t _status = { .ok = 1 };
+    size_t opened = 0;
+
+    if (lsm == NULL || cb == NULL) {
+        return statusnotok0(_status, "lsm or cb is NULL");
+    }
+    pthread_rwlock_rdlock(&lsm->lock);
+    size_t n = 1 + (lsm->imm != NULL) + lsm->ntables;
+    source_t* srcs = (source_t*)calloc(n, sizeof(source_t));
+    if (srcs == NULL) {
+        pthread_rwlock_unlock(&lsm->lock);
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    _status = srcseek(&srcs[opened++], lsm->mem, NULL, lo, lo_len);
+    if (_status.ok && lsm->imm != NULL) {
+        _status = srcseek(&srcs[opened++], lsm->imm, NULL, lo, lo_len);
+    }
+    for (size_t i = 0; _status.ok && i < lsm->ntables; ++i) {
+        _status = srcseek(&srcs[opened++], NULL, lsm->tables[i], lo, lo_len);
+    }
+    if (_status.ok) {
+        _status = merge(srcs, n, hi, hi_len, 0, cb, arg);
+    }
+    for (size_t i = 0; i < opened; ++i) {
+        srcclose(&srcs[i]);
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+    free(srcs);
+    return _status;
+}
+
+status_t lsm_flush(lsm_t* lsm) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL) {
+        return statusnotok0(_status, "lsm is NULL");
+    }
+    pthread_rwlock_rdlock(&lsm->lock);
+    skiplist_t* mem = lsm->mem;
+    int empty = mem->meta->count == 0;
+    pthread_rwlock_unlock(&lsm->lock);
+    if (!empty) {
+        _status = freeze(lsm, mem);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    pthread_mutex_lock(&lsm->mutex);
+    while (lsm->imm != NULL && lsm->bgstatus.ok) {
+        pthread_cond_wait(&lsm->done, &lsm->mutex);
+    }
+    _status = lsm->bgstatus;
+    pthread_mutex_unlock(&lsm->mutex);
+    return _status;
+}
+
+status_t lsm_compact(lsm_t* lsm) {
+    status_t _status = lsm_flush(lsm);
+
+    if (!_status.ok) {
+        return _status;
+    }
+    return compact(lsm, 1);
+}
+
+status_t lsm_info(lsm_t* lsm, lsm_info_t* info) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL || info == NULL) {
+        return statusnotok0(_status, "lsm or info is NULL");
+    }
+    memset(info, 0, sizeof(lsm_info_t));
+    pthread_rwlock_rdlock(&lsm->lock);
+    info->memkeys = lsm->mem->meta->count + (lsm->imm != NULL ? lsm->imm->meta->count : 0);
+    info->tables = lsm->ntables;
+    for (size_t i = 0; i < lsm->ntables; ++i) {
+        info->tablekeys += lsm->tables[i]->count;
+        info->tablebytes += lsm->tables[i]->size;
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+    pthread_mutex_lock(&lsm->mutex);
+    info->flushes = lsm->flushes;
+    info->compactions = lsm->compactions;
+    pthread_mutex_unlock(&lsm->mutex);
+    return _status;
+}
+
+status_t lsm_sync(lsm_t* lsm) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL) {
+        return statusnotok0(_status, "lsm is NULL");
+    }
+    pthread_rwlock_rdlock(&lsm->lock);
+    _status = sl_sync(lsm->mem);
+    if (_status.ok && lsm->imm != NULL) {
+        _status = sl_sync(lsm->imm);
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+    return _status;
+}
+
+status_t lsm_close(lsm_t* lsm) {
+    status_t _status = { .ok = 1 };
+
+    if (lsm == NULL) {
+        return statusnotok0(_status, "lsm is NULL");
+    }
+    if (lsm->opts.sl.inmemory) {
+        _status = lsm_flush(lsm);
+    }
+    freelsm(lsm);
+    return _status;
+}
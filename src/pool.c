@@ -0,0 +1,779 @@
+#define _GNU_SOURCE
+#include "internal.h"
+#include <errno.h>
+#include <sys/uio.h>
+
+// 数据文件的缓冲池(sl_options_t.poolsize)：不映射数据文件，按POOL_PAGESIZE的页pread/pwrite到固定数量的帧，
+// CLOCK替换。页按hash分到最多POOL_PARTS个分区，每个分区有自己的锁、hash桶、帧和CLOCK指针，访问不同分区的页互不竞争。
+// sl_get_datanode返回帧内的指针并pin住该帧，pin记在线程的列表里，线程释放锁时(sl_unlock)
+// 或最外层read guard结束时统一解除；一次操作(或guard)内同一页只pin一次，跨页的datanode复制到堆上，同一个也只复制一次。
+// 写操作(持有写锁)修改帧并标记为脏，释放锁时按弄脏的顺序写回(头部所在的页通常最后)，
+// 因此写锁之外的文件内容和映射模式下的页缓存一样是完整的操作结果。
+// 分区的帧都被pin住时绕过缓冲池直接读写文件(bypass)，不会失败但失去缓存。
+// 元数据文件仍然映射：它不扩容，大小(metasize)已经是内存上限
+
+#define POOL_NOPAGE UINT64_MAX
+#define POOL_MINFRAMES 64 // 帧数下限，也是每个分区的帧数下限
+#define POOL_PARTS 16
+#define POOL_COPYKEY (1ULL << 63) // pin的key：帧为页号，跨页datanode的副本为位置 | POOL_COPYKEY
+
+typedef struct poolframe_s {
+    uint64_t page;   // 页号，POOL_NOPAGE为空闲
+    int32_t next;    // 同一个hash桶的下一个帧
+    uint32_t pins;
+    uint8_t ref;     // CLOCK引用位
+    uint8_t dirty;   // 只由持有写锁的线程设置和写回
+    uint8_t loading; // 正在读入，其他线程等待
+    uint8_t part;    // 所属分区
+} poolframe_t;
+
+typedef struct poolpart_s {
+    pthread_mutex_t mutex; // 保护本分区的hash、帧状态、CLOCK指针和计数
+    pthread_cond_t cond;   // 读入完成
+    uint32_t first;        // 本分区的帧为[first, first + nframes)
+    uint32_t nframes;
+    uint32_t hand;         // CLOCK指针
+    uint32_t mask;         // hash桶数 - 1
+    int32_t* buckets;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t readaheads;
+    uint64_t bypasses;
+} poolpart_t;
+
+typedef struct bufpool_s {
+    int fd;
+    int direct;
+    uint32_t nframes;
+    uint32_t nparts;       // 2的幂
+    poolpart_t* parts;
+    poolframe_t* frames;
+    char* mem;             // nframes * POOL_PAGESIZE，按页对齐(O_DIRECT要求)
+    skipdata_t header;     // 数据文件头部，sl->data指向这里
+    skipdata_t written;    // 最后写回的头部
+    int ioerr;             // 绕过缓冲池的写入失败时的errno，下一次释放时返回
+    uint64_t writebacks;
+} bufpool_t;
+
+// 线程持有的pin：frame为-1时是跨页datanode的堆副本；副本被写入覆盖后key改为POOL_NOPAGE，不再被找到
+typedef struct poolpin_s {
+    bufpool_t* pool;
+    uint64_t key;
+    int32_t frame;
+    void* copy;
+} poolpin_t;
+
+// 本次操作弄脏的帧，释放时按顺序写回
+typedef struct pooldirty_s {
+    bufpool_t* pool;
+    int32_t frame;
+} pooldirty_t;
+
+static __thread poolpin_t* pins = NULL;
+static __thread size_t npins = 0;
+static __thread size_t pincap = 0;
+static __thread int32_t* pinslots = NULL; // 按(pool, key)开放寻址的pins下标，-1为空
+static __thread size_t nslots = 0;
+static __thread size_t ncopies = 0;       // pins中副本的个数，没有时写入不必检查副本
+static __thread pooldirty_t* dirties = NULL;
+static __thread size_t ndirty = 0;
+static __thread size_t dirtycap = 0;
+static __thread int guarddepth = 0; // 线程内read guard的嵌套数，非0时不解除pin
+static pthread_key_t pinkey;          // 线程退出时释放pin列表
+static pthread_once_t pinonce = PTHREAD_ONCE_INIT;
+
+static void freepins(void* unused) {
+    free(pins);
+    free(pinslots);
+    free(dirties);
+    pins = NULL;
+    pinslots = NULL;
+    dirties = NULL;
+    npins = pincap = nslots = ncopies = ndirty = dirtycap = 0;
+}
+
+static void makekey() {
+    pthread_key_create(&pinkey, freepins);
+}
+
+// 第一次分配时登记，线程退出时由freepins释放
+static void registerthread() {
+    pthread_once(&pinonce, makekey);
+    pthread_setspecific(pinkey, (void*)1);
+}
+
+#define FRAME(pool, i) ((pool)->mem + (uint64_t)(i) * POOL_PAGESIZE)
+// 绕过缓冲池读写时的页缓冲：在栈上按页对齐(O_DIRECT要求)，读写路径不分配内存，也就不会因内存不足失败
+#define BOUNCEPAGE(name) char name[POOL_PAGESIZE] __attribute__((aligned(POOL_PAGESIZE)))
+#define FRAMEPART(pool, i) (&(pool)->parts[(pool)->frames[i].part])
+
+static inline uint64_t pagehash(uint64_t page) {
+    return page * 0x9e3779b97f4a7c15ULL;
+}
+
+// 高位选分区，中间的位选桶
+static inline poolpart_t* partof(bufpool_t* pool, uint64_t page) {
+    return &pool->parts[(pagehash(page) >> 60) & (pool->nparts - 1)];
+}
+
+static inline uint32_t bucketof(poolpart_t* part, uint64_t page) {
+    return (uint32_t)(pagehash(page) >> 32) & part->mask;
+}
+
+static inline size_t slotof(bufpool_t* pool, uint64_t key) {
+    return (size_t)(pagehash(key ^ ((uintptr_t)pool >> 4)) >> 32) & (nslots - 1);
+}
+
+static void addslot(size_t k) {
+    size_t s = slotof(pins[k].pool, pins[k].key);
+
+    while (pinslots[s] >= 0) {
+        s = (s + 1) & (nslots - 1);
+    }
+    pinslots[s] = (int32_t)k;
+}
+
+static void rehash() {
+    if (nslots == 0) {
+        return;
+    }
+    memset(pinslots, 0xff, sizeof(int32_t) * nslots);
+    for (size_t k = 0; k < npins; ++k) {
+        addslot(k);
+    }
+}
+
+// 本线程在pool上key的pin的下标，没有时返回-1
+static int32_t findpin(bufpool_t* pool, uint64_t key) {
+    if (npins == 0) {
+        return -1;
+    }
+    for (size_t s = slotof(pool, key); pinslots[s] >= 0; s = (s + 1) & (nslots - 1)) {
+        poolpin_t* p = &pins[pinslots[s]];
+        if (p->key == key && p->pool == pool) {
+            return pinslots[s];
+        }
+    }
+    return -1;
+}
+
+static void addpin(bufpool_t* pool, uint64_t key, int32_t frame, void* copy) {
+    if (npins == pincap) {
+        pincap = pincap == 0 ? 64 : pincap * 2;
+        pins = (poolpin_t*)realloc(pins, sizeof(poolpin_t) * pincap);
+        registerthread();
+    }
+    pins[npins].pool = pool;
+    pins[npins].key = key;
+    pins[npins].frame = frame;
+    pins[npins].copy = copy;
+    ++npins;
+    ncopies += frame < 0;
+    if (npins * 2 > nslots) { // 装载率不超过1/2
+        nslots = nslots == 0 ? 128 : nslots * 2;
+        pinslots = (int32_t*)realloc(pinslots, sizeof(int32_t) * nslots);
+        rehash();
+    } else {
+        addslot(npins - 1);
+    }
+}
+
+static void adddirty(bufpool_t* pool, int32_t frame) {
+    if (ndirty == dirtycap) {
+        dirtycap = dirtycap == 0 ? 64 : dirtycap * 2;
+        dirties = (pooldirty_t*)realloc(dirties, sizeof(pooldirty_t) * dirtycap);
+        registerthread();
+    }
+    dirties[ndirty].pool = pool;
+    dirties[ndirty].frame = frame;
+    ++ndirty;
+}
+
+// 读错误和映射模式下的SIGBUS一样无法恢复
+static void readpage(bufpool_t* pool, uint64_t page, char* buf) {
+    size_t done = 0;
+
+    while (done < POOL_PAGESIZE) {
+        ssize_t n = pread(pool->fd, buf + done, POOL_PAGESIZE - done, page * POOL_PAGESIZE + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "skiplist: pread(page %lu): %s\n", page, strerror(errno));
+            abort();
+        }
+        if (n == 0) { // 文件末尾
+            memset(buf + done, 0, POOL_PAGESIZE - done);
+            break;
+        }
+        done += n;
+    }
+}
+
+static int writepage(bufpool_t* pool, uint64_t page, const char* buf) {
+    size_t done = 0;
+
+    while (done < POOL_PAGESIZE) {
+        ssize_t n = pwrite(pool->fd, buf + done, POOL_PAGESIZE - done, page * POOL_PAGESIZE + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? errno : EIO;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// 持有分区的mutex：CLOCK选一个未pin的帧，转两圈都没有时返回-1
+static int32_t victim(bufpool_t* pool, poolpart_t* part) {
+    for (uint64_t n = 0; n < 2 * (uint64_t)part->nframes; ++n) {
+        uint32_t i = part->hand;
+        poolframe_t* f = &pool->frames[i];
+        part->hand = i + 1 == part->first + part->nframes ? part->first : i + 1;
+        if (f->pins > 0) {
+            continue;
+        }
+        if (f->ref) {
+            f->ref = 0;
+            continue;
+        }
+        return (int32_t)i;
+    }
+    return -1;
+}
+
+// 持有分区的mutex
+static void unhash(bufpool_t* pool, poolpart_t* part, int32_t i) {
+    int32_t* p = &part->buckets[bucketof(part, pool->frames[i].page)];
+
+    while (*p != i) {
+        p = &pool->frames[*p].next;
+    }
+    *p = pool->frames[i].next;
+}
+
+// 持有分区的mutex
+static int32_t lookup(bufpool_t* pool, poolpart_t* part, uint64_t page) {
+    for (int32_t i = part->buckets[bucketof(part, page)]; i >= 0; i = pool->frames[i].next) {
+        if (pool->frames[i].page == page) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 持有分区的mutex：把帧i换成page并pin住，标记为读入中
+static void claim(bufpool_t* pool, poolpart_t* part, int32_t i, uint64_t page) {
+    poolframe_t* f = &pool->frames[i];
+    uint32_t b = bucketof(part, page);
+
+    if (f->page != POOL_NOPAGE) {
+        unhash(pool, part, i);
+        ++part->evictions;
+    }
+    f->page = page;
+    f->pins = 1;
+    f->ref = 1;
+    f->loading = 1;
+    f->next = part->buckets[b];
+    part->buckets[b] = i;
+}
+
+static void loaded(bufpool_t* pool, int32_t i) {
+    poolpart_t* part = FRAMEPART(pool, i);
+
+    pthread_mutex_lock(&part->mutex);
+    pool->frames[i].loading = 0;
+    pthread_cond_broadcast(&part->cond);
+    pthread_mutex_unlock(&part->mutex);
+}
+
+// 返回pin住的帧，没有可替换的帧时返回-1。fresh表示页内没有已使用的字节，不需要读入
+static int32_t fetch(bufpool_t* pool, uint64_t page, int fresh) {
+    poolpart_t* part = partof(pool, page);
+
+    pthread_mutex_lock(&part->mutex);
+    int32_t i = lookup(pool, part, page);
+    if (i >= 0) {
+        poolframe_t* f = &pool->frames[i];
+        ++f->pins;
+        f->ref = 1;
+        ++part->hits;
+        while (f->loading) {
+            pthread_cond_wait(&part->cond, &part->mutex);
+        }
+        pthread_mutex_unlock(&part->mutex);
+        return i;
+    }
+    ++part->misses;
+    if ((i = victim(pool, part)) < 0) {
+        ++part->bypasses;
+        pthread_mutex_unlock(&part->mutex);
+        return -1;
+    }
+    claim(pool, part, i, page);
+    pthread_mutex_unlock(&part->mutex);
+    if (fresh) {
+        memset(FRAME(pool, i), 0, POOL_PAGESIZE);
+    } else {
+        readpage(pool, page, FRAME(pool, i));
+    }
+    loaded(pool, i);
+    return i;
+}
+
+// 本线程已pin住page时直接返回它的帧，否则fetch并记录pin；没有可替换的帧时返回-1
+static int32_t pinpage(bufpool_t* pool, uint64_t page, int fresh) {
+    int32_t k = findpin(pool, page);
+
+    if (k >= 0) {
+        return pins[k].frame;
+    }
+    int32_t i = fetch(pool, page, fresh);
+    if (i >= 0) {
+        addpin(pool, page, i, NULL);
+    }
+    return i;
+}
+
+static void unpin(bufpool_t* pool, int32_t i) {
+    poolpart_t* part = FRAMEPART(pool, i);
+
+    pthread_mutex_lock(&part->mutex);
+    --pool->frames[i].pins;
+    pthread_mutex_unlock(&part->mutex);
+}
+
+// 复制[offset, offset + len)，不保留新的pin
+static void copyout(bufpool_t* pool, uint64_t offset, void* buf, size_t len) {
+    while (len > 0) {
+        uint64_t page = offset / POOL_PAGESIZE;
+        size_t in = offset % POOL_PAGESIZE;
+        size_t n = len < POOL_PAGESIZE - in ? len : POOL_PAGESIZE - in;
+        int32_t k = findpin(pool, page);
+        int32_t i = k >= 0 ? pins[k].frame : fetch(pool, page, 0);
+        if (i >= 0) {
+            memcpy(buf, FRAME(pool, i) + in, n);
+            if (k < 0) {
+                unpin(pool, i);
+            }
+        } else {
+            BOUNCEPAGE(b);
+            readpage(pool, page, b);
+            memcpy(buf, b + in, n);
+        }
+        buf = (char*)buf + n;
+        offset += n;
+        len -= n;
+    }
+}
+
+datanode_t* sl_pool_datanode(skiplist_t* sl, uint64_t offset) {
+    bufpool_t* pool = sl->pool;
+    size_t in = offset % POOL_PAGESIZE;
+    datanode_t head;
+
+    if (in + sizeof(datanode_t) <= POOL_PAGESIZE) {
+        int32_t i = pinpage(pool, offset / POOL_PAGESIZE, 0);
+        if (i >= 0) {
+            datanode_t* dnode = (datanode_t*)(FRAME(pool, i) + in);
+            if (in + DATANODESIZE(dnode) <= POOL_PAGESIZE) {
+                return dnode;
+            }
+        }
+    }
+    // 跨页或没有可替换的帧
+    int32_t k = findpin(pool, offset | POOL_COPYKEY);
+    if (k >= 0) {
+        return (datanode_t*)pins[k].copy;
+    }
+    copyout(pool, offset, &head, sizeof(datanode_t));
+    datanode_t* copy = (datanode_t*)malloc(DATANODESIZE(&head));
+    memcpy(copy, &head, sizeof(datanode_t));
+    copyout(pool, offset + sizeof(datanode_t), copy->data, head.size);
+    addpin(pool, offset | POOL_COPYKEY, -1, copy);
+    return copy;
+}
+
+datanode_t* sl_pool_trydatanode(skiplist_t* sl, uint64_t offset) {
+    bufpool_t* pool = sl->pool;
+    uint64_t page = offset / POOL_PAGESIZE;
+    size_t in = offset % POOL_PAGESIZE;
+
+    if (in + sizeof(datanode_t) > POOL_PAGESIZE) {
+        return NULL;
+    }
+    int32_t i = -1;
+    int32_t k = findpin(pool, page);
+    if (k >= 0) {
+        i = pins[k].frame;
+    } else {
+        poolpart_t* part = partof(pool, page);
+        pthread_mutex_lock(&part->mutex);
+        i = lookup(pool, part, page);
+        if (i < 0 || pool->frames[i].loading) {
+            pthread_mutex_unlock(&part->mutex);
+            return NULL;
+        }
+        ++pool->frames[i].pins;
+        pool->frames[i].ref = 1;
+        ++part->hits;
+        pthread_mutex_unlock(&part->mutex);
+        addpin(pool, page, i, NULL);
+    }
+    datanode_t* dnode = (datanode_t*)(FRAME(pool, i) + in);
+    return in + DATANODESIZE(dnode) <= POOL_PAGESIZE ? dnode : NULL;
+}
+
+// 本线程被[offset, offset + len)覆盖的datanode副本不再复用(已返回的指针到解除pin前仍然有效)
+static void dropcopies(bufpool_t* pool, uint64_t offset, size_t len) {
+    for (size_t k = 0; k < npins && ncopies > 0; ++k) {
+        poolpin_t* p = &pins[k];
+        if (p->frame >= 0 || p->pool != pool || p->key == POOL_NOPAGE) {
+            continue;
+        }
+        uint64_t at = p->key & ~POOL_COPYKEY;
+        if (at < offset + len && offset < at + DATANODESIZE((datanode_t*)p->copy)) {
+            p->key = POOL_NOPAGE;
+        }
+    }
+}
+
+void sl_pool_write(skiplist_t* sl, uint64_t offset, const void* buf, size_t len) {
+    bufpool_t* pool = sl->pool;
+    uint64_t used = pool->header.mapsize + 1; // 之后的字节还没有使用过
+
+    if (ncopies > 0) {
+        dropcopies(pool, offset, len);
+    }
+    while (len > 0) {
+        uint64_t page = offset / POOL_PAGESIZE;
+        size_t in = offset % POOL_PAGESIZE;
+        size_t n = len < POOL_PAGESIZE - in ? len : POOL_PAGESIZE - in;
+        int fresh = page * POOL_PAGESIZE >= used;
+        int32_t i = pinpage(pool, page, fresh);
+        if (i >= 0) {
+            memcpy(FRAME(pool, i) + in, buf, n);
+            if (!pool->frames[i].dirty) {
+                pool->frames[i].dirty = 1;
+                adddirty(pool, i);
+            }
+        } else {
+            BOUNCEPAGE(b);
+            if (fresh) {
+                memset(b, 0, POOL_PAGESIZE);
+            } else {
+                readpage(pool, page, b);
+            }
+            memcpy(b + in, buf, n);
+            int err = writepage(pool, page, b);
+            if (err != 0) {
+                pool->ioerr = err;
+            }
+        }
+        buf = (const char*)buf + n;
+        offset += n;
+        len -= n;
+    }
+}
+
+// 预读offsets所在的页：缓冲I/O时对不在池中的页发posix_fadvise(WILLNEED)，由内核异步读入页缓存；
+// O_DIRECT时把连续的缺失页领取到帧里(各自分区)，一次preadv读入
+void sl_pool_readahead(skiplist_t* sl, const uint64_t offsets[], size_t n) {
+    bufpool_t* pool = sl->pool;
+    uint64_t pages[POOL_READAHEAD];
+    size_t m = 0;
+
+    for (size_t k = 0; k < n && m < POOL_READAHEAD; ++k) {
+        pages[m++] = offsets[k] / POOL_PAGESIZE;
+    }
+    for (size_t a = 1; a < m; ++a) { // 插入排序，m很小
+        uint64_t p = pages[a];
+        size_t b = a;
+        for (; b > 0 && pages[b - 1] > p; --b) {
+            pages[b] = pages[b - 1];
+        }
+        pages[b] = p;
+    }
+    size_t k = 0;
+    while (k < m) {
+        struct iovec iov[POOL_READAHEAD];
+        int32_t claimed[POOL_READAHEAD];
+        size_t run = 0;
+        uint64_t first = pages[k];
+        for (; k < m; ++k) {
+            if (k > 0 && pages[k] == pages[k - 1]) {
+                continue;
+            }
+            if (run > 0 && pages[k] != first + run) {
+                break;
+            }
+            poolpart_t* part = partof(pool, pages[k]);
+            int32_t i = 0;
+            pthread_mutex_lock(&part->mutex);
+            int present = lookup(pool, part, pages[k]) >= 0;
+            if (!present && pool->direct && (i = victim(pool, part)) >= 0) {
+                claim(pool, part, i, pages[k]);
+            }
+            part->readaheads += !present && i >= 0;
+            pthread_mutex_unlock(&part->mutex);
+            if (present) {
+                if (run > 0) {
+                    break;
+                }
+                continue;
+            }
+            if (i < 0) {
+                k = m;
+                break;
+            }
+            if (run == 0) {
+                first = pages[k];
+            }
+            if (pool->direct) {
+                claimed[run] = i;
+                iov[run].iov_base = FRAME(pool, i);
+                iov[run].iov_len = POOL_PAGESIZE;
+            }
+            ++run;
+        }
+        if (run == 0) {
+            continue;
+        }
+        if (!pool->direct) {
+            posix_fadvise(pool->fd, first * POOL_PAGESIZE, run * POOL_PAGESIZE, POSIX_FADV_WILLNEED);
+            continue;
+        }
+        ssize_t got = preadv(pool->fd, iov, (int)run, first * POOL_PAGESIZE);
+        for (size_t r = 0; r < run; ++r) {
+            if (got < (ssize_t)((r + 1) * POOL_PAGESIZE)) { // 短读或失败时逐页读(文件末尾补0)
+                readpage(pool, first + r, FRAME(pool, claimed[r]));
+            }
+            loaded(pool, claimed[r]);
+            unpin(pool, claimed[r]);
+        }
+    }
+}
+
+// 去掉本线程在pool上的pin和脏帧记录；unpin为0时pool即将关闭，只释放副本
+static void droppins(bufpool_t* pool, int unpin) {
+    poolpart_t* locked = NULL;
+    size_t kept = 0;
+
+    ncopies = 0;
+    for (size_t k = 0; k < npins; ++k) {
+        poolpin_t* p = &pins[k];
+        if (p->pool != pool) {
+            ncopies += p->frame < 0;
+            pins[kept++] = *p;
+        } else if (p->frame < 0) {
+            free(p->copy);
+        } else if (unpin) { // 相邻的pin多在同一分区，换分区时才换锁
+            poolpart_t* part = FRAMEPART(pool, p->frame);
+            if (part != locked) {
+                if (locked != NULL) {
+                    pthread_mutex_unlock(&locked->mutex);
+                }
+                pthread_mutex_lock(&part->mutex);
+                locked = part;
+            }
+            --pool->frames[p->frame].pins;
+        }
+    }
+    if (locked != NULL) {
+        pthread_mutex_unlock(&locked->mutex);
+    }
+    npins = kept;
+    if (npins == 0 && nslots > 1024) { // guard内累积的大列表不留到之后的每次操作
+        free(pins);
+        free(pinslots);
+        pins = NULL;
+        pinslots = NULL;
+        pincap = nslots = 0;
+    } else {
+        rehash();
+    }
+    kept = 0;
+    for (size_t k = 0; k < ndirty; ++k) {
+        if (dirties[k].pool != pool) {
+            dirties[kept++] = dirties[k];
+        }
+    }
+    ndirty = kept;
+}
+
+// 持有锁时调用(sl_unlock)：写回头部和脏页，不在read guard内时解除pin
+status_t sl_pool_release(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+    bufpool_t* pool = sl->pool;
+    int err = 0;
+
+    // 只有写锁的持有者会改动头部，读者比较时总是相等
+    if (memcmp(&pool->header, &pool->written, sizeof(skipdata_t)) != 0) {
+        pool->written = pool->header;
+        sl_pool_write(sl, 0, &pool->header, sizeof(skipdata_t));
+    }
+    // 按弄脏的顺序写回；脏帧都有本线程的pin。其他pool的脏帧要等它的持有者写回
+    size_t kept = 0;
+    for (size_t k = 0; k < ndirty; ++k) {
+        if (dirties[k].pool != pool) {
+            dirties[kept++] = dirties[k];
+            continue;
+        }
+        poolframe_t* f = &pool->frames[dirties[k].frame];
+        f->dirty = 0;
+        if ((err = writepage(pool, f->page, FRAME(pool, dirties[k].frame))) != 0 && pool->ioerr == 0) {
+            pool->ioerr = err;
+        }
+        __sync_fetch_and_add(&pool->writebacks, 1);
+    }
+    ndirty = kept;
+    if (pool->ioerr != 0) {
+        err = pool->ioerr;
+        pool->ioerr = 0;
+        _status = statusnotok2(_status, "pwrite(%d): %s", err, strerror(err));
+    }
+    if (guarddepth == 0 && npins > 0) {
+        droppins(pool, 1);
+    }
+    return _status;
+}
+
+// read guard开始/结束时调用，可能不持有锁，所以结束时只解除pin
+void sl_pool_guard(skiplist_t* sl, int delta) {
+    guarddepth += delta;
+    if (guarddepth == 0 && npins > 0) {
+        droppins(sl->pool, 1);
+    }
+}
+
+status_t sl_pool_open(skiplist_t* sl, uint64_t datacap, int isload, uint64_t poolsize, int direct) {
+    status_t _status = { .ok = 1 };
+    void* mem = NULL;
+    int err;
+
+    bufpool_t* pool = (bufpool_t*)calloc(1, sizeof(bufpool_t));
+    if (pool == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    pool->nframes = poolsize / POOL_PAGESIZE < POOL_MINFRAMES ? POOL_MINFRAMES : poolsize / POOL_PAGESIZE;
+    pool->direct = direct;
+    pool->fd = -1;
+    sl->pool = pool;
+    uint32_t nparts = 1; // 每个分区至少POOL_MINFRAMES个帧，分区太小时pin容易占满整个分区
+    while (nparts < POOL_PARTS && pool->nframes / (nparts * 2) >= POOL_MINFRAMES) {
+        nparts *= 2;
+    }
+    if ((pool->parts = (poolpart_t*)calloc(nparts, sizeof(poolpart_t))) == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    pool->nparts = nparts;
+    if ((err = posix_memalign(&mem, POOL_PAGESIZE, (size_t)pool->nframes * POOL_PAGESIZE)) != 0) {
+        return statusnotok2(_status, "posix_memalign(%d): %s", err, strerror(err));
+    }
+    pool->mem = (char*)mem;
+    pool->frames = (poolframe_t*)malloc(sizeof(poolframe_t) * pool->nframes);
+    if (pool->frames == NULL) {
+        return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    }
+    for (uint32_t p = 0; p < nparts; ++p) {
+        poolpart_t* part = &pool->parts[p];
+        pthread_mutex_init(&part->mutex, NULL);
+        pthread_cond_init(&part->cond, NULL);
+        part->first = pool->nframes / nparts * p;
+        part->nframes = p + 1 < nparts ? pool->nframes / nparts : pool->nframes - part->first;
+        part->hand = part->first;
+        uint32_t nbuckets = 1;
+        while (nbuckets < part->nframes * 2) {
+            nbuckets <<= 1;
+        }
+        part->mask = nbuckets - 1;
+        if ((part->buckets = (int32_t*)malloc(sizeof(int32_t) * nbuckets)) == NULL) {
+            return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+        }
+        memset(part->buckets, 0xff, sizeof(int32_t) * nbuckets);
+        for (uint32_t i = part->first; i < part->first + part->nframes; ++i) {
+            pool->frames[i] = (poolframe_t){ .page = POOL_NOPAGE, .next = -1, .part = (uint8_t)p };
+        }
+    }
+    if ((pool->fd = open(sl->dataname, O_RDWR | (direct ? O_DIRECT : 0))) < 0) {
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    if (isload) {
+        copyout(pool, 0, &pool->header, sizeof(skipdata_t));
+        pool->written = pool->header;
+    } else {
+        pool->header.mapsize = sizeof(skipdata_t);
+        pool->header.datafree = 0;
+    }
+    pool->header.mapcap = datacap;
+    sl->data = &pool->header;
+    sl->datacap = datacap;
+    return sl_pool_release(sl);
+}
+
+void sl_pool_close(skiplist_t* sl) {
+    bufpool_t* pool = sl->pool;
+
+    if (pool == NULL) {
+        return;
+    }
+    if (npins > 0 || ndirty > 0) { // 本线程遗留的pin(没有经过sl_unlock的调用)
+        droppins(pool, 0);
+    }
+    if (pool->fd >= 0) {
+        close(pool->fd);
+    }
+    for (uint32_t p = 0; p < pool->nparts; ++p) {
+        pthread_cond_destroy(&pool->parts[p].cond);
+        pthread_mutex_destroy(&pool->parts[p].mutex);
+        free(pool->parts[p].buckets);
+    }
+    free(pool->parts);
+    free(pool->mem);
+    free(pool->frames);
+    free(pool);
+    sl->pool = NULL;
+    sl->data = NULL;
+}
+
+// 头部和脏页在释放写锁时已经写回，这里只需落盘
+status_t sl_pool_sync(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    if (fdatasync(sl->pool->fd) != 0) {
+        return statusnotok2(_status, "fdatasync(%d): %s", errno, strerror(errno));
+    }
+    return _status;
+}
+
+status_t sl_pool_truncate(skiplist_t* sl, uint64_t newcap) {
+    status_t _status = { .ok = 1 };
+
+    if (ftruncate(sl->pool->fd, newcap) < 0) {
+        return statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
+    }
+    sl->datacap = newcap;
+    return _status;
+}
+
+void sl_pool_stats(skiplist_t* sl, sl_stats_t* stats) {
+    bufpool_t* pool = sl->pool;
+
+    stats->poolframes = pool->nframes;
+    stats->poolhits = stats->poolmisses = stats->poolevictions = stats->poolreadaheads = stats->poolbypasses = 0;
+    for (uint32_t p = 0; p < pool->nparts; ++p) {
+        poolpart_t* part = &pool->parts[p];
+        pthread_mutex_lock(&part->mutex);
+        stats->poolhits += part->hits;
+        stats->poolmisses += part->misses;
+        stats->poolevictions += part->evictions;
+        stats->poolreadaheads += part->readaheads;
+        stats->poolbypasses += part->bypasses;
+        pthread_mutex_unlock(&part->mutex);
+    }
+    stats->poolwritebacks = __atomic_load_n(&pool->writebacks, __ATOMIC_RELAXED);
+}
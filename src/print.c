@@ -1,4 +1,5 @@
 #include "print.h"
+#include "internal.h"
 
 static void printmetanode(FILE* stream, metanode_t* mnode, uint64_t pos) {
     if (mnode == NULL) {
@@ -28,12 +29,25 @@ static void printdatanode(FILE* stream, datanode_t* dnode) {
 
 static void printnode(skiplist_t* sl, FILE* stream, metanode_t* mnode, uint64_t pos) {
     printmetanode(stream, mnode, pos);
+    if (mnode->flag & METANODE_BLOCK) {
+        fprintf(stream, " entries = %ld\n", mnode->value);
+        for (uint64_t i = 0; i < mnode->value; ++i) {
+            fprintf(stream, "    value = %ld, ", BLOCKENTRIES(mnode)->values[i]);
+            printdatanode(stream, sl_get_datanode(sl, BLOCKENTRIES(mnode)->offsets[i]));
+        }
+        return;
+    }
     datanode_t* dnode = sl_get_datanode(sl, mnode->offset);
     printdatanode(stream, dnode);
 }
 
+static void printentry(skiplist_t* sl, FILE* stream, uint64_t offset, uint64_t value) {
+    datanode_t* dnode = sl_get_datanode(sl, offset);
+    write(fileno(stream), dnode->data, dnode->size);
+    fprintf(stream, ", %ld\n", value);
+}
+
 void sl_print(skiplist_t* sl, FILE* stream, int isprintnode) {
-    int lvlcnt[SKIPLIST_MAXLEVEL] = { 0 };
     metanode_t* curr = NULL;
     metanode_t* next = NULL;
 
@@ -45,20 +59,11 @@ void sl_print(skiplist_t* sl, FILE* stream, int isprintnode) {
             if (next == NULL) {
                 break;
             }
-            printnode(sl, stream, next, (uint64_t)((void*)next - sl->meta->mapped));
+            printnode(sl, stream, next, METANODEPOSITION(sl, next));
             curr = next;
         }
     }
     curr = METANODEHEAD(sl);
-    while (1) {
-        next = METANODE(sl, curr->forwards[0]);
-        if (next == NULL) {
-            break;
-        }
-        ++lvlcnt[next->level];
-        curr = next;
-    }
-    curr = METANODEHEAD(sl);
 
     // skiplist
     fprintf(stream, "\033[31m[ skiplist ]\033[0m\n");
@@ -69,7 +74,7 @@ void sl_print(skiplist_t* sl, FILE* stream, int isprintnode) {
     // skiplist->meta
     fprintf(stream, "\033[31m[ skiplist->meta ]\033[0m\n");
     for (int i = 0; i < curr->level; ++i) {
-        fprintf(stream, "[LEVEL %2d]: %d\n", i + 1, lvlcnt[i + 1]);
+        fprintf(stream, "[LEVEL %2d]: %ld\n", i + 1, sl->meta->levels[i + 1]);
     }
     fprintf(stream, "\033[34mcount = %d, p = %.2f, tail = %ld, mapsize = %ldB(%.2lfM), mapcap = %ldB(%.2lfM)\033[0m\n",
             sl->meta->count,
@@ -80,14 +85,14 @@ void sl_print(skiplist_t* sl, FILE* stream, int isprintnode) {
 
     // skiplist->metafree
     fprintf(stream, "\033[31m[ skiplist->metafree ]\033[0m\n");
-    for (int i = 0; i < SKIPLIST_MAXLEVEL; ++i) {
-        if (sl->metafree[i] != NULL) {
-            listnode_t* lnode = sl->metafree[i]->head;
-            while (lnode != NULL) {
-                printmetanode(stream, METANODE(sl, lnode->value), lnode->value);
-                fprintf(stream, "\n");
-                lnode = lnode->next;
-            }
+    fprintf(stream, "\033[34mmetafree = %ld nodes, %ldB\033[0m\n", sl->meta->metafreen, sl->meta->metafreebytes);
+    for (int i = 0; i <= SKIPLIST_MAXLEVEL; ++i) {
+        uint64_t offset = sl->meta->metafree[i];
+        while (offset != 0) {
+            metanode_t* mnode = METANODE(sl, offset);
+            printmetanode(stream, mnode, offset);
+            fprintf(stream, "\n");
+            offset = mnode->backward;
         }
     }
 
@@ -99,17 +104,16 @@ void sl_print(skiplist_t* sl, FILE* stream, int isprintnode) {
 
     // skiplist->metafree
     fprintf(stream, "\033[31m[ skiplist->datafree ]\033[0m\n");
-    if (sl->datafree != NULL) {
-        listnode_t* lnode = sl->datafree->head;
-        while (lnode != NULL) {
-            datanode_t* dnode = sl_get_datanode(sl, lnode->value);
-            fprintf(stream, "[\033[36m%8lu\033[0m]]: offset = %ld, size = %d, data = ",
-                    lnode->value,
-                    dnode->offset,
-                    dnode->size);
-            printdatanode(stream, dnode);
-            lnode = lnode->next;
-        }
+    fprintf(stream, "\033[34mdatafree = %ld nodes, %ldB\033[0m\n", sl->meta->datafreen, sl->meta->datafreebytes);
+    uint64_t offset = sl->data->datafree;
+    while (offset != 0) {
+        datanode_t* dnode = sl_get_datanode(sl, offset);
+        fprintf(stream, "[\033[36m%8lu\033[0m]]: next = %ld, size = %d, data = ",
+                offset,
+                dnode->offset,
+                dnode->size);
+        printdatanode(stream, dnode);
+        offset = dnode->offset;
     }
 }
 
@@ -125,6 +129,13 @@ void sl_print_keys(skiplist_t* sl, FILE* stream) {
         if (next == NULL) {
             break;
         }
+        if (next->flag & METANODE_BLOCK) {
+            for (uint64_t i = 0; i < next->value; ++i) {
+                printentry(sl, stream, BLOCKENTRIES(next)->offsets[i], BLOCKENTRIES(next)->values[i]);
+            }
+            curr = next;
+            continue;
+        }
         dnode = sl_get_datanode(sl, next->offset);
         write(fileno(stream), dnode->data, dnode->size);
         fprintf(stream, ", %ld\n", next->value);
@@ -137,14 +148,52 @@ void sl_print_rkeys(skiplist_t* sl, FILE* stream) {
     datanode_t* dnode = NULL;
 
     fprintf(stream, "\033[32m[ skiplist rkeys ]\033[0m\n");
+    if (sl->meta->format == SL_FORMAT_BLOCKED) { // 从最后一个块沿backward倒序
+        curr = METANODEHEAD(sl);
+        for (int level = (int)curr->level - 1; level >= 0; --level) {
+            while (curr->forwards[level] != 0) {
+                curr = METANODE(sl, curr->forwards[level]);
+            }
+        }
+        for (; curr != NULL && (curr->flag & METANODE_HEAD) != METANODE_HEAD; curr = METANODE(sl, curr->backward)) {
+            for (uint64_t i = curr->value; i > 0; --i) {
+                printentry(sl, stream, BLOCKENTRIES(curr)->offsets[i - 1], BLOCKENTRIES(curr)->values[i - 1]);
+            }
+        }
+        return;
+    }
     curr = METANODE(sl, sl->meta->tail);
     while (curr != NULL && (curr->flag & METANODE_HEAD) != METANODE_HEAD) {
         dnode = sl_get_datanode(sl, curr->offset);
         if (curr->value == 0) {
-            printnode(sl, stream, curr, (uint64_t)((void*)curr - sl->meta->mapped));
+            printnode(sl, stream, curr, METANODEPOSITION(sl, curr));
         }
         write(fileno(stream), dnode->data, dnode->size);
         fprintf(stream, ", %ld\n", curr->value);
         curr = METANODE(sl, curr->backward);
     }
 }
+
+static double percent(uint64_t n, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * n / total;
+}
+
+void sl_print_residency(const sl_residency_t* r, FILE* stream) {
+    fprintf(stream, "\033[31m[ residency ]\033[0m\n");
+    fprintf(stream, "\033[34mmeta %ld/%ld pages(%.1f%%), data %ld/%ld pages(%.1f%%), pagesize = %ld\033[0m\n",
+            r->metaresident, r->metapages, percent(r->metaresident, r->metapages),
+            r->dataresident, r->datapages, percent(r->dataresident, r->datapages),
+            r->pagesize);
+    for (int i = 0; i < SL_RESIDENCY_REGIONS; ++i) {
+        fprintf(stream, "[REGION %2d]: meta %5.1f%%, data %5.1f%%\n", i,
+                percent(r->metaregion[i][1], r->metaregion[i][0]),
+                percent(r->dataregion[i][1], r->dataregion[i][0]));
+    }
+    for (int i = SKIPLIST_MAXLEVEL - 1; i >= 0; --i) {
+        if (r->levelnodes[i] == 0) {
+            continue;
+        }
+        fprintf(stream, "[LEVEL %2d]: %ld/%ld nodes(%.1f%%)\n", i + 1,
+                r->levelresident[i], r->levelnodes[i], percent(r->levelresident[i], r->levelnodes[i]));
+    }
+}
@@ -0,0 +1,223 @@
+#include "internal.h"
+
+// 范围删除：两次查找得到lo、hi在每层的前驱，整段在O(level)内摘除，不逐个key下降。
+// 摘除前仍沿第0层走一遍范围内的k个节点，维护计数(删除数要返回)和上层/哈希/值索引，所以总体为O(log n + k)；
+// 索引的维护不能推迟到回收时，否则回收前经索引还能查到已删除的key。
+// 摘下的节点挂到头节点的待回收链表(经forwards[0]串联)，先回收RECLAIM_BATCH个，
+// 其余由之后的写操作每次回收RECLAIM_STEP个，元数据空间不足时全部回收；链表在文件中，重新打开后继续
+
+#define RECLAIM_BATCH 4096
+#define RANGE_LOOPEN (1ULL << 62) // 日志记录value：lo不限
+#define RANGE_HIOPEN (1ULL << 63) // 日志记录value：hi不限
+
+// 回收待回收链表上最多n个节点(块)，返回回收数
+uint64_t sl_reclaim(skiplist_t* sl, uint64_t n) {
+    uint64_t done = 0;
+
+    for (; done < n && RECLAIMHEAD(sl) != 0; ++done) {
+        metanode_t* mnode = METANODE(sl, RECLAIMHEAD(sl));
+        RECLAIMHEAD(sl) = mnode->forwards[0];
+        if ((mnode->flag & METANODE_BLOCK) == METANODE_BLOCK) {
+            for (uint32_t i = 0; i < mnode->value; ++i) {
+                sl_freedatanode(sl, BLOCKENTRIES(mnode)->offsets[i]);
+            }
+        } else {
+            sl_freedatanode(sl, mnode->offset);
+        }
+        sl_freemetanode(sl, mnode);
+    }
+    return done;
+}
+
+// 每层最后一个节点
+static void lastpath(skiplist_t* sl, metanode_t* update[]) {
+    metanode_t* curr = METANODEHEAD(sl);
+
+    for (int level = (int)curr->level - 1; level >= 0; --level) {
+        while (curr->forwards[level] != 0) {
+            curr = METANODE(sl, curr->forwards[level]);
+        }
+        update[level] = curr;
+    }
+}
+
+static uint64_t delrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len) {
+    metanode_t* head = METANODEHEAD(sl);
+    metanode_t* ulo[SKIPLIST_MAXLEVEL] = { NULL };
+    metanode_t* uhi[SKIPLIST_MAXLEVEL] = { NULL };
+    uint64_t removed = 0;
+    int iseq = 0;
+
+    if (lo != NULL) {
+        sl->keyops->findpath(sl, lo, lo_len, ulo, &iseq);
+    } else {
+        for (uint32_t i = 0; i < head->level; ++i) {
+            ulo[i] = head;
+        }
+    }
+    if (hi != NULL) {
+        sl->keyops->findpath(sl, hi, hi_len, uhi, &iseq);
+    } else {
+        lastpath(sl, uhi);
+    }
+    if (head->level == 0 || ulo[0] == uhi[0]) { // [lo, hi)内没有节点
+        return 0;
+    }
+    // 整段为ulo[0]之后到uhi[0]，先逐个维护计数和各索引(O(k)，只沿第0层前进)，再逐层摘除
+    metanode_t* first = METANODE(sl, ulo[0]->forwards[0]);
+    metanode_t* last = uhi[0];
+    for (metanode_t* curr = first;; curr = METANODE(sl, curr->forwards[0])) {
+        sl_upper_remove(sl, curr);
+        if (sl->hash != NULL) {
+            datanode_t* dnode = sl_get_datanode(sl, curr->offset);
+            sl_hash_remove(sl, dnode->data, dnode->size);
+        }
+        sl_vidx_remove(sl, curr);
+        ++removed;
+        if (curr == last) {
+            break;
+        }
+    }
+    for (uint32_t i = 0; i < head->level; ++i) {
+        if (ulo[i] != uhi[i]) { // 第i层有节点在范围内，uhi[i]是其中最后一个
+            ulo[i]->forwards[i] = uhi[i]->forwards[i];
+        }
+    }
+    metanode_t* next = METANODE(sl, last->forwards[0]);
+    if (next != NULL) {
+        next->backward = METANODEPOSITION(sl, ulo[0]);
+    } else {
+        sl->meta->tail = METANODEPOSITION(sl, ulo[0]);
+    }
+    while (head->level > 0 && head->forwards[head->level - 1] == 0) {
+        --head->level;
+    }
+    last->forwards[0] = RECLAIMHEAD(sl);
+    RECLAIMHEAD(sl) = METANODEPOSITION(sl, first);
+    sl->meta->count -= removed;
+    return removed;
+}
+
+// 日志记录：data为lo和hi拼接(分两段写入)，value低16位为lo的长度；总长由sl_del_range限制在UINT16_MAX内
+static status_t logrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len) {
+    struct iovec parts[2] = { { (void*)lo, lo_len }, { (void*)hi, hi_len } };
+    uint64_t value = lo != NULL ? lo_len : 0;
+
+    if (lo == NULL) {
+        value |= RANGE_LOOPEN;
+        parts[0].iov_len = 0;
+    }
+    if (hi == NULL) {
+        value |= RANGE_HIOPEN;
+        parts[1].iov_len = 0;
+    }
+    if (sl->log == NULL) {
+        return sl_logchange(sl, SL_OP_DELRANGE, NULL, 0, value);
+    }
+    return cl_appendv(sl->log, SL_OP_DELRANGE, parts, 2, value, &sl->meta->seq);
+}
+
+status_t sl_dodelrange(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, uint64_t* removed) {
+    status_t _status = { .ok = 1 };
+    uint64_t n = 0;
+
+    *removed = 0;
+    if (lo != NULL && hi != NULL && sl->keyops->cmp(sl, lo, lo_len, hi, hi_len) >= 0) {
+        return _status;
+    }
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        n = blk_delrange(sl, lo, lo_len, hi, hi_len);
+    } else {
+        n = delrange(sl, lo, lo_len, hi, hi_len);
+    }
+    if (n == 0) {
+        return _status;
+    }
+    *removed = n;
+    sl_reclaim(sl, RECLAIM_BATCH);
+    if (sl->bloom != NULL) {
+        sl_bloom_del(sl, n);
+    }
+    return logrange(sl, lo, lo_len, hi, hi_len);
+}
+
+// 应用SL_OP_DELRANGE日志记录
+status_t sl_applyrange(skiplist_t* sl, const void* data, size_t size, uint64_t value) {
+    status_t _status = { .ok = 1 };
+    size_t lo_len = value & 0xFFFF;
+    uint64_t removed = 0;
+
+    if (lo_len > size) {
+        return statusnotok2(_status, "range record lo_len(%ld) over size(%ld)", lo_len, size);
+    }
+    const void* lo = (value & RANGE_LOOPEN) ? NULL : data;
+    const void* hi = (value & RANGE_HIOPEN) ? NULL : data + lo_len;
+    return sl_dodelrange(sl, lo, lo_len, hi, size - lo_len, &removed);
+}
+
+status_t sl_del_range(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, uint64_t* removed) {
+    SL_OPSCOPE(SL_STAT_DELRANGE);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    uint64_t n = 0;
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (lo != NULL && !(_status = sl_checkkey(sl, lo_len)).ok) {
+        return _status;
+    }
+    if (hi != NULL && !(_status = sl_checkkey(sl, hi_len)).ok) {
+        return _status;
+    }
+    if ((lo != NULL ? lo_len : 0) + (hi != NULL ? hi_len : 0) > UINT16_MAX) { // 日志记录中lo和hi拼接，size为16位
+        return statusnotok2(_status, "lo_len + hi_len(%ld) over %d", lo_len + hi_len, UINT16_MAX);
+    }
+    SL_STATADD(sl, ops[SL_STAT_DELRANGE], 1);
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_dodelrange(sl, lo, lo_len, hi, hi_len, &n);
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    if (removed != NULL) {
+        *removed = n;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+// 前缀删除即[prefix, prefix的后继)：去掉末尾的0xFF后最后一个字节加1，全为0xFF时不限上界。
+// 定长key类型的两个边界补0到key长度
+status_t sl_del_prefix(skiplist_t* sl, const void* prefix, size_t prefix_len, uint64_t* removed) {
+    SL_OPSCOPE(SL_STAT_DELRANGE);
+    status_t _status = { .ok = 1 };
+    char lo[MAX_KEY_LEN];
+    char hi[MAX_KEY_LEN];
+
+    if (sl == NULL || prefix == NULL) {
+        return statusnotok0(_status, "skiplist or prefix is NULL");
+    }
+    if (sl->meta->keytype == SL_KEY_CUSTOM) {
+        return statusnotok0(_status, "prefix delete is not supported with SL_KEY_CUSTOM");
+    }
+    size_t keylen = sl->keyops->keylen != 0 ? sl->keyops->keylen : prefix_len;
+    if (prefix_len > keylen || prefix_len > MAX_KEY_LEN) {
+        return statusnotok2(_status, "prefix_len(%ld) over key length(%ld)", prefix_len, keylen);
+    }
+    memset(lo, 0, keylen);
+    memcpy(lo, prefix, prefix_len);
+    size_t n = prefix_len;
+    while (n > 0 && (unsigned char)lo[n - 1] == 0xFF) {
+        --n;
+    }
+    if (n == 0) {
+        return sl_del_range(sl, lo, keylen, NULL, 0, removed);
+    }
+    memset(hi, 0, keylen);
+    memcpy(hi, prefix, n);
+    hi[n - 1] = (char)((unsigned char)hi[n - 1] + 1);
+    return sl_del_range(sl, lo, keylen, hi, sl->keyops->keylen != 0 ? keylen : n, removed);
+}
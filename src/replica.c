@@ -0,0 +1,185 @@
+#include "internal.h"
+#include "replica.h"
+#include <errno.h>
+#include <poll.h>
+
+#define REPLICA_BUFF_SIZE (1024 * 1024)
+#define REPLICA_POLL_MS 10
+
+status_t sl_log_reader(skiplist_t* sl, uint64_t seq, clreader_t** r) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+
+    if (sl == NULL || sl->log == NULL) {
+        return statusnotok0(_status, "skiplist is NULL or changelog is disabled");
+    }
+    _status = cl_flush(sl->log);
+    if (!_status.ok) {
+        return _status;
+    }
+    return cl_reader_open(sl->log->name, seq, r);
+}
+
+static status_t readall(int fd, void* buff, size_t size) {
+    status_t _status = { .ok = 1 };
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = read(fd, buff + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "read(%d): %s", errno, strerror(errno));
+        }
+        if (n == 0) {
+            return statusnotok0(_status, "unexpected EOF");
+        }
+        done += n;
+    }
+    return _status;
+}
+
+status_t sl_serve_replica(skiplist_t* sl, int fd, int istail) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    clreader_t* r = NULL;
+    uint64_t seq = 0;
+
+    _status = readall(fd, &seq, sizeof(uint64_t));
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_log_reader(sl, seq, &r);
+    if (!_status.ok) {
+        return _status;
+    }
+    while (1) {
+        _status = cl_ship(r, fd, NULL);
+        if (!_status.ok || !istail) {
+            break;
+        }
+        // 从库握手后不再发送数据，fd可读/挂断即对端已关闭
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int n = poll(&pfd, 1, REPLICA_POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            _status = statusnotok2(_status, "poll(%d): %s", errno, strerror(errno));
+            break;
+        }
+        if (n > 0) {
+            break;
+        }
+        _status = cl_flush(sl->log);
+        if (!_status.ok) {
+            break;
+        }
+    }
+    cl_reader_close(r);
+    return _status;
+}
+
+static status_t applybatch(skiplist_t* sl, logrecord_t* recs[], size_t recs_n) {
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (recs_n == 0) {
+        return _status;
+    }
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    for (size_t i = 0; i < recs_n && _status.ok; ++i) {
+        if (recs[i]->type == SL_OP_PUT) {
+            _status = sl_doput(sl, recs[i]->data, recs[i]->size, recs[i]->value);
+        } else if (recs[i]->type == SL_OP_DEL) {
+            _status = sl_dodel(sl, recs[i]->data, recs[i]->size);
+        } else if (recs[i]->type == SL_OP_DELRANGE) {
+            _status = sl_applyrange(sl, recs[i]->data, recs[i]->size, recs[i]->value);
+        } else {
+            _status = statusnotok2(_status, "record(%ld) type(%d) unknown", recs[i]->seq, recs[i]->type);
+        }
+        if (_status.ok) {
+            sl->meta->seq = recs[i]->seq;
+        }
+    }
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_follow(skiplist_t* sl, int fd, size_t batch) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    uint64_t seq = 0;
+    size_t cap = REPLICA_BUFF_SIZE;
+    size_t len = 0;
+    int iseof = 0;
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (batch == 0) {
+        batch = REPLICA_BATCH_SIZE;
+    }
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    seq = sl->meta->seq + 1;
+    sl_unlock(sl, _offsets, 0);
+    if (write(fd, &seq, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        return statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+    }
+
+    char* buff = (char*)malloc(cap);
+    logrecord_t** recs = (logrecord_t**)malloc(sizeof(logrecord_t*) * batch);
+    while (_status.ok && !iseof) {
+        ssize_t n = read(fd, buff + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _status = statusnotok2(_status, "read(%d): %s", errno, strerror(errno));
+            break;
+        }
+        iseof = (n == 0);
+        len += n;
+
+        size_t pos = 0;
+        size_t recs_n = 0;
+        while (_status.ok && pos + sizeof(logrecord_t) <= len) {
+            logrecord_t* rec = (logrecord_t*)(buff + pos);
+            if (pos + LOGRECORDSIZE(rec) > len) {
+                break;
+            }
+            pos += LOGRECORDSIZE(rec);
+            if (rec->seq < seq) { // 重连后已应用过的记录
+                continue;
+            }
+            recs[recs_n++] = rec;
+            if (recs_n == batch) {
+                _status = applybatch(sl, recs, recs_n);
+                recs_n = 0;
+            }
+        }
+        if (_status.ok) {
+            _status = applybatch(sl, recs, recs_n);
+        }
+        memmove(buff, buff + pos, len - pos);
+        len -= pos;
+        if (len == cap) { // 单条记录超过缓冲区
+            cap *= 2;
+            buff = (char*)realloc(buff, cap);
+        }
+    }
+    if (_status.ok && len != 0) {
+        _status = statusnotok1(_status, "truncated record(%ld bytes) at EOF", len);
+    }
+    free(recs);
+    free(buff);
+    return _status;
+}
@@ -0,0 +1,187 @@
+#include "internal.h"
+#include <errno.h>
+
+#define SCAN_MAXTHREADS 256
+
+typedef struct scanpart_s {
+    skiplist_t* sl;
+    int part;
+    metanode_t* start; // 分区第一个节点(块格式为块)
+    uint32_t index;    // 块格式：start块内第一个key的下标
+    metanode_t* stop;  // 下一个分区的第一个节点(不包含)，最后一个分区为NULL
+    const void* hi;
+    size_t hi_len;
+    sl_scan_cb cb;
+    void* arg;
+} scanpart_t;
+
+// 缓冲池模式：解除之前的pin，预读从curr开始的POOL_READAHEAD个节点的key
+static void readahead(skiplist_t* sl, metanode_t* curr, metanode_t* stop) {
+    uint64_t offsets[POOL_READAHEAD];
+    size_t n = 0;
+
+    sl_pool_release(sl);
+    for (; curr != NULL && curr != stop && n < POOL_READAHEAD; curr = METANODE(sl, curr->forwards[0])) {
+        offsets[n++] = curr->offset;
+    }
+    sl_pool_readahead(sl, offsets, n);
+}
+
+static void* scanpart(void* arg) {
+    scanpart_t* p = (scanpart_t*)arg;
+    skiplist_t* sl = p->sl;
+    uint64_t n = 0;
+
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        blk_scanpart(sl, p->start, p->index, p->stop, p->stop == NULL ? p->hi : NULL, p->hi_len, p->part, p->cb, p->arg);
+        sl_pool_yield(sl);
+        return NULL;
+    }
+    for (metanode_t* curr = p->start; curr != NULL && curr != p->stop; curr = METANODE(sl, curr->forwards[0])) {
+        if (sl->pool != NULL && n++ % POOL_READAHEAD == 0) {
+            readahead(sl, curr, p->stop);
+        }
+        datanode_t* dnode = sl_get_datanode(sl, curr->offset);
+        if (p->stop == NULL && p->hi != NULL && sl->keyops->cmp(sl, dnode->data, dnode->size, p->hi, p->hi_len) >= 0) {
+            break;
+        }
+        if (p->cb(p->part, dnode->data, dnode->size, curr->value, p->arg) != 0) {
+            break;
+        }
+    }
+    sl_pool_yield(sl); // 分区线程不经过sl_unlock
+    return NULL;
+}
+
+// 节点的key，块格式为块的首key
+static datanode_t* firstkey(skiplist_t* sl, metanode_t* mnode) {
+    return sl_get_datanode(sl, (mnode->flag & METANODE_BLOCK) ? BLOCKENTRIES(mnode)->offsets[0] : mnode->offset);
+}
+
+// 从最高层往下找第一个在[start, hi)内至少有nthreads - 1个节点的level，均匀选出分区点；
+// 高层节点在level 0上大致等距分布，因此各分区的节点数相近。上一层不足nthreads - 1个节点，
+// 所以该层期望只有约(nthreads - 1) / p个节点。块格式在块上选，分区点是块的首key
+static int pickpivots(skiplist_t* sl, metanode_t* update[], metanode_t* start, const void* hi, size_t hi_len,
+                      int nthreads, metanode_t* pivots[]) {
+    metanode_t* head = METANODEHEAD(sl);
+    int cap = nthreads * 4;
+    metanode_t** candidates = (metanode_t**)malloc(sizeof(metanode_t*) * cap);
+    int n = 0;
+
+    for (int level = (int)head->level - 1; level >= 1; --level) {
+        n = 0;
+        for (metanode_t* curr = METANODE(sl, update[level]->forwards[level]); curr != NULL;
+             curr = METANODE(sl, curr->forwards[level])) {
+            datanode_t* dnode = firstkey(sl, curr);
+            if (hi != NULL && sl->keyops->cmp(sl, dnode->data, dnode->size, hi, hi_len) >= 0) {
+                break;
+            }
+            if (curr == start) {
+                continue;
+            }
+            if (n == cap) {
+                cap *= 2;
+                candidates = (metanode_t**)realloc(candidates, sizeof(metanode_t*) * cap);
+            }
+            candidates[n++] = curr;
+        }
+        if (n >= nthreads - 1) {
+            break;
+        }
+    }
+    int npivots = n < nthreads - 1 ? n : nthreads - 1;
+    for (int i = 0; i < npivots; ++i) {
+        pivots[i] = candidates[(long)(i + 1) * n / (npivots + 1)];
+    }
+    free(candidates);
+    return npivots;
+}
+
+status_t sl_parallel_scan(skiplist_t* sl, int nthreads, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg) {
+    SL_OPSCOPE(SL_STAT_SCAN);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
+
+    if (sl == NULL || cb == NULL) {
+        return statusnotok0(_status, "skiplist or cb is NULL");
+    }
+    if (nthreads < 1 || nthreads > SCAN_MAXTHREADS) {
+        return statusnotok2(_status, "nthreads(%d) out of range [1, %d]", nthreads, SCAN_MAXTHREADS);
+    }
+    SL_STATADD(sl, ops[SL_STAT_SCAN], 1);
+    if ((lo != NULL && !(_status = sl_checkkey(sl, lo_len)).ok) || (hi != NULL && !(_status = sl_checkkey(sl, hi_len)).ok)) {
+        return _status;
+    }
+    // 整个扫描期间持有读锁，所有线程看到同一个一致的视图
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    int iseq = 0;
+    uint32_t index = 0;
+    metanode_t* start = NULL;
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        start = blk_seek(sl, lo, lo_len, &index, update);
+    } else if (lo != NULL) {
+        start = sl->keyops->findpath(sl, lo, lo_len, update, &iseq);
+    } else {
+        for (int level = 0; level < SKIPLIST_MAXLEVEL; ++level) {
+            update[level] = METANODEHEAD(sl);
+        }
+        start = METANODE(sl, METANODEHEAD(sl)->forwards[0]);
+    }
+    if (start == NULL) {
+        return sl_unlock(sl, _offsets, 0);
+    }
+
+    // 全量扫描和并行扫描通常覆盖大范围，期间打开预读；短范围扫描保持稳态模式
+    int issequential = nthreads > 1 || (lo == NULL && hi == NULL);
+    if (issequential) {
+        sl_seqbegin(sl);
+    }
+
+    metanode_t* pivots[SCAN_MAXTHREADS];
+    int npivots = nthreads > 1 ? pickpivots(sl, update, start, hi, hi_len, nthreads, pivots) : 0;
+    scanpart_t parts[SCAN_MAXTHREADS];
+    pthread_t threads[SCAN_MAXTHREADS];
+    int nparts = npivots + 1;
+    for (int i = 0; i < nparts; ++i) {
+        parts[i].sl = sl;
+        parts[i].part = i;
+        parts[i].start = i == 0 ? start : pivots[i - 1];
+        parts[i].index = i == 0 ? index : 0;
+        parts[i].stop = i == npivots ? NULL : pivots[i];
+        parts[i].hi = hi;
+        parts[i].hi_len = hi_len;
+        parts[i].cb = cb;
+        parts[i].arg = arg;
+    }
+    int started = 1;
+    for (; started < nparts; ++started) {
+        int err = pthread_create(&threads[started], NULL, scanpart, &parts[started]);
+        if (err != 0) {
+            _status = statusnotok2(_status, "pthread_create(%d): %s", err, strerror(err));
+            break;
+        }
+    }
+    if (_status.ok) {
+        scanpart(&parts[0]);
+    }
+    for (int i = 1; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    if (issequential) {
+        sl_seqend(sl);
+    }
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_scan(skiplist_t* sl, const void* lo, size_t lo_len, const void* hi, size_t hi_len, sl_scan_cb cb, void* arg) {
+    SL_OPSCOPE(SL_STAT_SCAN);
+    return sl_parallel_scan(sl, 1, lo, lo_len, hi, hi_len, cb, arg);
+}
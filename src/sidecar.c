@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include "internal.h"
+#include <errno.h>
+
+// 附属文件<prefix>.sl.<ext>的映射，存放可由跳表重建的辅助结构(布隆过滤器等)；
+// 内存模式下为匿名映射。只在单进程模式下使用，resize需持有写锁
+
+// 已存在且非空的文件按文件大小加载，返回的type为STATUS_SKIPLIST_LOAD；否则按size创建(内容全0)
+status_t sl_sidecar_open(skiplist_t* sl, const char* ext, uint64_t size, sidecar_t* sc) {
+    struct stat s;
+    status_t _status = { .ok = 1 };
+
+    sc->fd = -1;
+    sc->mapped = NULL;
+    sc->size = 0;
+    if (sl->inmemory) {
+        void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            return statusnotok2(_status, "mmap(%d): %s", errno, strerror(errno));
+        }
+        sc->mapped = mapped;
+        sc->size = size;
+        return _status;
+    }
+    char* name = sl_filename(sl, ext);
+    sc->fd = open(name, O_RDWR | O_CREAT, 0600);
+    free(name);
+    if (sc->fd < 0) {
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    if (fstat(sc->fd, &s) == -1) {
+        return statusnotok2(_status, "fstat(%d): %s", errno, strerror(errno));
+    }
+    if (s.st_size > 0) {
+        _status.type = STATUS_SKIPLIST_LOAD;
+        size = s.st_size;
+    } else if (ftruncate(sc->fd, size) < 0) {
+        return statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
+    }
+    void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, sc->fd, 0);
+    if (mapped == MAP_FAILED) {
+        return statusnotok2(_status, "mmap(%d): %s", errno, strerror(errno));
+    }
+    madvise(mapped, size, MADV_RANDOM); // 按hash访问，预读没有意义
+    sc->mapped = mapped;
+    sc->size = size;
+    return _status;
+}
+
+// 改变大小，保留[0, min(旧大小, size))的内容；映射地址可能改变
+status_t sl_sidecar_resize(sidecar_t* sc, uint64_t size) {
+    status_t _status = { .ok = 1 };
+
+    if (sc->fd >= 0 && ftruncate(sc->fd, size) < 0) {
+        return statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
+    }
+    void* mapped = mremap(sc->mapped, sc->size, size, MREMAP_MAYMOVE);
+    if (mapped == MAP_FAILED) {
+        return statusnotok2(_status, "mremap(%d): %s", errno, strerror(errno));
+    }
+    if (sc->fd >= 0) {
+        madvise(mapped, size, MADV_RANDOM);
+    }
+    sc->mapped = mapped;
+    sc->size = size;
+    return _status;
+}
+
+// 释放[off, off + len)占用的磁盘块/内存(页对齐)，之后读到全0
+void sl_sidecar_discard(sidecar_t* sc, uint64_t off, uint64_t len) {
+    if (sc->fd >= 0) {
+        fallocate(sc->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len);
+    } else {
+        madvise(sc->mapped + off, len, MADV_DONTNEED);
+    }
+}
+
+status_t sl_sidecar_sync(sidecar_t* sc) {
+    status_t _status = { .ok = 1 };
+
+    if (sc->fd >= 0 && sc->mapped != NULL && msync(sc->mapped, sc->size, MS_SYNC) != 0) {
+        return statusnotok2(_status, "msync(%d): %s", errno, strerror(errno));
+    }
+    return _status;
+}
+
+void sl_sidecar_close(sidecar_t* sc) {
+    if (sc->mapped != NULL) {
+        munmap(sc->mapped, sc->size);
+        sc->mapped = NULL;
+    }
+    if (sc->fd >= 0) {
+        close(sc->fd);
+        sc->fd = -1;
+    }
+}
@@ -1,16 +1,9 @@
-#include "skiplist.h"
+#define _GNU_SOURCE
+#include "internal.h"
+#include "warm.h"
 #include <errno.h>
 
-static inline int keycmp(const void* k1, size_t l1, const void* k2, size_t l2) {
-    size_t min = l1 < l2 ? l1 : l2;
-    int cmp = memcmp(k1, k2, min);
-    if (cmp == 0) {
-        return l1 < l2 ? -1 : (l1 > l2 ? 1 : 0);
-    }
-    return cmp > 0 ? 1 : -1;
-}
-
-static inline uint8_t random_level(float p) {
+uint8_t sl_random_level(float p) {
     uint8_t level = 1;
     while ((random() & 0xFFFF) < (p * 0xFFFF)) {
         ++level;
@@ -19,28 +12,33 @@ static inline uint8_t random_level(float p) {
 }
 
 inline datanode_t* sl_get_datanode(skiplist_t* sl, uint64_t offset) {
-    return (datanode_t*)(sl->data->mapped + offset);
+    if (sl->pool != NULL) {
+        return sl_pool_datanode(sl, offset);
+    }
+    return (datanode_t*)(DATAMAPPED(sl) + offset);
 }
 
-static status_t openfile(const char* filename, int* fd, uint64_t* size, size_t default_size) {
+// 打开(不存在则创建)文件；islock时先加flock作为多进程打开过程的互斥锁
+static status_t openfile(const char* filename, int* fd, uint64_t* size, size_t default_size, int islock) {
     struct stat s;
     status_t _status = { .ok = 1 };
 
-    if (access(filename, F_OK) == 0) {
-        if ((*fd = open(filename, O_RDWR)) < 0) {
-            return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
-        }
-        if ((fstat(*fd, &s)) == -1) {
-            close(*fd);
-            return statusnotok2(_status, "fstat(%d): %s", errno, strerror(errno));
-        }
+    if ((*fd = open(filename, O_RDWR | O_CREAT, 0600)) < 0) {
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    if (islock && flock(*fd, LOCK_EX) == -1) {
+        close(*fd);
+        return statusnotok2(_status, "flock(%d): %s", errno, strerror(errno));
+    }
+    if ((fstat(*fd, &s)) == -1) {
+        close(*fd);
+        return statusnotok2(_status, "fstat(%d): %s", errno, strerror(errno));
+    }
+    if (s.st_size > 0) {
         _status.type = STATUS_SKIPLIST_LOAD;
         *size = s.st_size;
         return _status;
     }
-    if ((*fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
-        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
-    }
     if (ftruncate(*fd, default_size) < 0) {
         close(*fd);
         return statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
@@ -49,32 +47,57 @@ static status_t openfile(const char* filename, int* fd, uint64_t* size, size_t d
     return _status;
 }
 
-static status_t filemmap(int fd, uint64_t size, void** mapped) {
+// 访问模式在首次访问前设置，否则加载头部时的缺页会按默认策略预读
+static status_t filemmap(int fd, uint64_t size, int advice, void** mapped) {
     status_t _status = { .ok = 1 };
 
     if ((*mapped = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == (void*)-1) {
         return statusnotok2(_status, "mmap(%d): %s", errno, strerror(errno));
     }
-    if (madvise(*mapped, size, MADV_RANDOM) == -1) {
+    if (madvise(*mapped, size, sl_madvflag(advice)) == -1) {
         munmap(*mapped, size);
         return statusnotok2(_status, "madvise(%d): %s", errno, strerror(errno));
     }
     return _status;
 }
 
-static void createmeta(skiplist_t* sl, void* mapped, uint64_t mapcap, float p) {
+// 初始化头部的进程间共享锁，调用时不能有其他进程持有该锁
+static status_t initsharedlock(skipmeta_t* meta) {
+    int err;
+    status_t _status = { .ok = 1 };
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if ((err = pthread_rwlock_init(&meta->rwlock, &attr)) != 0) {
+        _status = statusnotok2(_status, "pthread_rwlock_init(%d): %s", err, strerror(err));
+    }
+    pthread_rwlockattr_destroy(&attr);
+    return _status;
+}
+
+static void createmeta(skiplist_t* sl, void* mapped, uint64_t mapcap, float p, uint32_t keytype, uint32_t format) {
     metanode_t* head = NULL;
 
     sl->meta = (skipmeta_t*)mapped;
+    sl->meta->magic = SKIPLIST_MAGIC;
+    sl->meta->version = SKIPLIST_VERSION;
+    sl->meta->generation = 0;
     sl->meta->mapcap = mapcap;
-    sl->meta->mapped = mapped;
     sl->meta->mapsize = sizeof(skipmeta_t) + sizeof(metanode_t) + sizeof(uint64_t) * SKIPLIST_MAXLEVEL;
-    sl->meta->tail = sizeof(skipmeta_t);
+    sl->meta->tail = sizeof(skipmeta_t) + 1; // 头节点
     sl->meta->count = 0;
     sl->meta->p = p;
-    for (int i = 0; i < SKIPLIST_MAXLEVEL; ++i) {
-        sl->metafree[i] = NULL;
-    }
+    sl->meta->keytype = keytype;
+    sl->meta->format = format;
+    for (int i = 0; i <= SKIPLIST_MAXLEVEL; ++i) {
+        sl->meta->metafree[i] = 0;
+        sl->meta->levels[i] = 0;
+    }
+    sl->meta->metafreen = 0;
+    sl->meta->metafreebytes = 0;
+    sl->meta->datafreen = 0;
+    sl->meta->datafreebytes = 0;
     head = (metanode_t*)(mapped + sizeof(skipmeta_t) + 1);
     head->flag = METANODE_HEAD;
     head->offset = 0;
@@ -83,412 +106,989 @@ static void createmeta(skiplist_t* sl, void* mapped, uint64_t mapcap, float p) {
     head->level = 0;
 }
 
-static void loadmeta(skiplist_t* sl, void* mapped, uint64_t mapcap) {
-    sl->meta = (skipmeta_t*)mapped;
-    sl->meta->mapcap = mapcap;
-    sl->meta->mapped = mapped;
+// 只加载当前版本。头部变大时所有节点在文件中的位置都随之后移，节点间的偏移不能原地改写，
+// 所以旧版本(包括没有版本号的最早格式)不做升级，需用旧版本扫描导出后重新写入
+static status_t loadmeta(skiplist_t* sl, void* mapped, uint64_t mapcap) {
+    status_t _status = { .ok = 1 };
 
-    metanode_t* curr = (metanode_t*)(mapped + sizeof(skipmeta_t) + sizeof(metanode_t) + sizeof(uint64_t) * SKIPLIST_MAXLEVEL + 1);
-    while (curr->flag | METANODE_NONE) {
-        if ((curr->flag | METANODE_DELETED) == METANODE_DELETED) {
-            if (sl->metafree[curr->level] == NULL) {
-                list_create(&sl->metafree[curr->level]);
-            }
-            list_push_front(sl->metafree[curr->level], METANODEPOSITION(sl, curr)); // reload recycle meta space
-        }
-        // next
-        curr = (metanode_t*)((void*)curr + sizeof(metanode_t) + sizeof(uint64_t) * curr->level);
+    sl->meta = (skipmeta_t*)mapped;
+    if (sl->meta->magic != SKIPLIST_MAGIC || sl->meta->version != SKIPLIST_VERSION) {
+        sl->meta = NULL;
+        return statusnotok2(_status, "%s: incompatible file format(version %d)", sl->metaname, ((skipmeta_t*)mapped)->version);
     }
+    sl->meta->mapcap = mapcap;
+    return _status;
 }
 
 static void createdata(skiplist_t* sl, void* mapped, uint64_t mapcap) {
     sl->data = (skipdata_t*)mapped;
-    sl->data->mapped = mapped;
     sl->data->mapsize = sizeof(skipdata_t);
     sl->data->mapcap = mapcap;
-    sl->datafree = NULL;
-}
-
-static int cmpu64(const void* p1, const void* p2) {
-    return *((uint64_t*)p1) > *((uint64_t*)p2);
+    sl->data->datafree = 0;
+    sl->datacap = mapcap;
 }
 
 static void loaddata(skiplist_t* sl, void* mapped, uint64_t mapcap) {
     sl->data = (skipdata_t*)mapped;
     sl->data->mapcap = mapcap;
-    sl->data->mapped = mapped;
-
-    uint64_t* offsets = (uint64_t*)malloc(sizeof(uint64_t) * sl->meta->count);
-    for (int i = 0; i < sl->meta->count; ++i) {
-        offsets[i] = 0;
-    }
-    metanode_t* curr = METANODEHEAD(sl);
-    for (int i = 0; ; ++i) {
-        metanode_t* next = METANODE(sl, curr->forwards[0]);
-        if (next == NULL) {
-            break;
-        }
-        offsets[i] = next->offset;
-        curr = next;
-    }
-    qsort(offsets, sl->meta->count, sizeof(uint64_t*), cmpu64);
-    datanode_t* dnode = (datanode_t*)(sl->data->mapped + sizeof(skipdata_t) + 1);
-    for (int i = 0; i < sl->meta->count; ++i) {
-        while (offsets[i] != DATANODEPOSITION(sl, dnode)) {
-            if (sl->datafree == NULL) {
-                list_create(&sl->datafree);
-            }
-            list_push_front(sl->datafree, DATANODEPOSITION(sl, dnode));
-            dnode = (datanode_t*)((void*)dnode + sizeof(datanode_t) + dnode->size);
+    sl->datacap = mapcap;
+}
+
+void sl_options_init(sl_options_t* opts) {
+    opts->p = 0.25;
+    opts->changelog = 0;
+    opts->trace = 0;
+    opts->shared = 0;
+    opts->keytype = SL_KEY_BYTES;
+    opts->keycmp = NULL;
+    opts->inmemory = 0;
+    opts->hugepage = SL_HUGEPAGE_NONE;
+    opts->populate = 0;
+    opts->advice = SL_ADVISE_RANDOM;
+    opts->willneed = 0;
+    opts->heat = 0;
+    opts->format = SL_FORMAT_NODE;
+    opts->upperindex = 1;
+    opts->bloom = 0;
+    opts->hashindex = 0;
+    opts->valueindex = 0;
+    opts->iothreads = 0;
+    opts->metasize = DEFAULT_METAFILE_SIZE;
+    opts->datasize = DEFAULT_DATAFILE_SIZE;
+    opts->poolsize = 0;
+    opts->direct = 0;
+    opts->cache = 0;
+}
+
+status_t sl_open(const char* prefix, float p, skiplist_t** sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    sl_options_t opts;
+
+    sl_options_init(&opts);
+    opts.p = p;
+    return sl_open_opt(prefix, &opts, sl);
+}
+
+static status_t openlog(skiplist_t* sl, const char* prefix) {
+    status_t _status = { .ok = 1 };
+    size_t prefix_len = strlen(prefix);
+    char* logname = (char*)malloc(sizeof(char) * (prefix_len + 8));
+
+    snprintf(logname, prefix_len + 8, "%s.sl.log", prefix);
+    _status = cl_open(logname, &sl->log);
+    free(logname);
+    if (!_status.ok) {
+        return _status;
+    }
+    // 日志被清理过时，序列号沿用元数据中的记录，保证单调递增
+    if (sl->log->seq < sl->meta->seq) {
+        sl->log->seq = sl->meta->seq;
+    }
+    return _status;
+}
+
+// 单进程模式独占元数据文件；多进程模式各进程持有共享flock，
+// 第一个打开的进程(没有其他持有者)负责重置头部的共享锁，清除崩溃进程遗留的锁状态
+static status_t attach(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    if (!sl->shared) {
+        if (flock(sl->lockfd, LOCK_EX | LOCK_NB) == -1) {
+            return statusnotok2(_status, "%s is in use by another process(%s)", sl->metaname, strerror(errno));
         }
-        dnode = (datanode_t*)((void*)dnode + sizeof(datanode_t) + dnode->size);
+        return _status;
     }
-    free(offsets);
+    if (flock(sl->lockfd, LOCK_EX | LOCK_NB) == 0) {
+        _status = initsharedlock(sl->meta);
+        if (!_status.ok) {
+            return _status;
+        }
+    } else if (errno != EWOULDBLOCK) {
+        return statusnotok2(_status, "flock(%d): %s", errno, strerror(errno));
+    }
+    if (flock(sl->lockfd, LOCK_SH | LOCK_NB) == -1) {
+        return statusnotok2(_status, "%s is in use by a single process(%s)", sl->metaname, strerror(errno));
+    }
+    sl->generation = sl->meta->generation;
+    return _status;
 }
 
-status_t sl_open(const char* prefix, float p, skiplist_t** sl) {
+// 匿名内存映射(内存模式)。SL_HUGEPAGE_TLB需要预留hugetlb页，失败时退回THP
+static status_t anonmmap(int hugepage, int populate, uint64_t size, void** mapped) {
+    status_t _status = { .ok = 1 };
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
+
+    *mapped = (void*)-1;
+    if (hugepage == SL_HUGEPAGE_TLB) {
+        *mapped = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    }
+    if (*mapped == (void*)-1) {
+        if ((*mapped = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, flags, -1, 0)) == (void*)-1) {
+            return statusnotok2(_status, "mmap(%d): %s", errno, strerror(errno));
+        }
+        if (hugepage != SL_HUGEPAGE_NONE) {
+            madvise(*mapped, size, MADV_HUGEPAGE); // 内核未开启THP时忽略
+        }
+    }
+    return _status;
+}
+
+static status_t openmemory(skiplist_t* sl, const sl_options_t* opts) {
+    status_t _status = { .ok = 1 };
+    void* metamapped = NULL;
+    void* datamapped = NULL;
+
+    _status = anonmmap(opts->hugepage, opts->populate, opts->metasize, &metamapped);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = anonmmap(opts->hugepage, opts->populate, opts->datasize, &datamapped);
+    if (!_status.ok) {
+        munmap(metamapped, opts->metasize);
+        return _status;
+    }
+    createmeta(sl, metamapped, opts->metasize, opts->p, opts->keytype, opts->format);
+    createdata(sl, datamapped, opts->datasize);
+    sl_madvise(sl, opts->advice);
+    return _status;
+}
+
+static status_t openfiles(skiplist_t* sl, const sl_options_t* opts) {
     status_t _status = { .ok = 1 };
     int metafd;
     int datafd;
-    int err;
     uint64_t metacap = 0;
     uint64_t datacap = 0;
 
-    if (prefix == NULL) {
-        return statusnotok0(_status, "prefix is NULL");
-    }
-    *sl = (skiplist_t*)malloc(sizeof(skiplist_t));
-    if ((err = pthread_rwlock_init(&(*sl)->rwlock, NULL)) != 0) {
-        return statusnotok2(_status, "pthread_rwlock_init(%d): %s", err, strerror(err));
+    // 数据文件的flock串行化多个进程的打开(创建/加载)过程
+    status_t s2 = openfile(sl->dataname, &datafd, &datacap, opts->datasize, 1);
+    if (!s2.ok) {
+        return s2;
     }
-    // open meta/data file
-    size_t prefix_len = strlen(prefix);
-    (*sl)->metaname = (char*)malloc(sizeof(char) * (prefix_len + 9));
-    snprintf((*sl)->metaname, prefix_len + 9, "%s.sl.meta", prefix);
-    (*sl)->dataname = (char*)malloc(sizeof(char) * (prefix_len + 9));
-    snprintf((*sl)->dataname, prefix_len + 9, "%s.sl.data", prefix);
-
-    status_t s1 = openfile((*sl)->metaname, &metafd, &metacap, DEFAULT_METAFILE_SIZE);
+    status_t s1 = openfile(sl->metaname, &metafd, &metacap, opts->metasize, 0);
     if (!s1.ok) {
-        sl_close(*sl);
+        close(datafd);
         return s1;
     }
-    status_t s2 = openfile((*sl)->dataname, &datafd, &datacap, DEFAULT_DATAFILE_SIZE);
-    if (!s2.ok) {
-        close(metafd);
-        sl_close(*sl);
-        return s2;
-    }
     if (s1.type != s2.type) {
         _status.ok = 0;
         close(metafd);
         close(datafd);
         if (s1.type == STATUS_SKIPLIST_LOAD) {
-            remove((*sl)->dataname);
-            snprintf(_status.errmsg, ERRMSG_SIZE, "%s not found", (*sl)->dataname);
+            remove(sl->dataname);
+            snprintf(_status.errmsg, ERRMSG_SIZE, "%s not found", sl->dataname);
         } else {
-            remove((*sl)->metaname);
-            snprintf(_status.errmsg, ERRMSG_SIZE, "%s not found", (*sl)->metaname);
+            remove(sl->metaname);
+            snprintf(_status.errmsg, ERRMSG_SIZE, "%s not found", sl->metaname);
         }
-        sl_close(*sl);
         return _status;
     }
     int isload = 0;
     if (s1.type == STATUS_SKIPLIST_LOAD) {
         isload = 1;
     }
+    sl->lockfd = metafd;
 
     // mmap meta/data file
     void* metamapped = NULL;
-    s1 = filemmap(metafd, metacap, &metamapped);
+    s1 = filemmap(metafd, metacap, opts->advice, &metamapped);
     if (!s1.ok) {
-        close(metafd);
         close(datafd);
-        sl_close(*sl);
         return s1;
     }
-    close(metafd);
     void* datamapped = NULL;
-    s2 = filemmap(datafd, datacap, &datamapped);
+    if (opts->poolsize > 0) { // 数据文件经缓冲池读写，头部由缓冲池加载或初始化
+        s2 = sl_pool_open(sl, datacap, isload, opts->poolsize, opts->direct);
+    } else {
+        s2 = filemmap(datafd, datacap, opts->advice, &datamapped);
+    }
     if (!s2.ok) {
         close(datafd);
         munmap(metamapped, metacap);
-        sl_close(*sl);
         return s2;
     }
-    close(datafd);
+
+    if (opts->hugepage != SL_HUGEPAGE_NONE) {
+        madvise(metamapped, metacap, MADV_HUGEPAGE); // 文件映射的THP依赖内核与文件系统，不支持时忽略
+    }
 
     if (isload) {
-        loadmeta(*sl, metamapped, metacap);
-        loaddata(*sl, datamapped, datacap);
+        _status = loadmeta(sl, metamapped, metacap);
+        if (!_status.ok) {
+            close(datafd);
+            munmap(metamapped, metacap);
+            if (datamapped != NULL) {
+                munmap(datamapped, datacap);
+            }
+            return _status;
+        }
+        if (datamapped != NULL) {
+            loaddata(sl, datamapped, datacap);
+        }
+    } else {
+        createmeta(sl, metamapped, metacap, opts->p, opts->keytype, opts->format);
+        if (datamapped != NULL) {
+            createdata(sl, datamapped, datacap);
+        }
+    }
+    if (_status.ok && sl->meta->keytype != opts->keytype) {
+        _status = statusnotok2(_status, "keytype(%d) mismatch, file keytype is %d", opts->keytype, sl->meta->keytype);
+    }
+    if (_status.ok && sl->meta->format != opts->format) {
+        _status = statusnotok2(_status, "format(%d) mismatch, file format is %d", opts->format, sl->meta->format);
+    }
+    if (_status.ok) {
+        _status = attach(sl);
+    }
+    flock(datafd, LOCK_UN); // 映射持有文件引用，close不会释放flock
+    close(datafd);
+    return _status;
+}
+
+status_t sl_open_opt(const char* prefix, const sl_options_t* opts, skiplist_t** sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    int err;
+
+    if (opts == NULL || (prefix == NULL && !opts->inmemory)) {
+        return statusnotok0(_status, "prefix or opts is NULL");
+    }
+    if (opts->shared && opts->changelog) {
+        return statusnotok0(_status, "changelog is not supported in shared mode");
+    }
+    if (opts->inmemory && (opts->shared || ((opts->changelog || opts->trace) && prefix == NULL))) {
+        return statusnotok0(_status, "inmemory mode does not support shared, changelog and trace require a prefix");
+    }
+    if (opts->poolsize > 0 && (opts->shared || opts->inmemory)) {
+        return statusnotok0(_status, "poolsize is not supported in shared or inmemory mode");
+    }
+    if (opts->cache && (opts->shared || opts->format != SL_FORMAT_NODE)) {
+        return statusnotok0(_status, "cache requires SL_FORMAT_NODE and is not supported in shared mode");
+    }
+    if (opts->direct && opts->poolsize == 0) {
+        return statusnotok0(_status, "direct requires poolsize");
+    }
+    if (opts->advice < SL_ADVISE_NORMAL || opts->advice > SL_ADVISE_SEQUENTIAL) {
+        return statusnotok1(_status, "advice(%d) must be SL_ADVISE_NORMAL/RANDOM/SEQUENTIAL", opts->advice);
+    }
+    if (sl_keyops(opts->keytype) == NULL) {
+        return statusnotok1(_status, "unknown keytype(%d)", opts->keytype);
+    }
+    if (opts->format != SL_FORMAT_NODE && opts->format != SL_FORMAT_BLOCKED) {
+        return statusnotok1(_status, "unknown format(%d)", opts->format);
+    }
+    if (opts->format == SL_FORMAT_BLOCKED && opts->keytype == SL_KEY_CUSTOM) {
+        return statusnotok0(_status, "SL_FORMAT_BLOCKED does not support SL_KEY_CUSTOM");
+    }
+    if (opts->bloom > 0 && (opts->shared || opts->keytype == SL_KEY_CUSTOM)) {
+        return statusnotok0(_status, "bloom is not supported in shared mode or with SL_KEY_CUSTOM");
+    }
+    if (opts->hashindex && (opts->shared || opts->keytype == SL_KEY_CUSTOM || opts->format != SL_FORMAT_NODE)) {
+        return statusnotok0(_status, "hashindex requires SL_FORMAT_NODE and is not supported in shared mode or with SL_KEY_CUSTOM");
+    }
+    if (opts->valueindex && (opts->shared || opts->format != SL_FORMAT_NODE)) {
+        return statusnotok0(_status, "valueindex requires SL_FORMAT_NODE and is not supported in shared mode");
+    }
+    if (opts->keytype == SL_KEY_CUSTOM && opts->keycmp == NULL) {
+        return statusnotok0(_status, "SL_KEY_CUSTOM requires keycmp");
+    }
+    if (opts->metasize < sizeof(skipmeta_t) + sizeof(metanode_t) + sizeof(uint64_t) * SKIPLIST_MAXLEVEL + 1 ||
+        opts->datasize < sizeof(skipdata_t) + sizeof(datanode_t) + MAX_KEY_LEN) {
+        return statusnotok2(_status, "metasize(%ld) or datasize(%ld) too small", opts->metasize, opts->datasize);
+    }
+    *sl = (skiplist_t*)calloc(1, sizeof(skiplist_t));
+    if (*sl == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    if (((*sl)->stats = sl_stats_alloc()) == NULL) {
+        free(*sl);
+        *sl = NULL;
+        return statusnotok0(_status, "alloc stats failed");
+    }
+    if ((err = pthread_rwlock_init(&(*sl)->rwlock, NULL)) != 0) {
+        free((*sl)->stats);
+        free(*sl);
+        *sl = NULL;
+        return statusnotok2(_status, "pthread_rwlock_init(%d): %s", err, strerror(err));
+    }
+    (*sl)->shared = opts->shared;
+    (*sl)->inmemory = opts->inmemory;
+    (*sl)->hugepage = opts->hugepage;
+    (*sl)->advice = opts->advice;
+    (*sl)->heat = opts->heat && !opts->inmemory;
+    (*sl)->cache = opts->cache;
+    (*sl)->lockfd = -1;
+    (*sl)->keyops = sl_keyops(opts->keytype);
+    (*sl)->keycmp = opts->keycmp;
+    if (opts->inmemory) {
+        _status = openmemory(*sl, opts);
     } else {
-        createmeta(*sl, metamapped, metacap, p);
-        createdata(*sl, datamapped, datacap);
+        // open meta/data file
+        size_t prefix_len = strlen(prefix);
+        (*sl)->metaname = (char*)malloc(sizeof(char) * (prefix_len + 9));
+        snprintf((*sl)->metaname, prefix_len + 9, "%s.sl.meta", prefix);
+        (*sl)->dataname = (char*)malloc(sizeof(char) * (prefix_len + 9));
+        snprintf((*sl)->dataname, prefix_len + 9, "%s.sl.data", prefix);
+        _status = openfiles(*sl, opts);
+    }
+    if (!_status.ok) {
+        sl_close(*sl);
+        return _status;
+    }
+    if (opts->upperindex && !opts->shared && opts->keytype != SL_KEY_CUSTOM && opts->format == SL_FORMAT_NODE) {
+        _status = sl_upper_build(*sl);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->bloom > 0) {
+        _status = sl_bloom_open(*sl, opts->bloom);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->hashindex) {
+        _status = sl_hash_open(*sl);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->valueindex) {
+        _status = sl_vidx_open(*sl);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->iothreads > 0 && !opts->inmemory) {
+        _status = sl_async_open(*sl, opts->iothreads);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->willneed) {
+        sl_advise(*sl, SL_ADVISE_WILLNEED);
+    }
+    sl_pool_yield(*sl); // 上层索引、哈希索引等的建立在锁外读取了datanode
+    if (opts->changelog) {
+        _status = openlog(*sl, prefix);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    if (opts->trace) {
+        size_t prefix_len = strlen(prefix);
+        char* tracename = (char*)malloc(sizeof(char) * (prefix_len + 10));
+        snprintf(tracename, prefix_len + 10, "%s.sl.trace", prefix);
+        _status = sl_trace_open(*sl, tracename);
+        free(tracename);
+        if (!_status.ok) {
+            sl_close(*sl);
+            return _status;
+        }
+    }
+    return _status;
+}
+
+char* sl_filename(skiplist_t* sl, const char* ext) {
+    if (sl->metaname == NULL) {
+        return NULL;
+    }
+    size_t prefix_len = strlen(sl->metaname) - 4; // 去掉"meta"，保留"<prefix>.sl."
+    size_t name_len = prefix_len + strlen(ext) + 1;
+    char* name = (char*)malloc(name_len);
+    snprintf(name, name_len, "%.*s%s", (int)prefix_len, sl->metaname, ext);
+    return name;
+}
+
+status_t sl_checkkey(skiplist_t* sl, size_t key_len) {
+    status_t _status = { .ok = 1 };
+
+    if (sl->keyops->keylen != 0 && key_len != sl->keyops->keylen) {
+        return statusnotok2(_status, "key_len(%ld) must be %ld for this key type", key_len, sl->keyops->keylen);
+    }
+    if (key_len > MAX_KEY_LEN) {
+        return statusnotok2(_status, "key_len(%ld) over MAX_KEY_LEN(%d)", key_len, MAX_KEY_LEN);
     }
     return _status;
 }
 
+static int doget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    if (sl->bloom != NULL && !sl_bloom_maycontain(sl, key, key_len)) {
+        return 0;
+    }
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        return blk_get(sl, key, key_len, value);
+    }
+    metanode_t* mnode = sl->hash != NULL ? sl_hash_find(sl, key, key_len) : sl->keyops->find(sl, key, key_len);
+    if (mnode == NULL) {
+        return 0;
+    }
+    sl_cache_touch(sl, mnode);
+    *value = mnode->value;
+    return 1;
+}
+
+int sl_doget(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    int found = doget(sl, key, key_len, value);
+
+    if (found) {
+        SL_STATADD(sl, hits, 1);
+    } else {
+        SL_STATADD(sl, misses, 1);
+    }
+    return found;
+}
+
 status_t sl_get(skiplist_t* sl, const void* key, size_t key_len, uint64_t* value) {
+    SL_OPSCOPE(SL_STAT_GET);
     status_t _status = { .ok = 1 };
     uint64_t _offsets[] = {};
 
     if (sl == NULL || key == NULL) {
         return statusnotok0(_status, "skiplist or key is NULL");
     }
+    _status = sl_checkkey(sl, key_len);
+    if (!_status.ok) {
+        return _status;
+    }
+    SL_STATADD(sl, ops[SL_STAT_GET], 1);
     _status = sl_rdlock(sl, _offsets, 0);
     if (!_status.ok) {
         return _status;
     }
-    metanode_t* curr = METANODEHEAD(sl);
-    for (int level = curr->level - 1; level >= 0; --level) {
-        while (1) {
-            metanode_t* next = METANODE(sl, curr->forwards[level]);
-            if (next == NULL) {
-                break;
-            }
-            datanode_t* dnode = sl_get_datanode(sl, next->offset);
-            int cmp = keycmp(dnode->data, dnode->size, key, key_len);
-            if (cmp == -1) {
-                curr = next;
-                continue;
-            }
-            if (cmp == 0) {
-                *value = next->value;
-                return sl_unlock(sl, _offsets, 0);
-            }
-            break;
+    int found = sl_doget(sl, key, key_len, value);
+    if (sl->trace != NULL) {
+        sl_trace_record(sl, SL_TRACE_GET, found ? SL_TRACE_FOUND : 0, key, key_len, found ? *value : 0);
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_mget(skiplist_t* sl, size_t n, const void* const keys[], const size_t key_lens[], uint64_t values[], int found[]) {
+    SL_OPSCOPE(SL_STAT_GET);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || keys == NULL || key_lens == NULL || values == NULL || found == NULL) {
+        return statusnotok0(_status, "skiplist, keys, key_lens, values or found is NULL");
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (keys[i] == NULL) {
+            return statusnotok1(_status, "keys[%ld] is NULL", i);
+        }
+        _status = sl_checkkey(sl, key_lens[i]);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    SL_STATADD(sl, ops[SL_STAT_GET], n);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        found[i] = sl_doget(sl, keys[i], key_lens[i], &values[i]);
+        if (sl->trace != NULL) {
+            sl_trace_record(sl, SL_TRACE_GET, found[i] ? SL_TRACE_FOUND : 0, keys[i], key_lens[i], found[i] ? values[i] : 0);
         }
     }
     return sl_unlock(sl, _offsets, 0);
 }
 
+void sl_freemetanode(skiplist_t* sl, metanode_t* mnode) {
+    uint64_t size = (mnode->flag & METANODE_BLOCK) ? BLOCKNODESIZE(mnode->level) : METANODESIZE(mnode);
+
+    --sl->meta->levels[mnode->level];
+    ++sl->meta->metafreen;
+    sl->meta->metafreebytes += size;
+    mnode->flag = METANODE_DELETED;
+    mnode->backward = sl->meta->metafree[mnode->level];
+    sl->meta->metafree[mnode->level] = METANODEPOSITION(sl, mnode);
+}
+
+// 改写datanode的offset字段(空闲链表的下一个)
+void sl_setdatanodenext(skiplist_t* sl, uint64_t offset, uint64_t next) {
+    if (sl->pool != NULL) { // sl_get_datanode可能返回跨页时的副本
+        sl_pool_write(sl, offset, &next, sizeof(uint64_t));
+    } else {
+        sl_get_datanode(sl, offset)->offset = next;
+    }
+}
+
+void sl_freedatanode(skiplist_t* sl, uint64_t offset) {
+    datanode_t* dnode = sl_get_datanode(sl, offset);
+
+    ++sl->meta->datafreen;
+    sl->meta->datafreebytes += DATANODECAP(dnode);
+    sl_setdatanodenext(sl, offset, sl->data->datafree);
+    sl->data->datafree = offset;
+}
+
+// 记录一次变更：开启日志时追加记录(序列号由日志分配)，否则序列号加1
+status_t sl_logchange(skiplist_t* sl, uint16_t type, const void* key, size_t key_len, uint64_t value) {
+    status_t _status = { .ok = 1 };
+
+    if (sl->log != NULL) {
+        return cl_append(sl->log, type, key, key_len, value, &sl->meta->seq);
+    }
+    ++sl->meta->seq;
+    return _status;
+}
+
+// 写入成功后的收尾；覆盖已有的key时它已在布隆过滤器中，不再计入
+static status_t putdone(skiplist_t* sl, const void* key, size_t key_len, uint64_t value, int isnew) {
+    if (sl->bloom != NULL && isnew) {
+        sl_bloom_put(sl, key, key_len);
+    }
+    if (RECLAIMHEAD(sl) != 0) {
+        sl_reclaim(sl, RECLAIM_STEP);
+    }
+    return sl_logchange(sl, SL_OP_PUT, key, key_len, value);
+}
+
+// 删除成功后的收尾
+static status_t deldone(skiplist_t* sl, const void* key, size_t key_len) {
+    if (sl->bloom != NULL) {
+        sl_bloom_del(sl, 1);
+    }
+    if (RECLAIMHEAD(sl) != 0) {
+        sl_reclaim(sl, RECLAIM_STEP);
+    }
+    return sl_logchange(sl, SL_OP_DEL, key, key_len, 0);
+}
+
+status_t sl_dodel(skiplist_t* sl, const void* key, size_t key_len) {
+    status_t _status = { .ok = 1 };
+    metanode_t* curr = NULL;
+    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
+    int iseq = 0;
+
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        _status = blk_del(sl, key, key_len, &iseq);
+        if (!_status.ok || !iseq) {
+            return _status;
+        }
+        return deldone(sl, key, key_len);
+    }
+    metanode_t* mnode = sl->keyops->findpath(sl, key, key_len, update, &iseq);
+    if (!iseq) {
+        return _status;
+    }
+    for (int i = 0; i < mnode->level; ++i) {
+        update[i]->forwards[i] = mnode->forwards[i];
+    }
+    if (mnode->forwards[0] != 0) {
+        metanode_t* next = METANODE(sl, mnode->forwards[0]);
+        next->backward = mnode->backward;
+    } else {
+        sl->meta->tail = mnode->backward;
+    }
+    curr = METANODEHEAD(sl);
+    while (curr->level > 0 && curr->forwards[curr->level - 1] == 0) {
+        --curr->level;
+    }
+    --sl->meta->count;
+    sl_upper_remove(sl, mnode);
+    sl_hash_remove(sl, key, key_len);
+    sl_vidx_remove(sl, mnode);
+    sl_freedatanode(sl, mnode->offset);
+    sl_freemetanode(sl, mnode); // recycle meta space
+    return deldone(sl, key, key_len);
+}
+
 status_t sl_del(skiplist_t* sl, const void* key, size_t key_len) {
+    SL_OPSCOPE(SL_STAT_DEL);
     status_t _status = { .ok = 1 };
     uint64_t _offsets[] = {};
-    metanode_t* mnode = NULL;
-    metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
 
     if (sl == NULL || key == NULL) {
         return statusnotok0(_status, "skiplist or key is NULL");
     }
+    _status = sl_checkkey(sl, key_len);
+    if (!_status.ok) {
+        return _status;
+    }
+    SL_STATADD(sl, ops[SL_STAT_DEL], 1);
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_dodel(sl, key, key_len);
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    if (sl->trace != NULL) {
+        sl_trace_record(sl, SL_OP_DEL, 0, key, key_len, 0);
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_mdel(skiplist_t* sl, size_t n, const void* const keys[], const size_t key_lens[], uint64_t* removed) {
+    SL_OPSCOPE(SL_STAT_DEL);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || keys == NULL || key_lens == NULL) {
+        return statusnotok0(_status, "skiplist, keys or key_lens is NULL");
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (keys[i] == NULL) {
+            return statusnotok1(_status, "keys[%ld] is NULL", i);
+        }
+        _status = sl_checkkey(sl, key_lens[i]);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    SL_STATADD(sl, ops[SL_STAT_DEL], n);
     _status = sl_wrlock(sl, _offsets, 0);
     if (!_status.ok) {
         return _status;
     }
-    metanode_t* curr = METANODEHEAD(sl);
-    // find all level, update max level
-    for (int level = curr->level - 1; level >= 0; --level) {
-        while (1) {
-            metanode_t* next = METANODE(sl, curr->forwards[level]);
-            if (next == NULL) {
-                break;
-            }
-            datanode_t* dnode = sl_get_datanode(sl, next->offset);
-            int cmp = keycmp(dnode->data, dnode->size, key, key_len);
-            if (cmp == -1) {
-                curr = next;
-                continue;
-            }
-            if (cmp == 1) {
-                break;
-            }
-            update[level] = curr;
-            mnode = next;
-            break; // go to next level to find update[level-1]
+    uint32_t count = sl->meta->count; // 写锁内count的减少量即删除数
+    for (size_t i = 0; i < n && _status.ok; ++i) {
+        _status = sl_dodel(sl, keys[i], key_lens[i]);
+        if (_status.ok && sl->trace != NULL) {
+            sl_trace_record(sl, SL_OP_DEL, 0, keys[i], key_lens[i], 0);
         }
     }
-    if (mnode == NULL) {
-        return sl_unlock(sl, _offsets, 0);
-    }
-    for (int i = 0; i < mnode->level; ++i) {
-        update[i]->forwards[i] = mnode->forwards[i];
-    }
-    if (mnode->forwards[0] != 0) {
-        metanode_t* next = METANODE(sl, mnode->forwards[0]);
-        next->backward = mnode->backward;
+    if (removed != NULL) {
+        *removed = count - sl->meta->count;
     }
-    curr = METANODEHEAD(sl);
-    if (curr->forwards[mnode->level - 1] == METANODEPOSITION(sl, mnode) && mnode->forwards[mnode->level - 1] == 0) {
-        --curr->level;
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
     }
-    mnode->flag = METANODE_DELETED;
-    --sl->meta->count;
-    list_push_front(sl->datafree, mnode->offset); // unused
-    list_push_front(sl->metafree[mnode->level], METANODEPOSITION(sl, mnode)); // recycle meta space
     return sl_unlock(sl, _offsets, 0);
 }
 
 status_t sl_sync(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
     status_t _status = { .ok = 1 };
     if (sl == NULL) {
         return _status;
     }
-    if (sl->meta != NULL && sl->meta->mapped != NULL) {
-        if (msync(sl->meta->mapped, sl->meta->mapcap, MS_SYNC) != 0) {
+    if (sl->inmemory) { // 匿名映射没有回写
+        return sl->log != NULL ? cl_sync(sl->log) : _status;
+    }
+    if (sl->bloom != NULL) {
+        _status = sl_bloom_sync(sl);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    if (sl->hash != NULL) {
+        _status = sl_hash_sync(sl);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    if (sl->vidx != NULL) {
+        _status = sl_vidx_sync(sl);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    if (sl->meta != NULL) {
+        SL_PROBE2(sync__entry, 0, sl->meta->mapcap);
+        if (msync(METAMAPPED(sl), sl->meta->mapcap, MS_SYNC) != 0) {
             return statusnotok2(_status, "msync(%d): %s", errno, strerror(errno));
         }
+        SL_PROBE2(sync__return, 0, sl->meta->mapcap);
+        SL_STATADD(sl, synced, sl->meta->mapcap);
     }
-    if (sl->meta != NULL && sl->data->mapped != NULL) {
-        if (msync(sl->data->mapped, sl->data->mapcap, MS_SYNC) != 0) {
+    if (sl->pool != NULL && sl->data != NULL) {
+        SL_PROBE2(sync__entry, 1, sl->datacap);
+        _status = sl_pool_sync(sl);
+        if (!_status.ok) {
+            return _status;
+        }
+        SL_PROBE2(sync__return, 1, sl->datacap);
+    } else if (sl->data != NULL) {
+        SL_PROBE2(sync__entry, 1, sl->datacap);
+        if (msync(DATAMAPPED(sl), sl->datacap, MS_SYNC) != 0) {
             return statusnotok2(_status, "msync(%d): %s", errno, strerror(errno));
         }
+        SL_PROBE2(sync__return, 1, sl->datacap);
+        SL_STATADD(sl, synced, sl->datacap);
+    }
+    if (sl->log != NULL) {
+        return cl_sync(sl->log);
     }
     return _status;
 }
 
 status_t sl_close(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
     int err;
     status_t _status = { .ok = 1 };
 
     if (sl == NULL) {
         return _status;
     }
+    sl_async_close(sl);
+    sl_trace_close(sl);
     sl_sync(sl);
-    if (sl->meta != NULL && sl->meta->mapped != NULL) {
-        if (munmap(sl->meta->mapped, sl->meta->mapsize) == -1) {
+    if (sl->heat && sl->meta != NULL && sl->data != NULL) {
+        sl_heat_save(sl);
+    }
+    if (sl->log != NULL) {
+        cl_close(sl->log);
+    }
+    sl_upper_free(sl);
+    sl_bloom_close(sl);
+    sl_hash_close(sl);
+    sl_vidx_close(sl);
+    sl->guards = 0;
+    sl_release_retired(sl);
+    if (sl->pool != NULL) {
+        sl_pool_close(sl);
+    } else if (sl->data != NULL) {
+        if (munmap(DATAMAPPED(sl), sl->datacap) == -1) {
             return statusnotok2(_status, "munmap(%d): %s", errno, strerror(errno));
         }
     }
-    if (sl->meta != NULL && sl->data->mapped != NULL) {
-        if (munmap(sl->data->mapped, sl->data->mapsize) == -1) {
+    if (sl->meta != NULL) {
+        if (munmap(METAMAPPED(sl), sl->meta->mapcap) == -1) {
             return statusnotok2(_status, "munmap(%d): %s", errno, strerror(errno));
         }
     }
+    if (sl->lockfd >= 0) {
+        close(sl->lockfd); // release flock
+    }
     if (sl->metaname != NULL) {
         free(sl->metaname);
     }
-    if (sl->datafree != NULL) {
+    if (sl->dataname != NULL) {
         free(sl->dataname);
     }
-    for (int i = 0; i < SKIPLIST_MAXLEVEL; i++) {
-        if (sl->metafree[i] != NULL) {
-            list_free(sl->metafree[i]);
-        }
-    }
-    if (sl->datafree != NULL) {
-        list_free(sl->datafree);
-    }
     if ((err = pthread_rwlock_destroy(&sl->rwlock)) != 0) {
         return statusnotok2(_status, "pthread_rwlock_destroy(%d): %s", err, strerror(err));
     }
+    free(sl->stats);
     free(sl);
     return _status;
 }
 
-static status_t expanddatafile(skiplist_t* sl) {
+// 按数据文件当前大小重新映射(其他进程已扩容)，调用方需持有进程内写锁
+static status_t remapdata(skiplist_t* sl, uint64_t newcap) {
     int fd;
     void* newmapped = NULL;
-    uint64_t newcap = 0;
-    status_t  _status = { .ok = 1 };
+    status_t _status = { .ok = 1 };
 
     if ((fd = open(sl->dataname, O_RDWR)) < 0) {
         return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
     }
+    _status = filemmap(fd, newcap, sl->advice, &newmapped);
+    close(fd);
+    if (!_status.ok) {
+        return _status;
+    }
+    // 文件只增不减，旧映射的内容在新映射中位置不变
+    sl_retire(sl, DATAMAPPED(sl), sl->datacap);
+    sl->data = (skipdata_t*)newmapped;
+    sl->datacap = newcap;
+    return _status;
+}
+
+static status_t doexpand(skiplist_t* sl) {
+    int fd;
+    uint64_t newcap = 0;
+    status_t  _status = { .ok = 1 };
+
     if (sl->data->mapcap < 1073741824) { // 1G: 1024 * 1024 * 1024
         newcap = sl->data->mapcap * 2;
     } else {
         newcap = sl->data->mapcap + 1073741824;
     }
-    if (munmap(sl->data->mapped, sl->data->mapcap) == -1) {
-        close(fd);
-        return statusnotok2(_status, "munmap(%d): %s", errno, strerror(errno));
+    if (sl->inmemory) {
+        void* newmapped = NULL;
+        if (sl->guards > 0) { // read guard中的视图指向旧映射，复制到新映射后保留旧映射
+            _status = anonmmap(sl->hugepage, 0, newcap, &newmapped);
+            if (!_status.ok) {
+                return _status;
+            }
+            memcpy(newmapped, DATAMAPPED(sl), sl->datacap);
+            sl_retire(sl, DATAMAPPED(sl), sl->datacap);
+        } else if ((newmapped = mremap(DATAMAPPED(sl), sl->datacap, newcap, MREMAP_MAYMOVE)) == (void*)-1) {
+            return statusnotok2(_status, "mremap(%d): %s", errno, strerror(errno));
+        } else if (sl->hugepage != SL_HUGEPAGE_NONE) {
+            madvise(newmapped, newcap, MADV_HUGEPAGE);
+        }
+        madvise(newmapped, newcap, sl_madvflag(sl->advice));
+        sl->data = (skipdata_t*)newmapped;
+        sl->datacap = newcap;
+        sl->data->mapcap = newcap;
+        sl->generation = ++sl->meta->generation;
+        return _status;
+    }
+    if ((fd = open(sl->dataname, O_RDWR)) < 0) {
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
     }
     if (ftruncate(fd, newcap) < 0) {
         close(fd);
         return statusnotok2(_status, "ftruncate(%d): %s", errno, strerror(errno));
     }
-    if ((newmapped = mmap(NULL, newcap, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == (void *)-1) {
-        close(fd);
-        return statusnotok2(_status, "mmap(%d): %s", errno, strerror(errno));
-    }
     close(fd);
-    if (madvise(newmapped, newcap, MADV_RANDOM) == -1) {
-        return statusnotok2(_status, "madvise(%d): %s", errno, strerror(errno));
+    if (sl->pool != NULL) { // 缓冲池按偏移读写，不需要重新映射
+        sl->datacap = newcap;
+    } else if (!(_status = remapdata(sl, newcap)).ok) {
+        return _status;
     }
-    sl->data = (skipdata_t*)newmapped;
-    sl->data->mapped = newmapped;
     sl->data->mapcap = newcap;
+    sl->generation = ++sl->meta->generation;
+    return _status;
+}
 
+static status_t expanddatafile(skiplist_t* sl) {
+    SL_PROBE1(expand__entry, sl->data->mapcap);
+    status_t _status = doexpand(sl);
+    SL_PROBE2(expand__return, sl->data->mapcap, _status.ok);
     return _status;
 }
 
-status_t sl_put(skiplist_t* sl, const void* key, size_t key_len, uint64_t value) {
+// 按level分配元数据节点，优先复用同level的空闲节点(同一文件中同level的节点大小相同)，否则从文件尾部分配；
+// 元数据文件不扩容，空间不足返回NULL
+metanode_t* sl_allocnode(skiplist_t* sl, uint32_t level, uint64_t size) {
+    metanode_t* mnode = METANODE(sl, sl->meta->metafree[level]);
+
+    if (mnode != NULL) {
+        sl->meta->metafree[level] = mnode->backward;
+        --sl->meta->metafreen;
+        sl->meta->metafreebytes -= size;
+        ++sl->meta->levels[level];
+        return mnode;
+    }
+    if (sl->meta->mapcap - sl->meta->mapsize < size + 1) {
+        if (RECLAIMHEAD(sl) != 0) { // 回收范围删除留下的节点后重试
+            sl_reclaim(sl, UINT64_MAX);
+            return sl_allocnode(sl, level, size);
+        }
+        return NULL;
+    }
+    mnode = (metanode_t*)(METAMAPPED(sl) + sl->meta->mapsize + 1);
+    sl->meta->mapsize += size;
+    ++sl->meta->levels[level];
+    return mnode;
+}
+
+// 保证数据区能再写入一个最大的datanode，必要时扩容(数据映射可能被替换)
+status_t sl_reservedata(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    if (sl->data->mapcap - sl->data->mapsize < sizeof(datanode_t) + MAX_KEY_LEN) {
+        return expanddatafile(sl);
+    }
+    return _status;
+}
+
+// 在数据区末尾写入key，返回datanode位置；调用前需sl_reservedata。
+// 缓存模式在没有read guard时复用回收的datanode(guard内的视图可能指向它们)
+uint64_t sl_writedatanode(skiplist_t* sl, const void* key, size_t key_len, uint64_t owner) {
+    uint64_t offset = 0;
+    uint16_t slack = 0;
+
+    if (sl->cache && __atomic_load_n(&sl->guards, __ATOMIC_ACQUIRE) == 0) {
+        offset = sl_cache_takedata(sl, key_len, &slack);
+    }
+    int append = offset == 0;
+    if (append) {
+        offset = sl->data->mapsize + 1;
+    }
+    if (sl->pool != NULL) {
+        datanode_t head = { .offset = owner, .size = (uint16_t)key_len, .slack = slack };
+        sl_pool_write(sl, offset, &head, sizeof(datanode_t));
+        if (append) { // 先计入已使用：头部可能绕过缓冲池写到了文件，写key时同一页不能再当作全新的页清零
+            sl->data->mapsize += DATANODESIZE(&head);
+        }
+        sl_pool_write(sl, offset + sizeof(datanode_t), key, key_len);
+        return offset;
+    }
+    datanode_t* dnode = sl_get_datanode(sl, offset);
+
+    dnode->offset = owner;
+    dnode->size = key_len;
+    dnode->slack = slack;
+    memcpy((void*)dnode->data, key, key_len);
+    if (append) {
+        sl->data->mapsize += DATANODESIZE(dnode);
+    }
+    return offset;
+}
+
+// 一次查找内完成读-改-写，写入和普通put一样记录
+status_t sl_domerge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg) {
     status_t _status = { .ok = 1 };
     metanode_t* head = NULL;
     metanode_t* curr = NULL;
     metanode_t* update[SKIPLIST_MAXLEVEL] = { NULL };
-    uint64_t _offsets[] = {};
+    uint64_t value = 0;
+    int iseq = 0;
+    int evicted = 0;
 
-    if (sl == NULL || key == NULL) {
-        return statusnotok0(_status, "skiplist or key is NULL");
-    }
-    if (key_len > MAX_KEY_LEN) {
-        return statusnotok2(_status, "key_len(%ld) over MAX_KEY_LEN(%d)", key_len, MAX_KEY_LEN);
-    }
-    _status = sl_wrlock(sl, _offsets, 0);
+    _status = sl_checkkey(sl, key_len);
     if (!_status.ok) {
         return _status;
     }
-    if (sl->meta->mapcap - sl->meta->mapsize < (sizeof(metanode_t) + sizeof(uint64_t) * SKIPLIST_MAXLEVEL + MAX_KEY_LEN)) {
-        sl_unlock(sl, _offsets, 0);
-        _status.type = STATUS_SKIPLIST_FULL;
-        return statusnotok0(_status, "skiplist is full");
+    if (sl->meta->format == SL_FORMAT_BLOCKED) {
+        int written = 0;
+        uint32_t count = sl->meta->count;
+        _status = blk_merge(sl, key, key_len, fn, arg, &value, &written);
+        return _status.ok && written ? putdone(sl, key, key_len, value, sl->meta->count != count) : _status;
     }
-
-    head = curr = METANODEHEAD(sl);
-    for (int level = curr->level - 1; level >= 0; --level) {
-        while (1) {
-            metanode_t* next = METANODE(sl, curr->forwards[level]);
-            if (next == NULL) {
-                break;
-            }
-            datanode_t* dnode = sl_get_datanode(sl, next->offset);
-            int cmp = keycmp(dnode->data, dnode->size, key, key_len);
-            if (cmp == 0) {
-                next->value = value;
-                return sl_unlock(sl, _offsets, 0);
-            }
-            if (cmp == -1) {
-                curr = next;
-                continue;
-            }
-            break;
+    head = METANODEHEAD(sl);
+    metanode_t* found = sl->keyops->findpath(sl, key, key_len, update, &iseq);
+    if (iseq) {
+        if (!fn(key, key_len, 1, found->value, &value, arg)) {
+            return _status;
         }
-        update[level] = curr;
+        sl_vidx_update(sl, found, value);
+        found->value = value;
+        sl_cache_touch(sl, found);
+        return putdone(sl, key, key_len, value, 0);
+    }
+    if (!fn(key, key_len, 0, 0, &value, arg)) {
+        return _status;
     }
+    curr = head->level > 0 ? update[0] : head;
 
-    uint16_t level = random_level(sl->meta->p);
-    metanode_t* mnode = NULL;
-    if (sl->metafree[level] != NULL && sl->metafree[level]->head != NULL) {
-        listnode_t* reuse = NULL;
-        list_front(sl->metafree[level], &reuse);
-        mnode = (metanode_t*)(sl->meta->mapped + reuse->value);
-        list_remove(sl->metafree[level], reuse);
-    } else {
-        mnode = (metanode_t*)(sl->meta->mapped + sl->meta->mapsize + 1);
+    _status = sl->cache ? sl_cache_reservedata(sl, key_len, &evicted) : sl_reservedata(sl);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_vidx_reserve(sl);
+    if (!_status.ok) {
+        return _status;
+    }
+    uint16_t level = sl_random_level(sl->meta->p);
+    metanode_t* mnode = sl_allocnode(sl, level, sizeof(metanode_t) + sizeof(uint64_t) * level);
+    if (mnode == NULL && sl->cache && (level = sl_cache_evict(sl)) > 0) { // 沿用被淘汰节点的level复用其空间
+        mnode = sl_allocnode(sl, level, sizeof(metanode_t) + sizeof(uint64_t) * level);
+        evicted = 1;
+    }
+    if (evicted) { // 淘汰改变了结构，重新查找前驱
+        sl->keyops->findpath(sl, key, key_len, update, &iseq);
+        curr = head->level > 0 ? update[0] : head;
+    }
+    if (mnode == NULL) {
+        _status.type = STATUS_SKIPLIST_FULL;
+        return statusnotok0(_status, "skiplist is full");
     }
     mnode->level = level;
-    mnode->flag = METANODE_USED;
-    mnode->offset = sl->data->mapsize + 1;
+    mnode->flag = METANODE_USED; // 缓存模式下新key不置引用位，之后没被访问的先淘汰
+    mnode->offset = sl_writedatanode(sl, key, key_len, METANODEPOSITION(sl, mnode));
     mnode->value = value;
     mnode->backward = METANODEPOSITION(sl, curr);
     for (int i = 0; i < mnode->level; ++i) {
         mnode->forwards[i] = 0;
     }
 
-    if (sl->data->mapcap - sl->data->mapsize < sizeof(datanode_t) + MAX_KEY_LEN) {
-        _status = expanddatafile(sl);
-        if (!_status.ok) {
-            sl_unlock(sl, _offsets, 0);
-            return _status;
-        }
-    }
-    datanode_t* dnode = sl_get_datanode(sl, sl->data->mapsize + 1);
-    dnode->offset = METANODEPOSITION(sl, mnode);
-    dnode->size = key_len;
-    memcpy((void*)dnode->data, key, key_len);
-    sl->data->mapsize += DATANODESIZE(dnode);
-
     if (head->level < mnode->level) {
         for (int i = head->level; i < mnode->level; ++i) {
             update[i] = head;
@@ -506,33 +1106,224 @@ status_t sl_put(skiplist_t* sl, const void* key, size_t key_len, uint64_t value)
         update[i]->forwards[i] = METANODEPOSITION(sl, mnode);
     }
     sl->meta->count++;
-    sl->meta->tail = METANODEPOSITION(sl, mnode);
-    sl->meta->mapsize += METANODESIZE(mnode);
-    return sl_unlock(sl, _offsets, 0);
+    if (mnode->forwards[0] == 0) {
+        sl->meta->tail = METANODEPOSITION(sl, mnode);
+    }
+    sl_upper_insert(sl, update, mnode, key, key_len);
+    sl_hash_insert(sl, mnode, key, key_len);
+    sl_vidx_insert(sl, mnode);
+    return putdone(sl, key, key_len, value, 1);
+}
+
+static int setvalue(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg) {
+    *value = *(uint64_t*)arg;
+    return 1;
+}
+
+status_t sl_doput(skiplist_t* sl, const void* key, size_t key_len, uint64_t value) {
+    return sl_domerge(sl, key, key_len, setvalue, &value);
 }
 
-status_t sl_get_maxkey(skiplist_t* sl, void** key, size_t* size) {
+status_t sl_put(skiplist_t* sl, const void* key, size_t key_len, uint64_t value) {
+    SL_OPSCOPE(SL_STAT_PUT);
     status_t _status = { .ok = 1 };
     uint64_t _offsets[] = {};
 
     if (sl == NULL || key == NULL) {
         return statusnotok0(_status, "skiplist or key is NULL");
     }
+    SL_STATADD(sl, ops[SL_STAT_PUT], 1);
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_doput(sl, key, key_len, value);
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    if (sl->trace != NULL) {
+        sl_trace_record(sl, SL_OP_PUT, 0, key, key_len, value);
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
 
-    _status = sl_rdlock(sl, _offsets, 0);
+status_t sl_write(skiplist_t* sl, const sl_op_t ops[], size_t ops_n) {
+    SL_OPSCOPE(SL_STAT_WRITE);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || ops == NULL) {
+        return statusnotok0(_status, "skiplist or ops is NULL");
+    }
+    SL_STATADD(sl, ops[SL_STAT_WRITE], 1);
+    _status = sl_wrlock(sl, _offsets, 0);
     if (!_status.ok) {
         return _status;
     }
-    metanode_t* mnode = METANODE(sl, sl->meta->tail);
-    if (mnode == NULL) {
-        return sl_unlock(sl, _offsets, 0);
+    for (size_t i = 0; i < ops_n && _status.ok; ++i) {
+        if (ops[i].key == NULL) {
+            _status = statusnotok1(_status, "ops[%ld].key is NULL", i);
+        } else if (ops[i].type == SL_OP_PUT) {
+            _status = sl_doput(sl, ops[i].key, ops[i].key_len, ops[i].value);
+        } else if (ops[i].type == SL_OP_DEL) {
+            _status = sl_dodel(sl, ops[i].key, ops[i].key_len);
+        } else {
+            _status = statusnotok2(_status, "ops[%ld].type(%d) unknown", i, ops[i].type);
+        }
+    }
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_merge(skiplist_t* sl, const void* key, size_t key_len, sl_merge_fn fn, void* arg) {
+    SL_OPSCOPE(SL_STAT_MERGE);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || key == NULL || fn == NULL) {
+        return statusnotok0(_status, "skiplist, key or fn is NULL");
+    }
+    SL_STATADD(sl, ops[SL_STAT_MERGE], 1);
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sl_domerge(sl, key, key_len, fn, arg);
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
     }
-    datanode_t* dnode = sl_get_datanode(sl, mnode->offset);
-    *key = dnode->data;
-    *size = dnode->size;
     return sl_unlock(sl, _offsets, 0);
 }
 
+typedef struct rmwarg_s {
+    uint64_t operand;  // put_if_absent: 值; cas: desired; fetch_add: delta
+    uint64_t expected; // cas
+    uint64_t old;      // 原值，不存在为0
+    int done;          // 是否写入
+} rmwarg_t;
+
+static int putifabsent(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg) {
+    rmwarg_t* a = (rmwarg_t*)arg;
+    a->old = old;
+    a->done = !exists;
+    *value = a->operand;
+    return a->done;
+}
+
+static int cas(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg) {
+    rmwarg_t* a = (rmwarg_t*)arg;
+    a->old = old;
+    a->done = exists && old == a->expected;
+    *value = a->operand;
+    return a->done;
+}
+
+static int fetchadd(const void* key, size_t key_len, int exists, uint64_t old, uint64_t* value, void* arg) {
+    rmwarg_t* a = (rmwarg_t*)arg;
+    a->old = old;
+    a->done = 1;
+    *value = old + a->operand;
+    return 1;
+}
+
+status_t sl_put_if_absent(skiplist_t* sl, const void* key, size_t key_len, uint64_t value, int* inserted) {
+    SL_OPSCOPE(SL_STAT_MERGE);
+    rmwarg_t a = { .operand = value };
+    status_t _status = sl_merge(sl, key, key_len, putifabsent, &a);
+
+    if (_status.ok && inserted != NULL) {
+        *inserted = a.done;
+    }
+    return _status;
+}
+
+status_t sl_cas(skiplist_t* sl, const void* key, size_t key_len, uint64_t expected, uint64_t desired, int* swapped) {
+    SL_OPSCOPE(SL_STAT_MERGE);
+    rmwarg_t a = { .operand = desired, .expected = expected };
+    status_t _status = sl_merge(sl, key, key_len, cas, &a);
+
+    if (_status.ok && swapped != NULL) {
+        *swapped = a.done;
+    }
+    return _status;
+}
+
+status_t sl_fetch_add(skiplist_t* sl, const void* key, size_t key_len, uint64_t delta, uint64_t* old) {
+    SL_OPSCOPE(SL_STAT_MERGE);
+    rmwarg_t a = { .operand = delta };
+    status_t _status = sl_merge(sl, key, key_len, fetchadd, &a);
+
+    if (_status.ok && old != NULL) {
+        *old = a.old;
+    }
+    return _status;
+}
+
+// 多进程模式：加锁后若其他进程已扩容数据文件(generation变化)，在进程内写锁保护下重新映射
+static status_t checkremap(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    if (sl->generation == sl->meta->generation) {
+        return _status;
+    }
+    if (sl->datacap != sl->data->mapcap) {
+        _status = remapdata(sl, sl->data->mapcap);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    sl->generation = sl->meta->generation;
+    return _status;
+}
+
+static __thread uint32_t locksample = 0; // 本线程的加锁次数，用于抽样持有时间
+static __thread uint64_t holdstart = 0;  // 抽样中的加锁完成时刻
+
+// 先尝试加锁，失败时才计时等待，等待时间计入当前操作类型
+static int timedlock(skiplist_t* sl, pthread_rwlock_t* lock, int iswrite) {
+    int err = iswrite ? pthread_rwlock_trywrlock(lock) : pthread_rwlock_tryrdlock(lock);
+
+    if (err != EBUSY) {
+        return err;
+    }
+    SL_PROBE2(lock__wait, sl_curop, iswrite);
+    uint64_t start = sl_nowns();
+    err = iswrite ? pthread_rwlock_wrlock(lock) : pthread_rwlock_rdlock(lock);
+    uint64_t waited = sl_nowns() - start;
+    SL_STATADD(sl, lockcontended[sl_curop], 1);
+    SL_STATADD(sl, lockwaitns[sl_curop], waited);
+    return err;
+}
+
+static void lockacquired(skiplist_t* sl, int iswrite) {
+    SL_STATADD(sl, lockacquires[sl_curop], 1);
+    if (++locksample % SL_LOCK_SAMPLE == 0) {
+        holdstart = sl_nowns();
+    }
+    SL_PROBE2(lock__acquire, sl_curop, iswrite);
+}
+
+static status_t sharedlock(skiplist_t* sl, int iswrite) {
+    int err;
+    status_t _status = { .ok = 1 };
+
+    if (iswrite) {
+        if ((err = timedlock(sl, &sl->meta->rwlock, 1)) != 0) {
+            return statusnotok2(_status, "pthread_rwlock_wrlock(%d): %s", err, strerror(err));
+        }
+    } else {
+        if ((err = timedlock(sl, &sl->meta->rwlock, 0)) != 0) {
+            return statusnotok2(_status, "pthread_rwlock_rdlock(%d): %s", err, strerror(err));
+        }
+    }
+    return _status;
+}
+
 status_t sl_rdlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n) {
     int err;
     status_t _status = { .ok = 1 };
@@ -540,10 +1331,39 @@ status_t sl_rdlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n) {
     if (sl == NULL) {
         return statusnotok0(_status, "skiplist is NULL");
     }
-    if ((err = pthread_rwlock_rdlock(&sl->rwlock)) != 0) {
-        return statusnotok2(_status, "pthread_rwlock_rdlock(%d): %s", err, strerror(err));
+    while (1) {
+        if ((err = timedlock(sl, &sl->rwlock, 0)) != 0) {
+            return statusnotok2(_status, "pthread_rwlock_rdlock(%d): %s", err, strerror(err));
+        }
+        if (!sl->shared) {
+            lockacquired(sl, 0);
+            return _status;
+        }
+        _status = sharedlock(sl, 0);
+        if (!_status.ok) {
+            pthread_rwlock_unlock(&sl->rwlock);
+            return _status;
+        }
+        if (sl->generation == sl->meta->generation) {
+            lockacquired(sl, 0);
+            return _status;
+        }
+        // 需要重新映射：换成进程内写锁，防止本进程其他读线程仍在访问旧映射
+        pthread_rwlock_unlock(&sl->meta->rwlock);
+        pthread_rwlock_unlock(&sl->rwlock);
+        if ((err = timedlock(sl, &sl->rwlock, 1)) != 0) {
+            return statusnotok2(_status, "pthread_rwlock_wrlock(%d): %s", err, strerror(err));
+        }
+        _status = sharedlock(sl, 0);
+        if (_status.ok) {
+            _status = checkremap(sl);
+            pthread_rwlock_unlock(&sl->meta->rwlock);
+        }
+        pthread_rwlock_unlock(&sl->rwlock);
+        if (!_status.ok) {
+            return _status;
+        }
     }
-    return _status;
 }
 
 status_t sl_wrlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n) {
@@ -553,9 +1373,28 @@ status_t sl_wrlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n) {
     if (sl == NULL) {
         return statusnotok0(_status, "skiplist is NULL");
     }
-    if ((err = pthread_rwlock_wrlock(&sl->rwlock)) != 0) {
+    if ((err = timedlock(sl, &sl->rwlock, 1)) != 0) {
         return statusnotok2(_status, "pthread_rwlock_wrlock(%d): %s", err, strerror(err));
     }
+    if (sl->retired != NULL) {
+        sl_release_retired(sl);
+    }
+    if (!sl->shared) {
+        lockacquired(sl, 1);
+        return _status;
+    }
+    _status = sharedlock(sl, 1);
+    if (_status.ok) {
+        _status = checkremap(sl);
+        if (!_status.ok) {
+            pthread_rwlock_unlock(&sl->meta->rwlock);
+        }
+    }
+    if (!_status.ok) {
+        pthread_rwlock_unlock(&sl->rwlock);
+        return _status;
+    }
+    lockacquired(sl, 1);
     return _status;
 }
 
@@ -566,6 +1405,26 @@ status_t sl_unlock(skiplist_t* sl, uint64_t offsets[], size_t offsets_n) {
     if (sl == NULL) {
         return statusnotok0(_status, "skiplist is NULL");
     }
+    if (holdstart != 0) {
+        SL_STATADD(sl, lockholdns[sl_curop], sl_nowns() - holdstart);
+        SL_STATADD(sl, lockholdsamples[sl_curop], 1);
+        holdstart = 0;
+    }
+    SL_PROBE1(lock__release, sl_curop);
+    if (sl->pool != NULL) { // 写回失败时仍然释放锁，返回写回的错误
+        _status = sl_pool_release(sl);
+    }
+    // 释放锁前把本次写入的日志记录写到文件：变更对其他线程可见时记录已在内核中，进程崩溃不会在日志中留下空洞。
+    // 只有写锁的持有者会追加记录，读者看到的总是0
+    if (sl->log != NULL && __atomic_load_n(&sl->log->buffsize, __ATOMIC_RELAXED) > 0) {
+        status_t flushed = cl_flush(sl->log);
+        if (_status.ok && !flushed.ok) {
+            _status = flushed;
+        }
+    }
+    if (sl->shared && (err = pthread_rwlock_unlock(&sl->meta->rwlock)) != 0) {
+        return statusnotok2(_status, "pthread_rwlock_unlock(%d): %s", err, strerror(err));
+    }
     if ((err = pthread_rwlock_unlock(&sl->rwlock)) != 0) {
         return statusnotok2(_status, "pthread_rwlock_unlock(%d): %s", err, strerror(err));
     }
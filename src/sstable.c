@@ -0,0 +1,536 @@
+#include "internal.h"
+#include <errno.h>
+
+// 不可变有序表(<prefix>.<id>.sst)：
+//   数据块   条目为 uint16 key长度 | key | uint64 value，条目不跨块，块满blocksize后开始下一块
+//   稀疏索引 每块一项：uint64 块位置 | uint16 首key长度 | 首key
+//   布隆过滤器 64字节块，每个key只落在一块里(同bloom.c)
+//   尾部     sstfooter_t
+// 打开时索引和过滤器读入内存，点查最多一次pread；迭代按SST_READAHEAD一次读入多个块
+
+#define SST_MAGIC 0x54535353     // "SSST"
+#define SST_VERSION 1
+#define SST_READAHEAD (256 * 1024) // 迭代器每次读入的字节数(至少一个块)
+#define SST_STACKBLOCK 16384       // 点查时不超过该大小的块读到栈上
+
+typedef struct sstfooter_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t nblocks;
+    uint64_t indexoff;    // 也是数据区末尾
+    uint64_t bloomoff;
+    uint64_t bloomblocks;
+    uint32_t bloomk;
+    uint32_t maxblock;
+} sstfooter_t;
+
+struct sstbuilder_s {
+    int fd;
+    char* name;
+    char* tmpname;
+    uint32_t blocksize;
+    uint32_t bloombits;
+    char* block;        // 当前数据块
+    size_t blen;
+    size_t bcap;
+    char* index;
+    size_t ilen;
+    size_t icap;
+    uint64_t* hashes;   // 全部key的hash，完成时按总数确定过滤器大小
+    uint64_t count;
+    uint64_t hcap;
+    uint64_t off;       // 已写入的数据字节
+    uint64_t nblocks;
+    uint32_t maxblock;
+};
+
+static status_t writeall(int fd, const void* buff, size_t size) {
+    status_t _status = { .ok = 1 };
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = write(fd, buff + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+        }
+        done += n;
+    }
+    return _status;
+}
+
+static status_t readall(int fd, void* buff, size_t size, uint64_t offset) {
+    status_t _status = { .ok = 1 };
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = pread(fd, buff + done, size - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "pread(%d): %s", errno, strerror(errno));
+        }
+        if (n == 0) {
+            return statusnotok0(_status, "sstable is truncated");
+        }
+        done += n;
+    }
+    return _status;
+}
+
+// 保证*p至少有need字节
+static status_t reserve(void** p, size_t* cap, size_t need) {
+    status_t _status = { .ok = 1 };
+
+    if (need <= *cap) {
+        return _status;
+    }
+    size_t newcap = *cap == 0 ? 4096 : *cap;
+    while (newcap < need) {
+        newcap *= 2;
+    }
+    void* q = realloc(*p, newcap);
+    if (q == NULL) {
+        return statusnotok2(_status, "realloc(%d): %s", errno, strerror(errno));
+    }
+    *p = q;
+    *cap = newcap;
+    return _status;
+}
+
+// h的高32位选块，另一个混合值做32位双重hash产生块内位置(同bloom.c)
+static inline uint64_t* bloomblock(uint64_t* bloom, uint64_t nblocks, uint64_t h, uint32_t* x, uint32_t* d) {
+    uint64_t h2 = h * 0x9e3779b97f4a7c15ULL;
+    *x = (uint32_t)h;
+    *d = (uint32_t)(h2 >> 32) | 1;
+    return bloom + (((h >> 32) * nblocks) >> 32) * 8;
+}
+
+status_t sst_build_begin(const char* name, uint32_t blocksize, uint32_t bloombits, sstbuilder_t** b) {
+    status_t _status = { .ok = 1 };
+    size_t name_len = strlen(name);
+
+    *b = (sstbuilder_t*)calloc(1, sizeof(sstbuilder_t));
+    if (*b == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    (*b)->blocksize = blocksize;
+    (*b)->bloombits = bloombits;
+    (*b)->name = strdup(name);
+    (*b)->tmpname = (char*)malloc(name_len + 5);
+    if ((*b)->name == NULL || (*b)->tmpname == NULL) {
+        _status = statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+        free((*b)->name);
+        free((*b)->tmpname);
+        free(*b);
+        *b = NULL;
+        return _status;
+    }
+    snprintf((*b)->tmpname, name_len + 5, "%s.tmp", name);
+    (*b)->fd = open((*b)->tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if ((*b)->fd < 0) {
+        _status = statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+        sst_build_abort(*b);
+        *b = NULL;
+    }
+    return _status;
+}
+
+static status_t flushblock(sstbuilder_t* b) {
+    status_t _status = { .ok = 1 };
+
+    if (b->blen == 0) {
+        return _status;
+    }
+    _status = writeall(b->fd, b->block, b->blen);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (b->blen > b->maxblock) {
+        b->maxblock = b->blen;
+    }
+    b->off += b->blen;
+    b->blen = 0;
+    return _status;
+}
+
+status_t sst_build_add(sstbuilder_t* b, const void* key, size_t key_len, uint64_t value) {
+    status_t _status = { .ok = 1 };
+    uint16_t len = (uint16_t)key_len;
+    size_t size = sizeof(uint16_t) + key_len + sizeof(uint64_t);
+
+    if (b->blen > 0 && b->blen + size > b->blocksize) {
+        _status = flushblock(b);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    if (b->blen == 0) { // 新块，首key进入稀疏索引
+        _status = reserve((void**)&b->index, &b->icap, b->ilen + sizeof(uint64_t) + sizeof(uint16_t) + key_len);
+        if (!_status.ok) {
+            return _status;
+        }
+        memcpy(b->index + b->ilen, &b->off, sizeof(uint64_t));
+        memcpy(b->index + b->ilen + sizeof(uint64_t), &len, sizeof(uint16_t));
+        memcpy(b->index + b->ilen + sizeof(uint64_t) + sizeof(uint16_t), key, key_len);
+        b->ilen += sizeof(uint64_t) + sizeof(uint16_t) + key_len;
+        ++b->nblocks;
+    }
+    _status = reserve((void**)&b->block, &b->bcap, b->blen + size);
+    if (!_status.ok) {
+        return _status;
+    }
+    memcpy(b->block + b->blen, &len, sizeof(uint16_t));
+    memcpy(b->block + b->blen + sizeof(uint16_t), key, key_len);
+    memcpy(b->block + b->blen + sizeof(uint16_t) + key_len, &value, sizeof(uint64_t));
+    b->blen += size;
+
+    if (b->bloombits > 0) {
+        size_t hcap = b->hcap * sizeof(uint64_t);
+        _status = reserve((void**)&b->hashes, &hcap, (b->count + 1) * sizeof(uint64_t));
+        if (!_status.ok) {
+            return _status;
+        }
+        b->hcap = hcap / sizeof(uint64_t);
+        b->hashes[b->count] = sl_hashkey(key, key_len);
+    }
+    ++b->count;
+    return _status;
+}
+
+uint64_t sst_build_count(sstbuilder_t* b) {
+    return b->count;
+}
+
+status_t sst_build_finish(sstbuilder_t* b, uint64_t id, sst_t** t) {
+    status_t _status = { .ok = 1 };
+    sstfooter_t footer = { .magic = SST_MAGIC, .version = SST_VERSION };
+    uint64_t* bloom = NULL;
+
+    _status = flushblock(b);
+    if (!_status.ok) {
+        sst_build_abort(b);
+        return _status;
+    }
+    footer.count = b->count;
+    footer.nblocks = b->nblocks;
+    footer.indexoff = b->off;
+    footer.bloomoff = b->off + b->ilen;
+    footer.maxblock = b->maxblock;
+    if (b->bloombits > 0 && b->count > 0) {
+        footer.bloomblocks = (b->count * b->bloombits + 511) / 512;
+        footer.bloomk = (b->bloombits * 69 + 50) / 100; // bloombits * ln2
+        footer.bloomk = footer.bloomk < 1 ? 1 : (footer.bloomk > 16 ? 16 : footer.bloomk);
+        bloom = (uint64_t*)calloc(footer.bloomblocks * 8, sizeof(uint64_t));
+        if (bloom == NULL) {
+            sst_build_abort(b);
+            return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+        }
+        for (uint64_t i = 0; i < b->count; ++i) {
+            uint32_t x, d;
+            uint64_t* block = bloomblock(bloom, footer.bloomblocks, b->hashes[i], &x, &d);
+            for (uint32_t j = 0; j < footer.bloomk; ++j, x += d) {
+                uint32_t bit = x >> 23;
+                block[bit >> 6] |= 1ULL << (bit & 63);
+            }
+        }
+    }
+    _status = writeall(b->fd, b->index, b->ilen);
+    if (_status.ok && bloom != NULL) {
+        _status = writeall(b->fd, bloom, footer.bloomblocks * 64);
+    }
+    free(bloom);
+    if (_status.ok) {
+        _status = writeall(b->fd, &footer, sizeof(sstfooter_t));
+    }
+    if (_status.ok && fsync(b->fd) < 0) {
+        _status = statusnotok2(_status, "fsync(%d): %s", errno, strerror(errno));
+    }
+    if (_status.ok && rename(b->tmpname, b->name) < 0) {
+        _status = statusnotok2(_status, "rename(%d): %s", errno, strerror(errno));
+    }
+    if (!_status.ok) {
+        sst_build_abort(b);
+        return _status;
+    }
+    _status = sst_open(b->name, id, t);
+    close(b->fd);
+    b->fd = -1;
+    free(b->tmpname);
+    b->tmpname = NULL; // 已rename，abort不再删除
+    sst_build_abort(b);
+    return _status;
+}
+
+void sst_build_abort(sstbuilder_t* b) {
+    if (b == NULL) {
+        return;
+    }
+    if (b->fd >= 0) {
+        close(b->fd);
+    }
+    if (b->tmpname != NULL) {
+        unlink(b->tmpname);
+    }
+    free(b->tmpname);
+    free(b->name);
+    free(b->block);
+    free(b->index);
+    free(b->hashes);
+    free(b);
+}
+
+status_t sst_open(const char* name, uint64_t id, sst_t** t) {
+    status_t _status = { .ok = 1 };
+    sstfooter_t footer;
+    struct stat st;
+
+    *t = (sst_t*)calloc(1, sizeof(sst_t));
+    if (*t == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    sst_t* s = *t;
+    s->id = id;
+    s->name = strdup(name);
+    if ((s->fd = open(name, O_RDONLY)) < 0 || fstat(s->fd, &st) < 0) {
+        _status = statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+        goto failed;
+    }
+    s->size = st.st_size;
+    if (s->size < sizeof(sstfooter_t)) {
+        _status = statusnotok1(_status, "%s is not a sstable", name);
+        goto failed;
+    }
+    _status = readall(s->fd, &footer, sizeof(sstfooter_t), s->size - sizeof(sstfooter_t));
+    if (!_status.ok) {
+        goto failed;
+    }
+    if (footer.magic != SST_MAGIC || footer.version != SST_VERSION || footer.indexoff > footer.bloomoff ||
+        footer.bloomoff + footer.bloomblocks * 64 + sizeof(sstfooter_t) != s->size) {
+        _status = statusnotok1(_status, "%s is not a sstable or is corrupted", name);
+        goto failed;
+    }
+    s->count = footer.count;
+    s->nblocks = footer.nblocks;
+    s->maxblock = footer.maxblock;
+    s->bloomblocks = footer.bloomblocks;
+    s->bloomk = footer.bloomk;
+    size_t ilen = footer.bloomoff - footer.indexoff;
+    s->index = (char*)malloc(ilen + 1);
+    s->offs = (uint64_t*)malloc(sizeof(uint64_t) * (s->nblocks + 1));
+    s->keypos = (uint32_t*)malloc(sizeof(uint32_t) * (s->nblocks + 1));
+    s->bloom = s->bloomblocks > 0 ? (uint64_t*)malloc(s->bloomblocks * 64) : NULL;
+    if (s->index == NULL || s->offs == NULL || s->keypos == NULL || (s->bloomblocks > 0 && s->bloom == NULL)) {
+        _status = statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+        goto failed;
+    }
+    _status = readall(s->fd, s->index, ilen, footer.indexoff);
+    if (_status.ok && s->bloom != NULL) {
+        _status = readall(s->fd, s->bloom, s->bloomblocks * 64, footer.bloomoff);
+    }
+    if (!_status.ok) {
+        goto failed;
+    }
+    size_t pos = 0;
+    for (uint64_t i = 0; i < s->nblocks; ++i) {
+        uint16_t len;
+        if (pos + sizeof(uint64_t) + sizeof(uint16_t) > ilen) {
+            break;
+        }
+        memcpy(&s->offs[i], s->index + pos, sizeof(uint64_t));
+        memcpy(&len, s->index + pos + sizeof(uint64_t), sizeof(uint16_t));
+        s->keypos[i] = pos + sizeof(uint64_t);
+        pos += sizeof(uint64_t) + sizeof(uint16_t) + len;
+    }
+    if (pos != ilen) {
+        _status = statusnotok1(_status, "%s has a corrupted index", name);
+        goto failed;
+    }
+    s->offs[s->nblocks] = footer.indexoff;
+    return _status;
+
+failed:
+    sst_close(s);
+    *t = NULL;
+    return _status;
+}
+
+void sst_close(sst_t* t) {
+    if (t == NULL) {
+        return;
+    }
+    if (t->fd >= 0) {
+        close(t->fd);
+    }
+    free(t->index);
+    free(t->offs);
+    free(t->keypos);
+    free(t->bloom);
+    free(t->name);
+    free(t);
+}
+
+static inline int maycontain(sst_t* t, const void* key, size_t key_len) {
+    uint32_t x, d;
+
+    if (t->bloom == NULL) {
+        return 1;
+    }
+    uint64_t* block = bloomblock(t->bloom, t->bloomblocks, sl_hashkey(key, key_len), &x, &d);
+    for (uint32_t i = 0; i < t->bloomk; ++i, x += d) {
+        uint32_t bit = x >> 23;
+        if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline int cmpfirst(sst_t* t, uint64_t i, const void* key, size_t key_len) {
+    uint16_t len;
+    memcpy(&len, t->index + t->keypos[i], sizeof(uint16_t));
+    return keycmp(t->index + t->keypos[i] + sizeof(uint16_t), len, key, key_len);
+}
+
+// 最后一个首key <= key的块，key小于全部首key时返回-1
+static int64_t findblock(sst_t* t, const void* key, size_t key_len) {
+    int64_t lo = 0, hi = (int64_t)t->nblocks - 1, found = -1;
+
+    while (lo <= hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (cmpfirst(t, mid, key, key_len) <= 0) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// 解析buf[*pos]处的条目，返回0表示已到末尾(或条目不完整)
+static inline int parseentry(const char* buf, size_t len, size_t* pos, const void** key, size_t* key_len, uint64_t* value) {
+    uint16_t klen;
+
+    if (*pos + sizeof(uint16_t) > len) {
+        return 0;
+    }
+    memcpy(&klen, buf + *pos, sizeof(uint16_t));
+    if (*pos + sizeof(uint16_t) + klen + sizeof(uint64_t) > len) {
+        return 0;
+    }
+    *key = buf + *pos + sizeof(uint16_t);
+    *key_len = klen;
+    memcpy(value, buf + *pos + sizeof(uint16_t) + klen, sizeof(uint64_t));
+    *pos += sizeof(uint16_t) + klen + sizeof(uint64_t);
+    return 1;
+}
+
+status_t sst_get(sst_t* t, const void* key, size_t key_len, uint64_t* value, int* found) {
+    status_t _status = { .ok = 1 };
+    char stackbuf[SST_STACKBLOCK];
+    const void* k = NULL;
+    size_t klen = 0, pos = 0;
+    uint64_t v = 0;
+
+    *found = 0;
+    if (!maycontain(t, key, key_len)) {
+        return _status;
+    }
+    int64_t i = findblock(t, key, key_len);
+    if (i < 0) {
+        return _status;
+    }
+    size_t len = t->offs[i + 1] - t->offs[i];
+    char* buf = len <= sizeof(stackbuf) ? stackbuf : (char*)malloc(len);
+    if (buf == NULL) {
+        return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    }
+    _status = readall(t->fd, buf, len, t->offs[i]);
+    while (_status.ok && parseentry(buf, len, &pos, &k, &klen, &v)) {
+        int cmp = keycmp(k, klen, key, key_len);
+        if (cmp >= 0) {
+            if (cmp == 0) {
+                *value = v;
+                *found = 1;
+            }
+            break;
+        }
+    }
+    if (buf != stackbuf) {
+        free(buf);
+    }
+    return _status;
+}
+
+// 从it->block开始读入不超过SST_READAHEAD(至少一个块)的连续块
+static status_t loadblocks(sstiter_t* it) {
+    status_t _status = { .ok = 1 };
+    sst_t* t = it->t;
+
+    it->len = it->pos = 0;
+    if (it->block >= t->nblocks) {
+        it->valid = 0;
+        return _status;
+    }
+    uint64_t end = it->block + 1;
+    while (end < t->nblocks && t->offs[end + 1] - t->offs[it->block] <= SST_READAHEAD) {
+        ++end;
+    }
+    size_t len = t->offs[end] - t->offs[it->block];
+    _status = reserve((void**)&it->buf, &it->cap, len);
+    if (_status.ok) {
+        _status = readall(t->fd, it->buf, len, t->offs[it->block]);
+    }
+    if (!_status.ok) {
+        it->valid = 0;
+        return _status;
+    }
+    it->len = len;
+    it->block = end;
+    return _status;
+}
+
+status_t sst_iter_next(sstiter_t* it) {
+    status_t _status = { .ok = 1 };
+
+    while (it->valid && !parseentry(it->buf, it->len, &it->pos, &it->key, &it->key_len, &it->value)) {
+        _status = loadblocks(it);
+        if (!_status.ok) {
+            return _status;
+        }
+    }
+    return _status;
+}
+
+status_t sst_iter_seek(sst_t* t, sstiter_t* it, const void* key, size_t key_len) {
+    status_t _status = { .ok = 1 };
+
+    memset(it, 0, sizeof(sstiter_t));
+    it->t = t;
+    it->valid = 1;
+    if (key != NULL) {
+        int64_t i = findblock(t, key, key_len);
+        it->block = i < 0 ? 0 : i;
+    }
+    _status = loadblocks(it);
+    if (!_status.ok) {
+        return _status;
+    }
+    _status = sst_iter_next(it);
+    while (_status.ok && it->valid && key != NULL && keycmp(it->key, it->key_len, key, key_len) < 0) {
+        _status = sst_iter_next(it);
+    }
+    return _status;
+}
+
+void sst_iter_close(sstiter_t* it) {
+    free(it->buf);
+    it->buf = NULL;
+    it->cap = 0;
+    it->valid = 0;
+}
@@ -0,0 +1,114 @@
+#include "internal.h"
+
+// 运行时统计：操作计数在每线程的槽位里累加，sl_stats时汇总；
+// level分布、空闲链表大小在元数据头部随分配/回收维护，不需要遍历
+
+__thread int sl_statslot = -1;
+__thread int sl_curop = SL_STAT_OTHER;
+
+static uint64_t slotsused = 0; // 已领取的独占槽位(位图)
+static pthread_key_t slotkey;
+static pthread_once_t slotonce = PTHREAD_ONCE_INIT;
+
+// 线程退出时归还槽位，计数留在槽位里继续累加
+static void releaseslot(void* arg) {
+    uint64_t bit = 1ULL << ((uintptr_t)arg - 1);
+    __sync_fetch_and_and(&slotsused, ~bit);
+}
+
+static void makekey() {
+    pthread_key_create(&slotkey, releaseslot);
+}
+
+int sl_claimslot() {
+    pthread_once(&slotonce, makekey);
+    while (1) {
+        uint64_t used = slotsused;
+        if (used == UINT64_MAX) {
+            return SL_STATS_SLOTS;
+        }
+        int slot = __builtin_ctzll(~used);
+        if (__sync_bool_compare_and_swap(&slotsused, used, used | (1ULL << slot))) {
+            pthread_setspecific(slotkey, (void*)(uintptr_t)(slot + 1));
+            return slot;
+        }
+    }
+}
+
+// 独占槽位 + 共用槽位
+statslot_t* sl_stats_alloc() {
+    void* p = NULL;
+
+    if (posix_memalign(&p, 64, sizeof(statslot_t) * (SL_STATS_SLOTS + 1)) != 0) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(statslot_t) * (SL_STATS_SLOTS + 1));
+    return (statslot_t*)p;
+}
+
+static double ratio(uint64_t n, uint64_t total) {
+    return total == 0 ? 0.0 : (double)n / total;
+}
+
+status_t sl_stats(skiplist_t* sl, sl_stats_t* stats) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || stats == NULL) {
+        return statusnotok0(_status, "skiplist or stats is NULL");
+    }
+    memset(stats, 0, sizeof(sl_stats_t));
+    for (int i = 0; i <= SL_STATS_SLOTS; ++i) {
+        statslot_t* slot = &sl->stats[i];
+        for (int op = 0; op < SL_STAT_OPS; ++op) {
+            stats->ops[op] += slot->ops[op];
+        }
+        stats->hits += slot->hits;
+        stats->misses += slot->misses;
+        stats->lookups += slot->lookups;
+        stats->hops += slot->hops;
+        stats->compares += slot->compares;
+        stats->synced += slot->synced;
+        stats->evictions += slot->evictions;
+        for (int op = 0; op < SL_STAT_OPS; ++op) {
+            stats->locks[op].acquires += slot->lockacquires[op];
+            stats->locks[op].contended += slot->lockcontended[op];
+            stats->locks[op].waitns += slot->lockwaitns[op];
+            stats->locks[op].holdns += slot->lockholdns[op];
+            stats->locks[op].holdsamples += slot->lockholdsamples[op];
+        }
+    }
+    for (int op = 0; op < SL_STAT_OPS; ++op) {
+        sl_lockstats_t* l = &stats->locks[op];
+        l->avgwaitns = ratio(l->waitns, l->acquires);
+        l->avgholdns = ratio(l->holdns, l->holdsamples);
+    }
+    stats->hitrate = ratio(stats->hits, stats->hits + stats->misses);
+    stats->avghops = ratio(stats->hops, stats->lookups);
+    stats->avgcompares = ratio(stats->compares, stats->lookups);
+
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    skipmeta_t* meta = sl->meta;
+    stats->count = meta->count;
+    stats->maxlevel = METANODEHEAD(sl)->level;
+    memcpy(stats->levels, meta->levels, sizeof(stats->levels));
+    stats->metafreen = meta->metafreen;
+    stats->metafreebytes = meta->metafreebytes;
+    stats->datafreen = meta->datafreen;
+    stats->datafreebytes = meta->datafreebytes;
+    stats->metamapsize = meta->mapsize;
+    stats->metamapcap = meta->mapcap;
+    stats->datamapsize = sl->data->mapsize;
+    stats->datamapcap = sl->data->mapcap;
+    stats->expansions = meta->generation;
+    if (sl->pool != NULL) {
+        sl_pool_stats(sl, stats);
+    }
+    stats->metafrag = ratio(stats->metafreebytes, stats->metamapsize);
+    stats->datafrag = ratio(stats->datafreebytes, stats->datamapsize);
+    return sl_unlock(sl, _offsets, 0);
+}
@@ -0,0 +1,203 @@
+#include "internal.h"
+#include "trace.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+// 操作跟踪：记录在调用方持有的锁内写入本线程的缓冲区，读操作之间不竞争；
+// 缓冲区满时在mutex内整块write到文件。开始/停止跟踪持有写锁，与记录互斥
+
+typedef struct tracebuf_s {
+    struct tracebuf_s* next;
+    pthread_t owner;
+    uint32_t thread;
+    size_t len;
+    char data[SL_TRACE_BUFF_SIZE];
+} tracebuf_t;
+
+typedef struct tracer_s {
+    pthread_mutex_t mutex;
+    int fd;
+    uint64_t id;      // 区分先后的跟踪(地址可能复用)
+    uint64_t start;   // CLOCK_MONOTONIC
+    uint32_t threads; // 已分配的线程编号数
+    tracebuf_t* bufs;
+} tracer_t;
+
+// 本线程最近使用的缓冲区
+static __thread struct {
+    uint64_t id;
+    tracebuf_t* buf;
+} tls;
+
+static uint64_t nextid = 0;
+
+static inline uint64_t monotonic() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static status_t writeall(int fd, const void* buff, size_t size) {
+    status_t _status = { .ok = 1 };
+
+    for (size_t done = 0; done < size;) {
+        ssize_t n = write(fd, buff + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+        }
+        done += n;
+    }
+    return _status;
+}
+
+// mutex内调用；写失败时丢弃缓冲内容，跟踪是尽力而为的
+static void flushbuf(tracer_t* tr, tracebuf_t* buf) {
+    if (buf->len > 0) {
+        writeall(tr->fd, buf->data, buf->len);
+        buf->len = 0;
+    }
+}
+
+static tracebuf_t* threadbuf(tracer_t* tr) {
+    pthread_t self = pthread_self();
+    tracebuf_t* buf = NULL;
+
+    if (tls.id == tr->id) {
+        return tls.buf;
+    }
+    pthread_mutex_lock(&tr->mutex);
+    for (buf = tr->bufs; buf != NULL && !pthread_equal(buf->owner, self); buf = buf->next) {
+    }
+    if (buf == NULL && (buf = (tracebuf_t*)malloc(sizeof(tracebuf_t))) != NULL) {
+        buf->owner = self;
+        buf->thread = tr->threads++;
+        buf->len = 0;
+        buf->next = tr->bufs;
+        tr->bufs = buf;
+    }
+    pthread_mutex_unlock(&tr->mutex);
+    if (buf != NULL) {
+        tls.id = tr->id;
+        tls.buf = buf;
+    }
+    return buf;
+}
+
+void sl_trace_record(skiplist_t* sl, uint8_t op, uint8_t flags, const void* key, size_t key_len, uint64_t value) {
+    tracer_t* tr = sl->trace;
+    tracebuf_t* buf = threadbuf(tr);
+
+    if (buf == NULL) {
+        return;
+    }
+    if (buf->len + sizeof(tracerecord_t) + key_len > SL_TRACE_BUFF_SIZE) {
+        pthread_mutex_lock(&tr->mutex);
+        flushbuf(tr, buf);
+        pthread_mutex_unlock(&tr->mutex);
+    }
+    tracerecord_t* rec = (tracerecord_t*)(buf->data + buf->len);
+    rec->ts = monotonic() - tr->start;
+    rec->value = value;
+    rec->thread = buf->thread;
+    rec->op = op;
+    rec->flags = flags;
+    rec->size = (uint16_t)key_len;
+    memcpy(rec->data, key, key_len);
+    buf->len += TRACERECORDSIZE(rec);
+}
+
+// 调用方持有写锁
+status_t sl_trace_open(skiplist_t* sl, const char* path) {
+    status_t _status = { .ok = 1 };
+    struct timespec ts;
+
+    tracer_t* tr = (tracer_t*)calloc(1, sizeof(tracer_t));
+    if (tr == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    tr->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (tr->fd < 0) {
+        free(tr);
+        return statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    traceheader_t header = {
+        .magic = SL_TRACE_MAGIC,
+        .version = SL_TRACE_VERSION,
+        .start = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+    };
+    _status = writeall(tr->fd, &header, sizeof(header));
+    if (!_status.ok) {
+        close(tr->fd);
+        free(tr);
+        return _status;
+    }
+    pthread_mutex_init(&tr->mutex, NULL);
+    tr->id = __sync_add_and_fetch(&nextid, 1);
+    tr->start = monotonic();
+    sl->trace = tr;
+    return _status;
+}
+
+// 调用方持有写锁(或已没有其他线程访问)
+void sl_trace_close(skiplist_t* sl) {
+    tracer_t* tr = sl->trace;
+
+    if (tr == NULL) {
+        return;
+    }
+    sl->trace = NULL;
+    while (tr->bufs != NULL) {
+        tracebuf_t* buf = tr->bufs;
+        tr->bufs = buf->next;
+        flushbuf(tr, buf);
+        free(buf);
+    }
+    close(tr->fd);
+    pthread_mutex_destroy(&tr->mutex);
+    free(tr);
+}
+
+status_t sl_trace_start(skiplist_t* sl, const char* path) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL || path == NULL) {
+        return statusnotok0(_status, "skiplist or path is NULL");
+    }
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    if (sl->trace != NULL) {
+        sl_unlock(sl, _offsets, 0);
+        return statusnotok0(_status, "trace is already started");
+    }
+    _status = sl_trace_open(sl, path);
+    if (!_status.ok) {
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
+
+status_t sl_trace_stop(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    _status = sl_wrlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    sl_trace_close(sl);
+    return sl_unlock(sl, _offsets, 0);
+}
@@ -0,0 +1,171 @@
+#include "internal.h"
+#include <errno.h>
+
+// 上层索引：level >= K的节点按key有序存放在两个连续数组里(8字节key前缀 + metanode位置)。
+// 点查先在前缀数组上二分，从最后一个前缀严格小于目标的节点的第K层进入跳表，
+// 省掉高层在映射中分散节点上的缓存未命中。前缀按大端取前8字节、不足补0，
+// 前缀严格小于则key严格小于
+
+#define UPPER_TARGET 256 // 期望每个索引项覆盖的节点数，决定K
+
+typedef struct upperidx_s {
+    int level;           // K
+    size_t n;
+    size_t cap;
+    uint64_t* prefixes;
+    uint64_t* offsets;   // metanode位置
+} upperidx_t;
+
+static inline uint64_t nodeprefix(skiplist_t* sl, metanode_t* mnode) {
+    datanode_t* dnode = sl_get_datanode(sl, mnode->offset);
+    return sl_keyprefix(dnode->data, dnode->size);
+}
+
+// 第一个prefixes[i] >= prefix的下标，无分支二分
+static inline size_t lowerbound(const uint64_t* prefixes, size_t n, uint64_t prefix) {
+    const uint64_t* base = prefixes;
+
+    if (n == 0) {
+        return 0;
+    }
+    while (n > 1) {
+        size_t half = n / 2;
+        base = base[half - 1] < prefix ? base + half : base;
+        n -= half;
+    }
+    return (size_t)(base - prefixes) + (*base < prefix);
+}
+
+// 节点在索引中的下标，不在索引中返回n
+static size_t locate(upperidx_t* idx, uint64_t prefix, uint64_t pos) {
+    for (size_t i = lowerbound(idx->prefixes, idx->n, prefix); i < idx->n && idx->prefixes[i] == prefix; ++i) {
+        if (idx->offsets[i] == pos) {
+            return i;
+        }
+    }
+    return idx->n;
+}
+
+// 两个数组都扩容成功后才更新cap：第二次realloc失败时第一个数组已变大，但cap不变，按原容量使用仍然安全
+static int grow(upperidx_t* idx) {
+    size_t cap = idx->cap == 0 ? 1024 : idx->cap * 2;
+    uint64_t* prefixes = (uint64_t*)realloc(idx->prefixes, sizeof(uint64_t) * cap);
+    if (prefixes == NULL) {
+        return -1;
+    }
+    idx->prefixes = prefixes;
+    uint64_t* offsets = (uint64_t*)realloc(idx->offsets, sizeof(uint64_t) * cap);
+    if (offsets == NULL) {
+        return -1;
+    }
+    idx->offsets = offsets;
+    idx->cap = cap;
+    return 0;
+}
+
+status_t sl_upper_build(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+    metanode_t* head = METANODEHEAD(sl);
+
+    upperidx_t* idx = (upperidx_t*)calloc(1, sizeof(upperidx_t));
+    if (idx == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    // 第K层的期望节点数为count * p^K
+    idx->level = 1;
+    for (double span = 1 / sl->meta->p; span < UPPER_TARGET && idx->level < SKIPLIST_MAXLEVEL - 1; span /= sl->meta->p) {
+        ++idx->level;
+    }
+    if ((int)head->level > idx->level) {
+        for (metanode_t* curr = METANODE(sl, head->forwards[idx->level]); curr != NULL;
+             curr = METANODE(sl, curr->forwards[idx->level])) {
+            if (idx->n == idx->cap && grow(idx) != 0) {
+                sl->upper = idx;
+                sl_upper_free(sl);
+                return statusnotok2(_status, "realloc(%d): %s", errno, strerror(errno));
+            }
+            idx->prefixes[idx->n] = nodeprefix(sl, curr);
+            idx->offsets[idx->n] = METANODEPOSITION(sl, curr);
+            ++idx->n;
+        }
+    }
+    sl->upper = idx;
+    return _status;
+}
+
+void sl_upper_free(skiplist_t* sl) {
+    if (sl->upper == NULL) {
+        return;
+    }
+    free(sl->upper->prefixes);
+    free(sl->upper->offsets);
+    free(sl->upper);
+    sl->upper = NULL;
+}
+
+// 新节点已链入，update为各层前驱。内存不足时丢弃整个索引，回退到从头节点查找
+void sl_upper_insert(skiplist_t* sl, metanode_t* update[], metanode_t* mnode, const void* key, size_t key_len) {
+    upperidx_t* idx = sl->upper;
+
+    if (idx == NULL || (int)mnode->level <= idx->level) {
+        return;
+    }
+    metanode_t* prev = update[idx->level];
+    if (idx->n == idx->cap && grow(idx) != 0) {
+        sl_upper_free(sl);
+        return;
+    }
+    size_t i = 0;
+    if ((prev->flag & METANODE_HEAD) != METANODE_HEAD) {
+        i = locate(idx, nodeprefix(sl, prev), METANODEPOSITION(sl, prev)) + 1;
+    }
+    memmove(idx->prefixes + i + 1, idx->prefixes + i, sizeof(uint64_t) * (idx->n - i));
+    memmove(idx->offsets + i + 1, idx->offsets + i, sizeof(uint64_t) * (idx->n - i));
+    idx->prefixes[i] = sl_keyprefix(key, key_len);
+    idx->offsets[i] = METANODEPOSITION(sl, mnode);
+    ++idx->n;
+}
+
+// 节点将被摘除，调用时其datanode仍有效
+void sl_upper_remove(skiplist_t* sl, metanode_t* mnode) {
+    upperidx_t* idx = sl->upper;
+
+    if (idx == NULL || (int)mnode->level <= idx->level) {
+        return;
+    }
+    size_t i = locate(idx, nodeprefix(sl, mnode), METANODEPOSITION(sl, mnode));
+    if (i == idx->n) {
+        return;
+    }
+    memmove(idx->prefixes + i, idx->prefixes + i + 1, sizeof(uint64_t) * (idx->n - i - 1));
+    memmove(idx->offsets + i, idx->offsets + i + 1, sizeof(uint64_t) * (idx->n - i - 1));
+    --idx->n;
+}
+
+// 返回查找的起点和起始层：最后一个key严格小于目标的索引节点，没有则为头节点。
+// 前缀相等的一段(key有长公共前缀时)再按完整key二分，只在这一段访问datanode
+metanode_t* sl_upper_seek(skiplist_t* sl, const void* key, size_t key_len, int* level) {
+    upperidx_t* idx = sl->upper;
+    metanode_t* head = METANODEHEAD(sl);
+    uint64_t prefix = sl_keyprefix(key, key_len);
+
+    *level = (int)head->level - 1 < idx->level ? (int)head->level - 1 : idx->level;
+    size_t lo = lowerbound(idx->prefixes, idx->n, prefix);
+    size_t hi = lo;
+    while (hi < idx->n && idx->prefixes[hi] == prefix && hi - lo < 8) {
+        ++hi;
+    }
+    if (hi - lo == 8) {
+        hi = prefix == UINT64_MAX ? idx->n : lowerbound(idx->prefixes, idx->n, prefix + 1);
+    }
+    while (lo < hi) { // [lo, hi)内找第一个key >= 目标
+        size_t mid = lo + (hi - lo) / 2;
+        datanode_t* dnode = sl_get_datanode(sl, METANODE(sl, idx->offsets[mid])->offset);
+        if (sl->keyops->cmp(sl, dnode->data, dnode->size, key, key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? head : METANODE(sl, idx->offsets[lo - 1]);
+}
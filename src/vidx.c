@@ -0,0 +1,276 @@
+#include "internal.h"
+#include <errno.h>
+
+// 值索引(<prefix>.sl.vidx)：按(value, 主跳表metanode位置)排序的第二个跳表，
+// 查找值在[lo, hi]内的key为O(log n + k)。节点为{value, pos, level, forwards[level]}，按level大小分配，
+// 删除的节点按level挂在空闲链表上复用；空间不足时文件扩为2倍(映射地址可能改变，所以只记录文件内偏移)。
+// 写操作在改动主跳表前预留一个节点的空间(sl_vidx_reserve)，之后的更新不会失败，两者在同一次写锁内一起完成。
+// 只用于SL_FORMAT_NODE，节点位置不会移动。文件头的seq在sync/关闭时写为meta->seq，加载时不一致则按跳表重建
+
+#define VIDX_MAGIC 0x56534c53 // "SLSV"
+#define VIDX_MINSIZE 65536
+
+typedef struct vidxnode_s {
+    uint64_t value;
+    uint64_t pos; // 主跳表的metanode位置
+    uint32_t level;
+    uint32_t reserved;
+    uint64_t forwards[]; // 下一个节点的偏移，0为链尾
+} vidxnode_t;
+
+typedef struct vidxhead_s {
+    uint32_t magic;
+    uint32_t level;  // 头节点当前的level
+    uint64_t seq;    // 与meta->seq相等时索引与跳表一致
+    uint64_t used;   // 已分配的字节，之后是未用过的空间
+    uint64_t count;
+    uint64_t free[SKIPLIST_MAXLEVEL + 1]; // 按level回收的节点链表头，经forwards[0]串联
+} vidxhead_t;
+
+typedef struct vidx_s {
+    sidecar_t sc;
+} vidx_t;
+
+#define VIDXHEAD(vx) ((vidxhead_t*)(vx)->sc.mapped)
+#define VIDXNODE(vx, off) ((off) == 0 ? NULL : (vidxnode_t*)((vx)->sc.mapped + (off)))
+#define VIDXNODESIZE(level) (sizeof(vidxnode_t) + sizeof(uint64_t) * (level))
+#define VIDXHEADNODE sizeof(vidxhead_t) // 头节点按最大level分配，紧跟文件头
+
+static inline int less(const vidxnode_t* node, uint64_t value, uint64_t pos) {
+    return node->value < value || (node->value == value && node->pos < pos);
+}
+
+// 每层最后一个 < (value, pos)的节点偏移，返回第0层的下一个节点
+static vidxnode_t* findpath(vidx_t* vx, uint64_t value, uint64_t pos, uint64_t update[]) {
+    uint64_t curr = VIDXHEADNODE;
+
+    for (int level = (int)VIDXHEAD(vx)->level - 1; level >= 0; --level) {
+        vidxnode_t* next = NULL;
+        while ((next = VIDXNODE(vx, VIDXNODE(vx, curr)->forwards[level])) != NULL && less(next, value, pos)) {
+            curr = VIDXNODE(vx, curr)->forwards[level];
+        }
+        update[level] = curr;
+    }
+    return VIDXHEAD(vx)->level > 0 ? VIDXNODE(vx, VIDXNODE(vx, curr)->forwards[0]) : NULL;
+}
+
+static void linknode(vidx_t* vx, uint64_t off) {
+    uint64_t update[SKIPLIST_MAXLEVEL];
+    vidxhead_t* head = VIDXHEAD(vx);
+    vidxnode_t* node = VIDXNODE(vx, off);
+
+    findpath(vx, node->value, node->pos, update);
+    for (uint32_t i = head->level; i < node->level; ++i) {
+        update[i] = VIDXHEADNODE;
+    }
+    if (head->level < node->level) {
+        head->level = node->level;
+    }
+    for (uint32_t i = 0; i < node->level; ++i) {
+        node->forwards[i] = VIDXNODE(vx, update[i])->forwards[i];
+        VIDXNODE(vx, update[i])->forwards[i] = off;
+    }
+}
+
+// 摘除(value, pos)的节点，返回其偏移，不存在返回0
+static uint64_t unlinknode(vidx_t* vx, uint64_t value, uint64_t pos) {
+    uint64_t update[SKIPLIST_MAXLEVEL];
+    vidxhead_t* head = VIDXHEAD(vx);
+    vidxnode_t* node = findpath(vx, value, pos, update);
+
+    if (node == NULL || node->value != value || node->pos != pos) {
+        return 0;
+    }
+    uint64_t off = VIDXNODE(vx, update[0])->forwards[0];
+    for (uint32_t i = 0; i < node->level; ++i) {
+        VIDXNODE(vx, update[i])->forwards[i] = node->forwards[i];
+    }
+    vidxnode_t* first = VIDXNODE(vx, VIDXHEADNODE);
+    while (head->level > 0 && first->forwards[head->level - 1] == 0) {
+        --head->level;
+    }
+    return off;
+}
+
+// 空间由sl_vidx_reserve保证
+static uint64_t allocnode(vidx_t* vx, uint32_t level) {
+    vidxhead_t* head = VIDXHEAD(vx);
+    uint64_t off = head->free[level];
+
+    if (off != 0) {
+        head->free[level] = VIDXNODE(vx, off)->forwards[0];
+    } else {
+        off = head->used;
+        head->used += VIDXNODESIZE(level);
+    }
+    VIDXNODE(vx, off)->level = level;
+    return off;
+}
+
+static void freenode(vidx_t* vx, uint64_t off) {
+    vidxhead_t* head = VIDXHEAD(vx);
+    vidxnode_t* node = VIDXNODE(vx, off);
+
+    node->forwards[0] = head->free[node->level];
+    head->free[node->level] = off;
+}
+
+static status_t reserve(vidx_t* vx) {
+    status_t _status = { .ok = 1 };
+    uint64_t need = VIDXHEAD(vx)->used + VIDXNODESIZE(SKIPLIST_MAXLEVEL);
+
+    if (need <= vx->sc.size) {
+        return _status;
+    }
+    uint64_t size = vx->sc.size;
+    while (size < need) {
+        size *= 2;
+    }
+    return sl_sidecar_resize(&vx->sc, size);
+}
+
+static void insert(skiplist_t* sl, metanode_t* mnode) {
+    vidx_t* vx = sl->vidx;
+    uint64_t off = allocnode(vx, sl_random_level(sl->meta->p));
+    vidxnode_t* node = VIDXNODE(vx, off);
+
+    node->value = mnode->value;
+    node->pos = METANODEPOSITION(sl, mnode);
+    linknode(vx, off);
+    ++VIDXHEAD(vx)->count;
+}
+
+static status_t rebuild(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+    vidx_t* vx = sl->vidx;
+    metanode_t* head = METANODEHEAD(sl);
+
+    if (vx->sc.size < VIDX_MINSIZE && !(_status = sl_sidecar_resize(&vx->sc, VIDX_MINSIZE)).ok) {
+        return _status;
+    }
+    memset(vx->sc.mapped, 0, VIDXHEADNODE + VIDXNODESIZE(SKIPLIST_MAXLEVEL));
+    vidxhead_t* vh = VIDXHEAD(vx);
+    vh->magic = VIDX_MAGIC;
+    vh->used = VIDXHEADNODE + VIDXNODESIZE(SKIPLIST_MAXLEVEL);
+    VIDXNODE(vx, VIDXHEADNODE)->level = SKIPLIST_MAXLEVEL;
+    for (metanode_t* curr = METANODE(sl, head->forwards[0]); curr != NULL; curr = METANODE(sl, curr->forwards[0])) {
+        if (!(_status = reserve(vx)).ok) {
+            return _status;
+        }
+        insert(sl, curr);
+    }
+    return _status;
+}
+
+status_t sl_vidx_open(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    sl->vidx = (vidx_t*)calloc(1, sizeof(vidx_t));
+    if (sl->vidx == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    _status = sl_sidecar_open(sl, "vidx", VIDX_MINSIZE, &sl->vidx->sc);
+    if (!_status.ok) {
+        sl_vidx_close(sl);
+        return _status;
+    }
+    vidxhead_t* head = VIDXHEAD(sl->vidx);
+    if (_status.type == STATUS_SKIPLIST_LOAD && sl->vidx->sc.size >= VIDX_MINSIZE && head->magic == VIDX_MAGIC &&
+        head->seq == sl->meta->seq && head->used <= sl->vidx->sc.size && head->count == sl->meta->count) {
+        return (status_t){ .ok = 1 };
+    }
+    _status = rebuild(sl);
+    if (!_status.ok) {
+        sl_vidx_close(sl);
+    }
+    return _status;
+}
+
+void sl_vidx_close(skiplist_t* sl) {
+    if (sl->vidx == NULL) {
+        return;
+    }
+    sl_sidecar_close(&sl->vidx->sc);
+    free(sl->vidx);
+    sl->vidx = NULL;
+}
+
+status_t sl_vidx_sync(skiplist_t* sl) {
+    VIDXHEAD(sl->vidx)->seq = sl->meta->seq;
+    return sl_sidecar_sync(&sl->vidx->sc);
+}
+
+status_t sl_vidx_reserve(skiplist_t* sl) {
+    status_t _status = { .ok = 1 };
+
+    return sl->vidx != NULL ? reserve(sl->vidx) : _status;
+}
+
+// 新节点已链入，需先sl_vidx_reserve
+void sl_vidx_insert(skiplist_t* sl, metanode_t* mnode) {
+    if (sl->vidx != NULL) {
+        insert(sl, mnode);
+    }
+}
+
+// 节点的值将改为value：摘下后按新值重新链入，节点不变
+void sl_vidx_update(skiplist_t* sl, metanode_t* mnode, uint64_t value) {
+    vidx_t* vx = sl->vidx;
+
+    if (vx == NULL || mnode->value == value) {
+        return;
+    }
+    uint64_t off = unlinknode(vx, mnode->value, METANODEPOSITION(sl, mnode));
+    if (off != 0) {
+        VIDXNODE(vx, off)->value = value;
+        linknode(vx, off);
+    }
+}
+
+// 节点将被摘除
+void sl_vidx_remove(skiplist_t* sl, metanode_t* mnode) {
+    vidx_t* vx = sl->vidx;
+
+    if (vx == NULL) {
+        return;
+    }
+    uint64_t off = unlinknode(vx, mnode->value, METANODEPOSITION(sl, mnode));
+    if (off != 0) {
+        freenode(vx, off);
+        --VIDXHEAD(vx)->count;
+    }
+}
+
+status_t sl_scan_by_value(skiplist_t* sl, uint64_t lo, uint64_t hi, sl_scan_cb cb, void* arg) {
+    SL_OPSCOPE(SL_STAT_SCAN);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    uint64_t update[SKIPLIST_MAXLEVEL];
+    uint64_t n = 0;
+
+    if (sl == NULL || cb == NULL) {
+        return statusnotok0(_status, "skiplist or cb is NULL");
+    }
+    SL_STATADD(sl, ops[SL_STAT_SCAN], 1);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    vidx_t* vx = sl->vidx;
+    if (vx == NULL) {
+        sl_unlock(sl, _offsets, 0);
+        return statusnotok0(_status, "valueindex is not enabled");
+    }
+    for (vidxnode_t* node = findpath(vx, lo, 0, update); node != NULL && node->value <= hi;
+         node = VIDXNODE(vx, node->forwards[0])) {
+        if (++n % POOL_READAHEAD == 0) { // 缓冲池模式下不累积pin
+            sl_pool_yield(sl);
+        }
+        metanode_t* mnode = METANODE(sl, node->pos);
+        datanode_t* dnode = sl_get_datanode(sl, mnode->offset);
+        if (cb(0, dnode->data, dnode->size, node->value, arg) != 0) {
+            break;
+        }
+    }
+    return sl_unlock(sl, _offsets, 0);
+}
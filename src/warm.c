@@ -0,0 +1,308 @@
+#include "warm.h"
+#include "internal.h"
+#include <errno.h>
+
+#define HEAT_MAGIC 0x48454154 // "HEAT"
+#define WARMUP_CHUNK 64        // 预热线程每次领取的页数
+#define WARMUP_MAXTHREADS 64
+
+// heat文件：头部 + 元数据页位图 + 数据页位图(每页1bit，1表示保存时驻留)
+typedef struct heathead_s {
+    uint32_t magic;
+    uint32_t pagesize;
+    uint64_t metapages;
+    uint64_t datapages;
+} heathead_t;
+
+typedef struct warmup_s {
+    uintptr_t* pages;
+    size_t n;
+    size_t next;      // 下一个待领取的下标
+    size_t pagesize;
+    uint64_t touched; // 已缺页的页数
+} warmup_t;
+
+static uint64_t usedpages(uint64_t mapsize, uint64_t mapcap, size_t pagesize) {
+    uint64_t used = mapsize + 1 < mapcap ? mapsize + 1 : mapcap;
+    return (used + pagesize - 1) / pagesize;
+}
+
+// 返回[mapped, mapped + npages * pagesize)的mincore向量，调用者free
+static status_t residentvec(void* mapped, uint64_t npages, size_t pagesize, unsigned char** vec) {
+    status_t _status = { .ok = 1 };
+
+    *vec = (unsigned char*)malloc(npages + 1);
+    if (*vec == NULL) {
+        return statusnotok2(_status, "malloc(%d): %s", errno, strerror(errno));
+    }
+    if (npages > 0 && mincore(mapped, npages * pagesize, *vec) == -1) {
+        free(*vec);
+        *vec = NULL;
+        return statusnotok2(_status, "mincore(%d): %s", errno, strerror(errno));
+    }
+    return _status;
+}
+
+static int isresident(const unsigned char* vec, uint64_t npages, uint64_t pos, size_t pagesize) {
+    return pos / pagesize < npages && (vec[pos / pagesize] & 1);
+}
+
+static void countregions(const unsigned char* vec, uint64_t npages, uint64_t* total, uint64_t region[][2]) {
+    *total = 0;
+    for (uint64_t i = 0; i < npages; ++i) {
+        int r = (int)(i * SL_RESIDENCY_REGIONS / npages);
+        ++region[r][0];
+        if (vec[i] & 1) {
+            ++region[r][1];
+            ++*total;
+        }
+    }
+}
+
+status_t sl_residency(skiplist_t* sl, sl_residency_t* r) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    unsigned char* metavec = NULL;
+    unsigned char* datavec = NULL;
+
+    if (sl == NULL || r == NULL) {
+        return statusnotok0(_status, "skiplist or residency is NULL");
+    }
+    memset(r, 0, sizeof(sl_residency_t));
+    r->pagesize = (uint64_t)sysconf(_SC_PAGESIZE);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    r->metapages = usedpages(sl->meta->mapsize, sl->meta->mapcap, r->pagesize);
+    r->datapages = sl->pool != NULL ? 0 : usedpages(sl->data->mapsize, sl->datacap, r->pagesize); // 缓冲池模式没有数据映射
+    if (!(_status = residentvec(METAMAPPED(sl), r->metapages, r->pagesize, &metavec)).ok ||
+        !(_status = residentvec(DATAMAPPED(sl), r->datapages, r->pagesize, &datavec)).ok) {
+        free(metavec);
+        sl_unlock(sl, _offsets, 0);
+        return _status;
+    }
+    countregions(metavec, r->metapages, &r->metaresident, r->metaregion);
+    countregions(datavec, r->datapages, &r->dataresident, r->dataregion);
+    for (metanode_t* curr = METANODE(sl, METANODEHEAD(sl)->forwards[0]); curr != NULL;
+         curr = METANODE(sl, curr->forwards[0])) {
+        uint64_t mpos = METANODEPOSITION(sl, curr);
+        ++r->levelnodes[curr->level - 1];
+        uint64_t offset = (curr->flag & METANODE_BLOCK) ? BLOCKENTRIES(curr)->offsets[0] : curr->offset;
+        if (isresident(metavec, r->metapages, mpos, r->pagesize) &&
+            (sl->pool != NULL || isresident(datavec, r->datapages, offset, r->pagesize))) {
+            ++r->levelresident[curr->level - 1];
+        }
+    }
+    free(metavec);
+    free(datavec);
+    return sl_unlock(sl, _offsets, 0);
+}
+
+static status_t writeheat(int fd, const unsigned char* vec, uint64_t npages) {
+    status_t _status = { .ok = 1 };
+    uint64_t nbytes = (npages + 7) / 8;
+
+    unsigned char* bitmap = (unsigned char*)calloc(nbytes + 1, 1);
+    if (bitmap == NULL) {
+        return statusnotok2(_status, "calloc(%d): %s", errno, strerror(errno));
+    }
+    for (uint64_t i = 0; i < npages; ++i) {
+        bitmap[i / 8] |= (vec[i] & 1) << (i % 8);
+    }
+    if (write(fd, bitmap, nbytes) != (ssize_t)nbytes) {
+        _status = statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+    }
+    free(bitmap);
+    return _status;
+}
+
+status_t sl_heat_save(skiplist_t* sl) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    unsigned char* metavec = NULL;
+    unsigned char* datavec = NULL;
+    heathead_t head = { .magic = HEAT_MAGIC, .pagesize = (uint32_t)sysconf(_SC_PAGESIZE) };
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    char* name = sl_filename(sl, "heat");
+    if (name == NULL) {
+        return statusnotok0(_status, "heat file is not supported in inmemory mode");
+    }
+    size_t name_len = strlen(name) + 5;
+    char* tmpname = (char*)malloc(name_len);
+    snprintf(tmpname, name_len, "%s.tmp", name);
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        free(name);
+        free(tmpname);
+        return _status;
+    }
+    head.metapages = usedpages(sl->meta->mapsize, sl->meta->mapcap, head.pagesize);
+    head.datapages = sl->pool != NULL ? 0 : usedpages(sl->data->mapsize, sl->datacap, head.pagesize);
+    if ((_status = residentvec(METAMAPPED(sl), head.metapages, head.pagesize, &metavec)).ok) {
+        _status = residentvec(DATAMAPPED(sl), head.datapages, head.pagesize, &datavec);
+    }
+    sl_unlock(sl, _offsets, 0);
+
+    // 先写临时文件再rename，多进程模式下各进程关闭时互不覆盖出半个文件
+    int fd = -1;
+    if (_status.ok && (fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+        _status = statusnotok2(_status, "open(%d): %s", errno, strerror(errno));
+    }
+    if (_status.ok && write(fd, &head, sizeof(heathead_t)) != sizeof(heathead_t)) {
+        _status = statusnotok2(_status, "write(%d): %s", errno, strerror(errno));
+    }
+    if (_status.ok) {
+        _status = writeheat(fd, metavec, head.metapages);
+    }
+    if (_status.ok) {
+        _status = writeheat(fd, datavec, head.datapages);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (_status.ok && rename(tmpname, name) == -1) {
+        _status = statusnotok2(_status, "rename(%d): %s", errno, strerror(errno));
+    }
+    if (!_status.ok) {
+        remove(tmpname);
+    }
+    free(metavec);
+    free(datavec);
+    free(name);
+    free(tmpname);
+    return _status;
+}
+
+// 按heat文件记录追加本进程映射中对应的页地址，超出当前映射的部分忽略
+static size_t loadheat(skiplist_t* sl, size_t pagesize, uintptr_t** pages, size_t n, size_t* cap) {
+    heathead_t head;
+    char* name = sl_filename(sl, "heat");
+    int fd = name != NULL ? open(name, O_RDONLY) : -1;
+
+    free(name);
+    if (fd < 0) {
+        return n;
+    }
+    if (read(fd, &head, sizeof(heathead_t)) != sizeof(heathead_t) || head.magic != HEAT_MAGIC ||
+        head.pagesize != pagesize) {
+        close(fd);
+        return n;
+    }
+    void* mapped[2] = { METAMAPPED(sl), DATAMAPPED(sl) };
+    uint64_t npages[2] = { head.metapages, head.datapages };
+    uint64_t limit[2] = { sl->meta->mapcap / pagesize, sl->pool != NULL ? 0 : sl->datacap / pagesize };
+    for (int f = 0; f < 2; ++f) {
+        uint64_t nbytes = (npages[f] + 7) / 8;
+        unsigned char* bitmap = (unsigned char*)malloc(nbytes + 1);
+        if (bitmap == NULL || read(fd, bitmap, nbytes) != (ssize_t)nbytes) {
+            free(bitmap);
+            break;
+        }
+        for (uint64_t i = 0; i < npages[f] && i < limit[f]; ++i) {
+            if ((bitmap[i / 8] >> (i % 8) & 1) == 0) {
+                continue;
+            }
+            if (n == *cap) {
+                *cap *= 2;
+                *pages = (uintptr_t*)realloc(*pages, sizeof(uintptr_t) * *cap);
+            }
+            (*pages)[n++] = (uintptr_t)mapped[f] + i * pagesize;
+        }
+        free(bitmap);
+    }
+    close(fd);
+    return n;
+}
+
+// 保持优先级顺序去掉重复的页
+static size_t uniqpages(skiplist_t* sl, uintptr_t pages[], size_t n, size_t pagesize) {
+    uintptr_t base[2] = { (uintptr_t)METAMAPPED(sl), (uintptr_t)DATAMAPPED(sl) };
+    uint64_t npages[2] = { sl->meta->mapcap / pagesize + 1, sl->pool != NULL ? 0 : sl->datacap / pagesize + 1 };
+    unsigned char* seen[2] = { calloc(npages[0] / 8 + 1, 1), calloc(npages[1] / 8 + 1, 1) };
+    size_t m = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        int f = pages[i] >= base[1] && pages[i] < base[1] + npages[1] * pagesize;
+        uint64_t p = (pages[i] - base[f]) / pagesize;
+        if (seen[f] == NULL || (seen[f][p / 8] >> (p % 8) & 1)) {
+            continue;
+        }
+        seen[f][p / 8] |= 1 << (p % 8);
+        pages[m++] = pages[i];
+    }
+    free(seen[0]);
+    free(seen[1]);
+    return m;
+}
+
+static void* warmupthread(void* arg) {
+    warmup_t* w = (warmup_t*)arg;
+    uint64_t touched = 0;
+    volatile unsigned char sum = 0;
+
+    while (1) {
+        size_t i = __sync_fetch_and_add(&w->next, WARMUP_CHUNK);
+        if (i >= w->n) {
+            break;
+        }
+        size_t end = i + WARMUP_CHUNK < w->n ? i + WARMUP_CHUNK : w->n;
+        for (; i < end; ++i) {
+            sum += *(volatile unsigned char*)w->pages[i]; // 读缺页，不弄脏页
+            ++touched;
+        }
+    }
+    __sync_fetch_and_add(&w->touched, touched);
+    return NULL;
+}
+
+// 整个预热期间持有读锁，保证映射不被替换；适合在打开后、接入流量前调用
+status_t sl_warmup(skiplist_t* sl, int nthreads, uint64_t budget, uint64_t* warmed) {
+    SL_OPSCOPE(SL_STAT_OTHER);
+    status_t _status = { .ok = 1 };
+    uint64_t _offsets[] = {};
+    pthread_t threads[WARMUP_MAXTHREADS];
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (sl == NULL) {
+        return statusnotok0(_status, "skiplist is NULL");
+    }
+    if (nthreads < 1 || nthreads > WARMUP_MAXTHREADS) {
+        return statusnotok2(_status, "nthreads(%d) out of range [1, %d]", nthreads, WARMUP_MAXTHREADS);
+    }
+    _status = sl_rdlock(sl, _offsets, 0);
+    if (!_status.ok) {
+        return _status;
+    }
+    size_t cap = 2 * SL_WILLNEED_NODES;
+    uintptr_t* pages = (uintptr_t*)malloc(sizeof(uintptr_t) * cap);
+    size_t n = sl_indexpages(sl, pages, cap);
+    n = loadheat(sl, pagesize, &pages, n, &cap);
+    n = uniqpages(sl, pages, n, pagesize);
+    if (budget > 0 && n > budget / pagesize) {
+        n = budget / pagesize;
+    }
+
+    warmup_t w = { .pages = pages, .n = n, .next = 0, .pagesize = pagesize, .touched = 0 };
+    int started = 1;
+    for (; started < nthreads; ++started) {
+        int err = pthread_create(&threads[started], NULL, warmupthread, &w);
+        if (err != 0) {
+            break; // 线程不足时由已启动的线程完成
+        }
+    }
+    warmupthread(&w);
+    for (int i = 1; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    if (warmed != NULL) {
+        *warmed = w.touched * pagesize;
+    }
+    free(pages);
+    return sl_unlock(sl, _offsets, 0);
+}
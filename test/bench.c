@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+#include "../include/skiplist.h"
+#include "test.h"
+#include <endian.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// 回归微基准：在固定随机种子下按key长度和p的组合运行各项操作，每项重复reps次取中位数，
+// 以每行一条结果的JSON输出；同一组key上用有序数组(二分查找)作为基线。
+// -c指定之前保存的输出时逐项对比，ns/op变慢超过阈值的项记为回归，返回非0
+
+#define BENCH_MAXREPS 64
+#define BENCH_MAXRESULTS 1024
+#define BENCH_SYNCKEYS 1000 // sl_sync前改写的key数
+
+typedef struct _options {
+    int count;
+    int reps;
+    int keysizes[16];
+    int nkeysizes;
+    float ps[16];
+    int nps;
+    double threshold; // 回归阈值(比例)
+    char prefix[128];
+    char baseline[256];
+    char output[256];
+} _options;
+
+_options opt = {
+    .count     = 50000,
+    .reps      = 5,
+    .keysizes  = { 8, 16, 64, 256, 1024 },
+    .nkeysizes = 5,
+    .ps        = { 0.25, 0.5 },
+    .nps       = 2,
+    .threshold = 0.10,
+    .prefix    = "bench",
+    .baseline  = "",
+    .output    = "",
+};
+
+typedef struct result_s {
+    char name[32];
+    char impl[16];
+    int keysize;
+    float p;
+    double ns; // 每次操作的纳秒数(中位数)
+} result_t;
+
+static result_t results[BENCH_MAXRESULTS];
+static int nresults = 0;
+static char** hits = NULL;   // 已写入的key
+static char** misses = NULL; // 不存在的key
+static char** seqkeys = NULL; // 递增的key
+
+static inline uint64_t nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 前8字节为大端的v，其余填充
+static char* makekey(uint64_t v, int keysize) {
+    char* key = (char*)malloc(keysize);
+    uint64_t be = htobe64(v);
+
+    memcpy(key, &be, sizeof(uint64_t));
+    memset(key + sizeof(uint64_t), 'k', keysize - sizeof(uint64_t));
+    return key;
+}
+
+static void makekeys(int keysize) {
+    hits = (char**)malloc(sizeof(char*) * opt.count);
+    misses = (char**)malloc(sizeof(char*) * opt.count);
+    seqkeys = (char**)malloc(sizeof(char*) * opt.count);
+    for (int i = 0; i < opt.count; ++i) { // i * 奇数常数是双射，命中与不命中的key不相交
+        hits[i] = makekey((uint64_t)i * 0x9e3779b97f4a7c15ULL, keysize);
+        misses[i] = makekey((uint64_t)(i + opt.count) * 0x9e3779b97f4a7c15ULL, keysize);
+        seqkeys[i] = makekey((uint64_t)i, keysize);
+    }
+}
+
+static void freekeyset() {
+    for (int i = 0; i < opt.count; ++i) {
+        free(hits[i]);
+        free(misses[i]);
+        free(seqkeys[i]);
+    }
+    free(hits);
+    free(misses);
+    free(seqkeys);
+}
+
+static void removedb() {
+    const char* exts[] = { "meta", "data", "log", "heat", "bloom", "hash", "trace" };
+    char name[256];
+
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        snprintf(name, sizeof(name), "%s.sl.%s", opt.prefix, exts[i]);
+        unlink(name);
+    }
+}
+
+static skiplist_t* opendb(float p) {
+    sl_options_t opts;
+    skiplist_t* sl = NULL;
+
+    sl_options_init(&opts);
+    opts.p = p;
+    uint64_t metasize = (uint64_t)opt.count * 96 + DEFAULT_METAFILE_SIZE;
+    opts.metasize = metasize > opts.metasize ? metasize : opts.metasize;
+    status_t s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    return sl;
+}
+
+static void addresult(const char* name, const char* impl, int keysize, float p, double* samples, int n) {
+    if (nresults == BENCH_MAXRESULTS) {
+        log_fatal("too many results\n");
+    }
+    for (int i = 1; i < n; ++i) { // 插入排序取中位数
+        for (int j = i; j > 0 && samples[j - 1] > samples[j]; --j) {
+            double t = samples[j];
+            samples[j] = samples[j - 1];
+            samples[j - 1] = t;
+        }
+    }
+    result_t* r = &results[nresults++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    snprintf(r->impl, sizeof(r->impl), "%s", impl);
+    r->keysize = keysize;
+    r->p = p;
+    r->ns = samples[n / 2];
+}
+
+enum { B_INSERT, B_OVERWRITE, B_GETHIT, B_GETMISS, B_DEL, B_APPEND, B_SYNC, B_OPEN, B_NUM };
+static const char* bnames[B_NUM] = { "put_insert", "put_overwrite", "get_hit", "get_miss", "del", "seq_append", "sync", "open" };
+
+static void benchskiplist(int keysize, float p) {
+    double samples[B_NUM][BENCH_MAXREPS];
+    uint64_t value = 0;
+    skiplist_t* sl = NULL;
+    uint64_t t = 0;
+
+    for (int rep = 0; rep < opt.reps; ++rep) {
+        srandom(1); // 节点层数可重复
+        removedb();
+        sl = opendb(p);
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_put(sl, hits[i], keysize, i);
+        }
+        samples[B_INSERT][rep] = (double)(nowns() - t) / opt.count;
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_put(sl, hits[i], keysize, i + 1);
+        }
+        samples[B_OVERWRITE][rep] = (double)(nowns() - t) / opt.count;
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_get(sl, hits[i], keysize, &value);
+        }
+        samples[B_GETHIT][rep] = (double)(nowns() - t) / opt.count;
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_get(sl, misses[i], keysize, &value);
+        }
+        samples[B_GETMISS][rep] = (double)(nowns() - t) / opt.count;
+        int nsync = BENCH_SYNCKEYS < opt.count ? BENCH_SYNCKEYS : opt.count;
+        for (int i = 0; i < nsync; ++i) {
+            sl_put(sl, hits[i], keysize, i);
+        }
+        t = nowns();
+        sl_sync(sl);
+        samples[B_SYNC][rep] = (double)(nowns() - t);
+        sl_close(sl);
+        t = nowns();
+        sl = opendb(p);
+        samples[B_OPEN][rep] = (double)(nowns() - t);
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_del(sl, hits[i], keysize);
+        }
+        samples[B_DEL][rep] = (double)(nowns() - t) / opt.count;
+        sl_close(sl);
+
+        srandom(1);
+        removedb();
+        sl = opendb(p);
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            sl_put(sl, seqkeys[i], keysize, i);
+        }
+        samples[B_APPEND][rep] = (double)(nowns() - t) / opt.count;
+        sl_close(sl);
+    }
+    removedb();
+    for (int b = 0; b < B_NUM; ++b) {
+        addresult(bnames[b], "skiplist", keysize, p, samples[b], opt.reps);
+    }
+}
+
+static int sortedkeysize = 0;
+
+static int cmpkeyp(const void* a, const void* b) {
+    return memcmp(*(char**)a, *(char**)b, sortedkeysize);
+}
+
+static int bsearchkey(char** arr, int n, const char* key, int keysize) {
+    int lo = 0, hi = n;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(arr[mid], key, keysize);
+        if (cmp == 0) {
+            return mid;
+        }
+        cmp < 0 ? (lo = mid + 1) : (hi = mid);
+    }
+    return -1;
+}
+
+// 有序数组基线：批量排序建立，二分查找
+static void benchsorted(int keysize) {
+    double samples[3][BENCH_MAXREPS];
+    char** arr = (char**)malloc(sizeof(char*) * opt.count);
+    volatile int found = 0;
+
+    sortedkeysize = keysize;
+    for (int rep = 0; rep < opt.reps; ++rep) {
+        uint64_t t = nowns();
+        memcpy(arr, hits, sizeof(char*) * opt.count);
+        qsort(arr, opt.count, sizeof(char*), cmpkeyp);
+        samples[0][rep] = (double)(nowns() - t) / opt.count;
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            found += bsearchkey(arr, opt.count, hits[i], keysize) >= 0;
+        }
+        samples[1][rep] = (double)(nowns() - t) / opt.count;
+        t = nowns();
+        for (int i = 0; i < opt.count; ++i) {
+            found += bsearchkey(arr, opt.count, misses[i], keysize) >= 0;
+        }
+        samples[2][rep] = (double)(nowns() - t) / opt.count;
+    }
+    free(arr);
+    addresult("put_insert", "sorted", keysize, 0, samples[0], opt.reps);
+    addresult("get_hit", "sorted", keysize, 0, samples[1], opt.reps);
+    addresult("get_miss", "sorted", keysize, 0, samples[2], opt.reps);
+}
+
+static void output(FILE* fp) {
+    fprintf(fp, "{\"bench\":\"skipdb\",\"count\":%d,\"reps\":%d,\"results\":[\n", opt.count, opt.reps);
+    for (int i = 0; i < nresults; ++i) {
+        result_t* r = &results[i];
+        fprintf(fp, "{\"name\":\"%s\",\"impl\":\"%s\",\"key_size\":%d,\"p\":%.2f,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f}%s\n",
+            r->name, r->impl, r->keysize, r->p, r->ns, 1e9 / r->ns, i + 1 < nresults ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+}
+
+// 读取output的输出(每行一条结果)，与本次结果逐项对比，返回回归项数
+static int compare(const char* path) {
+    char line[512];
+    int regressions = 0, matched = 0;
+
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        log_fatal("open %s failed\n", path);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        result_t b;
+        if (sscanf(line, "{\"name\":\"%31[^\"]\",\"impl\":\"%15[^\"]\",\"key_size\":%d,\"p\":%f,\"ns_per_op\":%lf", b.name,
+                b.impl, &b.keysize, &b.p, &b.ns) != 5) {
+            continue;
+        }
+        for (int i = 0; i < nresults; ++i) {
+            result_t* r = &results[i];
+            if (strcmp(r->name, b.name) != 0 || strcmp(r->impl, b.impl) != 0 || r->keysize != b.keysize ||
+                (int)(r->p * 100 + 0.5) != (int)(b.p * 100 + 0.5)) {
+                continue;
+            }
+            double delta = (r->ns - b.ns) / b.ns;
+            int regressed = delta > opt.threshold;
+            regressions += regressed;
+            ++matched;
+            (regressed ? log_error : log_info)("%-14s %-8s key %5d p %.2f: %10.1f -> %10.1f ns/op %+6.1f%%%s\n", r->name,
+                r->impl, r->keysize, r->p, b.ns, r->ns, delta * 100, regressed ? " REGRESSION" : "");
+        }
+    }
+    fclose(fp);
+    log_info("compared %d results against %s, %d regression(s) over %.0f%%\n", matched, path, regressions,
+        opt.threshold * 100);
+    return regressions;
+}
+
+static int parselist(const char* arg, int isfloat, void* out) {
+    int n = 0;
+    char* copy = strdup(arg);
+
+    for (char* tok = strtok(copy, ","); tok != NULL && n < 16; tok = strtok(NULL, ","), ++n) {
+        if (isfloat) {
+            ((float*)out)[n] = atof(tok);
+        } else {
+            ((int*)out)[n] = atoi(tok);
+        }
+    }
+    free(copy);
+    return n;
+}
+
+void usage() {
+    log_info("\t./bench [-n count] [-r reps] [-k 8,16,64,256,1024] [-p 0.25,0.5] [-o output.json]\n"
+           "\t        [-c baseline.json] [-t threshold%%] [-f prefix]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+
+    while ((c = getopt(argc, argv, "n:r:k:p:o:c:t:f:h")) != -1) {
+        switch (c) {
+        case 'n':
+            opt.count = atoi(optarg);
+            break;
+        case 'r':
+            opt.reps = atoi(optarg);
+            break;
+        case 'k':
+            opt.nkeysizes = parselist(optarg, 0, opt.keysizes);
+            break;
+        case 'p':
+            opt.nps = parselist(optarg, 1, opt.ps);
+            break;
+        case 'o':
+            snprintf(opt.output, sizeof(opt.output), "%s", optarg);
+            break;
+        case 'c':
+            snprintf(opt.baseline, sizeof(opt.baseline), "%s", optarg);
+            break;
+        case 't':
+            opt.threshold = atof(optarg) / 100;
+            break;
+        case 'f':
+            snprintf(opt.prefix, sizeof(opt.prefix), "%s", optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (opt.count < 1 || opt.reps < 1 || opt.reps > BENCH_MAXREPS) {
+        log_fatal("count > 0, reps in [1, %d]\n", BENCH_MAXREPS);
+    }
+    for (int k = 0; k < opt.nkeysizes; ++k) {
+        if (opt.keysizes[k] < 8 || opt.keysizes[k] > MAX_KEY_LEN) {
+            log_fatal("key size must be in [8, %d]\n", MAX_KEY_LEN);
+        }
+        makekeys(opt.keysizes[k]);
+        for (int i = 0; i < opt.nps; ++i) {
+            benchskiplist(opt.keysizes[k], opt.ps[i]);
+        }
+        benchsorted(opt.keysizes[k]);
+        freekeyset();
+        log_info("bench: key size %d done\n", opt.keysizes[k]);
+    }
+    FILE* fp = stdout;
+    if (opt.output[0] != '\0' && (fp = fopen(opt.output, "w")) == NULL) {
+        log_fatal("open %s failed\n", opt.output);
+    }
+    output(fp);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    if (opt.baseline[0] != '\0' && compare(opt.baseline) > 0) {
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,443 @@
+#define _GNU_SOURCE
+#include "../include/skiplist.h"
+#include "test.h"
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// 多线程压测：按读/写/删除/扫描比例混合操作，key按uniform/zipfian/latest分布选取，
+// 预热后在测量阶段记录每种操作的延迟直方图(对数分桶，每个2的幂区间16个子桶，误差约6%)，
+// 结束后以一行JSON输出到stdout，便于脚本收集
+
+#define LG_MAXTHREADS 256
+#define LG_SUBBITS 4
+#define LG_BUCKETS (64 << LG_SUBBITS)
+
+enum { OP_GET, OP_PUT, OP_DEL, OP_SCAN, OP_NUM };
+static const char* opnames[OP_NUM] = { "get", "put", "del", "scan" };
+
+enum { DIST_UNIFORM, DIST_ZIPF, DIST_LATEST };
+static const char* distnames[] = { "uniform", "zipf", "latest" };
+
+typedef struct _options {
+    int threads;
+    int mix[OP_NUM];   // 各操作的百分比
+    uint64_t keys;     // 预加载的key数
+    int dist;
+    double theta;      // zipfian参数
+    int keymin;        // key长度范围
+    int keymax;
+    int scanlen;       // 每次扫描的key数
+    double warmup;     // 秒
+    double duration;   // 秒
+    float p;
+    uint32_t format;
+    int inmemory;
+    char prefix[128];
+    char trace[256];   // 非空时跟踪全部操作(含预加载)，供replay在新库上回放
+} _options;
+
+_options opt = {
+    .threads  = 4,
+    .mix      = { 90, 8, 1, 1 },
+    .keys     = 100000,
+    .dist     = DIST_ZIPF,
+    .theta    = 0.99,
+    .keymin   = 16,
+    .keymax   = 16,
+    .scanlen  = 50,
+    .warmup   = 1,
+    .duration = 5,
+    .p        = 0.25,
+    .format   = SL_FORMAT_NODE,
+    .inmemory = 0,
+    .prefix   = "loadgen",
+    .trace    = "",
+};
+
+typedef struct histogram_s {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[LG_BUCKETS];
+} histogram_t;
+
+typedef struct worker_s {
+    pthread_t tid;
+    int id;
+    uint64_t rnd;
+    uint64_t hits;
+    uint64_t misses;
+    histogram_t hist[OP_NUM];
+} worker_t;
+
+static skiplist_t* sl = NULL;
+static volatile int phase = 0; // 0预热，1测量，2结束
+static uint64_t inserted = 0;  // latest分布下已写入的最大下标+1
+static double zetan = 0;       // zipfian的zeta(n, theta)
+static double zipfeta = 0;
+static double zipfalpha = 0;
+
+static inline uint64_t xorshift(uint64_t* s) {
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static inline uint64_t nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 值v的桶：最高位所在的2的幂区间，区间内按其下LG_SUBBITS位再分
+static inline int bucketof(uint64_t v) {
+    if (v < (1 << LG_SUBBITS)) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - LG_SUBBITS;
+    return ((shift + 1) << LG_SUBBITS) + (int)((v >> shift) & ((1 << LG_SUBBITS) - 1));
+}
+
+// 桶的上界
+static inline uint64_t bucketvalue(int b) {
+    if (b < (1 << LG_SUBBITS)) {
+        return (uint64_t)b;
+    }
+    int shift = (b >> LG_SUBBITS) - 1;
+    uint64_t sub = (uint64_t)(b & ((1 << LG_SUBBITS) - 1)) | (1 << LG_SUBBITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void record(histogram_t* h, uint64_t ns) {
+    ++h->count;
+    h->sum += ns;
+    if (ns > h->max) {
+        h->max = ns;
+    }
+    ++h->buckets[bucketof(ns)];
+}
+
+static uint64_t percentile(histogram_t* h, double q) {
+    uint64_t target = (uint64_t)ceil(q * h->count);
+    uint64_t seen = 0;
+
+    for (int b = 0; b < LG_BUCKETS; ++b) {
+        seen += h->buckets[b];
+        if (seen >= target && seen > 0) {
+            return bucketvalue(b) < h->max ? bucketvalue(b) : h->max;
+        }
+    }
+    return h->max;
+}
+
+// YCSB的zipfian生成：rank 0最热
+static void zipfinit(uint64_t n, double theta) {
+    zetan = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+        zetan += 1 / pow((double)i, theta);
+    }
+    double zeta2 = 1 + 1 / pow(2, theta);
+    zipfalpha = 1 / (1 - theta);
+    zipfeta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+}
+
+static uint64_t zipf(uint64_t* rnd, uint64_t n) {
+    double u = (double)(xorshift(rnd) >> 11) / (double)(1ULL << 53);
+    double uz = u * zetan;
+
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < 1 + pow(0.5, opt.theta)) {
+        return 1;
+    }
+    uint64_t r = (uint64_t)(n * pow(zipfeta * u - zipfeta + 1, zipfalpha));
+    return r < n ? r : n - 1;
+}
+
+// 下标为i的key：下标的hash决定长度，内容为hash的十六进制重复填充，不同下标的key不同
+static size_t makekey(uint64_t i, char* key) {
+    uint64_t h = (i + 1) * 0x9e3779b97f4a7c15ULL;
+    size_t len = opt.keymin + (opt.keymax > opt.keymin ? (h >> 40) % (opt.keymax - opt.keymin + 1) : 0);
+
+    sprintf(key, "%016lx", h);
+    for (size_t j = 16; j < len; ++j) {
+        key[j] = key[j % 16];
+    }
+    return len;
+}
+
+static uint64_t pickkey(worker_t* w) {
+    switch (opt.dist) {
+    case DIST_ZIPF: // 热点打散到整个key空间
+        return (zipf(&w->rnd, opt.keys) * 0xff51afd7ed558ccdULL) % opt.keys;
+    case DIST_LATEST: {
+        uint64_t n = __atomic_load_n(&inserted, __ATOMIC_RELAXED);
+        uint64_t r = zipf(&w->rnd, opt.keys);
+        return r < n ? n - 1 - r : 0;
+    }
+    }
+    return xorshift(&w->rnd) % opt.keys;
+}
+
+static int scanstop(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    return --*(int*)arg <= 0;
+}
+
+static void* worker(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    char key[MAX_KEY_LEN];
+    status_t s;
+
+    while (phase < 2) {
+        int r = (int)(xorshift(&w->rnd) % 100);
+        int op = 0;
+        while (op < OP_NUM - 1 && r >= opt.mix[op]) {
+            r -= opt.mix[op++];
+        }
+        uint64_t i = 0;
+        if (op == OP_PUT && opt.dist == DIST_LATEST) { // latest分布下写入新key
+            i = __atomic_fetch_add(&inserted, 1, __ATOMIC_RELAXED);
+        } else {
+            i = pickkey(w);
+        }
+        size_t len = makekey(i, key);
+        uint64_t value = UINT64_MAX;
+        int n = opt.scanlen;
+        uint64_t start = nowns();
+        switch (op) {
+        case OP_GET:
+            s = sl_get(sl, key, len, &value);
+            break;
+        case OP_PUT:
+            s = sl_put(sl, key, len, i);
+            break;
+        case OP_DEL:
+            s = sl_del(sl, key, len);
+            break;
+        case OP_SCAN:
+            s = sl_scan(sl, key, len, NULL, 0, scanstop, &n);
+            break;
+        }
+        uint64_t ns = nowns() - start;
+        if (!s.ok) {
+            log_fatal("%s: %s\n", opnames[op], s.errmsg);
+        }
+        if (phase == 1) {
+            record(&w->hist[op], ns);
+            if (op == OP_GET) {
+                value != UINT64_MAX ? ++w->hits : ++w->misses;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void preload() {
+    char key[MAX_KEY_LEN];
+
+    for (uint64_t i = 0; i < opt.keys; ++i) {
+        size_t len = makekey(i, key);
+        status_t s = sl_put(sl, key, len, i);
+        if (!s.ok) {
+            log_fatal("preload: %s\n", s.errmsg);
+        }
+    }
+    inserted = opt.keys;
+}
+
+static void report(worker_t* workers, double elapsed) {
+    histogram_t total[OP_NUM];
+    uint64_t hits = 0, misses = 0, ops = 0;
+
+    memset(total, 0, sizeof(total));
+    for (int t = 0; t < opt.threads; ++t) {
+        hits += workers[t].hits;
+        misses += workers[t].misses;
+        for (int op = 0; op < OP_NUM; ++op) {
+            histogram_t* h = &workers[t].hist[op];
+            total[op].count += h->count;
+            total[op].sum += h->sum;
+            total[op].max = h->max > total[op].max ? h->max : total[op].max;
+            for (int b = 0; b < LG_BUCKETS; ++b) {
+                total[op].buckets[b] += h->buckets[b];
+            }
+        }
+    }
+    printf("{\"threads\":%d,\"keys\":%lu,\"dist\":\"%s\",\"theta\":%.3f,\"key_size\":[%d,%d],\"format\":%u,"
+           "\"inmemory\":%d,\"warmup_s\":%.3f,\"duration_s\":%.3f,\"ops\":{",
+        opt.threads, opt.keys, distnames[opt.dist], opt.theta, opt.keymin, opt.keymax, opt.format, opt.inmemory,
+        opt.warmup, elapsed);
+    int first = 1;
+    for (int op = 0; op < OP_NUM; ++op) {
+        histogram_t* h = &total[op];
+        if (h->count == 0) {
+            continue;
+        }
+        ops += h->count;
+        printf("%s\"%s\":{\"count\":%lu,\"ops_per_sec\":%.1f,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,"
+               "\"p999_us\":%.3f,\"max_us\":%.3f}",
+            first ? "" : ",", opnames[op], h->count, h->count / elapsed, h->sum / 1000.0 / h->count,
+            percentile(h, 0.5) / 1000.0, percentile(h, 0.99) / 1000.0, percentile(h, 0.999) / 1000.0, h->max / 1000.0);
+        first = 0;
+    }
+    printf("},\"total_ops_per_sec\":%.1f,\"get_hits\":%lu,\"get_misses\":%lu,\"final_count\":%u}\n", ops / elapsed, hits,
+        misses, sl->meta->count);
+    fflush(stdout);
+}
+
+static void removedb() {
+    const char* exts[] = { "meta", "data", "log", "heat", "bloom", "hash", "trace" };
+    char name[256];
+
+    for (size_t i = 0; !opt.inmemory && i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        snprintf(name, sizeof(name), "%s.sl.%s", opt.prefix, exts[i]);
+        unlink(name);
+    }
+}
+
+static void parsemix(const char* arg) {
+    char name[16];
+    int pct = 0, n = 0, sum = 0;
+
+    memset(opt.mix, 0, sizeof(opt.mix));
+    for (const char* p = arg; sscanf(p, "%15[a-z]:%d%n", name, &pct, &n) == 2; p += n + (p[n] == ',')) {
+        int op = 0;
+        while (op < OP_NUM && strcmp(name, opnames[op]) != 0) {
+            ++op;
+        }
+        if (op == OP_NUM || pct < 0) {
+            log_fatal("unknown mix entry %s:%d\n", name, pct);
+        }
+        opt.mix[op] = pct;
+        sum += pct;
+        if (p[n] == '\0') {
+            break;
+        }
+    }
+    if (sum != 100) {
+        log_fatal("mix must sum to 100, got %d\n", sum);
+    }
+}
+
+void usage() {
+    log_info("\t./loadgen [-t threads] [-n keys] [-m get:90,put:8,del:1,scan:1] [-d uniform|zipf|latest]\n"
+           "\t          [-z theta] [-k keysize|min-max] [-l scanlen] [-w warmup_s] [-T duration_s]\n"
+           "\t          [-p p] [-b(locked format)] [-M(inmemory)] [-f prefix] [-r trace]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+    sl_options_t opts;
+    worker_t* workers = NULL;
+
+    while ((c = getopt(argc, argv, "t:n:m:d:z:k:l:w:T:p:bMf:r:h")) != -1) {
+        switch (c) {
+        case 't':
+            opt.threads = atoi(optarg);
+            break;
+        case 'n':
+            opt.keys = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            parsemix(optarg);
+            break;
+        case 'd':
+            for (opt.dist = 0; opt.dist <= DIST_LATEST && strcmp(optarg, distnames[opt.dist]) != 0; ++opt.dist) {
+            }
+            if (opt.dist > DIST_LATEST) {
+                usage();
+            }
+            break;
+        case 'z':
+            opt.theta = atof(optarg);
+            break;
+        case 'k':
+            if (sscanf(optarg, "%d-%d", &opt.keymin, &opt.keymax) != 2) {
+                opt.keymax = opt.keymin;
+            }
+            break;
+        case 'l':
+            opt.scanlen = atoi(optarg);
+            break;
+        case 'w':
+            opt.warmup = atof(optarg);
+            break;
+        case 'T':
+            opt.duration = atof(optarg);
+            break;
+        case 'p':
+            opt.p = atof(optarg);
+            break;
+        case 'b':
+            opt.format = SL_FORMAT_BLOCKED;
+            break;
+        case 'M':
+            opt.inmemory = 1;
+            break;
+        case 'f':
+            snprintf(opt.prefix, sizeof(opt.prefix), "%s", optarg);
+            break;
+        case 'r':
+            snprintf(opt.trace, sizeof(opt.trace), "%s", optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (opt.threads < 1 || opt.threads > LG_MAXTHREADS || opt.keys == 0 || opt.keymin < 16 || opt.keymax < opt.keymin ||
+        opt.keymax > MAX_KEY_LEN || opt.theta <= 0 || opt.theta >= 1) {
+        log_fatal("threads in [1, %d], keys > 0, 16 <= keymin <= keymax <= %d, theta in (0, 1)\n", LG_MAXTHREADS,
+            MAX_KEY_LEN);
+    }
+    removedb();
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.format = opt.format;
+    opts.inmemory = opt.inmemory;
+    // 元数据文件不扩容，按key空间(latest分布下还有写入的新key)留足
+    uint64_t metasize = (opt.keys + (opt.dist == DIST_LATEST ? opt.keys * 4 : 0)) * 96 + DEFAULT_METAFILE_SIZE;
+    opts.metasize = metasize > opts.metasize ? metasize : opts.metasize;
+    status_t s = sl_open_opt(opt.inmemory ? NULL : opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    if (opt.trace[0] != '\0' && !(s = sl_trace_start(sl, opt.trace)).ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    if (opt.dist != DIST_UNIFORM) {
+        zipfinit(opt.keys, opt.theta);
+    }
+    preload();
+    log_info("loadgen: preloaded %lu keys, warmup %.1fs, measure %.1fs\n", opt.keys, opt.warmup, opt.duration);
+
+    workers = (worker_t*)calloc(opt.threads, sizeof(worker_t));
+    for (int t = 0; t < opt.threads; ++t) {
+        workers[t].id = t;
+        workers[t].rnd = 0x853c49e6748fea9bULL * (t + 1);
+        pthread_create(&workers[t].tid, NULL, worker, &workers[t]);
+    }
+    usleep((useconds_t)(opt.warmup * 1000000));
+    uint64_t start = nowns();
+    phase = 1;
+    usleep((useconds_t)(opt.duration * 1000000));
+    phase = 2;
+    double elapsed = (nowns() - start) / 1e9;
+    for (int t = 0; t < opt.threads; ++t) {
+        pthread_join(workers[t].tid, NULL);
+    }
+    report(workers, elapsed);
+    free(workers);
+    sl_trace_stop(sl);
+    sl_close(sl);
+    removedb();
+    return 0;
+}
@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include "../include/skiplist.h"
+#include "../include/trace.h"
+#include "test.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 回放操作跟踪文件：每个被跟踪的线程对应一个回放线程，按原顺序执行该线程的记录；
+// 默认尽快执行(只保留线程开始与结束的先后)，-R按原始时间间隔(-x倍速)执行。数据库为新建的，或先从-s指定的快照(<snapshot>.sl.meta/.data)复制。
+// get命中与否和跟踪时不同的记录数记为divergence，从跟踪开始时的快照回放单线程跟踪时应为0
+
+typedef struct _options {
+    char trace[256];
+    char prefix[128];
+    char snapshot[128];
+    int timed;
+    double speed;
+    float p;
+    uint32_t format;
+} _options;
+
+_options opt = {
+    .trace    = "",
+    .prefix   = "replay",
+    .snapshot = "",
+    .timed    = 0,
+    .speed    = 1,
+    .p        = 0.25,
+    .format   = SL_FORMAT_NODE,
+};
+
+typedef struct player_s {
+    pthread_t tid;
+    tracerecord_t** recs;
+    size_t n;
+    size_t cap;
+    uint64_t busy;       // 执行操作的纳秒数
+    uint64_t lag;        // 按原始时间回放时最大的落后纳秒数
+    uint64_t divergence;
+    volatile int done;
+} player_t;
+
+static skiplist_t* sl = NULL;
+static player_t* players = NULL;
+static size_t nplayers = 0;
+static uint64_t startns = 0;
+static pthread_barrier_t barrier;
+
+static inline uint64_t nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void* play(void* arg) {
+    player_t* pl = (player_t*)arg;
+    status_t s;
+
+    pthread_barrier_wait(&barrier);
+    // 尽快回放时保留线程间的先后：跟踪中在本线程开始前已结束的线程(如预加载)先回放完
+    for (size_t t = 0; !opt.timed && pl->n > 0 && t < nplayers; ++t) {
+        player_t* q = &players[t];
+        while (q != pl && q->n > 0 && q->recs[q->n - 1]->ts < pl->recs[0]->ts && !q->done) {
+            usleep(100);
+        }
+    }
+    for (size_t i = 0; i < pl->n; ++i) {
+        tracerecord_t* rec = pl->recs[i];
+        if (opt.timed) {
+            uint64_t due = startns + (uint64_t)(rec->ts / opt.speed);
+            uint64_t now = nowns();
+            if (now < due) {
+                struct timespec ts = { .tv_sec = due / 1000000000, .tv_nsec = due % 1000000000 };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            } else if (now - due > pl->lag) {
+                pl->lag = now - due;
+            }
+        }
+        uint64_t value = UINT64_MAX;
+        uint64_t t = nowns();
+        switch (rec->op) {
+        case SL_OP_PUT:
+            s = sl_put(sl, rec->data, rec->size, rec->value);
+            break;
+        case SL_OP_DEL:
+            s = sl_del(sl, rec->data, rec->size);
+            break;
+        case SL_TRACE_GET:
+            s = sl_get(sl, rec->data, rec->size, &value);
+            pl->divergence += (value != UINT64_MAX) != ((rec->flags & SL_TRACE_FOUND) != 0);
+            break;
+        default:
+            log_fatal("unknown op %d in trace\n", rec->op);
+        }
+        pl->busy += nowns() - t;
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+    }
+    __sync_synchronize();
+    pl->done = 1;
+    return NULL;
+}
+
+static void copyfile(const char* from, const char* to) {
+    char buff[65536];
+    ssize_t n;
+
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return; // 快照中可以没有附属文件
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out < 0) {
+        log_fatal("open %s failed\n", to);
+    }
+    while ((n = read(in, buff, sizeof(buff))) > 0) {
+        if (write(out, buff, n) != n) {
+            log_fatal("write %s failed\n", to);
+        }
+    }
+    close(in);
+    close(out);
+}
+
+static void preparedb() {
+    const char* exts[] = { "meta", "data", "log", "heat", "bloom", "hash", "trace" };
+    char from[256], to[256];
+
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        snprintf(to, sizeof(to), "%s.sl.%s", opt.prefix, exts[i]);
+        unlink(to);
+    }
+    for (size_t i = 0; opt.snapshot[0] != '\0' && i < 2; ++i) {
+        snprintf(from, sizeof(from), "%s.sl.%s", opt.snapshot, exts[i]);
+        snprintf(to, sizeof(to), "%s.sl.%s", opt.prefix, exts[i]);
+        copyfile(from, to);
+    }
+}
+
+void usage() {
+    log_info("\t./replay -t <trace> [-f prefix] [-s snapshot_prefix] [-R(original timing)] [-x speed] [-p p] [-b(locked format)]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+    struct stat st;
+    sl_options_t opts;
+
+    while ((c = getopt(argc, argv, "t:f:s:Rx:p:bh")) != -1) {
+        switch (c) {
+        case 't':
+            snprintf(opt.trace, sizeof(opt.trace), "%s", optarg);
+            break;
+        case 'f':
+            snprintf(opt.prefix, sizeof(opt.prefix), "%s", optarg);
+            break;
+        case 's':
+            snprintf(opt.snapshot, sizeof(opt.snapshot), "%s", optarg);
+            break;
+        case 'R':
+            opt.timed = 1;
+            break;
+        case 'x':
+            opt.speed = atof(optarg);
+            break;
+        case 'p':
+            opt.p = atof(optarg);
+            break;
+        case 'b':
+            opt.format = SL_FORMAT_BLOCKED;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (opt.trace[0] == '\0' || opt.speed <= 0) {
+        usage();
+    }
+    int fd = open(opt.trace, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(traceheader_t)) {
+        log_fatal("open %s failed or too small\n", opt.trace);
+    }
+    char* mapped = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        log_fatal("mmap %s failed\n", opt.trace);
+    }
+    traceheader_t* header = (traceheader_t*)mapped;
+    if (header->magic != SL_TRACE_MAGIC || header->version != SL_TRACE_VERSION) {
+        log_fatal("%s is not a trace file\n", opt.trace);
+    }
+
+    // 按线程编号分组，同一线程的记录在文件中按时间有序
+    size_t nrecs = 0;
+    uint64_t lastts = 0;
+    for (size_t pos = sizeof(traceheader_t); pos + sizeof(tracerecord_t) <= (size_t)st.st_size;) {
+        tracerecord_t* rec = (tracerecord_t*)(mapped + pos);
+        if (pos + TRACERECORDSIZE(rec) > (size_t)st.st_size) {
+            break;
+        }
+        if (rec->thread >= nplayers) {
+            size_t n = rec->thread + 1;
+            players = (player_t*)realloc(players, sizeof(player_t) * n);
+            memset(players + nplayers, 0, sizeof(player_t) * (n - nplayers));
+            nplayers = n;
+        }
+        player_t* pl = &players[rec->thread];
+        if (pl->n == pl->cap) {
+            pl->cap = pl->cap == 0 ? 1024 : pl->cap * 2;
+            pl->recs = (tracerecord_t**)realloc(pl->recs, sizeof(tracerecord_t*) * pl->cap);
+        }
+        pl->recs[pl->n++] = rec;
+        lastts = rec->ts > lastts ? rec->ts : lastts;
+        ++nrecs;
+        pos += TRACERECORDSIZE(rec);
+    }
+
+    preparedb();
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.format = opt.format;
+    status_t s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    log_info("replay: %lu records from %lu threads, traced %.3fs\n", nrecs, nplayers, lastts / 1e9);
+    pthread_barrier_init(&barrier, NULL, nplayers + 1);
+    for (size_t t = 0; t < nplayers; ++t) {
+        pthread_create(&players[t].tid, NULL, play, &players[t]);
+    }
+    startns = nowns();
+    pthread_barrier_wait(&barrier);
+    uint64_t busy = 0, lag = 0, divergence = 0;
+    for (size_t t = 0; t < nplayers; ++t) {
+        pthread_join(players[t].tid, NULL);
+        busy += players[t].busy;
+        lag = players[t].lag > lag ? players[t].lag : lag;
+        divergence += players[t].divergence;
+        free(players[t].recs);
+    }
+    double elapsed = (nowns() - startns) / 1e9;
+    printf("{\"records\":%lu,\"threads\":%lu,\"timed\":%d,\"speed\":%.2f,\"traced_s\":%.3f,\"elapsed_s\":%.3f,"
+           "\"ops_per_sec\":%.1f,\"mean_op_us\":%.3f,\"max_lag_us\":%.1f,\"get_divergence\":%lu,\"final_count\":%u}\n",
+        nrecs, nplayers, opt.timed, opt.speed, lastts / 1e9, elapsed, nrecs / elapsed,
+        nrecs > 0 ? busy / 1000.0 / nrecs : 0, lag / 1000.0, divergence, sl->meta->count);
+    free(players);
+    pthread_barrier_destroy(&barrier);
+    munmap(mapped, st.st_size);
+    sl_close(sl);
+    return 0;
+}
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// skipdb-server的压测客户端：每个连接一个线程，阻塞I/O，每轮发送pipeline条命令后读回全部回复，
+// 命令按-t列出的类型轮流，key为"key:<随机数>"。结束后以一行JSON输出到stdout。
+// 也可以用redis-benchmark，值须为整数：redis-benchmark -p 6380 -r 100000 -n 1000000 -P 16 SET key:__rand_int__ 42
+
+#define RB_MAXCONNS 1024
+#define RB_BUFSIZE (1 << 20)
+
+enum { RB_GET, RB_SET, RB_NUM };
+static const char* typenames[RB_NUM] = { "get", "set" };
+
+typedef struct _options {
+    char host[64];
+    int port;
+    char unixpath[108];
+    int conns;
+    uint64_t requests; // 总命令数
+    int pipeline;
+    int types[RB_NUM];
+    int ntypes;
+    uint64_t keyspace;
+} _options;
+
+_options opt = {
+    .host      = "127.0.0.1",
+    .port      = 6380,
+    .unixpath  = "",
+    .conns     = 50,
+    .requests  = 1000000,
+    .pipeline  = 1,
+    .types     = { RB_GET, RB_SET },
+    .ntypes    = 2,
+    .keyspace  = 100000,
+};
+
+typedef struct client_s {
+    pthread_t tid;
+    int id;
+    int fd;
+    uint64_t requests;
+    uint64_t done;
+    uint64_t errors;
+    uint64_t rnd;
+} client_t;
+
+static uint64_t nextrand(uint64_t* s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static int connectserver() {
+    int fd;
+
+    if (opt.unixpath[0] != '\0') {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", opt.unixpath);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(opt.port) };
+        int one = 1;
+        inet_pton(AF_INET, opt.host, &addr.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int writeall(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 跳过一个完整的回复，返回其长度；不完整返回0，格式错误返回-1；*err记录错误回复
+static ssize_t skipreply(const char* data, size_t len, int* err) {
+    const char* end = memchr(data, '\n', len);
+
+    if (end == NULL) {
+        return 0;
+    }
+    size_t pos = end - data + 1;
+    switch (data[0]) {
+    case '+':
+    case ':':
+        return pos;
+    case '-':
+        ++*err;
+        return pos;
+    case '$': {
+        long n = atol(data + 1);
+        if (n < 0) {
+            return pos;
+        }
+        return len - pos < (size_t)n + 2 ? 0 : (ssize_t)(pos + n + 2);
+    }
+    case '*': {
+        long n = atol(data + 1);
+        for (long i = 0; i < n; ++i) {
+            ssize_t r = skipreply(data + pos, len - pos, err);
+            if (r <= 0) {
+                return r;
+            }
+            pos += r;
+        }
+        return pos;
+    }
+    }
+    return -1;
+}
+
+static void* run(void* arg) {
+    client_t* c = (client_t*)arg;
+    char* wbuf = (char*)malloc(RB_BUFSIZE);
+    char* rbuf = (char*)malloc(RB_BUFSIZE);
+    char key[32];
+
+    while (c->done < c->requests) {
+        size_t wlen = 0;
+        uint64_t batch = c->requests - c->done < (uint64_t)opt.pipeline ? c->requests - c->done : (uint64_t)opt.pipeline;
+        for (uint64_t i = 0; i < batch; ++i) {
+            int type = opt.types[(c->done + i) % opt.ntypes];
+            int klen = snprintf(key, sizeof(key), "key:%012lu", nextrand(&c->rnd) % opt.keyspace);
+            if (type == RB_GET) {
+                wlen += sprintf(wbuf + wlen, "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", klen, key);
+            } else {
+                wlen += sprintf(wbuf + wlen, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$2\r\n42\r\n", klen, key);
+            }
+        }
+        if (writeall(c->fd, wbuf, wlen) < 0) {
+            fprintf(stderr, "write failed: %s\n", strerror(errno));
+            break;
+        }
+        size_t rlen = 0, pos = 0;
+        uint64_t replies = 0;
+        int err = 0;
+        while (replies < batch) {
+            ssize_t n = read(c->fd, rbuf + rlen, RB_BUFSIZE - rlen);
+            if (n <= 0) {
+                fprintf(stderr, "read failed: %s\n", n == 0 ? "connection closed" : strerror(errno));
+                goto out;
+            }
+            rlen += n;
+            ssize_t r;
+            while (replies < batch && (r = skipreply(rbuf + pos, rlen - pos, &err)) > 0) {
+                pos += r;
+                ++replies;
+            }
+            if (r < 0) {
+                fprintf(stderr, "invalid reply\n");
+                goto out;
+            }
+            memmove(rbuf, rbuf + pos, rlen - pos);
+            rlen -= pos;
+            pos = 0;
+        }
+        c->errors += err;
+        c->done += batch;
+    }
+out:
+    free(wbuf);
+    free(rbuf);
+    return NULL;
+}
+
+void usage() {
+    fprintf(stderr, "\n\t./respbench [-h host] [-p port] [-s unix_socket] [-c conns] [-n requests] [-P pipeline]\n"
+                    "\t            [-t get,set] [-r keyspace]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int ch;
+    struct timeval start, stop;
+
+    while ((ch = getopt(argc, argv, "h:p:s:c:n:P:t:r:")) != -1) {
+        switch (ch) {
+        case 'h':
+            snprintf(opt.host, sizeof(opt.host), "%s", optarg);
+            break;
+        case 'p':
+            opt.port = atoi(optarg);
+            break;
+        case 's':
+            snprintf(opt.unixpath, sizeof(opt.unixpath), "%s", optarg);
+            break;
+        case 'c':
+            opt.conns = atoi(optarg);
+            break;
+        case 'n':
+            opt.requests = strtoull(optarg, NULL, 10);
+            break;
+        case 'P':
+            opt.pipeline = atoi(optarg);
+            break;
+        case 't':
+            opt.ntypes = 0;
+            for (char* t = strtok(optarg, ","); t != NULL && opt.ntypes < RB_NUM; t = strtok(NULL, ",")) {
+                if (strcasecmp(t, "get") == 0) {
+                    opt.types[opt.ntypes++] = RB_GET;
+                } else if (strcasecmp(t, "set") == 0) {
+                    opt.types[opt.ntypes++] = RB_SET;
+                } else {
+                    usage();
+                }
+            }
+            break;
+        case 'r':
+            opt.keyspace = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    // 每条命令最多约60字节
+    if (opt.conns <= 0 || opt.conns > RB_MAXCONNS || opt.pipeline <= 0 || opt.pipeline > RB_BUFSIZE / 64 ||
+        opt.ntypes == 0 || opt.keyspace == 0) {
+        usage();
+    }
+
+    client_t* clients = (client_t*)calloc(opt.conns, sizeof(client_t));
+    for (int i = 0; i < opt.conns; ++i) {
+        client_t* c = &clients[i];
+        c->id = i;
+        c->rnd = 0x9e3779b97f4a7c15ULL * (i + 1);
+        c->requests = opt.requests / opt.conns + (i < (int)(opt.requests % opt.conns) ? 1 : 0);
+        if ((c->fd = connectserver()) < 0) {
+            fprintf(stderr, "connect failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < opt.conns; ++i) {
+        pthread_create(&clients[i].tid, NULL, run, &clients[i]);
+    }
+    uint64_t done = 0, errors = 0;
+    for (int i = 0; i < opt.conns; ++i) {
+        pthread_join(clients[i].tid, NULL);
+        close(clients[i].fd);
+        done += clients[i].done;
+        errors += clients[i].errors;
+    }
+    gettimeofday(&stop, NULL);
+    double secs = elapse(stop, start);
+
+    printf("{\"conns\":%d,\"pipeline\":%d,\"types\":[", opt.conns, opt.pipeline);
+    for (int i = 0; i < opt.ntypes; ++i) {
+        printf("%s\"%s\"", i > 0 ? "," : "", typenames[opt.types[i]]);
+    }
+    printf("],\"keyspace\":%lu,\"requests\":%lu,\"errors\":%lu,\"secs\":%.3f,\"ops_per_sec\":%.0f}\n", opt.keyspace,
+        done, errors, secs, secs > 0 ? done / secs : 0.0);
+    free(clients);
+    return done == opt.requests && errors == 0 ? 0 : 1;
+}
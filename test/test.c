@@ -1,8 +1,17 @@
+#define _GNU_SOURCE
 #include "../include/print.h"
 #include "../include/list.h"
+#include "../include/lsm.h"
+#include "../include/replica.h"
 #include "../include/skiplist.h"
+#include "../include/trace.h"
 #include "test.h"
+#include <errno.h>
 #include <getopt.h>
+#include <glob.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -268,6 +277,2324 @@ void benchmarkseq() {
     sl_close(sl);
 }
 
+static void removedb(const char* prefix) {
+    char name[256];
+    const char* exts[] = { "meta", "data", "log", "heat", "bloom", "hash", "vidx", "trace" };
+
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        snprintf(name, sizeof(name), "%s.sl.%s", prefix, exts[i]);
+        remove(name);
+    }
+}
+
+void test_replica() {
+    char str[128];
+    char leader[160];
+    char follower[160];
+    int sv[2];
+    status_t s;
+    skiplist_t* sl = NULL;
+    skiplist_t* fl = NULL;
+    sl_options_t lopts;
+    struct timeval start, stop;
+
+    snprintf(leader, sizeof(leader), "%s_leader", opt.prefix);
+    snprintf(follower, sizeof(follower), "%s_follower", opt.prefix);
+    removedb(leader);
+    removedb(follower);
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        log_fatal("socketpair: %s\n", strerror(errno));
+    }
+    pid_t pid = fork();
+    if (pid == 0) { // follower
+        close(sv[0]);
+        s = sl_open(follower, opt.p, &fl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        s = sl_follow(fl, sv[1], REPLICA_BATCH_SIZE);
+        if (!s.ok) {
+            log_fatal("follow failed: %s\n", s.errmsg);
+        }
+        log_info("%s: follower applied seq = %ld, count = %d\n", __FUNCTION__, fl->meta->seq, fl->meta->count);
+        sl_close(fl);
+        exit(0);
+    }
+    close(sv[1]);
+
+    sl_options_init(&lopts);
+    lopts.p = opt.p;
+    lopts.changelog = 1;
+    s = sl_open_opt(leader, &lopts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        sprintf(str, "key_%d", i);
+        s = sl_put(sl, str, strlen(str), (uint64_t)i);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        if (i % 10 == 0) {
+            sl_del(sl, str, strlen(str));
+        }
+    }
+    s = sl_del_prefix(sl, "key_7", 5, NULL); // 范围删除以一条记录复制
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    gettimeofday(&start, NULL);
+    s = sl_serve_replica(sl, sv[0], 0);
+    if (!s.ok) {
+        log_fatal("serve failed: %s\n", s.errmsg);
+    }
+    close(sv[0]);
+    waitpid(pid, NULL, 0);
+    gettimeofday(&stop, NULL);
+    log_info("%s: replicated seq = %ld in %fs\n", __FUNCTION__, sl->meta->seq, elapse(stop, start));
+
+    s = sl_open(follower, opt.p, &fl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    int diff = 0;
+    for (int i = 0; i < opt.count; ++i) {
+        uint64_t lv = UINT64_MAX;
+        uint64_t fv = UINT64_MAX;
+        sprintf(str, "key_%d", i);
+        sl_get(sl, str, strlen(str), &lv);
+        sl_get(fl, str, strlen(str), &fv);
+        diff += (lv != fv);
+    }
+    if (diff != 0 || sl->meta->count != fl->meta->count || sl->meta->seq != fl->meta->seq) {
+        log_fatal("%s: follower diverged, diff = %d\n", __FUNCTION__, diff);
+    }
+    log_info("%s: leader and follower match, count = %d\n", __FUNCTION__, fl->meta->count);
+    sl_close(fl);
+    sl_close(sl);
+}
+
+void test_shared(int nprocs) {
+    char str[128];
+    char c = 0;
+    int done[2];
+    int go[2];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.shared = 1;
+    removedb(opt.prefix);
+    if (pipe(done) < 0 || pipe(go) < 0) {
+        log_fatal("pipe: %s\n", strerror(errno));
+    }
+    for (int n = 0; n < nprocs; ++n) {
+        if (fork() != 0) {
+            continue;
+        }
+        close(done[0]);
+        close(go[1]);
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            sprintf(str, "process_%02d_key_padding_padding_padding_%08d", n, i);
+            s = sl_put(sl, str, strlen(str), (uint64_t)i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        // 等所有进程写完后读取全部key，先写完的进程需要感知其他进程的扩容
+        uint64_t generation = sl->generation;
+        write(done[1], &c, 1);
+        read(go[0], &c, 1);
+        int miss = 0;
+        for (int m = 0; m < nprocs; ++m) {
+            for (int i = 0; i < opt.count; ++i) {
+                uint64_t value = UINT64_MAX;
+                sprintf(str, "process_%02d_key_padding_padding_padding_%08d", m, i);
+                sl_get(sl, str, strlen(str), &value);
+                miss += (value != (uint64_t)i);
+            }
+        }
+        log_info("%s: process %d put %d keys, miss = %d, generation = %ld -> %ld\n",
+            __FUNCTION__, n, opt.count, miss, generation, sl->generation);
+        sl_close(sl);
+        exit(miss != 0);
+    }
+    close(done[1]);
+    close(go[0]);
+    for (int n = 0; n < nprocs; ++n) {
+        read(done[0], &c, 1);
+    }
+    close(go[1]);
+    int failed = 0;
+    for (int n = 0; n < nprocs; ++n) {
+        int wstatus = 0;
+        wait(&wstatus);
+        failed += !(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    }
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    if (failed != 0 || sl->meta->count != (uint32_t)(nprocs * opt.count)) {
+        log_fatal("%s: failed = %d, count = %d\n", __FUNCTION__, failed, sl->meta->count);
+    }
+    log_info("%s: %d processes, count = %d, data mapcap = %ld\n", __FUNCTION__, nprocs, sl->meta->count, sl->data->mapcap);
+    sl_close(sl);
+}
+
+typedef struct scanstat_s {
+    uint64_t count;
+    uint64_t checksum;
+    char pad[48]; // 避免false sharing
+} scanstat_t;
+
+static int scanchecksum(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    scanstat_t* stat = (scanstat_t*)arg + part;
+    uint64_t h = 14695981039346656037UL;
+    for (size_t i = 0; i < key_len; ++i) {
+        h = (h ^ ((const unsigned char*)key)[i]) * 1099511628211UL;
+    }
+    stat->checksum ^= h ^ value;
+    ++stat->count;
+    return 0;
+}
+
+void test_pscan(int nthreads) {
+    status_t s;
+    skiplist_t* sl = NULL;
+    struct timeval start, stop;
+    scanstat_t stats[256];
+    uint64_t count[2] = { 0 };
+    uint64_t checksum[2] = { 0 };
+
+    s = sl_open(opt.prefix, opt.p, &sl);
+    if (!s.ok) {
+        log_fatal("%s", s.errmsg);
+    }
+    for (int round = 0; round < 2; ++round) {
+        int n = round == 0 ? 1 : nthreads;
+        memset(stats, 0, sizeof(stats));
+        gettimeofday(&start, NULL);
+        s = sl_parallel_scan(sl, n, NULL, 0, NULL, 0, scanchecksum, stats);
+        gettimeofday(&stop, NULL);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < n; ++i) {
+            count[round] += stats[i].count;
+            checksum[round] ^= stats[i].checksum;
+        }
+        log_info("%s: %d thread(s) scanned %ld keys in %fs, checksum = %016lx\n",
+            __FUNCTION__, n, count[round], elapse(stop, start), checksum[round]);
+    }
+    if (count[0] != sl->meta->count || count[0] != count[1] || checksum[0] != checksum[1]) {
+        log_fatal("%s: parallel scan mismatch\n", __FUNCTION__);
+    }
+    sl_close(sl);
+}
+
+static int reversecmp(const void* k1, size_t l1, const void* k2, size_t l2) {
+    size_t min = l1 < l2 ? l1 : l2;
+    int cmp = memcmp(k2, k1, min);
+    return cmp != 0 ? cmp : (l1 < l2) - (l1 > l2);
+}
+
+static int scanorder(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    uint64_t* prev = (uint64_t*)arg;
+    if (prev[1]++ > 0 && value >= prev[0]) { // reversecmp: key越大越靠前，value递减
+        prev[2]++;
+    }
+    prev[0] = value;
+    return 0;
+}
+
+void test_keytype() {
+    char name[160];
+    const char* names[] = { "bytes", "u64", "u128", "custom" };
+    uint32_t types[] = { SL_KEY_BYTES, SL_KEY_U64, SL_KEY_U128, SL_KEY_CUSTOM };
+    struct timeval start, stop;
+    unsigned char key[16];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    uint64_t* ids = (uint64_t*)malloc(sizeof(uint64_t) * opt.count);
+    for (int i = 0; i < opt.count; ++i) {
+        ids[i] = ((uint64_t)random() << 31) ^ random();
+    }
+    for (int t = 0; t < 4; ++t) {
+        size_t key_len = types[t] == SL_KEY_U128 ? 16 : 8;
+        snprintf(name, sizeof(name), "%s_%s", opt.prefix, names[t]);
+        removedb(name);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.keytype = types[t];
+        opts.keycmp = reversecmp;
+        s = sl_open_opt(name, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        memset(key, 0, sizeof(key));
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            for (int b = 0; b < 8; ++b) { // 大端
+                key[key_len - 8 + b] = (unsigned char)(ids[i] >> (56 - 8 * b));
+            }
+            s = sl_put(sl, key, key_len, ids[i]);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        gettimeofday(&stop, NULL);
+        float eput = elapse(stop, start);
+        int miss = 0;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = 0;
+            for (int b = 0; b < 8; ++b) {
+                key[key_len - 8 + b] = (unsigned char)(ids[i] >> (56 - 8 * b));
+            }
+            sl_get(sl, key, key_len, &value);
+            miss += (value != ids[i]);
+        }
+        gettimeofday(&stop, NULL);
+        float eget = elapse(stop, start);
+        uint64_t order[3] = { 0 };
+        if (types[t] == SL_KEY_CUSTOM) {
+            sl_scan(sl, NULL, 0, NULL, 0, scanorder, order);
+        }
+        log_info("%s: keytype %-6s put %fw key/s, get %fw key/s, miss = %d, misordered = %ld\n",
+            __FUNCTION__, names[t], opt.count / eput / 10000, opt.count / eget / 10000, miss, order[2]);
+        if (miss != 0 || order[2] != 0) {
+            log_fatal("%s: keytype %s failed\n", __FUNCTION__, names[t]);
+        }
+        sl_close(sl);
+    }
+    free(ids);
+}
+
+// 内存模式与文件模式对比，数据区从最小尺寸开始以覆盖mremap扩容
+void test_mem(int hugepage) {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    for (int inmemory = 1; inmemory >= 0; --inmemory) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.inmemory = inmemory;
+        opts.hugepage = hugepage;
+        opts.datasize = sizeof(skipdata_t) + sizeof(datanode_t) + MAX_KEY_LEN;
+        s = sl_open_opt(inmemory ? NULL : opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            snprintf(key, sizeof(key), "%lu", (uint64_t)i * 0x9e3779b97f4a7c15);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        gettimeofday(&stop, NULL);
+        float eput = elapse(stop, start);
+        int miss = 0;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "%lu", (uint64_t)i * 0x9e3779b97f4a7c15);
+            s = sl_get(sl, key, strlen(key), &value);
+            miss += (!s.ok || value == UINT64_MAX);
+        }
+        gettimeofday(&stop, NULL);
+        float eget = elapse(stop, start);
+        log_info("%s: %-6s put %fw key/s, get %fw key/s, count = %d, datacap = %ld, miss = %d\n", __FUNCTION__,
+            inmemory ? "memory" : "file", opt.count / eput / 10000, opt.count / eget / 10000, sl->meta->count,
+            sl->datacap, miss);
+        if (miss != 0) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+// 不同访问模式下的全量扫描/点查耗时；冷缓存对比需先执行 echo 1 > /proc/sys/vm/drop_caches
+void test_advise() {
+    const char* names[] = { "normal", "random", "sequential" };
+    char key[32];
+    struct timeval start, stop;
+    scanstat_t stat;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    removedb(opt.prefix);
+    s = sl_open(opt.prefix, opt.p, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        snprintf(key, sizeof(key), "%lu", (uint64_t)i * 0x9e3779b97f4a7c15);
+        s = sl_put(sl, key, strlen(key), i);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+    }
+    sl_close(sl);
+
+    for (int advice = SL_ADVISE_NORMAL; advice <= SL_ADVISE_SEQUENTIAL; ++advice) {
+        sl_options_init(&opts);
+        opts.advice = advice;
+        opts.willneed = 1;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        memset(&stat, 0, sizeof(stat));
+        gettimeofday(&start, NULL);
+        s = sl_scan(sl, NULL, 0, NULL, 0, scanchecksum, &stat);
+        gettimeofday(&stop, NULL);
+        if (!s.ok || stat.count != sl->meta->count) {
+            log_fatal("%s: scan failed\n", __FUNCTION__);
+        }
+        float escan = elapse(stop, start);
+        int miss = 0;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "%lu", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            miss += (value != (uint64_t)i);
+        }
+        gettimeofday(&stop, NULL);
+        float eget = elapse(stop, start);
+        if (!(s = sl_advise(sl, SL_ADVISE_HUGEPAGE)).ok) {
+            log_info("%s: %s\n", __FUNCTION__, s.errmsg); // 文件映射可能不支持THP
+        }
+        log_info("%s: %-10s scan %ld keys in %fs, get %fw key/s, miss = %d\n",
+            __FUNCTION__, names[advice], stat.count, escan, opt.count / eget / 10000, miss);
+        if (miss != 0) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+// 从页缓存中丢弃文件(干净页)，模拟重启后的冷缓存
+static void dropcache(const char* prefix) {
+    char name[256];
+    const char* exts[] = { "meta", "data" };
+
+    for (int i = 0; i < 2; ++i) {
+        snprintf(name, sizeof(name), "%s.sl.%s", prefix, exts[i]);
+        int fd = open(name, O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+void test_warm(int nthreads) {
+    char key[32];
+    struct timeval start, stop;
+    sl_residency_t r;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    uint64_t warmed = 0;
+
+    removedb(opt.prefix);
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.heat = 1;
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        snprintf(key, sizeof(key), "%lu", (uint64_t)i * 0x9e3779b97f4a7c15);
+        s = sl_put(sl, key, strlen(key), i);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+    }
+    sl_close(sl);
+    dropcache(opt.prefix);
+
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    sl_residency(sl, &r);
+    log_info("%s: cold, meta %ld/%ld pages, data %ld/%ld pages\n",
+        __FUNCTION__, r.metaresident, r.metapages, r.dataresident, r.datapages);
+    gettimeofday(&start, NULL);
+    s = sl_warmup(sl, nthreads, 0, &warmed);
+    gettimeofday(&stop, NULL);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    sl_residency(sl, &r);
+    sl_print_residency(&r, stdout);
+    log_info("%s: %d thread(s) warmed %ldB in %fs, meta %ld/%ld pages, data %ld/%ld pages\n",
+        __FUNCTION__, nthreads, warmed, elapse(stop, start), r.metaresident, r.metapages, r.dataresident, r.datapages);
+    if (r.metaresident != r.metapages || r.dataresident != r.datapages) {
+        log_fatal("%s: warmup incomplete\n", __FUNCTION__);
+    }
+    sl_close(sl);
+    removedb(opt.prefix);
+}
+
+// 上层索引开/关的点查对比；8字节前缀只有"user" + 4位十六进制，覆盖前缀相等的情况
+void test_upper() {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    for (int upperindex = 0; upperindex <= 1; ++upperindex) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.upperindex = upperindex;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            snprintf(key, sizeof(key), "user%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        for (int i = 0; i < opt.count; i += 3) {
+            snprintf(key, sizeof(key), "user%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_del(sl, key, strlen(key));
+        }
+        { // 重新打开，覆盖从文件构建索引
+            sl_close(sl);
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        int wrong = 0;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "user%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            wrong += i % 3 == 0 ? value != UINT64_MAX : value != (uint64_t)i;
+        }
+        gettimeofday(&stop, NULL);
+        log_info("%s: upperindex %d get %fw key/s, count = %d, wrong = %d\n", __FUNCTION__, upperindex,
+            opt.count / elapse(stop, start) / 10000, sl->meta->count, wrong);
+        if (wrong != 0) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+typedef struct ordercheck_s {
+    uint64_t count;
+    uint64_t misordered;
+    size_t last_len;
+    char last[32];
+} ordercheck_t;
+
+static int scancheck(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    ordercheck_t* c = (ordercheck_t*)arg;
+    size_t min = key_len < c->last_len ? key_len : c->last_len;
+    int cmp = memcmp(c->last, key, min);
+    if (c->count > 0 && (cmp > 0 || (cmp == 0 && c->last_len >= key_len))) {
+        ++c->misordered;
+    }
+    memcpy(c->last, key, key_len);
+    c->last_len = key_len;
+    ++c->count;
+    return 0;
+}
+
+// 两种节点格式下随机put/del，与数组模型对比；同时比较每个key的元数据开销和点查速度
+void test_block() {
+    const char* names[] = { "node", "blocked" };
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    uint64_t range = opt.count / 2 + 1;
+    uint64_t* model = (uint64_t*)malloc(sizeof(uint64_t) * range);
+
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        uint64_t x = 88172645463325252UL; // xorshift，sl_put会消耗random()
+        for (uint64_t id = 0; id < range; ++id) {
+            model[id] = UINT64_MAX;
+        }
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            uint64_t id = x % range;
+            snprintf(key, sizeof(key), "%lu", id * 0x9e3779b97f4a7c15);
+            if (x >> 62 == 0) {
+                s = sl_del(sl, key, strlen(key));
+                model[id] = UINT64_MAX;
+            } else {
+                s = sl_put(sl, key, strlen(key), i);
+                model[id] = i;
+            }
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        sl_close(sl);
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        uint64_t live = 0;
+        int wrong = 0;
+        gettimeofday(&start, NULL);
+        for (uint64_t id = 0; id < range; ++id) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "%lu", id * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            wrong += value != model[id];
+            live += model[id] != UINT64_MAX;
+        }
+        gettimeofday(&stop, NULL);
+        ordercheck_t stat;
+        memset(&stat, 0, sizeof(stat));
+        sl_scan(sl, NULL, 0, NULL, 0, scancheck, &stat);
+        const char* bounds[][2] = { { NULL, NULL }, { "3", "7" } };
+        for (int b = 0; b < 2; ++b) { // 并行扫描(块格式按块分区)与单线程结果相同，并且确实分区了
+            const char* lo = bounds[b][0];
+            const char* hi = bounds[b][1];
+            scanstat_t stats[8];
+            uint64_t count[2] = { 0 }, checksum[2] = { 0 };
+            for (int round = 0; round < 2; ++round) {
+                int n = round == 0 ? 1 : 8;
+                memset(stats, 0, sizeof(stats));
+                wrong += !sl_parallel_scan(sl, n, lo, lo ? strlen(lo) : 0, hi, hi ? strlen(hi) : 0, scanchecksum, stats).ok;
+                for (int i = 0; i < n; ++i) {
+                    count[round] += stats[i].count;
+                    checksum[round] ^= stats[i].checksum;
+                }
+            }
+            wrong += count[0] != count[1] || checksum[0] != checksum[1] || (lo == NULL && count[0] != live);
+            wrong += live > 10000 && stats[1].count == 0;
+        }
+        log_info("%s: %-7s get %fw key/s, count = %d/%ld, scanned = %ld, misordered = %ld, wrong = %d, meta %.1fB/key\n",
+            __FUNCTION__, names[format], range / elapse(stop, start) / 10000, sl->meta->count, live, stat.count,
+            stat.misordered, wrong, (double)sl->meta->mapsize / (live ? live : 1));
+        if (wrong != 0 || sl->meta->count != live || stat.count != live || stat.misordered != 0) {
+            log_fatal("%s: %s failed\n", __FUNCTION__, names[format]);
+        }
+        sl_close(sl);
+    }
+    free(model);
+
+    // 顺序写入：追加到最后一个块时开新块，块是满的，每个key的元数据开销应明显小于节点格式
+    double perkey[2] = { 0 };
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count / 4; ++i) { // 与上面留下的key数相当，默认元数据大小放得下
+            snprintf(key, sizeof(key), "seq%016x", i);
+            if (!(s = sl_put(sl, key, strlen(key), i)).ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        perkey[format] = (double)sl->meta->mapsize / (sl->meta->count ? sl->meta->count : 1);
+        log_info("%s: %-7s sequential meta %.1fB/key\n", __FUNCTION__, names[format], perkey[format]);
+        sl_close(sl);
+    }
+    if (opt.count > 4000 && perkey[SL_FORMAT_BLOCKED] * 4 >= perkey[SL_FORMAT_NODE] * 3) { // 对半分裂时块半满，会超过节点格式
+        log_fatal("%s: sequential blocked %.1fB/key, node %.1fB/key\n", __FUNCTION__, perkey[SL_FORMAT_BLOCKED],
+            perkey[SL_FORMAT_NODE]);
+    }
+    removedb(opt.prefix);
+}
+
+// 不存在key的点查在有无布隆过滤器时的速度；并检查删除、重建、未开启过滤器时写入后重新打开都没有漏判
+void test_bloom() {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    for (uint32_t bloom = 0; bloom <= 10; bloom += 10) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.bloom = bloom;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        if (bloom > 0) { // 覆盖写不计入过滤器的key数，不触发重建
+            for (int round = 0; round < 4; ++round) {
+                for (int i = 0; i < opt.count; ++i) {
+                    snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+                    sl_put(sl, key, strlen(key), i);
+                }
+            }
+            char name[256];
+            uint64_t nkeys = 0;
+            snprintf(name, sizeof(name), "%s.sl.bloom", opt.prefix);
+            FILE* fp = fopen(name, "r");
+            if (fp == NULL || fseek(fp, 24, SEEK_SET) != 0 || fread(&nkeys, sizeof(nkeys), 1, fp) != 1) { // bloomhead_t.nkeys
+                log_fatal("%s: read %s failed\n", __FUNCTION__, name);
+            }
+            fclose(fp);
+            if (nkeys != (uint64_t)opt.count) {
+                log_fatal("%s: bloom nkeys = %lu after overwrites, count = %d\n", __FUNCTION__, nkeys, opt.count);
+            }
+        }
+        for (int i = 0; i < opt.count; i += 3) {
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_del(sl, key, strlen(key));
+        }
+        if (bloom > 0) {
+            s = sl_bloom_rebuild(sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        sl_close(sl);
+        if (bloom > 0) { // 未开启过滤器时写入，过滤器文件过期
+            opts.bloom = 0;
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            for (int i = 0; i < opt.count; i += 3) {
+                snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+                sl_put(sl, key, strlen(key), i);
+            }
+            sl_close(sl);
+            opts.bloom = bloom;
+        }
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        int wrong = 0;
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            wrong += bloom == 0 && i % 3 == 0 ? value != UINT64_MAX : value != (uint64_t)i;
+        }
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "miss%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            wrong += value != UINT64_MAX;
+        }
+        gettimeofday(&stop, NULL);
+        log_info("%s: bloom %2d miss get %fw key/s, count = %d, wrong = %d\n", __FUNCTION__, bloom,
+            opt.count / elapse(stop, start) / 10000, sl->meta->count, wrong);
+        if (wrong != 0) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+// 有无哈希索引时的点查速度；写入过程中经历多次渐进扩容，并检查未开启索引时写入后重新打开不会漏查
+void test_hash() {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    for (int hashindex = 0; hashindex <= 1; ++hashindex) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.hashindex = hashindex;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            if (i % 4 == 3) { // 扩容迁移期间删除
+                snprintf(key, sizeof(key), "key%016lx", (uint64_t)(i - 1) * 0x9e3779b97f4a7c15);
+                sl_del(sl, key, strlen(key));
+            }
+        }
+        int wrong = 0;
+        for (int i = 0; i < opt.count; ++i) { // 扩容后的索引
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            wrong += i % 4 == 2 && i + 1 < opt.count ? value != UINT64_MAX : value != (uint64_t)i;
+        }
+        sl_close(sl);
+        if (hashindex) { // 未开启索引时写入，索引文件过期
+            opts.hashindex = 0;
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            for (int i = 0; i < opt.count; i += 5) {
+                snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+                sl_del(sl, key, strlen(key));
+            }
+            sl_close(sl);
+            opts.hashindex = 1;
+        }
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        if (!hashindex) {
+            for (int i = 0; i < opt.count; i += 5) {
+                snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+                sl_del(sl, key, strlen(key));
+            }
+        }
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            snprintf(key, sizeof(key), "key%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+            int deleted = (i % 4 == 2 && i + 1 < opt.count) || i % 5 == 0;
+            wrong += deleted ? value != UINT64_MAX : value != (uint64_t)i;
+        }
+        gettimeofday(&stop, NULL);
+        log_info("%s: hashindex %d get %fw key/s, count = %d, wrong = %d\n", __FUNCTION__, hashindex,
+            opt.count / elapse(stop, start) / 10000, sl->meta->count, wrong);
+        if (wrong != 0) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+typedef struct rmwworker_s {
+    skiplist_t* sl;
+    int id;
+    int failed;
+} rmwworker_t;
+
+static void* rmwworker(void* arg) {
+    rmwworker_t* w = (rmwworker_t*)arg;
+    char key[32];
+    status_t s;
+
+    for (int i = 0; i < opt.count; ++i) {
+        int inserted = 0;
+        int swapped = 0;
+        uint64_t old = 0;
+        snprintf(key, sizeof(key), "counter%02d", i % 16);
+        s = sl_fetch_add(w->sl, key, strlen(key), 1, NULL);
+        w->failed += !s.ok;
+        snprintf(key, sizeof(key), "uniq%08d", i);
+        s = sl_put_if_absent(w->sl, key, strlen(key), w->id, &inserted);
+        w->failed += !s.ok;
+        do { // cas自增
+            old = 0;
+            sl_get(w->sl, "cas", 3, &old);
+            s = sl_cas(w->sl, "cas", 3, old, old + 1, &swapped);
+            w->failed += !s.ok;
+        } while (s.ok && !swapped);
+    }
+    return NULL;
+}
+
+// 多线程fetch_add/put_if_absent/cas与单线程的get+put计数对比，两种节点格式
+void test_rmw(int nthreads) {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    pthread_t threads[64];
+    rmwworker_t workers[64];
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        sl_put(sl, "cas", 3, 0);
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < nthreads; ++i) {
+            workers[i].sl = sl;
+            workers[i].id = i;
+            workers[i].failed = 0;
+            pthread_create(&threads[i], NULL, rmwworker, &workers[i]);
+        }
+        int failed = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            pthread_join(threads[i], NULL);
+            failed += workers[i].failed;
+        }
+        gettimeofday(&stop, NULL);
+        uint64_t total = 0;
+        for (int i = 0; i < 16; ++i) {
+            uint64_t value = 0;
+            snprintf(key, sizeof(key), "counter%02d", i);
+            sl_get(sl, key, strlen(key), &value);
+            total += value;
+        }
+        uint64_t casvalue = 0;
+        sl_get(sl, "cas", 3, &casvalue);
+        uint64_t expected = (uint64_t)nthreads * opt.count;
+        log_info("%s: format %d %d thread(s) %fs, counters = %ld/%ld, cas = %ld, count = %d, failed = %d\n",
+            __FUNCTION__, format, nthreads, elapse(stop, start), total, expected, casvalue, sl->meta->count, failed);
+        if (failed != 0 || total != expected || casvalue != expected || sl->meta->count != (uint32_t)opt.count + 17) {
+            log_fatal("%s: failed\n", __FUNCTION__);
+        }
+        { // 单线程计数：get+put与fetch_add
+            double elapsed[2];
+            for (int rmw = 0; rmw <= 1; ++rmw) {
+                gettimeofday(&start, NULL);
+                for (int i = 0; i < opt.count; ++i) {
+                    snprintf(key, sizeof(key), "counter%02d", i % 16);
+                    if (rmw) {
+                        sl_fetch_add(sl, key, strlen(key), 1, NULL);
+                    } else {
+                        uint64_t value = 0;
+                        sl_get(sl, key, strlen(key), &value);
+                        sl_put(sl, key, strlen(key), value + 1);
+                    }
+                }
+                gettimeofday(&stop, NULL);
+                elapsed[rmw] = elapse(stop, start);
+            }
+            log_info("%s: format %d get+put %fw op/s, fetch_add %fw op/s\n", __FUNCTION__, format,
+                opt.count / elapsed[0] / 10000, opt.count / elapsed[1] / 10000);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+static void rangekey(char* key, int i) {
+    sprintf(key, "t%02d:%08d", i % 16, i / 16);
+}
+
+// 在模型中删除[lo, hi)，lo/hi为NULL表示不限
+static uint64_t rangemodel(uint64_t* model, const char* lo, const char* hi) {
+    char key[32];
+    uint64_t removed = 0;
+
+    for (int i = 0; i < opt.count; ++i) {
+        rangekey(key, i);
+        if ((lo == NULL || strcmp(key, lo) >= 0) && (hi == NULL || strcmp(key, hi) < 0) && model[i] != UINT64_MAX) {
+            model[i] = UINT64_MAX;
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+static int rangecheck(skiplist_t* sl, uint64_t* model) {
+    char key[32];
+    uint64_t live = 0;
+    int wrong = 0;
+    ordercheck_t stat;
+    void* maxkey = NULL;
+    size_t maxkey_len = 0;
+    char expectmax[32] = "";
+
+    for (int i = 0; i < opt.count; ++i) {
+        uint64_t value = UINT64_MAX;
+        rangekey(key, i);
+        sl_get(sl, key, strlen(key), &value);
+        wrong += value != model[i];
+        if (model[i] != UINT64_MAX) {
+            ++live;
+            if (strcmp(key, expectmax) > 0) {
+                strcpy(expectmax, key);
+            }
+        }
+    }
+    memset(&stat, 0, sizeof(stat));
+    sl_scan(sl, NULL, 0, NULL, 0, scancheck, &stat);
+    sl_get_maxkey(sl, &maxkey, &maxkey_len);
+    wrong += stat.count != live || stat.misordered != 0 || sl->meta->count != live;
+    wrong += live > 0 && (maxkey == NULL || maxkey_len != strlen(expectmax) || memcmp(maxkey, expectmax, maxkey_len) != 0);
+    return wrong;
+}
+
+// 两种节点格式下前缀删除和范围删除与模型对比，并比较逐个sl_del与sl_del_prefix删除一个租户的耗时
+void test_range() {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    uint64_t removed = 0;
+    uint64_t* model = (uint64_t*)malloc(sizeof(uint64_t) * opt.count);
+    struct {
+        const char* lo;
+        const char* hi;
+    } ranges[] = {
+        { "t05:00000100", "t05:00000200" }, // 同一段内
+        { "t06:000001", "t09:00000050" },   // 跨多个租户，边界不是已有key
+        { NULL, "t01:00000010" },           // 下界不限
+        { "t15:00000300", NULL },           // 上界不限，包括最大key
+        { "t12", "t12" },                   // 空范围
+    };
+
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        opts.hashindex = format == SL_FORMAT_NODE; // 范围删除同时维护哈希索引、上层索引和布隆过滤器
+        opts.bloom = 10;
+        opts.changelog = 1; // 范围删除的日志记录为lo和hi拼接
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            rangekey(key, i);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            model[i] = i;
+        }
+        int wrong = 0;
+        { // 逐个删除租户t02与前缀删除租户t03
+            double elapsed[2];
+            gettimeofday(&start, NULL);
+            for (int i = 2; i < opt.count; i += 16) {
+                rangekey(key, i);
+                sl_del(sl, key, strlen(key));
+            }
+            gettimeofday(&stop, NULL);
+            elapsed[0] = elapse(stop, start);
+            rangemodel(model, "t02:", "t03:");
+            gettimeofday(&start, NULL);
+            s = sl_del_prefix(sl, "t03:", 4, &removed);
+            gettimeofday(&stop, NULL);
+            elapsed[1] = elapse(stop, start);
+            wrong += !s.ok || removed != rangemodel(model, "t03:", "t04:");
+            log_info("%s: format %d delete tenant: sl_del %fs, sl_del_prefix %fs, removed = %ld\n", __FUNCTION__,
+                format, elapsed[0], elapsed[1], removed);
+        }
+        for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+            const char* lo = ranges[r].lo;
+            const char* hi = ranges[r].hi;
+            s = sl_del_range(sl, lo, lo ? strlen(lo) : 0, hi, hi ? strlen(hi) : 0, &removed);
+            wrong += !s.ok || removed != rangemodel(model, lo, hi);
+        }
+        { // lo和hi合计超过日志记录的16位长度时拒绝
+            char* big = (char*)malloc(40001);
+            memset(big, 'u', 40000);
+            big[40000] = '\0';
+            wrong += sl_del_range(sl, big, 40000, big, 40000, &removed).ok;
+            s = sl_del_range(sl, big, 40000, NULL, 0, &removed);
+            wrong += !s.ok || removed != rangemodel(model, big, NULL);
+            free(big);
+        }
+        wrong += rangecheck(sl, model);
+        for (int i = 0; i < opt.count; i += 2) { // 重新写入，复用回收的节点
+            rangekey(key, i);
+            sl_put(sl, key, strlen(key), i);
+            model[i] = i;
+        }
+        wrong += rangecheck(sl, model);
+        sl_close(sl);
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        wrong += rangecheck(sl, model);
+        s = sl_del_prefix(sl, "", 0, &removed);
+        wrong += !s.ok || removed != rangemodel(model, NULL, NULL) || rangecheck(sl, model);
+        log_info("%s: format %d count = %d, head level = %d, wrong = %d\n", __FUNCTION__, format, sl->meta->count,
+            METANODEHEAD(sl)->level, wrong);
+        if (wrong != 0 || METANODEHEAD(sl)->level != 0) {
+            log_fatal("%s: format %d failed\n", __FUNCTION__, format);
+        }
+        sl_close(sl);
+    }
+    free(model);
+    removedb(opt.prefix);
+}
+
+static void guardkey(char* key, int i) {
+    sprintf(key, "g:%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+}
+
+// read guard内持有视图和迭代器，同时写入大量key(含长key)使数据映射多次扩容，
+// 检查视图内容不变、迭代器有序且不漏guard开始时已有的key
+void test_guard() {
+    char key[MAX_KEY_LEN];
+    char minkey[MAX_KEY_LEN];
+    char maxkey[MAX_KEY_LEN];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    sl_view_t vmin, vmax;
+    sl_iter_t it;
+    int half = opt.count / 2;
+
+    for (int mode = 0; mode < 4; ++mode) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = mode & 1 ? SL_FORMAT_BLOCKED : SL_FORMAT_NODE;
+        opts.inmemory = mode >> 1;
+        opts.datasize = 131072;
+        s = sl_open_opt(opts.inmemory ? NULL : opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < half; ++i) {
+            guardkey(key, i);
+            sl_put(sl, key, strlen(key), i);
+        }
+        int wrong = sl_view_minkey(sl, &vmin).ok; // guard外不能取视图
+        sl_read_begin(sl);
+        sl_view_minkey(sl, &vmin);
+        sl_view_maxkey(sl, &vmax);
+        memcpy(minkey, vmin.data, vmin.size);
+        memcpy(maxkey, vmax.data, vmax.size);
+        void* mapped = DATAMAPPED(sl);
+        uint64_t seen = 0;
+        char prev[MAX_KEY_LEN + 1] = "";
+        size_t prev_len = 0;
+        int n = half;
+        for (s = sl_iter_seek(sl, &it, NULL, 0); s.ok && it.valid; s = sl_iter_next(&it)) {
+            if (prev_len > 0) {
+                size_t l = prev_len < it.key.size ? prev_len : it.key.size;
+                int c = memcmp(prev, it.key.data, l);
+                wrong += c > 0 || (c == 0 && prev_len >= it.key.size);
+            }
+            memcpy(prev, it.key.data, it.key.size);
+            prev_len = it.key.size;
+            seen += it.key.size == 18 && ((const char*)it.key.data)[0] == 'g';
+            if ((seen & 3) == 0 && n < opt.count) { // 迭代中写入，新key插在各处
+                guardkey(key, n);
+                sl_put(sl, key, strlen(key), n++);
+                memset(key, 'x', 120);
+                sprintf(key, "x%08d", n);
+                key[9] = 'x';
+                sl_put(sl, key, 120, n);
+            }
+        }
+        wrong += !s.ok || seen < (uint64_t)half;
+        wrong += memcmp(minkey, vmin.data, vmin.size) != 0 || memcmp(maxkey, vmax.data, vmax.size) != 0;
+        int remapped = DATAMAPPED(sl) != mapped;
+        int retired = sl->retired != NULL;
+        sl_read_end(sl);
+        wrong += !remapped || !retired || sl->retired != NULL || sl->guards != 0;
+        sl_read_begin(sl);
+        sl_view_maxkey(sl, &vmax);
+        wrong += vmax.size != 120 || ((const char*)vmax.data)[0] != 'x';
+        sl_read_end(sl);
+        log_info("%s: mode %d count = %d, seen = %ld, datacap = %ld, wrong = %d\n", __FUNCTION__, mode,
+            sl->meta->count, seen, sl->datacap, wrong);
+        if (wrong != 0) {
+            log_fatal("%s: mode %d failed\n", __FUNCTION__, mode);
+        }
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+typedef struct asyncstat_s {
+    uint64_t completed;
+    uint64_t found;
+    uint64_t wrong;
+} asyncstat_t;
+
+static void asyncdone(status_t status, int found, uint64_t value, void* arg) {
+    asyncstat_t* stat = (asyncstat_t*)arg;
+    __sync_fetch_and_add(&stat->found, found);
+    __sync_fetch_and_add(&stat->wrong, !status.ok || (found && value % 7 != 3));
+    __sync_fetch_and_add(&stat->completed, 1);
+}
+
+// 冷缓存下sl_get_async：不驻留的查找交给I/O线程，调用线程不缺页；再次查找时全部同步完成
+void test_async() {
+    char key[32];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        opts.bloom = 10;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            sprintf(key, "a:%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+            sl_put(sl, key, strlen(key), (uint64_t)i * 7 + 3);
+        }
+        sl_close(sl);
+        dropcache(opt.prefix);
+        opts.iothreads = 4;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            asyncstat_t stat = { 0 };
+            uint64_t pending = 0, syncfound = 0, wrong = 0;
+            struct rusage ru0, ru1;
+            getrusage(RUSAGE_THREAD, &ru0);
+            gettimeofday(&start, NULL);
+            for (int i = 0; i < opt.count * 2; ++i) { // 后一半不存在
+                uint64_t value = UINT64_MAX;
+                sprintf(key, "%s:%016lx", i < opt.count ? "a" : "b", (uint64_t)(i % opt.count) * 0x9e3779b97f4a7c15);
+                s = sl_get_async(sl, key, strlen(key), &value, asyncdone, &stat);
+                if (!s.ok) {
+                    log_fatal("%s\n", s.errmsg);
+                }
+                if (s.type == STATUS_SKIPLIST_PENDING) {
+                    ++pending;
+                } else if (value != UINT64_MAX) {
+                    ++syncfound;
+                    wrong += value % 7 != 3;
+                }
+            }
+            gettimeofday(&stop, NULL);
+            getrusage(RUSAGE_THREAD, &ru1);
+            while (__sync_fetch_and_add(&stat.completed, 0) < pending) {
+                usleep(1000);
+            }
+            wrong += stat.wrong + (syncfound + stat.found != (uint64_t)opt.count);
+            log_info("%s: format %d pass %d %fs, pending = %ld, found = %ld + %ld, major faults on caller = %ld, wrong = %ld\n",
+                __FUNCTION__, format, pass, elapse(stop, start), pending, syncfound, stat.found,
+                ru1.ru_majflt - ru0.ru_majflt, wrong);
+            if (wrong != 0 || (pass == 1 && pending > (uint64_t)opt.count / 100)) {
+                log_fatal("%s: format %d failed\n", __FUNCTION__, format);
+            }
+        }
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < opt.count * 2; ++i) { // 与已驻留时的同步路径对比
+            uint64_t value = UINT64_MAX;
+            sprintf(key, "%s:%016lx", i < opt.count ? "a" : "b", (uint64_t)(i % opt.count) * 0x9e3779b97f4a7c15);
+            sl_get(sl, key, strlen(key), &value);
+        }
+        gettimeofday(&stop, NULL);
+        log_info("%s: format %d sl_get %fs\n", __FUNCTION__, format, elapse(stop, start));
+        sl_close(sl);
+    }
+    removedb(opt.prefix);
+}
+
+static void* traceworker(void* arg) {
+    rmwworker_t* w = (rmwworker_t*)arg;
+    char key[32];
+    uint64_t value = 0;
+
+    for (int i = 0; i < opt.count; ++i) { // 每轮put、get、del各一次
+        snprintf(key, sizeof(key), "t%02d:%08d", w->id, i);
+        w->failed += !sl_put(w->sl, key, strlen(key), i).ok;
+        w->failed += !sl_get(w->sl, key, strlen(key), &value).ok || value != (uint64_t)i;
+        if (i % 2 == 0) {
+            w->failed += !sl_del(w->sl, key, strlen(key)).ok;
+        }
+    }
+    return NULL;
+}
+
+// 读取跟踪文件，检查记录数、每个线程的时间有序和get命中标记，返回错误数
+static int tracecheck(const char* path, uint64_t expect[], int nthreads) {
+    char buff[sizeof(tracerecord_t) + MAX_KEY_LEN];
+    uint64_t counts[5] = { 0 };
+    uint64_t lastts[64] = { 0 };
+    int wrong = 0;
+    traceheader_t header;
+
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1) {
+        return 1;
+    }
+    wrong += header.magic != SL_TRACE_MAGIC;
+    tracerecord_t* rec = (tracerecord_t*)buff;
+    while (fread(rec, sizeof(tracerecord_t), 1, fp) == 1 && fread(rec->data, 1, rec->size, fp) == rec->size) {
+        if (rec->op > SL_TRACE_GET || rec->thread >= (uint32_t)nthreads) {
+            ++wrong;
+            break;
+        }
+        wrong += rec->ts < lastts[rec->thread];
+        wrong += rec->op == SL_TRACE_GET && !(rec->flags & SL_TRACE_FOUND);
+        lastts[rec->thread] = rec->ts;
+        ++counts[rec->op];
+    }
+    fclose(fp);
+    for (int op = 1; op <= SL_TRACE_GET; ++op) {
+        wrong += counts[op] != expect[op];
+    }
+    return wrong;
+}
+
+// 多线程写入跟踪文件并检查内容，再在运行中开始/停止一次跟踪
+void test_trace(int nthreads) {
+    char path[256];
+    struct timeval start, stop;
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    pthread_t threads[64];
+    rmwworker_t workers[64];
+    uint64_t expect[5] = { 0 };
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    removedb(opt.prefix);
+    sl_options_init(&opts);
+    opts.trace = 1;
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < nthreads; ++i) {
+        workers[i].sl = sl;
+        workers[i].id = i;
+        workers[i].failed = 0;
+        pthread_create(&threads[i], NULL, traceworker, &workers[i]);
+    }
+    int wrong = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+        wrong += workers[i].failed;
+    }
+    gettimeofday(&stop, NULL);
+    sl_close(sl);
+    expect[SL_OP_PUT] = expect[SL_TRACE_GET] = (uint64_t)opt.count * nthreads;
+    expect[SL_OP_DEL] = (uint64_t)(opt.count + 1) / 2 * nthreads;
+    snprintf(path, sizeof(path), "%s.sl.trace", opt.prefix);
+    wrong += tracecheck(path, expect, nthreads);
+    log_info("%s: %d thread(s) %fw op/s with trace, wrong = %d\n", __FUNCTION__, nthreads,
+        (expect[1] + expect[2] + expect[4]) / elapse(stop, start) / 10000, wrong);
+
+    opts.trace = 0; // 运行中开始/停止
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    snprintf(path, sizeof(path), "%s.sl.trace2", opt.prefix);
+    sl_trace_start(sl, path);
+    wrong += sl_trace_start(sl, path).ok; // 不能重复开始
+    workers[0].sl = sl;
+    workers[0].failed = 0;
+    traceworker(&workers[0]);
+    wrong += workers[0].failed;
+    sl_trace_stop(sl);
+    sl_put(sl, "untraced", 8, 0);
+    sl_close(sl);
+    expect[SL_OP_PUT] = expect[SL_TRACE_GET] = opt.count;
+    expect[SL_OP_DEL] = (opt.count + 1) / 2;
+    wrong += tracecheck(path, expect, 1);
+    remove(path);
+    if (wrong != 0) {
+        log_fatal("%s: failed, wrong = %d\n", __FUNCTION__, wrong);
+    }
+    removedb(opt.prefix);
+}
+
+static void statskey(char* key, int i) {
+    sprintf(key, "s:%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+}
+
+static void* statsworker(void* arg) {
+    rmwworker_t* w = (rmwworker_t*)arg;
+    char key[32];
+    uint64_t value = 0;
+
+    for (int i = 0; i < opt.count * 2; ++i) { // 后一半key不存在
+        statskey(key, i);
+        w->failed += !sl_get(w->sl, key, strlen(key), &value).ok;
+    }
+    return NULL;
+}
+
+// 遍历跳表和空闲链表，与sl_stats中增量维护的值对比，返回不一致数
+static int statswalk(skiplist_t* sl, const sl_stats_t* st) {
+    uint64_t levels[SKIPLIST_MAXLEVEL + 1] = { 0 };
+    uint64_t metafreen = 0, metafreebytes = 0, datafreen = 0, datafreebytes = 0;
+    int wrong = 0;
+
+    for (metanode_t* curr = METANODE(sl, METANODEHEAD(sl)->forwards[0]); curr != NULL; curr = METANODE(sl, curr->forwards[0])) {
+        ++levels[curr->level];
+    }
+    for (int i = 0; i <= SKIPLIST_MAXLEVEL; ++i) {
+        wrong += levels[i] != st->levels[i];
+        for (uint64_t offset = sl->meta->metafree[i]; offset != 0; offset = METANODE(sl, offset)->backward) {
+            ++metafreen;
+            metafreebytes += sl->meta->format == SL_FORMAT_BLOCKED ? sizeof(metanode_t) + sizeof(uint64_t) * i + sizeof(uint64_t) * 3 * SL_BLOCK_ENTRIES
+                                                                   : sizeof(metanode_t) + sizeof(uint64_t) * i;
+        }
+    }
+    for (uint64_t offset = sl->data->datafree; offset != 0; offset = sl_get_datanode(sl, offset)->offset) {
+        ++datafreen;
+        datafreebytes += DATANODECAP(sl_get_datanode(sl, offset));
+    }
+    wrong += metafreen != st->metafreen || metafreebytes != st->metafreebytes;
+    wrong += datafreen != st->datafreen || datafreebytes != st->datafreebytes;
+    wrong += st->metamapsize != sl->meta->mapsize || st->datamapsize != sl->data->mapsize || st->count != sl->meta->count;
+    return wrong;
+}
+
+// 多线程点查和写入后检查各计数器，level分布和空闲链表与遍历结果一致(包括重新打开后)
+void test_stats(int nthreads) {
+    char key[32];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    sl_stats_t st;
+    pthread_t threads[64];
+    rmwworker_t workers[64];
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    for (uint32_t format = SL_FORMAT_NODE; format <= SL_FORMAT_BLOCKED; ++format) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = format;
+        opts.datasize = 131072; // 写入时多次扩容
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            statskey(key, i);
+            s = sl_put(sl, key, strlen(key), i);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+        }
+        int wrong = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            workers[i].sl = sl;
+            workers[i].id = i;
+            workers[i].failed = 0;
+            pthread_create(&threads[i], NULL, statsworker, &workers[i]);
+        }
+        for (int i = 0; i < nthreads; ++i) {
+            pthread_join(threads[i], NULL);
+            wrong += workers[i].failed;
+        }
+        uint64_t deleted = 0;
+        for (int i = 0; i < opt.count; i += 2) {
+            statskey(key, i);
+            sl_del(sl, key, strlen(key));
+            ++deleted;
+        }
+        statskey(key, 1); // 已有的key，原地修改
+        sl_fetch_add(sl, key, strlen(key), 1, NULL);
+        sl_sync(sl);
+        s = sl_stats(sl, &st);
+        wrong += !s.ok || statswalk(sl, &st);
+        wrong += st.ops[SL_STAT_PUT] != (uint64_t)opt.count || st.ops[SL_STAT_DEL] != deleted || st.ops[SL_STAT_MERGE] != 1;
+        wrong += st.ops[SL_STAT_GET] != (uint64_t)opt.count * 2 * nthreads;
+        wrong += st.hits != (uint64_t)opt.count * nthreads || st.misses != (uint64_t)opt.count * nthreads;
+        wrong += st.datafreen != deleted || st.expansions == 0 || st.expansions != sl->meta->generation;
+        wrong += st.synced != sl->meta->mapcap + sl->datacap || st.lookups == 0 || st.compares < st.hops;
+        wrong += format == SL_FORMAT_NODE && st.metafreen != deleted;
+        log_info("%s: format %d lookups = %ld, avghops = %.2f, avgcompares = %.2f, maxlevel = %d, "
+                 "metafrag = %.3f, datafrag = %.3f, expansions = %ld, wrong = %d\n", __FUNCTION__, format,
+            st.lookups, st.avghops, st.avgcompares, st.maxlevel, st.metafrag, st.datafrag, st.expansions, wrong);
+        sl_close(sl);
+        s = sl_open_opt(opt.prefix, &opts, &sl); // 计数器从0开始，文件中维护的值不变
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        s = sl_stats(sl, &st);
+        wrong += !s.ok || statswalk(sl, &st) || st.ops[SL_STAT_PUT] != 0 || st.lookups != 0;
+        for (int i = 0; i < opt.count; i += 2) { // 复用回收的节点
+            statskey(key, i);
+            sl_put(sl, key, strlen(key), i);
+        }
+        s = sl_stats(sl, &st);
+        wrong += !s.ok || statswalk(sl, &st);
+        sl_close(sl);
+        if (wrong != 0) {
+            log_fatal("%s: format %d failed, wrong = %d\n", __FUNCTION__, format, wrong);
+        }
+    }
+    removedb(opt.prefix);
+}
+
+static void* lockwriter(void* arg) {
+    rmwworker_t* w = (rmwworker_t*)arg;
+    char key[32];
+
+    for (int i = 0; i < opt.count; ++i) {
+        statskey(key, opt.count + i);
+        w->failed += !sl_put(w->sl, key, strlen(key), i).ok;
+    }
+    return NULL;
+}
+
+// 读线程与一个写线程并发，检查按操作类型的加锁次数、等待与抽样的持有时间
+void test_locks(int nthreads) {
+    char key[32];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    sl_stats_t st;
+    pthread_t threads[65];
+    rmwworker_t workers[65];
+    scanstat_t scan = { 0 };
+    const char* names[SL_STAT_OPS] = { "get", "put", "del", "write", "merge", "delrange", "scan", "other" };
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    removedb(opt.prefix);
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        statskey(key, i);
+        sl_put(sl, key, strlen(key), i);
+    }
+    for (int i = 0; i <= nthreads; ++i) {
+        workers[i].sl = sl;
+        workers[i].id = i;
+        workers[i].failed = 0;
+        pthread_create(&threads[i], NULL, i < nthreads ? statsworker : lockwriter, &workers[i]);
+    }
+    int wrong = 0;
+    for (int i = 0; i <= nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+        wrong += workers[i].failed;
+    }
+    sl_put_if_absent(sl, "l:absent", 8, 1, NULL); // 嵌套的公开调用按外层类型统计
+    sl_scan(sl, NULL, 0, NULL, 0, scanchecksum, &scan);
+    s = sl_stats(sl, &st);
+    wrong += !s.ok;
+    wrong += st.locks[SL_STAT_GET].acquires != (uint64_t)opt.count * 2 * nthreads;
+    wrong += st.locks[SL_STAT_PUT].acquires != (uint64_t)opt.count * 2;
+    wrong += st.locks[SL_STAT_MERGE].acquires != 1 || st.locks[SL_STAT_SCAN].acquires != 1;
+    for (int op = 0; op < SL_STAT_OPS; ++op) {
+        sl_lockstats_t* l = &st.locks[op];
+        wrong += l->contended > l->acquires || (l->contended == 0) != (l->waitns == 0);
+        wrong += l->holdsamples > l->acquires / SL_LOCK_SAMPLE + nthreads + 2;
+        if (l->acquires > 0) {
+            log_info("%s: %-8s acquires = %ld, contended = %ld, avgwait = %.0fns, avghold = %.0fns(%ld samples)\n",
+                __FUNCTION__, names[op], l->acquires, l->contended, l->avgwaitns, l->avgholdns, l->holdsamples);
+        }
+    }
+    wrong += st.locks[SL_STAT_GET].holdsamples == 0;
+    sl_close(sl);
+    if (wrong != 0) {
+        log_fatal("%s: failed, wrong = %d\n", __FUNCTION__, wrong);
+    }
+    removedb(opt.prefix);
+}
+
+static void lsmkey(char* key, int i) {
+    sprintf(key, "l:%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+}
+
+// lsmkey的逆，乘以0x9e3779b97f4a7c15在模2^64下的逆元
+static int lsmindex(const void* key, size_t key_len) {
+    char hex[17];
+
+    if (key_len != 18) {
+        return -1;
+    }
+    memcpy(hex, (const char*)key + 2, 16);
+    hex[16] = '\0';
+    return (int)(strtoull(hex, NULL, 16) * 0xf1de83e19937733dULL);
+}
+
+// 写线程负责i % nthreads == id的key：全部写入，覆盖偶数的，再删除7的倍数
+static int lsmexpect(int i, uint64_t* value) {
+    *value = i % 2 == 0 ? (uint64_t)i * 3 : (uint64_t)i;
+    return i % 7 != 0;
+}
+
+typedef struct lsmworker_s {
+    lsm_t* lsm;
+    int id;
+    int nthreads;
+    int failed;
+} lsmworker_t;
+
+static void* lsmwriter(void* arg) {
+    lsmworker_t* w = (lsmworker_t*)arg;
+    char key[32];
+
+    for (int round = 0; round < 3; ++round) {
+        for (int i = w->id; i < opt.count; i += w->nthreads) {
+            lsmkey(key, i);
+            if (round == 0) {
+                w->failed += !lsm_put(w->lsm, key, strlen(key), i).ok;
+            } else if (round == 1 && i % 2 == 0) {
+                w->failed += !lsm_put(w->lsm, key, strlen(key), (uint64_t)i * 3).ok;
+            } else if (round == 2 && i % 7 == 0) {
+                w->failed += !lsm_del(w->lsm, key, strlen(key)).ok;
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct lsmscan_s {
+    char last[32];
+    size_t last_len;
+    int n;
+    int wrong;
+    int checkvalue; // 写入结束后才检查值
+} lsmscan_t;
+
+static int lsmscancheck(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    lsmscan_t* s = (lsmscan_t*)arg;
+    uint64_t expect = 0;
+    int i = lsmindex(key, key_len);
+
+    if (s->n > 0) { // 必须严格递增
+        size_t min = key_len < s->last_len ? key_len : s->last_len;
+        int cmp = memcmp(key, s->last, min);
+        s->wrong += cmp < 0 || (cmp == 0 && key_len <= s->last_len);
+    }
+    if (s->checkvalue && (i < 0 || i >= opt.count || !lsmexpect(i, &expect) || value != expect)) {
+        ++s->wrong;
+    }
+    memcpy(s->last, key, key_len < sizeof(s->last) ? key_len : sizeof(s->last));
+    s->last_len = key_len;
+    ++s->n;
+    return 0;
+}
+
+static void* lsmscanner(void* arg) {
+    lsmworker_t* w = (lsmworker_t*)arg;
+
+    for (int round = 0; round < 20; ++round) {
+        lsmscan_t scan = { .n = 0 };
+        w->failed += !lsm_scan(w->lsm, NULL, 0, NULL, 0, lsmscancheck, &scan).ok || scan.wrong;
+    }
+    return NULL;
+}
+
+// 点查、全量扫描和一个范围扫描都与期望一致
+static int lsmverify(lsm_t* lsm) {
+    char key[32], lo[32], hi[32];
+    uint64_t value = 0, expect = 0;
+    int found = 0, wrong = 0, live = 0, inrange = 0;
+    lsmscan_t scan = { .checkvalue = 1 };
+    lsmscan_t range = { .checkvalue = 1 };
+
+    lsmkey(lo, opt.count / 3);
+    lsmkey(hi, opt.count / 2);
+    if (strcmp(lo, hi) > 0) {
+        char tmp[32];
+        strcpy(tmp, lo);
+        strcpy(lo, hi);
+        strcpy(hi, tmp);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        lsmkey(key, i);
+        int exists = lsmexpect(i, &expect);
+        wrong += !lsm_get(lsm, key, strlen(key), &value, &found).ok || found != exists || (found && value != expect);
+        live += exists;
+        inrange += exists && strcmp(key, lo) >= 0 && strcmp(key, hi) < 0;
+    }
+    wrong += !lsm_get(lsm, "l:missing", 9, &value, &found).ok || found;
+    wrong += !lsm_scan(lsm, NULL, 0, NULL, 0, lsmscancheck, &scan).ok || scan.wrong || scan.n != live;
+    wrong += !lsm_scan(lsm, lo, strlen(lo), hi, strlen(hi), lsmscancheck, &range).ok || range.wrong || range.n != inrange;
+    return wrong;
+}
+
+static void removelsm(const char* prefix) {
+    char pattern[256];
+    glob_t g;
+
+    snprintf(pattern, sizeof(pattern), "%s.*", prefix);
+    if (glob(pattern, 0, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; ++i) {
+            remove(g.gl_pathv[i]);
+        }
+        globfree(&g);
+    }
+}
+
+static void lsmprint(lsm_t* lsm, const char* stage) {
+    lsm_info_t info;
+
+    lsm_info(lsm, &info);
+    log_info("%s: %-8s memkeys = %ld, tables = %ld, tablekeys = %ld, tablebytes = %ld, flushes = %ld, compactions = %ld\n",
+        __FUNCTION__, stage, info.memkeys, info.tables, info.tablekeys, info.tablebytes, info.flushes, info.compactions);
+}
+
+// 小memtable触发多次冻结和后台合并：并发写入与扫描后校验，重新打开后校验，全量合并后校验；
+// 再以内存模式的memtable写入，关闭时写成表
+void test_lsm(int nthreads) {
+    char prefix[160];
+    status_t s;
+    lsm_t* lsm = NULL;
+    lsm_options_t opts;
+    lsm_info_t info;
+    pthread_t threads[65];
+    lsmworker_t workers[65];
+    uint64_t value = 0;
+    int found = 0;
+    int wrong = 0;
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    snprintf(prefix, sizeof(prefix), "%s_lsm", opt.prefix);
+    removelsm(prefix);
+    lsm_options_init(&opts);
+    opts.sl.p = opt.p;
+    opts.sl.metasize = 1024 * 1024;
+    opts.flushsize = 256 * 1024;
+    opts.blocksize = 512;
+    opts.maxtables = 3;
+    s = lsm_open(prefix, &opts, &lsm);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i <= nthreads; ++i) {
+        workers[i].lsm = lsm;
+        workers[i].id = i;
+        workers[i].nthreads = nthreads;
+        workers[i].failed = 0;
+        pthread_create(&threads[i], NULL, i < nthreads ? lsmwriter : lsmscanner, &workers[i]);
+    }
+    for (int i = 0; i <= nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+        wrong += workers[i].failed;
+    }
+    wrong += lsmverify(lsm);
+    lsmprint(lsm, "written");
+    s = lsm_put(lsm, "l:reserved", 10, SL_LSM_TOMBSTONE);
+    wrong += s.ok;
+    lsm_close(lsm);
+
+    s = lsm_open(prefix, &opts, &lsm);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    wrong += lsmverify(lsm);
+    lsmprint(lsm, "reopened");
+    s = lsm_compact(lsm);
+    wrong += !s.ok;
+    wrong += lsmverify(lsm);
+    lsm_info(lsm, &info);
+    lsmprint(lsm, "compacted");
+    wrong += info.tables != 1 || info.memkeys != 0 || info.tablekeys != (uint64_t)(opt.count - (opt.count + 6) / 7);
+    lsm_close(lsm);
+
+    opts.sl.inmemory = 1;
+    s = lsm_open(prefix, &opts, &lsm);
+    wrong += !s.ok || !lsm_put(lsm, "l:inmemory", 10, 42).ok;
+    lsm_close(lsm);
+    opts.sl.inmemory = 0;
+    s = lsm_open(prefix, &opts, &lsm);
+    wrong += !s.ok || !lsm_get(lsm, "l:inmemory", 10, &value, &found).ok || !found || value != 42;
+    lsm_close(lsm);
+    if (wrong != 0) {
+        log_fatal("%s: failed, wrong = %d\n", __FUNCTION__, wrong);
+    }
+    removelsm(prefix);
+}
+
+// 变长key，每97个一个跨越多页的长key
+static size_t poolkey(char* key, int i) {
+    uint64_t h = (uint64_t)i * 0x9e3779b97f4a7c15ULL;
+    size_t len = i % 97 == 0 ? 4096 + h % 4096 : 18 + h % 64;
+
+    sprintf(key, "p:%016lx", h);
+    for (size_t j = 18; j < len; ++j) {
+        key[j] = 'a' + (h >> (j % 57)) % 26;
+    }
+    return len;
+}
+
+// 删除i % 7 == 0的key，i % 5 == 0的值改为i * 2 + 1，其余为i + 1
+static uint64_t poolexpect(int i) {
+    return i % 7 == 0 ? 0 : (i % 5 == 0 ? (uint64_t)i * 2 + 1 : (uint64_t)i + 1);
+}
+
+static void* poolworker(void* arg) {
+    rmwworker_t* w = (rmwworker_t*)arg;
+    char* key = (char*)malloc(MAX_KEY_LEN);
+    uint64_t value = 0;
+
+    for (int i = w->id; i < opt.count; i += 4) {
+        size_t len = poolkey(key, i);
+        value = 0;
+        w->failed += !sl_get(w->sl, key, len, &value).ok || value != poolexpect(i);
+    }
+    free(key);
+    return NULL;
+}
+
+static int poolverify(skiplist_t* sl, int nthreads) {
+    pthread_t threads[4];
+    rmwworker_t workers[4];
+    int wrong = 0;
+
+    for (int i = 0; i < 4; ++i) { // 每个线程查一部分key
+        workers[i] = (rmwworker_t){ .sl = sl, .id = i, .failed = 0 };
+        if (i < nthreads) {
+            pthread_create(&threads[i], NULL, poolworker, &workers[i]);
+        } else {
+            poolworker(&workers[i]);
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (i < nthreads) {
+            pthread_join(threads[i], NULL);
+        }
+        wrong += workers[i].failed;
+    }
+    return wrong;
+}
+
+typedef struct poolscan_s {
+    char prev[MAX_KEY_LEN];
+    size_t prev_len;
+    uint64_t n;
+    uint64_t wrong;
+} poolscan_t;
+
+static int poolscancheck(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    poolscan_t* ps = (poolscan_t*)arg;
+
+    if (ps->n > 0) {
+        size_t l = ps->prev_len < key_len ? ps->prev_len : key_len;
+        int c = memcmp(ps->prev, key, l);
+        ps->wrong += c > 0 || (c == 0 && ps->prev_len >= key_len);
+    }
+    ps->wrong += value == 0;
+    memcpy(ps->prev, key, key_len);
+    ps->prev_len = key_len;
+    ++ps->n;
+    return 0;
+}
+
+// 缓冲池模式：池远小于数据(频繁替换)，写入、覆盖、删除后多线程点查、扫描、guard内迭代，
+// 重新打开后分别以映射模式和缓冲池模式检查文件内容一致
+void test_pool(int nthreads) {
+    char* key = (char*)malloc(MAX_KEY_LEN);
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    sl_stats_t st;
+    sl_iter_t it;
+    poolscan_t* ps = (poolscan_t*)malloc(sizeof(poolscan_t));
+    uint64_t expect = 0;
+
+    for (int i = 0; i < opt.count; ++i) {
+        expect += poolexpect(i) != 0;
+    }
+    for (int mode = 0; mode < 4; ++mode) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.format = mode & 1 ? SL_FORMAT_BLOCKED : SL_FORMAT_NODE;
+        opts.direct = mode >> 1;
+        opts.poolsize = 64 * 4096;
+        opts.datasize = 131072;
+        opts.metasize = 16 * DEFAULT_METAFILE_SIZE;
+        s = sl_open_opt(opt.prefix, &opts, &sl);
+        if (!s.ok && opts.direct) { // 文件系统不支持O_DIRECT(如tmpfs)
+            log_info("%s: mode %d skipped: %s\n", __FUNCTION__, mode, s.errmsg);
+            continue;
+        }
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        int wrong = 0;
+        for (int i = 0; i < opt.count; ++i) {
+            size_t len = poolkey(key, i);
+            wrong += !sl_put(sl, key, len, (uint64_t)i + 1).ok;
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            size_t len = poolkey(key, i);
+            if (i % 7 == 0) {
+                wrong += !sl_del(sl, key, len).ok;
+            } else if (i % 5 == 0) {
+                wrong += !sl_put(sl, key, len, (uint64_t)i * 2 + 1).ok;
+            }
+        }
+        wrong += poolverify(sl, nthreads);
+        memset(ps, 0, sizeof(poolscan_t));
+        wrong += !sl_scan(sl, NULL, 0, NULL, 0, poolscancheck, ps).ok || ps->wrong != 0 || ps->n != expect;
+        // guard内的视图一直有效，池不够时绕过缓冲池
+        sl_read_begin(sl);
+        sl_view_t first = { NULL, 0 };
+        uint64_t n = 0;
+        for (s = sl_iter_seek(sl, &it, NULL, 0); s.ok && it.valid; s = sl_iter_next(&it), ++n) {
+            if (first.data == NULL) {
+                first = it.key;
+                memcpy(ps->prev, first.data, first.size);
+            }
+        }
+        wrong += !s.ok || n != expect || first.data == NULL || memcmp(ps->prev, first.data, first.size) != 0;
+        sl_read_end(sl);
+        s = sl_stats(sl, &st);
+        wrong += !s.ok || st.poolframes != 64 || st.poolevictions == 0 || st.poolwritebacks == 0;
+        wrong += opts.format == SL_FORMAT_NODE && st.poolreadaheads == 0;
+        log_info("%s: mode %d count = %d, datamapsize = %ld, hits = %ld, misses = %ld, evictions = %ld, "
+                 "writebacks = %ld, readaheads = %ld, bypasses = %ld, wrong = %d\n", __FUNCTION__, mode,
+            sl->meta->count, st.datamapsize, st.poolhits, st.poolmisses, st.poolevictions, st.poolwritebacks,
+            st.poolreadaheads, st.poolbypasses, wrong);
+        sl_close(sl);
+        for (int reopen = 0; reopen < 2; ++reopen) { // 先以映射模式，再以多个分区的缓冲池模式打开
+            opts.poolsize = reopen ? 1024 * 4096 : 0;
+            opts.direct = reopen ? mode >> 1 : 0;
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            wrong += sl->meta->count != expect || poolverify(sl, nthreads);
+            size_t len = poolkey(key, opt.count + reopen); // 重新打开后继续写入
+            wrong += !sl_put(sl, key, len, 1).ok;
+            wrong += reopen && (!sl_stats(sl, &st).ok || st.poolframes != 1024 || st.poolhits == 0);
+            sl_close(sl);
+            ++expect;
+        }
+        expect -= 2;
+        if (wrong != 0) {
+            log_fatal("%s: mode %d failed, wrong = %d\n", __FUNCTION__, mode, wrong);
+        }
+    }
+    free(ps);
+    free(key);
+    removedb(opt.prefix);
+}
+
+static int cachepad = 0; // 非0时key按i变长，见test_cache的mode 4
+
+static void cachekey(char* key, int i) {
+    int n = sprintf(key, "c:%016lx", (uint64_t)i * 0x9e3779b97f4a7c15);
+    if (cachepad) {
+        memset(key + n, 'x', (size_t)(i % 4) * 8);
+        key[n + (i % 4) * 8] = '\0';
+    }
+}
+
+typedef struct cachereader_s {
+    skiplist_t* sl;
+    volatile int* stop;
+    uint64_t wrong;
+} cachereader_t;
+
+static void* cachereader(void* arg) {
+    cachereader_t* r = (cachereader_t*)arg;
+    char key[64];
+    uint64_t value = 0;
+
+    for (int i = 0; !*r->stop; ++i) { // 热点key一直被访问
+        cachekey(key, i % 64);
+        value = 0;
+        r->wrong += !sl_get(r->sl, key, strlen(key), &value).ok || (value != 0 && value != (uint64_t)(i % 64) + 1);
+        if (i % 64 == 63) { // 读锁偏向读者，留出写入的机会
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+typedef struct cachescan_s {
+    char key[64];
+    uint64_t n;
+    uint64_t wrong;
+} cachescan_t;
+
+static int cachescancheck(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    cachescan_t* cs = (cachescan_t*)arg;
+    char expect[64];
+
+    cachekey(expect, (int)value - 1);
+    cs->wrong += key_len != strlen(expect) || memcmp(key, expect, key_len) != 0;
+    cs->wrong += cs->n > 0 && memcmp(cs->key, key, key_len) >= 0;
+    memcpy(cs->key, key, key_len);
+    ++cs->n;
+    return 0;
+}
+
+// 缓存模式：元数据远小于写入量，写入期间读线程反复访问热点key，检查写入不失败、热点key不被淘汰、
+// 每个留下的key值正确且有序、计数与遍历一致、datanode被复用(数据不随写入增长)、guard内被淘汰的key视图不变。
+// mode 4的数据区远小于元数据且key变长，淘汰由数据区放不下触发，guard结束后数据文件不再扩容
+void test_cache(int nthreads) {
+    char key[64];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    sl_stats_t st;
+    pthread_t threads[64];
+    cachereader_t readers[64];
+    cachescan_t cs;
+    volatile int stop = 0;
+
+    if (nthreads > 64) {
+        nthreads = 64;
+    }
+    for (int mode = 0; mode < 5; ++mode) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.cache = 1;
+        opts.metasize = mode == 4 ? 16777216 : 262144;
+        opts.datasize = mode == 4 ? 131072 : opts.datasize;
+        opts.hashindex = mode == 1;
+        opts.bloom = mode == 1 ? 10 : 0;
+        opts.poolsize = mode == 2 ? 1048576 : 0;
+        opts.inmemory = mode == 3;
+        cachepad = mode == 4;
+        s = sl_open_opt(opts.inmemory ? NULL : opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        int wrong = 0;
+        for (int i = 0; i < 64; ++i) {
+            cachekey(key, i);
+            wrong += !sl_put(sl, key, strlen(key), i + 1).ok;
+        }
+        stop = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            readers[i] = (cachereader_t){ .sl = sl, .stop = &stop, .wrong = 0 };
+            pthread_create(&threads[i], NULL, cachereader, &readers[i]);
+        }
+        sl_view_t view = { NULL, 0 };
+        char viewed[64];
+        uint64_t datamapsize = 0;
+        uint64_t datamapcap = 0;
+        for (int i = 64; i < opt.count; ++i) {
+            cachekey(key, i);
+            if ((s = sl_put(sl, key, strlen(key), i + 1)).ok == 0) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            if (i % 64 == 0 && nthreads == 0) { // 没有读线程时由写线程访问热点key
+                uint64_t value = 0;
+                for (int h = 0; h < 64; ++h) {
+                    cachekey(key, h);
+                    sl_get(sl, key, strlen(key), &value);
+                }
+            }
+            if (i == opt.count / 2) { // guard内持有一个很快会被淘汰的key的视图
+                sl_read_begin(sl);
+                wrong += !sl_view_maxkey(sl, &view).ok;
+                memcpy(viewed, view.data, view.size);
+            }
+            if (i == opt.count / 2 + opt.count / 4) {
+                wrong += memcmp(viewed, view.data, view.size) != 0;
+                sl_read_end(sl);
+            }
+            if (i == opt.count / 2 + opt.count / 4 + 1) { // guard结束后datanode全部复用，数据区不再增长
+                datamapsize = sl->data->mapsize;
+                datamapcap = sl->data->mapcap;
+            }
+        }
+        stop = 1;
+        for (int i = 0; i < nthreads; ++i) {
+            pthread_join(threads[i], NULL);
+            wrong += readers[i].wrong;
+        }
+        for (int i = 0; i < 64; ++i) {
+            uint64_t value = 0;
+            cachekey(key, i);
+            wrong += !sl_get(sl, key, strlen(key), &value).ok || value != (uint64_t)i + 1;
+        }
+        memset(&cs, 0, sizeof(cs));
+        wrong += !sl_scan(sl, NULL, 0, NULL, 0, cachescancheck, &cs).ok || cs.wrong != 0 || cs.n != sl->meta->count;
+        s = sl_stats(sl, &st);
+        wrong += !s.ok || statswalk(sl, &st);
+        wrong += st.evictions != (uint64_t)opt.count - sl->meta->count || st.hitrate <= 0;
+        wrong += st.datamapcap != datamapcap || (mode != 4 && st.datamapsize != datamapsize); // mode 4变长，末尾可能还在填充
+        wrong += mode == 4 && sl->meta->mapsize * 2 > sl->meta->mapcap; // 淘汰由数据区触发
+        log_info("%s: mode %d count = %d, evictions = %ld, hitrate = %.3f, datamapsize = %ld, datafreen = %ld, wrong = %d\n",
+            __FUNCTION__, mode, sl->meta->count, st.evictions, st.hitrate, st.datamapsize, st.datafreen, wrong);
+        if (!opts.inmemory) {
+            uint32_t count = sl->meta->count;
+            sl_close(sl);
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            if (!s.ok) {
+                log_fatal("%s\n", s.errmsg);
+            }
+            memset(&cs, 0, sizeof(cs));
+            wrong += sl->meta->count != count || !sl_scan(sl, NULL, 0, NULL, 0, cachescancheck, &cs).ok || cs.wrong != 0;
+            cachekey(key, opt.count); // 重新打开后继续淘汰(mode 4能复用空闲的datanode时不淘汰，但数据区不扩容)
+            wrong += !sl_put(sl, key, strlen(key), opt.count + 1).ok;
+            wrong += mode != 4 ? sl->meta->count != count : sl->data->mapcap != datamapcap;
+        }
+        sl_close(sl);
+        if (wrong != 0) {
+            log_fatal("%s: mode %d failed, wrong = %d\n", __FUNCTION__, mode, wrong);
+        }
+    }
+    cachepad = 0;
+
+    // 数据区写满定长的小key后写入一个比所有回收的datanode都大的key：最多淘汰CACHE_EVICTMAX(16)个后扩容，不清空缓存
+    removedb(opt.prefix);
+    sl_options_init(&opts);
+    opts.p = opt.p;
+    opts.cache = 1;
+    opts.metasize = 16777216;
+    opts.datasize = 131072;
+    s = sl_open_opt(opt.prefix, &opts, &sl);
+    if (!s.ok) {
+        log_fatal("%s\n", s.errmsg);
+    }
+    for (int i = 0; i < opt.count; ++i) {
+        cachekey(key, i);
+        if ((s = sl_put(sl, key, strlen(key), i + 1)).ok == 0) {
+            log_fatal("%s\n", s.errmsg);
+        }
+    }
+    char big[200];
+    uint64_t value = 0;
+    uint32_t before = sl->meta->count;
+    memset(big, 'z', sizeof(big));
+    int wrong = !sl_put(sl, big, sizeof(big), 1).ok || !sl_get(sl, big, sizeof(big), &value).ok || value != 1;
+    wrong += sl->meta->count + 16 < before;
+    log_info("%s: big key count = %d -> %d, datamapcap = %ld, wrong = %d\n", __FUNCTION__, before, sl->meta->count,
+        sl->data->mapcap, wrong);
+    sl_close(sl);
+    if (wrong != 0) {
+        log_fatal("%s: big key failed\n", __FUNCTION__);
+    }
+    removedb(opt.prefix);
+}
+
+static void vidxkey(char* key, int i) {
+    sprintf(key, "v%08d", i);
+}
+
+// 值有重复
+static uint64_t vidxvalue(int i) {
+    return ((uint64_t)i * 2654435761u) % (uint64_t)(opt.count / 4 + 1);
+}
+
+typedef struct vidxscan_s {
+    uint64_t* model;
+    uint32_t* seen;  // 本次扫描的编号，检查key不重复
+    uint32_t round;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t last;
+    uint64_t n;
+    uint64_t limit;  // 0不限
+    uint64_t wrong;
+} vidxscan_t;
+
+static int vidxscancheck(int part, const void* key, size_t key_len, uint64_t value, void* arg) {
+    vidxscan_t* vs = (vidxscan_t*)arg;
+    char buf[16];
+    int i = -1;
+
+    memcpy(buf, key, key_len < 15 ? key_len : 15);
+    buf[key_len < 15 ? key_len : 15] = '\0';
+    sscanf(buf, "v%d", &i);
+    vs->wrong += i < 0 || i >= opt.count || vs->model[i] != value || vs->seen[i] == vs->round;
+    vs->wrong += value < vs->lo || value > vs->hi || (vs->n > 0 && value < vs->last);
+    if (i >= 0 && i < opt.count) {
+        vs->seen[i] = vs->round;
+    }
+    vs->last = value;
+    return ++vs->n == vs->limit;
+}
+
+// 按值扫描若干区间，与模型中落在区间内的key数比较
+static int vidxverify(skiplist_t* sl, uint64_t* model, uint32_t* seen) {
+    static uint32_t round = 0;
+    uint64_t vmax = (uint64_t)opt.count / 2 + 2;
+    uint64_t r = 88172645463325252ULL;
+    int wrong = 0;
+
+    for (int k = 0; k < 64; ++k) {
+        vidxscan_t vs = { .model = model, .seen = seen, .round = ++round };
+        if (k == 0) {
+            vs.lo = 0;
+            vs.hi = UINT64_MAX;
+        } else if (k == 1) { // 空区间
+            vs.lo = 5;
+            vs.hi = 4;
+        } else {
+            r ^= r << 13, r ^= r >> 7, r ^= r << 17;
+            vs.lo = r % vmax;
+            vs.hi = k % 4 == 0 ? vs.lo : vs.lo + r % (vmax / 8 + 1); // 单个值或一段
+        }
+        wrong += !sl_scan_by_value(sl, vs.lo, vs.hi, vidxscancheck, &vs).ok || vs.wrong != 0;
+        uint64_t expect = 0;
+        for (int i = 0; i < opt.count; ++i) {
+            expect += model[i] != UINT64_MAX && model[i] >= vs.lo && model[i] <= vs.hi;
+        }
+        wrong += vs.n != expect;
+        if (k == 0) {
+            wrong += vs.n != sl->meta->count;
+        }
+    }
+    vidxscan_t vs = { .model = model, .seen = seen, .round = ++round, .hi = UINT64_MAX, .limit = 10 };
+    wrong += !sl_scan_by_value(sl, 0, UINT64_MAX, vidxscancheck, &vs).ok || vs.wrong != 0 ||
+             vs.n != (sl->meta->count < 10 ? sl->meta->count : 10);
+    return wrong;
+}
+
+// 值索引：写入、覆盖(含fetch_add)、删除、范围删除后按值扫描与模型比较；
+// 文件模式下检查重新打开时加载、删除索引文件或不带索引写入后重新打开时重建；缓存模式下淘汰同样维护索引
+void test_vidx() {
+    char key[32];
+    status_t s;
+    skiplist_t* sl = NULL;
+    sl_options_t opts;
+    uint64_t* model = (uint64_t*)malloc(sizeof(uint64_t) * opt.count);
+    uint32_t* seen = (uint32_t*)calloc(opt.count, sizeof(uint32_t));
+
+    for (int mode = 0; mode < 3; ++mode) {
+        removedb(opt.prefix);
+        sl_options_init(&opts);
+        opts.p = opt.p;
+        opts.valueindex = 1;
+        opts.inmemory = mode == 1;
+        opts.cache = mode == 2;
+        opts.metasize = mode == 2 ? 262144 : 16 * DEFAULT_METAFILE_SIZE;
+        s = sl_open_opt(opts.inmemory ? NULL : opt.prefix, &opts, &sl);
+        if (!s.ok) {
+            log_fatal("%s\n", s.errmsg);
+        }
+        int wrong = 0;
+        for (int i = 0; i < opt.count; ++i) {
+            vidxkey(key, i);
+            model[i] = vidxvalue(i);
+            wrong += !sl_put(sl, key, strlen(key), model[i]).ok;
+        }
+        for (int i = 0; i < opt.count; ++i) {
+            vidxkey(key, i);
+            if (i % 5 == 0) {
+                wrong += !sl_del(sl, key, strlen(key)).ok;
+                model[i] = UINT64_MAX;
+            } else if (i % 3 == 0) {
+                model[i] = vidxvalue(i + opt.count);
+                wrong += !sl_put(sl, key, strlen(key), model[i]).ok;
+            } else if (i % 7 == 1) {
+                model[i] += 3;
+                wrong += !sl_fetch_add(sl, key, strlen(key), 3, NULL).ok;
+            }
+        }
+        char lo[32];
+        char hi[32];
+        uint64_t removed = 0;
+        vidxkey(lo, opt.count / 4);
+        vidxkey(hi, opt.count / 3);
+        wrong += !sl_del_range(sl, lo, strlen(lo), hi, strlen(hi), &removed).ok;
+        for (int i = 0; i < opt.count; ++i) {
+            uint64_t value = UINT64_MAX;
+            vidxkey(key, i);
+            if (opts.cache) { // 被淘汰的key不在模型中(淘汰后的覆盖写和fetch_add重新写入)，以跳表为准
+                sl_get(sl, key, strlen(key), &value);
+                model[i] = value;
+            } else if (i >= opt.count / 4 && i < opt.count / 3) {
+                model[i] = UINT64_MAX;
+            }
+        }
+        wrong += vidxverify(sl, model, seen);
+        log_info("%s: mode %d count = %d, removed = %ld, wrong = %d\n", __FUNCTION__, mode, sl->meta->count, removed, wrong);
+        sl_close(sl);
+        if (mode == 0) {
+            char name[256];
+            s = sl_open_opt(opt.prefix, &opts, &sl); // 加载
+            wrong += !s.ok || vidxverify(sl, model, seen);
+            sl_close(sl);
+            snprintf(name, sizeof(name), "%s.sl.vidx", opt.prefix);
+            remove(name);
+            s = sl_open_opt(opt.prefix, &opts, &sl); // 重建
+            wrong += !s.ok || vidxverify(sl, model, seen);
+            sl_close(sl);
+            opts.valueindex = 0;
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            vidxscan_t vs = { .model = model, .seen = seen };
+            wrong += !s.ok || sl_scan_by_value(sl, 0, UINT64_MAX, vidxscancheck, &vs).ok;
+            for (int i = 0; i < opt.count; i += 11) { // 索引外的写入，重新打开时seq不一致
+                vidxkey(key, i);
+                model[i] = vidxvalue(i) + 1;
+                wrong += !sl_put(sl, key, strlen(key), model[i]).ok;
+            }
+            sl_close(sl);
+            opts.valueindex = 1;
+            s = sl_open_opt(opt.prefix, &opts, &sl);
+            wrong += !s.ok || vidxverify(sl, model, seen);
+            sl_close(sl);
+            log_info("%s: mode %d reopen wrong = %d\n", __FUNCTION__, mode, wrong);
+        }
+        if (wrong != 0) {
+            log_fatal("%s: mode %d failed, wrong = %d\n", __FUNCTION__, mode, wrong);
+        }
+    }
+    removedb(opt.prefix);
+    free(model);
+    free(seen);
+}
+
 void usage() {
     log_info("\t./test  put <key> <value>\n"
            "\t        get <key>\n"
@@ -278,7 +2605,29 @@ void usage() {
            "\t        rkeys\n"
            "\t        print <isprintnode>\n"
            "\t        rand <count> <isequal> <p>\n"
-           "\t        seq <count> <p>\n");
+           "\t        seq <count> <p>\n"
+           "\t        replica <count> <p>\n"
+           "\t        shared <nprocs> <count>\n"
+           "\t        pscan <nthreads>\n"
+           "\t        keytype <count> <p>\n"
+           "\t        mem <count> <p> <hugepage>\n"
+           "\t        advise <count> <p>\n"
+           "\t        warm <count> <p> <nthreads>\n"
+           "\t        upper <count> <p>\n"
+           "\t        block <count> <p>\n"
+           "\t        bloom <count> <p>\n"
+           "\t        hash <count> <p>\n"
+           "\t        rmw <count> <nthreads>\n"
+           "\t        range <count> <p>\n"
+           "\t        guard <count> <p>\n"
+           "\t        async <count> <p>\n"
+           "\t        trace <count> <nthreads>\n"
+           "\t        stats <count> <p> <nthreads>\n"
+           "\t        locks <count> <p> <nthreads>\n"
+           "\t        lsm <count> <p> <nthreads>\n"
+           "\t        pool <count> <p> <nthreads>\n"
+           "\t        cache <count> <p> <nthreads>\n"
+           "\t        vidx <count> <p>\n");
     exit(1);
 }
 
@@ -321,6 +2670,89 @@ int main(int argc, char *argv[]) {
         opt.count = atoi(argv[2]);
         opt.p = atof(argv[3]);
         benchmarkseq();
+    } else if (argvequal("replica", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_replica();
+    } else if (argvequal("shared", argv[1])) {
+        opt.count = atoi(argv[3]);
+        test_shared(atoi(argv[2]));
+    } else if (argvequal("pscan", argv[1])) {
+        test_pscan(atoi(argv[2]));
+    } else if (argvequal("keytype", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_keytype();
+    } else if (argvequal("mem", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_mem(atoi(argv[4]));
+    } else if (argvequal("advise", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_advise();
+    } else if (argvequal("warm", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_warm(atoi(argv[4]));
+    } else if (argvequal("upper", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_upper();
+    } else if (argvequal("block", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_block();
+    } else if (argvequal("bloom", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_bloom();
+    } else if (argvequal("hash", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_hash();
+    } else if (argvequal("rmw", argv[1])) {
+        opt.count = atoi(argv[2]);
+        test_rmw(atoi(argv[3]));
+    } else if (argvequal("range", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_range();
+    } else if (argvequal("guard", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_guard();
+    } else if (argvequal("async", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_async();
+    } else if (argvequal("trace", argv[1])) {
+        opt.count = atoi(argv[2]);
+        test_trace(atoi(argv[3]));
+    } else if (argvequal("stats", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_stats(atoi(argv[4]));
+    } else if (argvequal("locks", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_locks(atoi(argv[4]));
+    } else if (argvequal("lsm", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_lsm(atoi(argv[4]));
+    } else if (argvequal("pool", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_pool(atoi(argv[4]));
+    } else if (argvequal("cache", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_cache(atoi(argv[4]));
+    } else if (argvequal("vidx", argv[1])) {
+        opt.count = atoi(argv[2]);
+        opt.p = atof(argv[3]);
+        test_vidx();
     } else {
         usage();
     }